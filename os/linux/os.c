@@ -868,6 +868,19 @@ static const char scope_help_configuration[] =
 "    SCOPE_CONFIG_EVENT\n"
 "        Sends a single process-identifying event when a transport\n"
 "        connection is established.  true,false  Default is true\n"
+"    SCOPE_QUEUE_EVENTS\n"
+"        What to drop when the queue of records waiting to become\n"
+"        metrics and events is full.  drop-newest, drop-oldest, sample\n"
+"        Default is drop-newest.\n"
+"    SCOPE_QUEUE_MESSAGES\n"
+"        Same as SCOPE_QUEUE_EVENTS for messages waiting to be sent\n"
+"        to the event destination.  Default is drop-newest.\n"
+"    SCOPE_QUEUE_PAYLOADS\n"
+"        Same as SCOPE_QUEUE_EVENTS for captured payloads waiting to be\n"
+"        written.  Default is drop-newest.\n"
+"    SCOPE_QUEUE_SAMPLERATE\n"
+"        With sample, once a queue fills only 1 in this many entries is\n"
+"        kept until it drains to half full.  Default is 10.\n"
 "\n"
 "    Dynamic Configuration:\n"
 "        Dynamic Configuration allows configuration settings to be\n"
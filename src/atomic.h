@@ -47,6 +47,17 @@ atomicSwapU64(uint64_t *ptr, uint64_t val) {
     return __sync_lock_test_and_set(ptr, val);
 }
 
+// Return the value before the operation
+static inline uint64_t
+atomicOrU64(uint64_t *ptr, uint64_t val) {
+    return __sync_fetch_and_or(ptr, val);
+}
+
+static inline uint64_t
+atomicAndU64(uint64_t *ptr, uint64_t val) {
+    return __sync_fetch_and_and(ptr, val);
+}
+
 
 
 static inline bool
@@ -66,6 +77,13 @@ atomicSub32(int *ptr, int val)
     (void)__sync_sub_and_fetch(ptr, val);
 }
 
+// Return the value after the operation
+static inline int
+atomicAddFetch32(int *ptr, int val)
+{
+    return __sync_add_and_fetch(ptr, val);
+}
+
 static inline int
 atomicSwap32(int *ptr, int val)
 {
@@ -29,6 +29,10 @@ struct _config_t
         } statsd;
         unsigned period;
         unsigned verbosity;
+        struct {
+            unsigned maxtargets;
+            unsigned normalize;
+        } http;
     } mtc;
 
     struct {
@@ -50,6 +54,11 @@ struct _config_t
         char *dir;
     } pay;
 
+    struct {
+        cfg_overflow_t overflow[CFG_QUEUE_MAX];
+        unsigned rate;
+    } queue;
+
     // CFG_MTC, CFG_CTL, or CFG_LOG
     transport_struct_t transport[CFG_WHICH_MAX]; 
 
@@ -174,6 +183,8 @@ cfgCreateDefault()
     c->mtc.statsd.maxlen = DEFAULT_STATSD_MAX_LEN;
     c->mtc.period = DEFAULT_SUMMARY_PERIOD;
     c->mtc.verbosity = DEFAULT_MTC_VERBOSITY;
+    c->mtc.http.maxtargets = DEFAULT_HTTP_MAX_TARGETS;
+    c->mtc.http.normalize = DEFAULT_HTTP_NORMALIZE;
     c->evt.enable = DEFAULT_EVT_ENABLE;
     c->evt.format = DEFAULT_CTL_FORMAT;
     c->evt.ratelimit = DEFAULT_MAXEVENTSPERSEC;
@@ -206,6 +217,12 @@ cfgCreateDefault()
     c->pay.enable = DEFAULT_PAYLOAD_ENABLE;
     c->pay.dir = (DEFAULT_PAYLOAD_DIR) ? strdup(DEFAULT_PAYLOAD_DIR) : NULL;
 
+    cfg_queue_t q;
+    for (q = CFG_QUEUE_EVENTS; q < CFG_QUEUE_MAX; q++) {
+        c->queue.overflow[q] = DEFAULT_QUEUE_OVERFLOW;
+    }
+    c->queue.rate = DEFAULT_QUEUE_SAMPLE_RATE;
+
     c->tags = DEFAULT_TAGS;
     c->max_tags = DEFAULT_NUM_TAGS;
 
@@ -377,6 +394,18 @@ cfgMtcVerbosity(config_t* cfg)
     return (cfg) ? cfg->mtc.verbosity : DEFAULT_MTC_VERBOSITY;
 }
 
+unsigned
+cfgMtcHttpMaxTargets(config_t* cfg)
+{
+    return (cfg) ? cfg->mtc.http.maxtargets : DEFAULT_HTTP_MAX_TARGETS;
+}
+
+unsigned
+cfgMtcHttpNormalize(config_t* cfg)
+{
+    return (cfg) ? cfg->mtc.http.normalize : DEFAULT_HTTP_NORMALIZE;
+}
+
 cfg_transport_t
 cfgTransportType(config_t* cfg, which_transport_t t)
 {
@@ -487,6 +516,24 @@ cfgPayDir(config_t *cfg)
     return (cfg) ? cfg->pay.dir : DEFAULT_PAYLOAD_DIR;
 }
 
+cfg_overflow_t
+cfgQueueOverflow(config_t *cfg, cfg_queue_t q)
+{
+    if (q >= 0 && q < CFG_QUEUE_MAX) {
+        if (cfg) return cfg->queue.overflow[q];
+        return DEFAULT_QUEUE_OVERFLOW;
+    }
+
+    DBG("%d", q);
+    return DEFAULT_QUEUE_OVERFLOW;
+}
+
+unsigned
+cfgQueueSampleRate(config_t *cfg)
+{
+    return (cfg) ? cfg->queue.rate : DEFAULT_QUEUE_SAMPLE_RATE;
+}
+
 ///////////////////////////////////
 // Setters 
 ///////////////////////////////////
@@ -573,6 +620,20 @@ cfgMtcVerbositySet(config_t* cfg, unsigned val)
     cfg->mtc.verbosity = val;
 }
 
+void
+cfgMtcHttpMaxTargetsSet(config_t* cfg, unsigned val)
+{
+    if (!cfg || !val) return;
+    cfg->mtc.http.maxtargets = val;
+}
+
+void
+cfgMtcHttpNormalizeSet(config_t* cfg, unsigned val)
+{
+    if (!cfg || val > 1) return;
+    cfg->mtc.http.normalize = val;
+}
+
 void
 cfgEvtEnableSet(config_t* cfg, unsigned val)
 {
@@ -778,3 +839,17 @@ cfgPayDirSet(config_t *cfg, const char *dir)
     cfg->pay.dir = strdup(dir);
 }
 
+void
+cfgQueueOverflowSet(config_t *cfg, cfg_queue_t q, cfg_overflow_t val)
+{
+    if (!cfg || q < 0 || q >= CFG_QUEUE_MAX) return;
+    if (val < CFG_DROP_NEWEST || val > CFG_SAMPLE) return;
+    cfg->queue.overflow[q] = val;
+}
+
+void
+cfgQueueSampleRateSet(config_t *cfg, unsigned val)
+{
+    if (!cfg || !val) return;
+    cfg->queue.rate = val;
+}
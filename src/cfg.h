@@ -22,6 +22,8 @@ unsigned            cfgMtcPeriod(config_t*);
 const char*         cfgCmdDir(config_t*);
 unsigned            cfgSendProcessStartMsg(config_t*);
 unsigned            cfgMtcVerbosity(config_t*);
+unsigned            cfgMtcHttpMaxTargets(config_t*);
+unsigned            cfgMtcHttpNormalize(config_t*);
 unsigned            cfgEvtEnable(config_t*);
 cfg_mtc_format_t    cfgEventFormat(config_t*);
 unsigned            cfgEvtRateLimit(config_t*);
@@ -40,6 +42,8 @@ const char*         cfgCustomTagValue(config_t*, const char*);
 cfg_log_level_t     cfgLogLevel(config_t*);
 unsigned int        cfgPayEnable(config_t*);
 const char *        cfgPayDir(config_t*);
+cfg_overflow_t      cfgQueueOverflow(config_t*, cfg_queue_t);
+unsigned            cfgQueueSampleRate(config_t*);
 
 // Setters (modifies config_t, but does not persist modifications)
 void                cfgMtcEnableSet(config_t*, unsigned);
@@ -50,6 +54,8 @@ void                cfgMtcPeriodSet(config_t*, unsigned);
 void                cfgCmdDirSet(config_t*, const char*);
 void                cfgSendProcessStartMsgSet(config_t*, unsigned);
 void                cfgMtcVerbositySet(config_t*, unsigned);
+void                cfgMtcHttpMaxTargetsSet(config_t*, unsigned);
+void                cfgMtcHttpNormalizeSet(config_t*, unsigned);
 void                cfgEvtEnableSet(config_t*, unsigned);
 void                cfgEventFormatSet(config_t*, cfg_mtc_format_t);
 void                cfgEvtRateLimitSet(config_t*, unsigned);
@@ -67,4 +73,6 @@ void                cfgCustomTagAdd(config_t*, const char*, const char*);
 void                cfgLogLevelSet(config_t*, cfg_log_level_t);
 void                cfgPayEnableSet(config_t*, unsigned int);
 void                cfgPayDirSet(config_t*, const char *);
+void                cfgQueueOverflowSet(config_t*, cfg_queue_t, cfg_overflow_t);
+void                cfgQueueSampleRateSet(config_t*, unsigned);
 #endif // __CFG_H__
@@ -26,6 +26,8 @@
 #define STATSDPREFIX_NODE            "statsdprefix"
 #define STATSDMAXLEN_NODE            "statsdmaxlen"
 #define VERBOSITY_NODE               "verbosity"
+#define HTTPTARGETS_NODE             "httptargets"
+#define HTTPNORMALIZE_NODE           "httpnormalize"
 #define TAGS_NODE                    "tags"
 #define TRANSPORT_NODE           "transport"
 #define TYPE_NODE                    "type"
@@ -41,6 +43,11 @@
 #define SUMMARYPERIOD_NODE       "summaryperiod"
 #define COMMANDDIR_NODE          "commanddir"
 #define CFGEVENT_NODE            "configevent"
+#define QUEUE_NODE               "queue"
+#define EVENTS_NODE                  "events"
+#define MESSAGES_NODE                "messages"
+#define PAYLOADS_NODE                "payloads"
+#define SAMPLERATE_NODE              "samplerate"
 
 #define EVENT_NODE           "event"
 #define TRANSPORT_NODE           "transport"
@@ -131,6 +138,13 @@ enum_map_t boolMap[] = {
     {NULL,                    -1}
 };
 
+enum_map_t overflowMap[] = {
+    {"drop-newest",           CFG_DROP_NEWEST},
+    {"drop-oldest",           CFG_DROP_OLDEST},
+    {"sample",                CFG_SAMPLE},
+    {NULL,                    -1}
+};
+
 // forward declarations
 void cfgMtcEnableSetFromStr(config_t*, const char*);
 void cfgMtcFormatSetFromStr(config_t*, const char*);
@@ -148,11 +162,15 @@ void cfgEvtFormatFieldFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatNameFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatSourceEnabledSetFromStr(config_t*, watch_t, const char*);
 void cfgMtcVerbositySetFromStr(config_t*, const char*);
+void cfgMtcHttpMaxTargetsSetFromStr(config_t*, const char*);
+void cfgMtcHttpNormalizeSetFromStr(config_t*, const char*);
 void cfgTransportSetFromStr(config_t*, which_transport_t, const char*);
 void cfgCustomTagAddFromStr(config_t*, const char*, const char*);
 void cfgLogLevelSetFromStr(config_t*, const char*);
 void cfgPayEnableSetFromStr(config_t*, const char*);
 void cfgPayDirSetFromStr(config_t*, const char*);
+void cfgQueueOverflowSetFromStr(config_t*, cfg_queue_t, const char*);
+void cfgQueueSampleRateSetFromStr(config_t*, const char*);
 
 // These global variables limits us to only reading one config file at a time...
 // which seems fine for now, I guess.
@@ -421,6 +439,10 @@ processEnvStyleInput(config_t* cfg, const char* env_line)
         cfgConfigEventSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_METRIC_VERBOSITY")) {
         cfgMtcVerbositySetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_HTTP_TARGETS")) {
+        cfgMtcHttpMaxTargetsSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_HTTP_NORMALIZE")) {
+        cfgMtcHttpNormalizeSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_LOG_LEVEL")) {
         cfgLogLevelSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_METRIC_DEST")) {
@@ -433,6 +455,14 @@ processEnvStyleInput(config_t* cfg, const char* env_line)
         cfgPayEnableSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_PAYLOAD_DIR")) {
         cfgPayDirSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_QUEUE_EVENTS")) {
+        cfgQueueOverflowSetFromStr(cfg, CFG_QUEUE_EVENTS, value);
+    } else if (startsWith(env_line, "SCOPE_QUEUE_MESSAGES")) {
+        cfgQueueOverflowSetFromStr(cfg, CFG_QUEUE_MSGS, value);
+    } else if (startsWith(env_line, "SCOPE_QUEUE_PAYLOADS")) {
+        cfgQueueOverflowSetFromStr(cfg, CFG_QUEUE_PAYLOADS, value);
+    } else if (startsWith(env_line, "SCOPE_QUEUE_SAMPLERATE")) {
+        cfgQueueSampleRateSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_CMD_DBG_PATH")) {
         processCmdDebug(value);
     } else if (startsWith(env_line, "SCOPE_EVENT_DEST")) {
@@ -693,6 +723,25 @@ cfgMtcVerbositySetFromStr(config_t* cfg, const char* value)
     cfgMtcVerbositySet(cfg, x);
 }
 
+void
+cfgMtcHttpMaxTargetsSetFromStr(config_t* cfg, const char* value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgMtcHttpMaxTargetsSet(cfg, x);
+}
+
+void
+cfgMtcHttpNormalizeSetFromStr(config_t* cfg, const char* value)
+{
+    if (!cfg || !value) return;
+    cfgMtcHttpNormalizeSet(cfg, strToVal(boolMap, value));
+}
+
 void
 cfgTransportSetFromStr(config_t* cfg, which_transport_t t, const char* value)
 {
@@ -773,6 +822,25 @@ cfgPayDirSetFromStr(config_t *cfg, const char *value)
     cfgPayDirSet(cfg, value);
 }
 
+void
+cfgQueueOverflowSetFromStr(config_t *cfg, cfg_queue_t q, const char *value)
+{
+    if (!cfg || !value) return;
+    cfgQueueOverflowSet(cfg, q, strToVal(overflowMap, value));
+}
+
+void
+cfgQueueSampleRateSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgQueueSampleRateSet(cfg, x);
+}
+
 #ifndef NO_YAML
 
 #define foreach(pair, pairs) \
@@ -1004,6 +1072,22 @@ processVerbosity(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     if (value) free(value);
 }
 
+static void
+processHttpTargets(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgMtcHttpMaxTargetsSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processHttpNormalize(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgMtcHttpNormalizeSetFromStr(config, value);
+    if (value) free(value);
+}
+
 static void
 processMetricEnable(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1022,6 +1106,8 @@ processFormat(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    STATSDPREFIX_NODE,    processStatsDPrefix},
         {YAML_SCALAR_NODE,    STATSDMAXLEN_NODE,    processStatsDMaxLen},
         {YAML_SCALAR_NODE,    VERBOSITY_NODE,       processVerbosity},
+        {YAML_SCALAR_NODE,    HTTPTARGETS_NODE,     processHttpTargets},
+        {YAML_SCALAR_NODE,    HTTPNORMALIZE_NODE,   processHttpNormalize},
         {YAML_MAPPING_NODE,   TAGS_NODE,            processTags},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
@@ -1217,6 +1303,57 @@ processEvent(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     }
 }
 
+static void
+processQueueEvents(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgQueueOverflowSetFromStr(config, CFG_QUEUE_EVENTS, value);
+    if (value) free(value);
+}
+
+static void
+processQueueMessages(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgQueueOverflowSetFromStr(config, CFG_QUEUE_MSGS, value);
+    if (value) free(value);
+}
+
+static void
+processQueuePayloads(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgQueueOverflowSetFromStr(config, CFG_QUEUE_PAYLOADS, value);
+    if (value) free(value);
+}
+
+static void
+processQueueSampleRate(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgQueueSampleRateSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processQueue(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    parse_table_t t[] = {
+        {YAML_SCALAR_NODE,    EVENTS_NODE,          processQueueEvents},
+        {YAML_SCALAR_NODE,    MESSAGES_NODE,        processQueueMessages},
+        {YAML_SCALAR_NODE,    PAYLOADS_NODE,        processQueuePayloads},
+        {YAML_SCALAR_NODE,    SAMPLERATE_NODE,      processQueueSampleRate},
+        {YAML_NO_NODE,        NULL,                 NULL}
+    };
+
+    yaml_node_pair_t* pair;
+    foreach(pair, node->data.mapping.pairs) {
+        processKeyValuePair(t, pair, config, doc);
+    }
+}
+
 static void
 processLibscope(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1227,6 +1364,7 @@ processLibscope(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    SUMMARYPERIOD_NODE,   processSummaryPeriod},
         {YAML_SCALAR_NODE,    COMMANDDIR_NODE,      processCommandDir},
         {YAML_SCALAR_NODE,    CFGEVENT_NODE,        processConfigEvent},
+        {YAML_MAPPING_NODE,   QUEUE_NODE,           processQueue},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
@@ -1471,6 +1609,10 @@ createMetricFormatJson(config_t* cfg)
                                     cfgMtcStatsDMaxLen(cfg))) goto err;
     if (!cJSON_AddNumberToObjLN(root, VERBOSITY_NODE,
                                        cfgMtcVerbosity(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, HTTPTARGETS_NODE,
+                                  cfgMtcHttpMaxTargets(cfg))) goto err;
+    if (!cJSON_AddStringToObjLN(root, HTTPNORMALIZE_NODE,
+                   valToStr(boolMap, cfgMtcHttpNormalize(cfg)))) goto err;
 
     if (!(tags = createTagsJson(cfg))) goto err;
     cJSON_AddItemToObjectCS(root, TAGS_NODE, tags);
@@ -1610,17 +1752,41 @@ err:
     return NULL;
 }
 
+static cJSON*
+createQueueJson(config_t* cfg)
+{
+    cJSON* root = NULL;
+
+    if (!(root = cJSON_CreateObject())) goto err;
+    if (!cJSON_AddStringToObjLN(root, EVENTS_NODE,
+          valToStr(overflowMap, cfgQueueOverflow(cfg, CFG_QUEUE_EVENTS)))) goto err;
+    if (!cJSON_AddStringToObjLN(root, MESSAGES_NODE,
+          valToStr(overflowMap, cfgQueueOverflow(cfg, CFG_QUEUE_MSGS)))) goto err;
+    if (!cJSON_AddStringToObjLN(root, PAYLOADS_NODE,
+          valToStr(overflowMap, cfgQueueOverflow(cfg, CFG_QUEUE_PAYLOADS)))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, SAMPLERATE_NODE,
+                                cfgQueueSampleRate(cfg))) goto err;
+
+    return root;
+err:
+    if (root) cJSON_Delete(root);
+    return NULL;
+}
+
 static cJSON*
 createLibscopeJson(config_t* cfg)
 {
     cJSON* root = NULL;
-    cJSON *log;
+    cJSON *log, *queue;
 
     if (!(root = cJSON_CreateObject())) goto err;
 
     if (!(log = createLogJson(cfg))) goto err;
     cJSON_AddItemToObjectCS(root, LOG_NODE, log);
 
+    if (!(queue = createQueueJson(cfg))) goto err;
+    cJSON_AddItemToObjectCS(root, QUEUE_NODE, queue);
+
     if (!cJSON_AddStringToObjLN(root, CFGEVENT_NODE,
                  valToStr(boolMap, cfgSendProcessStartMsg(cfg)))) goto err;
 
@@ -1804,9 +1970,185 @@ initCtl(config_t *cfg)
     ctlPayEnableSet(ctl, cfgPayEnable(cfg));
     ctlPayDirSet(ctl,    cfgPayDir(cfg));
 
+    cfg_queue_t q;
+    for (q = CFG_QUEUE_EVENTS; q < CFG_QUEUE_MAX; q++) {
+        ctlQueuePolicySet(ctl, q, cfgQueueOverflow(cfg, q), cfgQueueSampleRate(cfg));
+    }
+
     return ctl;
 }
 
+// Bytes from hex, with spaces allowed between them ("16 03 01").
+// Returns how many, or -1 if str isn't that or there are more than max.
+static int
+hexBytes(const char *str, unsigned char *bytes, size_t max)
+{
+    size_t len = 0;
+
+    if (!str) return -1;
+    while (*str) {
+        if (isspace((unsigned char)*str)) {
+            str++;
+            continue;
+        }
+        if (!isxdigit((unsigned char)str[0]) || !isxdigit((unsigned char)str[1]) ||
+            (len >= max)) return -1;
+
+        char byte[3] = {str[0], str[1], '\0'};
+        bytes[len++] = strtoul(byte, NULL, 16);
+        str += 2;
+    }
+    return len;
+}
+
+bool
+protocolPatternAdd(protocol_def_t *prot, unsigned int offset, const char *value, const char *mask)
+{
+    if (!prot || (prot->npatterns >= PROT_MAX_PATTERNS)) return FALSE;
+
+    prot_bytes_t *pattern = &prot->pattern[prot->npatterns];
+    int len = hexBytes(value, pattern->value, sizeof(pattern->value));
+    if (len <= 0) return FALSE;
+
+    if (!mask) {
+        memset(pattern->mask, 0xff, len);
+    } else if (hexBytes(mask, pattern->mask, sizeof(pattern->mask)) != len) {
+        return FALSE;
+    }
+
+    int i;
+    for (i = 0; i < len; i++) {
+        pattern->value[i] &= pattern->mask[i];
+    }
+    pattern->offset = offset;
+    pattern->len = len;
+    prot->npatterns++;
+    return TRUE;
+}
+
+bool
+protocolLengthSet(protocol_def_t *prot, unsigned int offset, unsigned int size,
+                  const char *order, int adjust, unsigned int max, bool exact)
+{
+    if (!prot || ((size != 1) && (size != 2) && (size != 4))) return FALSE;
+
+    bool bigendian = TRUE;
+    if (order) {
+        if (!strcmp(order, "little")) {
+            bigendian = FALSE;
+        } else if (strcmp(order, "big")) {
+            return FALSE;
+        }
+    }
+
+    prot->length.size = size;
+    prot->length.offset = offset;
+    prot->length.bigendian = bigendian;
+    prot->length.adjust = adjust;
+    prot->length.max = max;
+    prot->length.exact = exact;
+    return TRUE;
+}
+
+static long long
+scalarNum(yaml_node_t *node)
+{
+    if (!node || (node->type != YAML_SCALAR_NODE)) return 0;
+
+    errno = 0;
+    long long num = strtoll((char *)node->data.scalar.value, NULL, 0);
+    return (errno) ? 0 : num;
+}
+
+static const char *
+scalarStr(yaml_node_t *node)
+{
+    if (!node || (node->type != YAML_SCALAR_NODE)) return NULL;
+    return (const char *)node->data.scalar.value;
+}
+
+/*
+ * signature: a sequence of byte patterns, each a mapping of
+ *     offset: an integer, from the start of the buffer
+ *     value: a string of hex bytes, "16 03"
+ *     mask: optional, a string of as many hex bytes, "ff fc"
+ */
+static bool
+protocolSignatureRead(yaml_document_t *doc, yaml_node_t *node, protocol_def_t *prot)
+{
+    yaml_node_item_t *item;
+    yaml_node_pair_t *pair;
+
+    if (node->type != YAML_SEQUENCE_NODE) return FALSE;
+
+    foreach (item, node->data.sequence.items) {
+        yaml_node_t *pattern = yaml_document_get_node(doc, *item);
+        if (!pattern || (pattern->type != YAML_MAPPING_NODE)) return FALSE;
+
+        unsigned int offset = 0;
+        const char *value = NULL;
+        const char *mask = NULL;
+        foreach (pair, pattern->data.mapping.pairs) {
+            const char *key = scalarStr(yaml_document_get_node(doc, pair->key));
+            yaml_node_t *val = yaml_document_get_node(doc, pair->value);
+            if (!key) return FALSE;
+
+            if (!strcmp(key, "offset")) {
+                offset = scalarNum(val);
+            } else if (!strcmp(key, "value")) {
+                value = scalarStr(val);
+            } else if (!strcmp(key, "mask")) {
+                mask = scalarStr(val);
+            }
+        }
+        if (!protocolPatternAdd(prot, offset, value, mask)) return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * length: a length field in the buffer, a mapping of
+ *     offset: an integer, from the start of the buffer
+ *     size: 1, 2 or 4 bytes
+ *     order: optional, big (the default) or little endian
+ *     adjust: optional, an integer added to the field before checks
+ *     max: optional, the most it can be
+ *     exact: optional, true if it has to equal the length of the buffer
+ */
+static bool
+protocolLengthRead(yaml_document_t *doc, yaml_node_t *node, protocol_def_t *prot)
+{
+    yaml_node_pair_t *pair;
+    unsigned int offset = 0, size = 0, max = 0;
+    int adjust = 0;
+    const char *order = NULL;
+    bool exact = FALSE;
+
+    if (node->type != YAML_MAPPING_NODE) return FALSE;
+
+    foreach (pair, node->data.mapping.pairs) {
+        const char *key = scalarStr(yaml_document_get_node(doc, pair->key));
+        yaml_node_t *val = yaml_document_get_node(doc, pair->value);
+        if (!key) return FALSE;
+
+        if (!strcmp(key, "offset")) {
+            offset = scalarNum(val);
+        } else if (!strcmp(key, "size")) {
+            size = scalarNum(val);
+        } else if (!strcmp(key, "order")) {
+            order = scalarStr(val);
+        } else if (!strcmp(key, "adjust")) {
+            adjust = scalarNum(val);
+        } else if (!strcmp(key, "max")) {
+            max = scalarNum(val);
+        } else if (!strcmp(key, "exact")) {
+            const char *str = scalarStr(val);
+            exact = (str && !strcmp(str, "true"));
+        }
+    }
+    return protocolLengthSet(prot, offset, size, order, adjust, max, exact);
+}
+
 /*
  * It goes like this:
  * the protocol config file is 3 levels deep
@@ -1820,6 +2162,8 @@ initCtl(config_t *cfg)
  * binary: a string, true or false
  * regex: a string, the regex pattern
  * len: an integer, len is optional, should be supplied for a binary protocol
+ * signature: byte patterns, instead of or as well as regex
+ * length: a length field to check, along with signature
  */
 bool
 protocolRead(const char *path, list_t *plist)
@@ -1830,6 +2174,7 @@ protocolRead(const char *path, list_t *plist)
     int doc_successful = 0;
     int num_found = 0;
     bool name_found = FALSE;
+    bool valid = TRUE;
     yaml_parser_t parser;
     yaml_document_t doc;
     yaml_node_t *node;
@@ -1880,6 +2225,7 @@ protocolRead(const char *path, list_t *plist)
 
             if ((prot = calloc(1, sizeof(protocol_def_t))) == NULL) goto cleanup;
             name_found = FALSE;
+            valid = TRUE;
 
             foreach (prot_pair, (yaml_node_pair_t *)plist_key->data.sequence.items) {
                 // 3rd level
@@ -1903,12 +2249,16 @@ protocolRead(const char *path, list_t *plist)
                     errno = 0;
                     prot->len = strtoull((char *)prot_value->data.scalar.value, NULL, 0);
                     if (errno != 0) prot->len = 0;
+                } else if (!strcmp((char *)prot_key->data.scalar.value, "signature")) {
+                    if (!protocolSignatureRead(&doc, prot_value, prot)) valid = FALSE;
+                } else if (!strcmp((char *)prot_key->data.scalar.value, "length")) {
+                    if (!protocolLengthRead(&doc, prot_value, prot)) valid = FALSE;
                 } else {
                     continue;
                 }
             }
 
-            if (!name_found  || (lstInsert(plist, num_found, prot) == FALSE)) {
+            if (!name_found || !valid || (lstInsert(plist, num_found, prot) == FALSE)) {
                 destroyProtEntry(prot);
             } else {
                 num_found++;
@@ -18,6 +18,13 @@ config_t* cfgRead(const char* path);
 bool protocolRead(const char *, list_t *);
 void destroyProtEntry(void *data);
 
+// For byte signatures, from the protocol file or an AddProto request.
+// Both return FALSE, and leave prot as it was, if what's given is bad.
+bool protocolPatternAdd(protocol_def_t *, unsigned int offset,
+                        const char *value, const char *mask);
+bool protocolLengthSet(protocol_def_t *, unsigned int offset, unsigned int size,
+                       const char *order, int adjust, unsigned int max, bool exact);
+
 // reads cfg from a string (containing json or yaml)
 config_t* cfgFromString(const char* string);
 
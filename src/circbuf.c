@@ -2,29 +2,43 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dbg.h"
 #include "atomic.h"
 #include "circbuf.h"
 
+#define LOAD_ACQ(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STORE_REL(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+// How many times a CBUF_DROP_OLDEST put will evict before giving up,
+// and how many it evicts at a time
+#define CBUF_EVICT_TRIES 4
+#define CBUF_EVICT_BATCH 64
+
 cbuf_handle_t
 cbufInit(size_t size)
 {
-    cbuf_handle_t cbuf = calloc(1, sizeof(struct circbuf_t));
-    if (!cbuf) {
-        DBG("Circbuf:calloc");
+    cbuf_handle_t cbuf = NULL;
+    if (posix_memalign((void **)&cbuf, CBUF_CACHE_LINE, sizeof(struct circbuf_t))) {
+        DBG("Circbuf:posix_memalign");
         return NULL;
     }
-    
-    uint64_t *buffer = calloc(size + 1, sizeof(uint64_t));
+    memset(cbuf, 0, sizeof(struct circbuf_t));
+
+    size_t slots = 2;
+    while (slots < size) slots <<= 1;
+
+    cbuf_slot_t *buffer = calloc(slots, sizeof(cbuf_slot_t));
     if (!buffer) {
         free(cbuf);
         DBG("Circbuf:calloc");
         return NULL;
     }
 
-    cbufReset(cbuf);
-    cbuf->maxlen = size + 1;
+    cbuf->mask = slots - 1;
     cbuf->buffer = buffer;
+    cbuf->rate = 1;
+    cbufReset(cbuf);
     return cbuf;
 }
 
@@ -42,81 +56,192 @@ cbufReset(cbuf_handle_t cbuf)
 {
     if (!cbuf) return;
 
+    uint64_t i;
+    for (i = 0; i <= cbuf->mask; i++) {
+        cbuf->buffer[i].seq = i;
+        cbuf->buffer[i].data = 0ULL;
+    }
     cbuf->head = 0;
     cbuf->tail = 0;
+    cbuf->dropped = 0;
+    cbuf->highwater = 0;
+    cbuf->sampled = 0;
+    cbuf->sampling = FALSE;
+    cbuf->head_stats = 0;
     return;
 }
 
 int
-cbufPut(cbuf_handle_t cbuf, uint64_t data)
+cbufPolicySet(cbuf_handle_t cbuf, cbuf_policy_t policy,
+              unsigned int rate, cbuf_evict_fn evict)
 {
-    int head, head_next, attempts, success;
-
     if (!cbuf) return -1;
-    attempts = success = 0;
-
-    do {
-        head = cbuf->head;
-        head_next = (head + 1) % cbuf->maxlen;
-        if (head_next == cbuf->tail) {
-            // Note: we commented this out as it caused a
-            // double free error when running with 100,000
-            // Go routines. We should determine why.
-            DBG("maxlen: %"PRIu64, cbuf->maxlen); // Full
+
+    switch (policy) {
+        case CBUF_DROP_NEWEST:
+            break;
+        case CBUF_DROP_OLDEST:
+            if (!evict && !cbuf->evict) return -1;
             break;
+        case CBUF_SAMPLE:
+            break;
+        default:
+            return -1;
+    }
+
+    // Puts may be running; leave nothing they could trip over
+    cbuf->sampling = FALSE;
+    cbuf->policy = policy;
+    if (rate) cbuf->rate = rate;
+    if (evict) cbuf->evict = evict;
+    return 0;
+}
+
+static int
+putRun(cbuf_handle_t cbuf, const uint64_t *data, int max)
+{
+    uint64_t pos = cbuf->head;
+    int num;
+
+    for (;;) {
+        // Count the free slots, in order, from pos
+        for (num = 0; num < max; num++) {
+            cbuf_slot_t *slot = &cbuf->buffer[(pos + num) & cbuf->mask];
+            if (LOAD_ACQ(&slot->seq) != pos + num) break;
         }
-        success = atomicCas32(&cbuf->head, head, head_next);
-    } while (!success && (attempts++ < cbuf->maxlen));
 
-    if (success) {
-        if (cbuf->buffer[head_next] != 0) {
-            // We expect that the entry is not used; has been read
-            DBG(NULL);
-            return -1;
+        if (num == 0) {
+            cbuf_slot_t *slot = &cbuf->buffer[pos & cbuf->mask];
+            int64_t diff = (int64_t)(LOAD_ACQ(&slot->seq) - pos);
+            // The slot still holds an entry from one lap ago; full
+            if (diff < 0) return 0;
+            // Another put claimed it first
+            pos = cbuf->head;
+            continue;
         }
-        cbuf->buffer[head_next] = data;
-        return 0;
+
+        // One CAS claims the whole run
+        if (atomicCasU64(&cbuf->head, pos, pos + num)) break;
+        pos = cbuf->head;
+    }
+
+    int i;
+    for (i = 0; i < num; i++) {
+        cbuf_slot_t *slot = &cbuf->buffer[(pos + i) & cbuf->mask];
+        slot->data = data[i];
+        // Now a get can have it
+        STORE_REL(&slot->seq, pos + i + 1);
     }
 
-    return -1;
+    // tail can pass pos while we're here; depth is only a guess then
+    uint64_t depth = pos + num - cbuf->tail;
+    uint64_t high = cbuf->highwater;
+    while ((depth <= cbuf->mask + 1) && (depth > high)) {
+        if (atomicCasU64(&cbuf->highwater, high, depth)) break;
+        high = cbuf->highwater;
+    }
+    return num;
 }
 
 int
-cbufGet(cbuf_handle_t cbuf, uint64_t *data)
+cbufPutBatch(cbuf_handle_t cbuf, const uint64_t *data, int num)
+{
+    if (!cbuf || !data || (num <= 0)) return 0;
+
+    int put = 0;
+
+    if (cbuf->sampling) {
+        if ((cbuf->head - cbuf->tail) <= ((cbuf->mask + 1) / 2)) {
+            // Drained enough; let everything in again
+            cbuf->sampling = FALSE;
+        } else if (__sync_fetch_and_add(&cbuf->sampled, 1) % cbuf->rate) {
+            goto drop;
+        }
+    }
+
+    put = putRun(cbuf, data, num);
+    if (put == num) return num;
+
+    cbuf_evict_fn evict = cbuf->evict;
+    if ((cbuf->policy == CBUF_DROP_OLDEST) && evict) {
+        int i, tries;
+        for (tries = 0; (put < num) && (tries < CBUF_EVICT_TRIES); tries++) {
+            uint64_t oldest[CBUF_EVICT_BATCH];
+            int want = num - put;
+            if (want > CBUF_EVICT_BATCH) want = CBUF_EVICT_BATCH;
+
+            int got = cbufGetBatch(cbuf, oldest, want);
+            for (i = 0; i < got; i++) {
+                evict(oldest[i]);
+            }
+            if (got) atomicAddU64(&cbuf->dropped, got);
+            put += putRun(cbuf, &data[put], num - put);
+        }
+        if (put == num) return num;
+    } else if (cbuf->policy == CBUF_SAMPLE) {
+        cbuf->sampling = TRUE;
+    }
+
+    DBG("maxlen: %"PRIu64, cbuf->mask + 1);
+drop:
+    atomicAddU64(&cbuf->dropped, num - put);
+    return put;
+}
+
+int
+cbufPut(cbuf_handle_t cbuf, uint64_t data)
 {
-    int tail, tail_next, attempts, success;
-    if (!cbuf || !data) return -1;
-
-    attempts = success = 0;
-
-    do {
-        tail = cbuf->tail;
-        tail_next = (tail + 1) % cbuf->maxlen;
-        if (tail == cbuf->head) break; // Empty
-        success = atomicCas32(&cbuf->tail, tail, tail_next);
-    } while (!success && (attempts++ < cbuf->maxlen));
-
-    if (success) {
-        *data = cbuf->buffer[tail_next];
-        if (*data == 0) {
-            // We expect data before we read
-            // Should we bail out here?
-            DBG(NULL);
+    return (cbufPutBatch(cbuf, &data, 1) == 1) ? 0 : -1;
+}
+
+int
+cbufGetBatch(cbuf_handle_t cbuf, uint64_t *data, int max)
+{
+    if (!cbuf || !data || (max <= 0)) return 0;
+
+    uint64_t pos = cbuf->tail;
+    int num;
+
+    for (;;) {
+        // Count the entries that are ready, in order, from pos
+        for (num = 0; num < max; num++) {
+            cbuf_slot_t *slot = &cbuf->buffer[(pos + num) & cbuf->mask];
+            if (LOAD_ACQ(&slot->seq) != pos + num + 1) break;
+        }
+
+        if (num == 0) {
+            uint64_t tail = cbuf->tail;
+            if (tail == pos) return 0;    // Empty, or the next put isn't done
+            pos = tail;                   // Another get moved tail; try again
+            continue;
         }
 
-        // Setting data to 0 to indicate to a put that we're empty
-        cbuf->buffer[tail_next] = 0ULL;
-        return 0;
+        if (atomicCasU64(&cbuf->tail, pos, pos + num)) break;
+        pos = cbuf->tail;
     }
 
-    return -1;
+    int i;
+    for (i = 0; i < num; i++) {
+        cbuf_slot_t *slot = &cbuf->buffer[(pos + i) & cbuf->mask];
+        data[i] = slot->data;
+        // Hand the slot back to puts for the next lap
+        STORE_REL(&slot->seq, pos + i + cbuf->mask + 1);
+    }
+
+    return num;
+}
+
+int
+cbufGet(cbuf_handle_t cbuf, uint64_t *data)
+{
+    return (cbufGetBatch(cbuf, data, 1) == 1) ? 0 : -1;
 }
 
 size_t
 cbufCapacity(cbuf_handle_t cbuf)
 {
     if (!cbuf) return -1;
-    return cbuf->maxlen - 1;
+    return cbuf->mask + 1;
 }
 
 int
@@ -125,3 +250,27 @@ cbufEmpty(cbuf_handle_t cbuf)
     if (!cbuf || (cbuf->tail == cbuf->head)) return TRUE;
     return FALSE;
 }
+
+void
+cbufStats(cbuf_handle_t cbuf, cbuf_stats_t *stats, int reset)
+{
+    if (!stats) return;
+    if (!cbuf) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    uint64_t head = cbuf->head;
+    stats->enqueued = head - cbuf->head_stats;
+    stats->highwater = cbuf->highwater;
+    if (!reset) {
+        stats->dropped = cbuf->dropped;
+        return;
+    }
+
+    stats->dropped = atomicSwapU64(&cbuf->dropped, 0);
+    cbuf->head_stats = head;
+    // Start the next period's high from what's there now
+    uint64_t depth = head - cbuf->tail;
+    cbuf->highwater = (depth <= cbuf->mask + 1) ? depth : 0;
+}
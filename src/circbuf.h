@@ -25,40 +25,106 @@
  * answer relates to how to respond to back pressure when data can't be
  * consumed as fast as it is being applied. Should we keep the first set of
  * data or should we keep the latest data in a back pressure situation?
- * We have chosen to not support overwrite at this point as it complicates the
- * mult-threaded aspects and we are not sure if it is needed at this point.
+ * The answer differs by queue, so it's a per-cbuf policy; see cbufPolicySet().
+ * By default a put to a full cbuf returns an error, keeping the first set of
+ * data.  With CBUF_DROP_OLDEST a put makes room by getting the oldest entry
+ * and handing it to an evict function, so the latest data is kept; the
+ * evict function is required because the cbuf can't free what it holds.
+ * With CBUF_SAMPLE, once a put finds the cbuf full only 1 in N puts are
+ * tried until the cbuf drains to half full, so a burst is represented by a
+ * sample rather than by whatever arrived first.
  */
 
+/*
+ * 3) The implementation is a bounded queue in the style of Dmitry Vyukov:
+ * each slot carries a sequence number that says whether it's ready to be
+ * written or read, so neither side looks at the data to decide, and any
+ * value (including 0) can be queued.  The number of slots is a power of 2
+ * so positions map to slots with a mask.  head and tail each sit on their
+ * own cache line; puts only move head and gets only move tail.  Gets claim
+ * entries with a CAS on tail, so more than one thread may get, though in
+ * practice it's just the periodic thread.
+ */
+
+#define CBUF_CACHE_LINE 64
+
+typedef enum {CBUF_DROP_NEWEST,
+              CBUF_DROP_OLDEST,
+              CBUF_SAMPLE} cbuf_policy_t;
+
+// Called with each entry a CBUF_DROP_OLDEST put evicts
+typedef void (*cbuf_evict_fn)(uint64_t);
+
+typedef struct {
+    uint64_t enqueued;      // successful puts
+    uint64_t dropped;       // puts that failed, plus entries evicted
+    uint64_t highwater;     // most entries held at once
+} cbuf_stats_t;
+
+typedef struct {
+    uint64_t seq;
+    uint64_t data;
+} cbuf_slot_t;
+
 typedef struct circbuf_t {
-    uint64_t *buffer;
-    int head;
-    int tail;
-    int maxlen;
+    uint64_t head __attribute__((aligned(CBUF_CACHE_LINE)));
+    uint64_t tail __attribute__((aligned(CBUF_CACHE_LINE)));
+    cbuf_slot_t *buffer __attribute__((aligned(CBUF_CACHE_LINE)));
+    uint64_t mask;
+    cbuf_policy_t policy;
+    unsigned int rate;      // for CBUF_SAMPLE, 1 in rate
+    cbuf_evict_fn evict;
+    // Only written when full, or when a put sets a new high
+    uint64_t dropped __attribute__((aligned(CBUF_CACHE_LINE)));
+    uint64_t highwater;
+    uint64_t sampled;
+    uint64_t sampling;
+    uint64_t head_stats;    // head at the last cbufStats() reset
 } cbuf_t;
 
 typedef cbuf_t * cbuf_handle_t ;
 
-// Given number of entries in a circbuf, return a circular buffer handle
+// Given number of entries in a circbuf, return a circular buffer handle.
+// The number of entries is rounded up to a power of 2.
 cbuf_handle_t cbufInit(size_t size);
 
 // Free the cbuf itself, not the buffers
 void cbufFree(cbuf_handle_t cbuf);
 
-// Reset to empty, head == tail
+// Reset to empty, head == tail.  Only safe when nothing else is using it.
 void cbufReset(cbuf_handle_t cbuf);
 
-// Add to the cbuf, if there is room
-// 0 on success, -1 if buffer is full
+// Set what a put does when the cbuf is full.  rate is only used by
+// CBUF_SAMPLE and evict only by CBUF_DROP_OLDEST, which needs one; a 0
+// rate or NULL evict keeps what was there.  Safe while puts are running.
+// 0 on success, -1 if the arguments don't make sense
+int cbufPolicySet(cbuf_handle_t cbuf, cbuf_policy_t policy,
+                  unsigned int rate, cbuf_evict_fn evict);
+
+// Add to the cbuf, if there is room or the policy makes room
+// 0 on success, -1 if data was dropped
 int cbufPut(cbuf_handle_t cbuf, uint64_t data);
 
+// Add up to num entries from data, in order, claiming room for them all
+// at once when there is room.  The policy applies as it does for a put.
+// Returns how many were added; data past that is still the caller's
+int cbufPutBatch(cbuf_handle_t cbuf, const uint64_t *data, int num);
+
 // Get an entry fromn the cbuf
 // 0 on success, -1 if the buffer is empty
 int cbufGet(cbuf_handle_t cbuf, uint64_t *data);
 
+// Get up to max entries from the cbuf, oldest first
+// Returns the number of entries in data, 0 if the buffer is empty
+int cbufGetBatch(cbuf_handle_t cbuf, uint64_t *data, int max);
+
 // Returns max capacity of the cbuf
 size_t cbufCapacity(cbuf_handle_t cbuf);
 
 // True if the circbuf is empty, else False
 int cbufEmpty(cbuf_handle_t cbuf);
 
+// Copy out the counts since the last reset; if reset, start over
+void cbufStats(cbuf_handle_t cbuf, cbuf_stats_t *stats, int reset);
+
 #endif // __CIRCBUF_H__
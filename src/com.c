@@ -170,6 +170,13 @@ msgEventGet(ctl_t *ctl)
     return ctlGetEvent(ctl);
 }
 
+int
+msgEventGetBatch(ctl_t *ctl, uint64_t *data, int max)
+{
+    if (!ctl) return 0;
+    return ctlGetEvents(ctl, data, max);
+}
+
 int
 pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
                     PCRE2_SIZE startoffset, uint32_t options,
@@ -272,3 +279,10 @@ msgPayloadGet(ctl_t *ctl)
     return ctlGetPayload(ctl);
 }
 
+int
+msgPayloadGetBatch(ctl_t *ctl, uint64_t *data, int max)
+{
+    if (!ctl) return 0;
+    return ctlGetPayloads(ctl, data, max);
+}
+
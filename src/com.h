@@ -45,6 +45,7 @@ cJSON *jsonConfigurationObject(config_t *);
 
 // Retreive messages
 uint64_t msgEventGet(ctl_t *);
+int msgEventGetBatch(ctl_t *, uint64_t *, int);
 
 // wrappers
 int pcre2_match_wrapper(pcre2_code *, PCRE2_SPTR, PCRE2_SIZE, PCRE2_SIZE,
@@ -57,5 +58,6 @@ bool cmdCbufEmpty(ctl_t *);
 int cmdSendPayload(ctl_t *, char *, size_t);
 int cmdPostPayload(ctl_t *, char *);
 uint64_t msgPayloadGet(ctl_t *);
+int msgPayloadGetBatch(ctl_t *, uint64_t *, int);
 
 #endif // __COM_H__
@@ -6,6 +6,12 @@
 #include "cfgutils.h"
 #include "ctl.h"
 #include "dbg.h"
+#include "evtstage.h"
+
+// Messages taken off a queue at a time
+#define CTL_BATCH_SIZE 64
+// Events a thread holds before handing them to the events queue
+#define CTL_STAGE_SIZE 32
 
 struct _ctl_t
 {
@@ -13,6 +19,7 @@ struct _ctl_t
     evt_fmt_t *evt;
     cbuf_handle_t evbuf;
     cbuf_handle_t events;
+    evt_stage_t *stage;
     unsigned enhancefs;
 
     struct {
@@ -20,6 +27,12 @@ struct _ctl_t
         char * dir;
         cbuf_handle_t ringbuf;
     } payload;
+
+    struct {
+        cfg_overflow_t overflow;
+        unsigned rate;
+        cbuf_evict_fn evict;
+    } queue[CFG_QUEUE_MAX];
 };
 
 typedef struct {
@@ -185,10 +198,53 @@ grab_supplemental_for_def_protocol(cJSON * json_root, request_t *req)
         prot->len = json->valueint;
     }
 
+    // signature and length are optional; with them, regex is too
+    json = cJSON_GetObjectItem(body, "signature");
+    if (json) {
+        cJSON *pattern;
+        if (!cJSON_IsArray(json)) goto err;
+        cJSON_ArrayForEach(pattern, json) {
+            cJSON *offset = cJSON_GetObjectItem(pattern, "offset");
+            cJSON *value = cJSON_GetObjectItem(pattern, "value");
+            cJSON *mask = cJSON_GetObjectItem(pattern, "mask");
+            if (offset && !cJSON_IsNumber(offset)) goto err;
+            if (!protocolPatternAdd(prot, (offset) ? offset->valueint : 0,
+                                    cJSON_GetStringValue(value),
+                                    (mask) ? cJSON_GetStringValue(mask) : NULL)) goto err;
+        }
+    }
+
+    json = cJSON_GetObjectItem(body, "length");
+    if (json) {
+        cJSON *item;
+        unsigned int offset = 0, size = 0, max = 0;
+        int adjust = 0;
+        if (!cJSON_IsObject(json)) goto err;
+        if ((item = cJSON_GetObjectItem(json, "offset")) && cJSON_IsNumber(item)) {
+            offset = item->valueint;
+        }
+        if ((item = cJSON_GetObjectItem(json, "size")) && cJSON_IsNumber(item)) {
+            size = item->valueint;
+        }
+        if ((item = cJSON_GetObjectItem(json, "adjust")) && cJSON_IsNumber(item)) {
+            adjust = item->valueint;
+        }
+        if ((item = cJSON_GetObjectItem(json, "max")) && cJSON_IsNumber(item)) {
+            max = item->valueint;
+        }
+        item = cJSON_GetObjectItem(json, "order");
+        char *order = (item) ? cJSON_GetStringValue(item) : NULL;
+        if (!protocolLengthSet(prot, offset, size, order, adjust, max,
+                               cJSON_IsTrue(cJSON_GetObjectItem(json, "exact")))) goto err;
+    }
+
     json = cJSON_GetObjectItem(body, "regex");
-    if (!json) goto err;
-    if (!(str = cJSON_GetStringValue(json))) goto err;
-    prot->regex = strdup(str);
+    if (json) {
+        if (!(str = cJSON_GetStringValue(json))) goto err;
+        prot->regex = strdup(str);
+    } else if (!prot->npatterns && !prot->length.size) {
+        goto err;
+    }
 
     json = cJSON_GetObjectItem(body, "pname");
     if (!json) goto err;
@@ -512,6 +568,29 @@ out:
     return msg;
 }
 
+static void
+evictMsg(uint64_t data)
+{
+    free((char *)data);
+}
+
+// Publish function for the per-thread event stage
+static void
+publishEvents(void *arg, uint64_t *data, int num)
+{
+    ctl_t *ctl = arg;
+
+    int put = cbufPutBatch(ctl->events, data, num);
+    if (put == num) return;
+
+    // Staging is only used with an evict function; see ctlPostEvent
+    cbuf_evict_fn evict = ctl->queue[CFG_QUEUE_EVENTS].evict;
+    int i;
+    for (i = put; evict && (i < num); i++) {
+        evict(data[i]);
+    }
+}
+
 ctl_t *
 ctlCreate()
 {
@@ -533,6 +612,12 @@ ctlCreate()
         return NULL;
     }
 
+    ctl->stage = evtStageCreate(CTL_STAGE_SIZE, publishEvents, ctl);
+    if (!ctl->stage) {
+        DBG(NULL);
+        return NULL;
+    }
+
     ctl->enhancefs = DEFAULT_ENHANCE_FS;
 
     ctl->payload.enable = DEFAULT_PAYLOAD_ENABLE;
@@ -543,6 +628,14 @@ ctlCreate()
         return NULL;
     }
 
+    cfg_queue_t q;
+    for (q = CFG_QUEUE_EVENTS; q < CFG_QUEUE_MAX; q++) {
+        ctl->queue[q].overflow = DEFAULT_QUEUE_OVERFLOW;
+        ctl->queue[q].rate = DEFAULT_QUEUE_SAMPLE_RATE;
+    }
+    // Messages are ours; we know how to free them
+    ctl->queue[CFG_QUEUE_MSGS].evict = evictMsg;
+
     return ctl;
 }
 
@@ -553,6 +646,8 @@ ctlDestroy(ctl_t **ctl)
 
     ctlFlush(*ctl);
     cbufFree((*ctl)->evbuf);
+    // Whatever is still staged goes to the events queue, then is freed with it
+    evtStageDestroy(&(*ctl)->stage);
     cbufFree((*ctl)->events);
 
     if ((*ctl)->payload.dir) free((*ctl)->payload.dir);
@@ -688,16 +783,19 @@ ctlSendEvent(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 int
 ctlPostEvent(ctl_t *ctl, char *event)
 {
-    if (!event) return -1;
-    if (!ctl) {
-        free(event);
-        return -1;
+    // On failure the caller still owns the event
+    if (!event || !ctl) return -1;
+
+    // A staged event may be dropped long after we return, so staging
+    // needs a way to free it; without one, queue it directly.
+    if (ctl->queue[CFG_QUEUE_EVENTS].evict &&
+        (evtStagePut(ctl->stage, (uint64_t)event) == 0)) {
+        return 0;
     }
 
     if (cbufPut(ctl->events, (uint64_t)event) == -1) {
         // Full; drop and ignore
         DBG(NULL);
-        free(event);
         return -1;
     }
     return 0;
@@ -721,8 +819,14 @@ sendBufferedMessages(ctl_t *ctl)
 {
     if (!ctl) return;
 
-    uint64_t data;
-    while (cbufGet(ctl->evbuf, &data) == 0) {
+    uint64_t batch[CTL_BATCH_SIZE];
+    int num = 0, i = 0;
+    for (;;) {
+        if (i == num) {
+            if ((num = cbufGetBatch(ctl->evbuf, batch, CTL_BATCH_SIZE)) == 0) break;
+            i = 0;
+        }
+        uint64_t data = batch[i++];
         if (data) {
             char *msg = (char*) data;
 
@@ -884,6 +988,13 @@ ctlPayDirSet(ctl_t *ctl, const char *dir)
 }
 
 
+void
+ctlFlushEvents(ctl_t *ctl)
+{
+    if (!ctl) return;
+    evtStageFlush(ctl->stage);
+}
+
 uint64_t
 ctlGetEvent(ctl_t *ctl)
 {
@@ -896,6 +1007,13 @@ ctlGetEvent(ctl_t *ctl)
     }
 }
 
+int
+ctlGetEvents(ctl_t *ctl, uint64_t *data, int max)
+{
+    if (!ctl) return 0;
+    return cbufGetBatch(ctl->events, data, max);
+}
+
 bool
 ctlCbufEmpty(ctl_t *ctl)
 {
@@ -929,3 +1047,82 @@ ctlGetPayload(ctl_t *ctl)
     }
 }
 
+int
+ctlGetPayloads(ctl_t *ctl, uint64_t *data, int max)
+{
+    if (!ctl) return 0;
+    return cbufGetBatch(ctl->payload.ringbuf, data, max);
+}
+
+static cbuf_handle_t
+queueBuf(ctl_t *ctl, cfg_queue_t q)
+{
+    switch (q) {
+        case CFG_QUEUE_EVENTS:
+            return ctl->events;
+        case CFG_QUEUE_MSGS:
+            return ctl->evbuf;
+        case CFG_QUEUE_PAYLOADS:
+            return ctl->payload.ringbuf;
+        default:
+            DBG("%d", q);
+            return NULL;
+    }
+}
+
+static void
+queuePolicyApply(ctl_t *ctl, cfg_queue_t q)
+{
+    cbuf_handle_t cbuf = queueBuf(ctl, q);
+    if (!cbuf) return;
+
+    cbuf_policy_t policy;
+    switch (ctl->queue[q].overflow) {
+        case CFG_DROP_OLDEST:
+            policy = CBUF_DROP_OLDEST;
+            break;
+        case CFG_SAMPLE:
+            policy = CBUF_SAMPLE;
+            break;
+        case CFG_DROP_NEWEST:
+        default:
+            policy = CBUF_DROP_NEWEST;
+            break;
+    }
+
+    // Without an evict function, drop-oldest has to wait; drop-newest
+    // until then.
+    if (cbufPolicySet(cbuf, policy, ctl->queue[q].rate, ctl->queue[q].evict)) {
+        cbufPolicySet(cbuf, CBUF_DROP_NEWEST, 0, NULL);
+    }
+}
+
+void
+ctlQueuePolicySet(ctl_t *ctl, cfg_queue_t q, cfg_overflow_t overflow, unsigned rate)
+{
+    if (!ctl || q < 0 || q >= CFG_QUEUE_MAX) return;
+    ctl->queue[q].overflow = overflow;
+    ctl->queue[q].rate = (rate) ? rate : DEFAULT_QUEUE_SAMPLE_RATE;
+    queuePolicyApply(ctl, q);
+}
+
+void
+ctlQueueEvictSet(ctl_t *ctl, cfg_queue_t q, cbuf_evict_fn evict)
+{
+    if (!ctl || q < 0 || q >= CFG_QUEUE_MAX) return;
+    ctl->queue[q].evict = evict;
+    queuePolicyApply(ctl, q);
+}
+
+void
+ctlQueueStats(ctl_t *ctl, cfg_queue_t q, cbuf_stats_t *stats)
+{
+    if (!stats) return;
+    if (!ctl || q < 0 || q >= CFG_QUEUE_MAX) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    // The counts are per call; each one starts a new period
+    cbufStats(queueBuf(ctl, q), stats, TRUE);
+}
@@ -2,6 +2,7 @@
 #define __CTL_H__
 
 #include "cfg.h"
+#include "circbuf.h"
 #include "cJSON.h"
 #include "transport.h"
 #include "evtformat.h"
@@ -34,6 +35,28 @@ typedef enum {
     URL_REDIRECT_OFF
 } switch_action_t;
 
+// A binary protocol can be detected from its raw bytes instead of, or as
+// well as, a regex over them as hex.  Every byte at offset, masked, has to
+// equal its value; and a length field, if there is one, has to make sense.
+#define PROT_MAX_BYTES 16
+#define PROT_MAX_PATTERNS 8
+
+typedef struct {
+    unsigned int offset;
+    unsigned int len;                       // of value and mask
+    unsigned char value[PROT_MAX_BYTES];    // already masked
+    unsigned char mask[PROT_MAX_BYTES];
+} prot_bytes_t;
+
+typedef struct {
+    unsigned int size;      // 1, 2 or 4 bytes; 0 if there's no length field
+    unsigned int offset;
+    bool bigendian;
+    int adjust;             // added to the field before it's checked
+    unsigned int max;       // largest it can be; 0 for no limit
+    bool exact;             // has to equal the length of the buffer
+} prot_length_t;
+
 typedef struct {
     bool binary;
     char *regex;
@@ -41,6 +64,9 @@ typedef struct {
     unsigned int len;
     unsigned int type;
     char *protname;
+    unsigned int npatterns;
+    prot_bytes_t pattern[PROT_MAX_PATTERNS];
+    prot_length_t length;
 } protocol_def_t;
 
 typedef struct {
@@ -124,14 +150,25 @@ void            ctlPayEnableSet(ctl_t *, unsigned int);
 const char *    ctlPayDir(ctl_t *);
 void            ctlPayDirSet(ctl_t *, const char *);
 
-// Retreive events
+// What to do when a queue is full, and what was dropped because of it.
+// Events and payloads are records the ctl can't free on its own; until
+// their owner gives an evict function they can't use CFG_DROP_OLDEST.
+void            ctlQueuePolicySet(ctl_t *, cfg_queue_t, cfg_overflow_t, unsigned);
+void            ctlQueueEvictSet(ctl_t *, cfg_queue_t, cbuf_evict_fn);
+void            ctlQueueStats(ctl_t *, cfg_queue_t, cbuf_stats_t *);
+
+// Retreive events.  Posted events can sit with the thread that posted
+// them; ctlFlushEvents() queues them all so a get can see them.
+void       ctlFlushEvents(ctl_t *);
 uint64_t   ctlGetEvent(ctl_t *);
+int        ctlGetEvents(ctl_t *, uint64_t *, int);
 
 bool ctlCbufEmpty(ctl_t *);
 
 // Payloads
 int ctlPostPayload(ctl_t *, char *);
 uint64_t ctlGetPayload(ctl_t *);
+int ctlGetPayloads(ctl_t *, uint64_t *, int);
 int ctlSendBin(ctl_t *, char *, size_t);
 
 #endif // _CTL_H__
@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "ctrshard.h"
+#include "dbg.h"
+#include "scopetypes.h"
+
+#define CACHE_LINE 64
+
+struct _ctr_shard_t {
+    unsigned int nctrs;
+    unsigned int nshards;   // a power of 2
+    size_t stride;          // uint64_t's per shard, a whole number of cache lines
+    uint64_t *ctr;          // nshards * stride, cache line aligned
+};
+
+// Which shard this thread uses; the same for every ctr_shard_t
+static __thread int t_shard = -1;
+static int g_next_shard = 0;
+
+ctr_shard_t *
+ctrShardCreate(unsigned int nctrs, unsigned int nshards)
+{
+    if (!nctrs || !nshards) return NULL;
+
+    ctr_shard_t *cs = calloc(1, sizeof(ctr_shard_t));
+    if (!cs) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    cs->nctrs = nctrs;
+    cs->nshards = 1;
+    while ((cs->nshards < nshards) && (cs->nshards < (1U << 16))) {
+        cs->nshards <<= 1;
+    }
+    cs->stride = ROUND_UP(nctrs * sizeof(uint64_t), CACHE_LINE) / sizeof(uint64_t);
+
+    size_t size = cs->stride * cs->nshards * sizeof(uint64_t);
+    if (posix_memalign((void **)&cs->ctr, CACHE_LINE, size)) {
+        DBG(NULL);
+        free(cs);
+        return NULL;
+    }
+    memset(cs->ctr, 0, size);
+
+    return cs;
+}
+
+void
+ctrShardDestroy(ctr_shard_t **cs_ptr)
+{
+    if (!cs_ptr || !*cs_ptr) return;
+    ctr_shard_t *cs = *cs_ptr;
+
+    free(cs->ctr);
+    free(cs);
+    *cs_ptr = NULL;
+}
+
+void
+ctrShardAdd(ctr_shard_t *cs, unsigned int ctr, int64_t val)
+{
+    if (!cs || (ctr >= cs->nctrs)) return;
+
+    int shard = t_shard;
+    if (shard < 0) {
+        // Hand shards out round robin; it spreads threads evenly and
+        // needs nothing from the thread's id.
+        shard = __sync_fetch_and_add(&g_next_shard, 1) & INT32_MAX;
+        t_shard = shard;
+    }
+
+    // Unsigned adds wrap, which is what makes negative values work
+    uint64_t *slot = &cs->ctr[(shard & (cs->nshards - 1)) * cs->stride + ctr];
+    (void)__sync_fetch_and_add(slot, (uint64_t)val);
+}
+
+int64_t
+ctrShardFold(ctr_shard_t *cs, unsigned int ctr)
+{
+    if (!cs || (ctr >= cs->nctrs)) return 0;
+
+    uint64_t sum = 0;
+    unsigned int i;
+    for (i = 0; i < cs->nshards; i++) {
+        uint64_t *slot = &cs->ctr[i * cs->stride + ctr];
+        if (*slot) sum += atomicSwapU64(slot, 0);
+    }
+    return (int64_t)sum;
+}
+
+unsigned int
+ctrShardCount(ctr_shard_t *cs)
+{
+    return (cs) ? cs->nshards : 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __CTRSHARD_H__
+#define __CTRSHARD_H__
+
+#include <stdint.h>
+
+//
+// A set of counters split into per-thread shards.
+//
+// Every counter exists once per shard, and each shard sits on its own
+// cache lines.  A thread is given a shard the first time it adds to any
+// counter set, so threads updating the same counter don't fight over one
+// cache line.  With more threads than shards, threads share shards;
+// updates are still atomic, just contended less.
+//
+// ctrShardFold() collects a counter from every shard, zeroing them as it
+// goes, and returns the sum.  Adds and subtracts can arrive in any order
+// between folds; the sum is signed so a subtract that lands in a
+// different shard than the add it undoes still comes out right.
+//
+
+typedef struct _ctr_shard_t ctr_shard_t;
+
+// Constructors Destructors
+ctr_shard_t *   ctrShardCreate(unsigned int nctrs, unsigned int nshards);  // nshards rounds up to a power of 2
+void            ctrShardDestroy(ctr_shard_t **);
+
+// Hot path
+void            ctrShardAdd(ctr_shard_t *, unsigned int ctr, int64_t val);
+
+// Returns the change in ctr since the last fold
+int64_t         ctrShardFold(ctr_shard_t *, unsigned int ctr);
+
+// Accessors
+unsigned int    ctrShardCount(ctr_shard_t *);
+
+#endif // __CTRSHARD_H__
@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "atomic.h"
+#include "dbg.h"
+#include "dnsresp.h"
+#include "scopetypes.h"
+
+#define DNS_HEADER_LEN 12
+#define DNS_QR 0x80
+#define DNS_CLASS_IN 1
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_MAX_POINTERS 16   // a loop of compression pointers ends here
+
+typedef struct {
+    int lock;
+    int used;
+    int fd;
+    uint16_t id;
+    uint64_t start;
+} pending_slot_t;
+
+struct _dns_pending_t {
+    unsigned int mask;
+    pending_slot_t slot[];
+};
+
+
+dns_pending_t *
+dnsPendingCreate(unsigned int entries)
+{
+    unsigned int size = 1;
+    while (size < entries) size <<= 1;
+
+    dns_pending_t *dp = calloc(1, sizeof(*dp) + size * sizeof(pending_slot_t));
+    if (!dp) {
+        DBG(NULL);
+        return NULL;
+    }
+    dp->mask = size - 1;
+    return dp;
+}
+
+void
+dnsPendingDestroy(dns_pending_t **dp_ptr)
+{
+    if (!dp_ptr || !*dp_ptr) return;
+
+    free(*dp_ptr);
+    *dp_ptr = NULL;
+}
+
+static pending_slot_t *
+slotFor(dns_pending_t *dp, int fd, uint16_t id)
+{
+    uint32_t hash = ((uint32_t)fd * 2654435761U) ^ id;
+    return &dp->slot[hash & dp->mask];
+}
+
+static void
+slotLock(pending_slot_t *slot)
+{
+    while (!atomicCas32(&slot->lock, 0, 1)) ;
+}
+
+static void
+slotUnlock(pending_slot_t *slot)
+{
+    atomicCas32(&slot->lock, 1, 0);
+}
+
+void
+dnsPendingAdd(dns_pending_t *dp, int fd, uint16_t id, uint64_t start)
+{
+    if (!dp) return;
+
+    pending_slot_t *slot = slotFor(dp, fd, id);
+    slotLock(slot);
+    slot->used = TRUE;
+    slot->fd = fd;
+    slot->id = id;
+    slot->start = start;
+    slotUnlock(slot);
+}
+
+int
+dnsPendingTake(dns_pending_t *dp, int fd, uint16_t id, uint64_t *start)
+{
+    if (!dp || !start) return FALSE;
+
+    int found = FALSE;
+    pending_slot_t *slot = slotFor(dp, fd, id);
+    slotLock(slot);
+    if (slot->used && (slot->fd == fd) && (slot->id == id)) {
+        *start = slot->start;
+        slot->used = FALSE;
+        found = TRUE;
+    }
+    slotUnlock(slot);
+    return found;
+}
+
+static uint16_t
+get16(const unsigned char *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t
+get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+int
+dnsQueryId(const void *pkt, size_t len)
+{
+    const unsigned char *p = pkt;
+    if (!p || (len < DNS_HEADER_LEN) || (p[2] & DNS_QR)) return -1;
+    return get16(p);
+}
+
+// Returns the offset just past the name at off, or 0 if it's bad.
+// If text is given, the name is put there with dots between labels.
+static size_t
+readName(const unsigned char *p, size_t len, size_t off, char *text, size_t tlen)
+{
+    size_t end = 0;         // past the name where it starts, at off
+    size_t tpos = 0;
+    int pointers = 0;
+
+    while (off < len) {
+        unsigned char llen = p[off];
+
+        if ((llen & 0xc0) == 0xc0) {
+            if ((off + 2 > len) || (++pointers > DNS_MAX_POINTERS)) return 0;
+            if (!end) end = off + 2;
+            off = ((llen & 0x3f) << 8) | p[off + 1];
+            continue;
+        }
+        if (llen & 0xc0) return 0;
+
+        if (llen == 0) {
+            if (text) text[tpos] = '\0';
+            return (end) ? end : off + 1;
+        }
+
+        if (off + 1 + llen > len) return 0;
+        if (text) {
+            // A dot and the label have to fit with the NUL at the end
+            if (tpos + (tpos ? 1 : 0) + llen >= tlen) return 0;
+            if (tpos) text[tpos++] = '.';
+            memcpy(&text[tpos], &p[off + 1], llen);
+            tpos += llen;
+        }
+        off += 1 + llen;
+    }
+    return 0;
+}
+
+int
+dnsParseResponse(const void *pkt, size_t len, dns_resp_t *resp)
+{
+    const unsigned char *p = pkt;
+    if (!p || !resp || (len < DNS_HEADER_LEN) || !(p[2] & DNS_QR)) return FALSE;
+
+    memset(resp, 0, sizeof(*resp));
+    resp->id = get16(p);
+    resp->rcode = p[3] & 0x0f;
+    resp->answers = get16(&p[6]);
+
+    unsigned int qdcount = get16(&p[4]);
+    size_t off = DNS_HEADER_LEN;
+    unsigned int i;
+
+    // The name we report is the first question's
+    for (i = 0; i < qdcount; i++) {
+        char *text = (i == 0) ? resp->name : NULL;
+        if (!(off = readName(p, len, off, text, sizeof(resp->name)))) return FALSE;
+        // type and class
+        if ((off += 4) > len) return FALSE;
+    }
+
+    // An answer section that's cut short still tells us the rcode and count
+    int first = TRUE;
+    for (i = 0; i < resp->answers; i++) {
+        if (!(off = readName(p, len, off, NULL, 0))) break;
+        // type, class, ttl, rdlength
+        if (off + 10 > len) break;
+        uint16_t type = get16(&p[off]);
+        uint16_t class = get16(&p[off + 2]);
+        uint32_t ttl = get32(&p[off + 4]);
+        size_t rdlen = get16(&p[off + 8]);
+        const unsigned char *rdata = &p[off + 10];
+        off += 10 + rdlen;
+        if (off > len) break;
+
+        if (first || (ttl < resp->ttl)) resp->ttl = ttl;
+        first = FALSE;
+
+        if ((class != DNS_CLASS_IN) || (resp->naddrs >= DNS_MAX_ADDRS)) continue;
+        int family = ((type == DNS_TYPE_A) && (rdlen == 4)) ? AF_INET :
+                     ((type == DNS_TYPE_AAAA) && (rdlen == 16)) ? AF_INET6 : 0;
+        if (family) {
+            resp->addr[resp->naddrs].family = family;
+            memcpy(resp->addr[resp->naddrs].addr, rdata, rdlen);
+            resp->naddrs++;
+        }
+    }
+
+    return TRUE;
+}
+
+const char *
+dnsRcodeName(int rcode)
+{
+    switch (rcode) {
+        case 0:
+            return "NOERROR";
+        case 1:
+            return "FORMERR";
+        case 2:
+            return "SERVFAIL";
+        case 3:
+            return "NXDOMAIN";
+        case 4:
+            return "NOTIMP";
+        case 5:
+            return "REFUSED";
+        default:
+            return "OTHER";
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef __DNSRESP_H__
+#define __DNSRESP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// For resolvers that speak DNS over UDP themselves (Go's own resolver,
+// c-ares, Java), instead of through getaddrinfo() and friends.
+//
+// Queries are remembered by (socket, transaction id) in a dns_pending_t
+// when they're sent; the response that comes back on the same socket
+// with the same id is matched with its query to give the latency.  The
+// table is fixed size and direct mapped: a query that lands on a slot
+// in use replaces the one there, which then goes unmatched.  Add and
+// Take are safe from any number of threads.
+//
+// dnsParseResponse() reads what we report from a response: the rcode,
+// the number of answers, the smallest TTL among them, the name in the
+// question and the first few addresses in A and AAAA answers.
+// Compressed names are followed; nothing is read past len.
+//
+
+#define DNS_RCODE_NOERROR   0
+#define DNS_RCODE_SERVFAIL  2
+#define DNS_RCODE_NXDOMAIN  3
+
+#define DNS_MAX_NAME 256
+#define DNS_MAX_ADDRS 8
+
+typedef struct {
+    uint16_t id;
+    int rcode;
+    unsigned int answers;       // ANCOUNT
+    uint32_t ttl;               // smallest of the answers; 0 if none
+    char name[DNS_MAX_NAME];    // from the question, as text
+    unsigned int naddrs;
+    struct {
+        int family;             // AF_INET or AF_INET6
+        unsigned char addr[16];
+    } addr[DNS_MAX_ADDRS];
+} dns_resp_t;
+
+// What's posted to the reporting thread for each response matched
+typedef struct {
+    int rcode;
+    unsigned int answers;
+    uint32_t ttl;
+    uint64_t duration;          // ns, from the query to the response
+    char name[];
+} dns_answer_t;
+
+typedef struct _dns_pending_t dns_pending_t;
+
+// entries is rounded up to a power of 2
+dns_pending_t *dnsPendingCreate(unsigned int entries);
+void           dnsPendingDestroy(dns_pending_t **);
+void           dnsPendingAdd(dns_pending_t *, int fd, uint16_t id, uint64_t start);
+// Returns TRUE, with the start of the query, if there is one; it's removed
+int            dnsPendingTake(dns_pending_t *, int fd, uint16_t id, uint64_t *start);
+
+// The id of a query; -1 if pkt isn't one
+int            dnsQueryId(const void *pkt, size_t len);
+// Returns TRUE if pkt is a response that could be read
+int            dnsParseResponse(const void *pkt, size_t len, dns_resp_t *resp);
+const char    *dnsRcodeName(int rcode);
+
+#endif // __DNSRESP_H__
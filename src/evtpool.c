@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "evtpool.h"
+#include "scopetypes.h"
+
+// Blocks are carved from slabs of this many blocks at a time
+#define POOL_CHUNK_SHIFT 6
+#define POOL_CHUNK_BLOCKS (1 << POOL_CHUNK_SHIFT)
+#define POOL_CHUNK_MASK (POOL_CHUNK_BLOCKS - 1)
+
+// A block with this index came from malloc, not from a slab
+#define POOL_NO_INDEX 0xffffffff
+#define POOL_IDX_MASK 0xffffffffULL
+
+/*
+ * Every block is preceded by this header.  It's 16 bytes so
+ * the block handed to the caller keeps malloc's alignment.
+ */
+typedef struct {
+    evt_pool_t *pool;
+    uint32_t index;         // position in the slabs or POOL_NO_INDEX
+    uint32_t next;          // free list link; index + 1, 0 ends the list
+} blk_hdr_t;
+
+struct _evt_pool_t {
+    size_t blksize;         // what the caller asked for
+    size_t stride;          // header + blksize, rounded up
+    int maxchunks;
+    int nchunks;
+    char **chunks;
+    uint64_t head;          // (tag << 32) | (index + 1) of the first free block
+    evt_pool_stats_t stats;
+};
+
+/*
+ * The free list is a Treiber stack of block indices.  The upper half
+ * of head is a tag that changes on every update, which is what keeps
+ * a pop from succeeding with a stale next link (the ABA problem).
+ * Slab memory is never released while the pool exists, so reading
+ * the next link of a block another thread just popped is safe; the
+ * CAS will fail and we retry.
+ */
+static inline blk_hdr_t *
+blockAt(evt_pool_t *pool, uint32_t index)
+{
+    char *chunk = pool->chunks[index >> POOL_CHUNK_SHIFT];
+    return (blk_hdr_t *)(chunk + ((index & POOL_CHUNK_MASK) * pool->stride));
+}
+
+static inline uint64_t
+nextHead(uint64_t oldhead, uint32_t link)
+{
+    return (((oldhead >> 32) + 1) << 32) | link;
+}
+
+static blk_hdr_t *
+popFree(evt_pool_t *pool)
+{
+    uint64_t oldhead;
+    blk_hdr_t *blk;
+
+    do {
+        oldhead = pool->head;
+        if (!(oldhead & POOL_IDX_MASK)) return NULL;
+        blk = blockAt(pool, (oldhead & POOL_IDX_MASK) - 1);
+    } while (!atomicCasU64(&pool->head, oldhead, nextHead(oldhead, blk->next)));
+
+    return blk;
+}
+
+// first through last must already be linked together
+static void
+pushFree(evt_pool_t *pool, blk_hdr_t *first, blk_hdr_t *last)
+{
+    uint64_t oldhead;
+
+    do {
+        oldhead = pool->head;
+        last->next = oldhead & POOL_IDX_MASK;
+    } while (!atomicCasU64(&pool->head, oldhead, nextHead(oldhead, first->index + 1)));
+}
+
+/*
+ * Add a slab to the pool.  The first block is returned to the caller,
+ * the rest go on the free list as one chain.
+ */
+static blk_hdr_t *
+growPool(evt_pool_t *pool)
+{
+    int chunk;
+    char *mem;
+    uint32_t i;
+
+    do {
+        chunk = pool->nchunks;
+        if (chunk >= pool->maxchunks) return NULL;
+    } while (!atomicCas32(&pool->nchunks, chunk, chunk + 1));
+
+    if ((mem = calloc(POOL_CHUNK_BLOCKS, pool->stride)) == NULL) {
+        // This chunk slot is lost; the pool is a bit smaller from now on.
+        DBG(NULL);
+        return NULL;
+    }
+
+    for (i = 0; i < POOL_CHUNK_BLOCKS; i++) {
+        blk_hdr_t *blk = (blk_hdr_t *)(mem + (i * pool->stride));
+        blk->pool = pool;
+        blk->index = (chunk << POOL_CHUNK_SHIFT) + i;
+        blk->next = blk->index + 2;
+    }
+    pool->chunks[chunk] = mem;
+    atomicAddU64(&pool->stats.slabbytes, POOL_CHUNK_BLOCKS * pool->stride);
+
+    pushFree(pool, blockAt(pool, (chunk << POOL_CHUNK_SHIFT) + 1),
+             blockAt(pool, (chunk << POOL_CHUNK_SHIFT) + POOL_CHUNK_MASK));
+
+    return (blk_hdr_t *)mem;
+}
+
+evt_pool_t *
+evtPoolCreate(size_t blksize, unsigned int maxblocks)
+{
+    if (!blksize) return NULL;
+
+    evt_pool_t *pool = calloc(1, sizeof(evt_pool_t));
+    if (!pool) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    pool->blksize = blksize;
+    pool->stride = ROUND_UP(sizeof(blk_hdr_t) + blksize, sizeof(blk_hdr_t));
+    pool->maxchunks = (maxblocks + POOL_CHUNK_MASK) >> POOL_CHUNK_SHIFT;
+
+    if (pool->maxchunks &&
+        ((pool->chunks = calloc(pool->maxchunks, sizeof(char *))) == NULL)) {
+        DBG(NULL);
+        free(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void
+evtPoolDestroy(evt_pool_t **pool)
+{
+    if (!pool || !*pool) return;
+
+    evt_pool_t *p = *pool;
+    int i;
+    for (i = 0; i < p->maxchunks; i++) {
+        if (p->chunks[i]) free(p->chunks[i]);
+    }
+    if (p->chunks) free(p->chunks);
+    free(p);
+    *pool = NULL;
+}
+
+void *
+evtPoolAlloc(evt_pool_t *pool)
+{
+    blk_hdr_t *blk;
+
+    if (!pool) return NULL;
+
+    if ((blk = popFree(pool)) || (blk = growPool(pool))) {
+        atomicAddU64(&pool->stats.allocs, 1);
+        return blk + 1;
+    }
+
+    // The slabs are exhausted; don't lose the event over it
+    if ((blk = malloc(sizeof(blk_hdr_t) + pool->blksize)) == NULL) {
+        atomicAddU64(&pool->stats.failed, 1);
+        return NULL;
+    }
+
+    atomicAddU64(&pool->stats.exhausted, 1);
+    blk->pool = pool;
+    blk->index = POOL_NO_INDEX;
+    blk->next = 0;
+    return blk + 1;
+}
+
+void *
+evtPoolTryAlloc(evt_pool_t *pool)
+{
+    blk_hdr_t *blk;
+
+    if (!pool) return NULL;
+
+    if ((blk = popFree(pool)) || (blk = growPool(pool))) {
+        atomicAddU64(&pool->stats.allocs, 1);
+        return blk + 1;
+    }
+
+    atomicAddU64(&pool->stats.failed, 1);
+    return NULL;
+}
+
+void
+evtPoolFree(void *data)
+{
+    if (!data) return;
+
+    blk_hdr_t *blk = (blk_hdr_t *)data - 1;
+
+    if (blk->index == POOL_NO_INDEX) {
+        free(blk);
+        return;
+    }
+
+    pushFree(blk->pool, blk, blk);
+}
+
+size_t
+evtPoolBlockSize(evt_pool_t *pool)
+{
+    return (pool) ? pool->blksize : 0;
+}
+
+void
+evtPoolStats(evt_pool_t *pool, evt_pool_stats_t *stats)
+{
+    if (!stats) return;
+
+    if (!pool) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    memmove(stats, &pool->stats, sizeof(*stats));
+}
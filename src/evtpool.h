@@ -0,0 +1,47 @@
+#ifndef __EVTPOOL_H__
+#define __EVTPOOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// This provides fixed size blocks for records that are posted from
+// interposed functions to the periodic thread (see ctlPostEvent()).
+//
+// Each pool hands out blocks of one size.  Blocks are carved from slabs
+// that are allocated lazily, a chunk at a time, up to maxblocks.  The
+// free list is lock-free so that any application thread can allocate
+// while the periodic thread returns blocks it has finished with.
+//
+// When a pool is exhausted evtPoolAlloc() falls back to malloc, so
+// callers never need to know where a block came from; every block is
+// returned with evtPoolFree().  Blocks are not zeroed.
+//
+
+typedef struct _evt_pool_t evt_pool_t;
+
+typedef struct {
+    uint64_t allocs;       // blocks handed out from a slab
+    uint64_t exhausted;    // allocs satisfied by malloc; slab was full
+    uint64_t failed;       // allocs that returned NULL
+    uint64_t slabbytes;    // memory currently held by slabs
+} evt_pool_stats_t;
+
+// Constructors Destructors
+evt_pool_t *    evtPoolCreate(size_t blksize, unsigned int maxblocks);
+void            evtPoolDestroy(evt_pool_t **);
+
+// Allocate a block of blksize bytes; NULL if no memory is available
+void *          evtPoolAlloc(evt_pool_t *);
+// The same, but NULL once the slabs are exhausted; for pools that
+// should never hold more than maxblocks
+void *          evtPoolTryAlloc(evt_pool_t *);
+
+// Return any block from evtPoolAlloc() to the pool it came from
+void            evtPoolFree(void *);
+
+// Accessors
+size_t          evtPoolBlockSize(evt_pool_t *);
+void            evtPoolStats(evt_pool_t *, evt_pool_stats_t *);
+
+#endif // __EVTPOOL_H__
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "evtstage.h"
+#include "scopetypes.h"
+
+#define CACHE_LINE 64
+#define MAX_BATCH 1024
+// How long a flush waits for a thread to finish a put before skipping
+// it.  A put holds its slot for a few instructions; if it's taking longer
+// than this the thread was preempted, and waiting on it only holds up
+// every other slot.
+#define FLUSH_SPINS 100
+
+#define LOAD_ACQ(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STORE_REL(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+// Who has a slot's entries right now
+#define SLOT_IDLE  0
+#define SLOT_OWNER 1
+#define SLOT_FLUSH 2
+
+typedef struct _stage_slot_t {
+    uint64_t busy;                  // SLOT_IDLE, SLOT_OWNER or SLOT_FLUSH
+    uint64_t inuse;                 // a thread has it
+    struct _stage_slot_t *next;     // every slot ever made, never unlinked
+    evt_stage_t *stage;
+    int num;
+    uint64_t ent[];
+} stage_slot_t;
+
+struct _evt_stage_t {
+    int batch;
+    evt_stage_publish_fn publish;
+    void *arg;
+    pthread_key_t key;
+    stage_slot_t *slots;
+};
+
+static void
+slotPublish(stage_slot_t *slot)
+{
+    if (slot->num) {
+        slot->stage->publish(slot->stage->arg, slot->ent, slot->num);
+        slot->num = 0;
+    }
+}
+
+// pthread key destructor; the thread is going away
+static void
+slotRelease(void *arg)
+{
+    stage_slot_t *slot = arg;
+    if (!slot) return;
+
+    while (!atomicCasU64(&slot->busy, SLOT_IDLE, SLOT_OWNER)) {
+        sched_yield();
+    }
+    slotPublish(slot);
+    STORE_REL(&slot->busy, SLOT_IDLE);
+    STORE_REL(&slot->inuse, FALSE);
+}
+
+static stage_slot_t *
+slotGet(evt_stage_t *stage)
+{
+    stage_slot_t *slot = pthread_getspecific(stage->key);
+    if (slot) return slot;
+
+    // One left behind by a thread that exited
+    for (slot = LOAD_ACQ(&stage->slots); slot; slot = slot->next) {
+        if (!slot->inuse && atomicCasU64(&slot->inuse, FALSE, TRUE)) break;
+    }
+
+    if (!slot) {
+        size_t size = ROUND_UP(sizeof(stage_slot_t) + stage->batch * sizeof(uint64_t), CACHE_LINE);
+        if (posix_memalign((void **)&slot, CACHE_LINE, size)) {
+            DBG(NULL);
+            return NULL;
+        }
+        memset(slot, 0, size);
+        slot->stage = stage;
+        slot->inuse = TRUE;
+
+        stage_slot_t *head;
+        do {
+            head = LOAD_ACQ(&stage->slots);
+            slot->next = head;
+        } while (!__sync_bool_compare_and_swap(&stage->slots, head, slot));
+    }
+
+    if (pthread_setspecific(stage->key, slot)) {
+        DBG(NULL);
+        // Give it back; it's on the list and the next thread can have it
+        STORE_REL(&slot->inuse, FALSE);
+        return NULL;
+    }
+    return slot;
+}
+
+evt_stage_t *
+evtStageCreate(int batch, evt_stage_publish_fn publish, void *arg)
+{
+    if ((batch <= 0) || (batch > MAX_BATCH) || !publish) return NULL;
+
+    evt_stage_t *stage = calloc(1, sizeof(evt_stage_t));
+    if (!stage) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    if (pthread_key_create(&stage->key, slotRelease)) {
+        DBG(NULL);
+        free(stage);
+        return NULL;
+    }
+
+    stage->batch = batch;
+    stage->publish = publish;
+    stage->arg = arg;
+    return stage;
+}
+
+void
+evtStageDestroy(evt_stage_t **stage_ptr)
+{
+    if (!stage_ptr || !*stage_ptr) return;
+    evt_stage_t *stage = *stage_ptr;
+
+    evtStageFlush(stage);
+
+    // No destructors run after this, so the slots are all ours
+    pthread_key_delete(stage->key);
+
+    stage_slot_t *slot = stage->slots;
+    while (slot) {
+        stage_slot_t *next = slot->next;
+        slotPublish(slot);
+        free(slot);
+        slot = next;
+    }
+
+    free(stage);
+    *stage_ptr = NULL;
+}
+
+int
+evtStagePut(evt_stage_t *stage, uint64_t data)
+{
+    if (!stage) return -1;
+
+    stage_slot_t *slot = slotGet(stage);
+    if (!slot) return -1;
+
+    while (!atomicCasU64(&slot->busy, SLOT_IDLE, SLOT_OWNER)) {
+        // We interrupted ourselves; don't wait on a put that can't finish
+        if (slot->busy == SLOT_OWNER) return -1;
+        // A flush has it, and doesn't hold it long
+        sched_yield();
+    }
+
+    slot->ent[slot->num++] = data;
+    if (slot->num >= stage->batch) slotPublish(slot);
+
+    STORE_REL(&slot->busy, SLOT_IDLE);
+    return 0;
+}
+
+void
+evtStageFlush(evt_stage_t *stage)
+{
+    if (!stage) return;
+
+    stage_slot_t *slot;
+    for (slot = LOAD_ACQ(&stage->slots); slot; slot = slot->next) {
+        if (!LOAD_ACQ(&slot->num)) continue;
+
+        int spins;
+        for (spins = 0; spins < FLUSH_SPINS; spins++) {
+            if (atomicCasU64(&slot->busy, SLOT_IDLE, SLOT_FLUSH)) break;
+        }
+        // Its thread is stuck mid put; it'll get it next time
+        if (spins == FLUSH_SPINS) continue;
+
+        slotPublish(slot);
+        STORE_REL(&slot->busy, SLOT_IDLE);
+    }
+}
+
+int
+evtStageBatch(evt_stage_t *stage)
+{
+    return (stage) ? stage->batch : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef __EVTSTAGE_H__
+#define __EVTSTAGE_H__
+
+#include <stdint.h>
+
+//
+// Per-thread staging for entries bound for a shared queue.
+//
+// Each thread that puts gets a small buffer of its own the first time it
+// puts, and entries collect there with no atomics shared with any other
+// thread.  A full buffer is handed to the publish function all at once,
+// so the shared queue sees one batch instead of one put per entry.
+//
+// evtStageFlush() publishes whatever every thread has staged; whoever
+// drains the queue calls it first.  A thread's buffer is published when
+// the thread exits and is then reused by the next new thread.
+//
+// The publish function owns the entries it's given, including any it
+// can't queue.
+//
+
+typedef struct _evt_stage_t evt_stage_t;
+typedef void (*evt_stage_publish_fn)(void *arg, uint64_t *data, int num);
+
+// Constructors Destructors
+evt_stage_t *   evtStageCreate(int batch, evt_stage_publish_fn, void *arg);
+void            evtStageDestroy(evt_stage_t **);    // publishes what's left
+
+// Hot path.  Returns -1 when the entry can't be staged right now (e.g.
+// a signal handler interrupted a put on the same thread); the caller
+// still owns it and should queue it directly.
+int             evtStagePut(evt_stage_t *, uint64_t);
+
+// Publish everything staged, from every thread
+void            evtStageFlush(evt_stage_t *);
+
+// Accessors
+int             evtStageBatch(evt_stage_t *);
+
+#endif // __EVTSTAGE_H__
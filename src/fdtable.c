@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "fdtable.h"
+
+// Entries per page
+#define FDT_PAGE_SHIFT 7
+#define FDT_PAGE_SIZE (1 << FDT_PAGE_SHIFT)
+#define FDT_PAGE_MASK (FDT_PAGE_SIZE - 1)
+#define FDT_PAGE_WORDS (FDT_PAGE_SIZE / 64)
+
+#define WORD_BITS 64
+#define BIT(n) (1ULL << ((n) & (WORD_BITS - 1)))
+
+typedef struct {
+    uint64_t active[FDT_PAGE_WORDS];   // one bit per entry
+    char ent[];
+} fdt_page_t;
+
+struct _fd_table_t {
+    size_t entsize;
+    int maxfds;
+    int npages;
+    int limit;              // one past the last fd of the highest page
+    fdt_page_t **page;
+    uint64_t *pagemap;      // one bit per page with any active entry
+};
+
+fd_table_t *
+fdTableCreate(size_t entsize, int maxfds)
+{
+    if (!entsize || (maxfds <= 0)) return NULL;
+
+    fd_table_t *tab = calloc(1, sizeof(fd_table_t));
+    if (!tab) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    tab->entsize = entsize;
+    tab->maxfds = maxfds;
+    tab->npages = (maxfds + FDT_PAGE_MASK) >> FDT_PAGE_SHIFT;
+
+    tab->page = calloc(tab->npages, sizeof(fdt_page_t *));
+    tab->pagemap = calloc((tab->npages + WORD_BITS - 1) / WORD_BITS, sizeof(uint64_t));
+    if (!tab->page || !tab->pagemap) {
+        DBG(NULL);
+        if (tab->page) free(tab->page);
+        if (tab->pagemap) free(tab->pagemap);
+        free(tab);
+        return NULL;
+    }
+
+    return tab;
+}
+
+void
+fdTableDestroy(fd_table_t **tab_ptr)
+{
+    if (!tab_ptr || !*tab_ptr) return;
+    fd_table_t *tab = *tab_ptr;
+
+    int i;
+    for (i = 0; i < tab->npages; i++) {
+        if (tab->page[i]) free(tab->page[i]);
+    }
+    free(tab->page);
+    free(tab->pagemap);
+    free(tab);
+    *tab_ptr = NULL;
+}
+
+static fdt_page_t *
+getPage(fd_table_t *tab, int fd)
+{
+    if (!tab || (fd < 0) || (fd >= tab->maxfds)) return NULL;
+    return tab->page[fd >> FDT_PAGE_SHIFT];
+}
+
+void *
+fdTableGet(fd_table_t *tab, int fd)
+{
+    fdt_page_t *page = getPage(tab, fd);
+    if (!page) return NULL;
+
+    return page->ent + ((fd & FDT_PAGE_MASK) * tab->entsize);
+}
+
+void *
+fdTableSlot(fd_table_t *tab, int fd)
+{
+    if (!tab || (fd < 0) || (fd >= tab->maxfds)) return NULL;
+
+    int pnum = fd >> FDT_PAGE_SHIFT;
+    fdt_page_t *page = tab->page[pnum];
+
+    if (!page) {
+        fdt_page_t *newpage = calloc(1, sizeof(fdt_page_t) + FDT_PAGE_SIZE * tab->entsize);
+        if (!newpage) {
+            DBG(NULL);
+            return NULL;
+        }
+        if (!atomicCasU64((uint64_t *)&tab->page[pnum], 0ULL, (uint64_t)newpage)) {
+            // Another thread got here first; use its page
+            free(newpage);
+        }
+        page = tab->page[pnum];
+
+        int oldlimit, newlimit = (pnum + 1) << FDT_PAGE_SHIFT;
+        do {
+            oldlimit = tab->limit;
+            if (oldlimit >= newlimit) break;
+        } while (!atomicCas32(&tab->limit, oldlimit, newlimit));
+    }
+
+    return page->ent + ((fd & FDT_PAGE_MASK) * tab->entsize);
+}
+
+void
+fdTableSetActive(fd_table_t *tab, int fd)
+{
+    fdt_page_t *page = getPage(tab, fd);
+    if (!page) return;
+
+    int pnum = fd >> FDT_PAGE_SHIFT;
+    int bit = fd & FDT_PAGE_MASK;
+
+    // Entry first, then page, so a scan never misses an active entry
+    atomicOrU64(&page->active[bit / WORD_BITS], BIT(bit));
+    atomicOrU64(&tab->pagemap[pnum / WORD_BITS], BIT(pnum));
+}
+
+void
+fdTableClearActive(fd_table_t *tab, int fd)
+{
+    fdt_page_t *page = getPage(tab, fd);
+    if (!page) return;
+
+    int pnum = fd >> FDT_PAGE_SHIFT;
+    int bit = fd & FDT_PAGE_MASK;
+    int i;
+
+    atomicAndU64(&page->active[bit / WORD_BITS], ~BIT(bit));
+    for (i = 0; i < FDT_PAGE_WORDS; i++) {
+        if (page->active[i]) return;
+    }
+
+    // The page looks empty.  Someone may set a bit while we clear the
+    // page's bit, so look again afterwards and put it back if needed.
+    atomicAndU64(&tab->pagemap[pnum / WORD_BITS], ~BIT(pnum));
+    for (i = 0; i < FDT_PAGE_WORDS; i++) {
+        if (page->active[i]) {
+            atomicOrU64(&tab->pagemap[pnum / WORD_BITS], BIT(pnum));
+            return;
+        }
+    }
+}
+
+int
+fdTableNextActive(fd_table_t *tab, int fd)
+{
+    if (!tab || (fd >= tab->maxfds)) return -1;
+    if (fd < 0) fd = 0;
+
+    int pnum = fd >> FDT_PAGE_SHIFT;
+    int bit = fd & FDT_PAGE_MASK;
+
+    while (pnum < tab->npages) {
+        // Skip a word of pages at a time
+        uint64_t pages = tab->pagemap[pnum / WORD_BITS] & (~0ULL << (pnum & (WORD_BITS - 1)));
+        if (!pages) {
+            pnum = (pnum | (WORD_BITS - 1)) + 1;
+            bit = 0;
+            continue;
+        }
+
+        int found = (pnum & ~(WORD_BITS - 1)) + __builtin_ctzll(pages);
+        if (found != pnum) bit = 0;
+        pnum = found;
+
+        fdt_page_t *page = tab->page[pnum];
+        if (page) {
+            int w;
+            for (w = bit / WORD_BITS; w < FDT_PAGE_WORDS; w++) {
+                uint64_t word = page->active[w];
+                if (w == bit / WORD_BITS) word &= (~0ULL << (bit & (WORD_BITS - 1)));
+                if (word) {
+                    int next = (pnum << FDT_PAGE_SHIFT) + (w * WORD_BITS) + __builtin_ctzll(word);
+                    return (next < tab->maxfds) ? next : -1;
+                }
+            }
+        }
+
+        pnum++;
+        bit = 0;
+    }
+
+    return -1;
+}
+
+int
+fdTableMaxFds(fd_table_t *tab)
+{
+    return (tab) ? tab->maxfds : 0;
+}
+
+int
+fdTableLimit(fd_table_t *tab)
+{
+    if (!tab) return 0;
+    return (tab->limit < tab->maxfds) ? tab->limit : tab->maxfds;
+}
@@ -0,0 +1,44 @@
+#ifndef __FDTABLE_H__
+#define __FDTABLE_H__
+
+#include <stddef.h>
+
+//
+// A sparse table of fixed size entries indexed by file descriptor.
+//
+// The table is two levels: a directory of page pointers sized for maxfds
+// up front, and pages of entries that are allocated (zeroed) the first
+// time an fd in that page is needed.  Pages are installed with a CAS and
+// never move or get freed while the table exists, so a pointer to an
+// entry stays valid and lookups need no lock, even while other threads
+// are adding pages.  Memory in use is proportional to the fds that have
+// been seen, not to maxfds.
+//
+
+typedef struct _fd_table_t fd_table_t;
+
+// Constructors Destructors
+fd_table_t *    fdTableCreate(size_t entsize, int maxfds);
+void            fdTableDestroy(fd_table_t **);
+
+// Returns the entry for fd, or NULL if fd is out of range or its page
+// has not been allocated.  Never allocates.
+void *          fdTableGet(fd_table_t *, int fd);
+
+// Like fdTableGet(), but allocates the page if it isn't there yet.
+// Returns NULL if fd is out of range or there is no memory.
+void *          fdTableSlot(fd_table_t *, int fd);
+
+// The table keeps a bitmap of which entries are in use, so callers can
+// visit just those.  Setting an fd whose page isn't allocated is a no-op.
+void            fdTableSetActive(fd_table_t *, int fd);
+void            fdTableClearActive(fd_table_t *, int fd);
+// Returns the lowest active fd >= fd, or -1 if there is none
+int             fdTableNextActive(fd_table_t *, int fd);
+
+// Accessors
+int             fdTableMaxFds(fd_table_t *);
+// One more than the highest fd whose page has been allocated
+int             fdTableLimit(fd_table_t *);
+
+#endif // __FDTABLE_H__
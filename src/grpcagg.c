@@ -0,0 +1,301 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "com.h"
+#include "dbg.h"
+#include "grpcagg.h"
+#include "sketch.h"
+
+
+#define OTHER_METHOD "other"
+#define MAX_METHOD_SLOTS ( GRPC_MAX_METHODS * 2 )  // a power of 2
+#define SIDES ( 2 )           // server, client
+#define OUTCOMES ( 2 )        // ok, error
+
+typedef struct {
+    uint64_t total;       // cumulative total
+    uint64_t num_entries; // number of entries, to support average calculation
+} agg_counter_t;
+
+typedef struct {
+    uint64_t calls[GRPC_STATUSES];
+    agg_counter_t duration;
+    agg_counter_t size[2];            // of request and response messages
+    sketch_t *latency[OUTCOMES];      // created when first needed
+} side_agg_t;
+
+typedef struct {
+    strtab_id_t name;     // the key that comes from the :path
+    uint64_t hash;        // of the name
+    side_agg_t side[SIDES];
+} method_agg_t;
+
+struct _grpc_agg_t {
+    strtab_t *names;
+    method_agg_t *method[GRPC_MAX_METHODS]; // in the order they were first seen
+    unsigned count;
+    uint32_t slot[MAX_METHOD_SLOTS];  // index into method + 1, 0 if empty
+    method_agg_t *other;              // for everything past GRPC_MAX_METHODS
+};
+
+static const char *sideName[SIDES] = {"server", "client"};
+static const char *outcomeName[OUTCOMES] = {"ok", "error"};
+static const char *msgName[2] = {"request", "response"};
+
+// What the duration sketches report
+static const struct {
+    const char *name;
+    double quantile;
+} quantileMap[] = {
+    {"p50",   0.50},
+    {"p90",   0.90},
+    {"p99",   0.99},
+    {"max",   1.00},
+};
+
+
+grpc_agg_t *
+grpcAggCreate(strtab_t *names)
+{
+    grpc_agg_t *agg = calloc(1, sizeof(*agg));
+    if (!agg) {
+        DBG(NULL);
+        return NULL;
+    }
+    agg->names = names;
+    return agg;
+}
+
+void
+grpcAggDestroy(grpc_agg_t **agg_ptr)
+{
+    if (!agg_ptr || !*agg_ptr) return;
+
+    grpcAggReset(*agg_ptr);
+    free(*agg_ptr);
+    *agg_ptr = NULL;
+}
+
+static uint64_t
+hashMethod(const char *str)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *str; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static method_agg_t *
+get_other_entry(grpc_agg_t *agg)
+{
+    if (!agg->other) {
+        if ((agg->other = calloc(1, sizeof(*agg->other))) == NULL) {
+            DBG(NULL);
+        }
+    }
+    return agg->other;
+}
+
+static method_agg_t *
+get_method_entry(grpc_agg_t *agg, const char *name)
+{
+    uint64_t hash = hashMethod(name);
+    uint64_t mask = MAX_METHOD_SLOTS - 1;
+    uint64_t i = hash & mask;
+
+    // The slots are never more than half full, so this ends
+    while (agg->slot[i]) {
+        method_agg_t *entry = agg->method[agg->slot[i] - 1];
+        if ((entry->hash == hash) &&
+            !strcmp(strtabStr(agg->names, entry->name), name)) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+
+    if (agg->count >= GRPC_MAX_METHODS) return get_other_entry(agg);
+
+    // A full strtab is a limit too
+    strtab_id_t id = strtabIntern(agg->names, name);
+    if (id == STRTAB_NONE) return get_other_entry(agg);
+
+    method_agg_t *entry = calloc(1, sizeof(*entry));
+    if (!entry) {
+        DBG(NULL);
+        strtabRelease(agg->names, id);
+        return NULL;
+    }
+    entry->name = id;
+    entry->hash = hash;
+    agg->method[agg->count++] = entry;
+    agg->slot[i] = agg->count;
+    return entry;
+}
+
+static void
+free_method(method_agg_t *entry)
+{
+    if (!entry) return;
+
+    int i, j;
+    for (i = 0; i < SIDES; i++) {
+        for (j = 0; j < OUTCOMES; j++) {
+            sketchDestroy(&entry->side[i].latency[j]);
+        }
+    }
+    free(entry);
+}
+
+static void
+add_counter(agg_counter_t *counter, uint64_t value, uint64_t entries)
+{
+    counter->total += value;
+    counter->num_entries += entries;
+}
+
+void
+grpcAggAddCall(grpc_agg_t *agg, const grpc_call_t *call)
+{
+    if (!agg || !call || !call->method) return;
+
+    method_agg_t *entry = get_method_entry(agg, call->method);
+    if (!entry) return;
+    side_agg_t *side = &entry->side[(call->isServer) ? 0 : 1];
+
+    // Per the spec, a status we don't know is UNKNOWN
+    int status = call->status;
+    if ((status < 0) || (status >= GRPC_STATUSES)) status = GRPC_STATUS_UNKNOWN;
+    side->calls[status]++;
+
+    add_counter(&side->duration, call->duration, 1);
+    sketch_t **sketch = &side->latency[(status == GRPC_STATUS_OK) ? 0 : 1];
+    if (*sketch || ((*sketch = sketchCreate()) != NULL)) {
+        sketchAdd(*sketch, call->duration);
+    }
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (call->msgs[i]) add_counter(&side->size[i], call->bytes[i], call->msgs[i]);
+    }
+}
+
+static void
+report_latency(mtc_t *mtc, sketch_t *sketch, const char *method,
+               const char *side, const char *outcome)
+{
+    char name[64];
+
+    int i;
+    for (i = 0; i < sizeof(quantileMap) / sizeof(quantileMap[0]); i++) {
+        event_field_t fields[] = {
+            STRFIELD("grpc.method", method,          4, TRUE),
+            STRFIELD("grpc.status_class", outcome,   1, TRUE),
+            STRFIELD("proc",        g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",         g_proc.pid,      4, TRUE),
+            STRFIELD("host",        g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",        "millisecond",   4, TRUE),
+            FIELDEND
+        };
+        snprintf(name, sizeof(name), "grpc.%s.duration.%s", side, quantileMap[i].name);
+        event_t metric = INT_EVENT(name,
+                                   sketchQuantile(sketch, quantileMap[i].quantile),
+                                   CURRENT, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+}
+
+static void
+report_side(mtc_t *mtc, side_agg_t *agg, const char *method, const char *side)
+{
+    char name[64];
+
+    int status;
+    for (status = 0; status < GRPC_STATUSES; status++) {
+        if (!agg->calls[status]) continue;
+
+        event_field_t fields[] = {
+            STRFIELD("grpc.method", method,          4, TRUE),
+            NUMFIELD("grpc.status_code", status,     1, TRUE),
+            STRFIELD("proc",        g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",         g_proc.pid,      4, TRUE),
+            STRFIELD("host",        g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",        "call",          4, TRUE),
+            FIELDEND
+        };
+        snprintf(name, sizeof(name), "grpc.%s.calls", side);
+        event_t metric = INT_EVENT(name, agg->calls[status], DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+
+    // The duration, then the request and response message sizes
+    int i;
+    for (i = -1; i < 2; i++) {
+        agg_counter_t *counter = (i < 0) ? &agg->duration : &agg->size[i];
+        if (!counter->num_entries) continue;
+
+        event_field_t fields[] = {
+            STRFIELD("grpc.method", method,          4, TRUE),
+            NUMFIELD("numops",      counter->num_entries, 8, TRUE),
+            STRFIELD("proc",        g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",         g_proc.pid,      4, TRUE),
+            STRFIELD("host",        g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",        (i < 0) ? "millisecond" : "byte", 4, TRUE),
+            FIELDEND
+        };
+        if (i < 0) {
+            snprintf(name, sizeof(name), "grpc.%s.duration", side);
+        } else {
+            snprintf(name, sizeof(name), "grpc.%s.%s.message_size", side, msgName[i]);
+        }
+        event_t metric = INT_EVENT(name, counter->total, DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+
+    for (i = 0; i < OUTCOMES; i++) {
+        if (!sketchCount(agg->latency[i])) continue;
+        report_latency(mtc, agg->latency[i], method, side, outcomeName[i]);
+    }
+}
+
+static void
+report_method(mtc_t *mtc, method_agg_t *entry, const char *method)
+{
+    int i;
+    for (i = 0; i < SIDES; i++) {
+        report_side(mtc, &entry->side[i], method, sideName[i]);
+    }
+}
+
+void
+grpcAggSendReport(grpc_agg_t *agg, mtc_t *mtc)
+{
+    if (!agg || !mtc) return;
+
+    int i;
+    for (i = 0; i < agg->count; i++) {
+        method_agg_t *entry = agg->method[i];
+        report_method(mtc, entry, strtabStr(agg->names, entry->name));
+    }
+    if (agg->other) report_method(mtc, agg->other, OTHER_METHOD);
+}
+
+void
+grpcAggReset(grpc_agg_t *agg)
+{
+    if (!agg) return;
+
+    int i;
+    for (i = 0; i < agg->count; i++) {
+        strtabRelease(agg->names, agg->method[i]->name);
+        free_method(agg->method[i]);
+        agg->method[i] = NULL;
+    }
+    agg->count = 0;
+    memset(agg->slot, 0, sizeof(agg->slot));
+
+    free_method(agg->other);
+    agg->other = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef __GRPCAGG_H__
+#define __GRPCAGG_H__
+#include <stdint.h>
+#include "mtc.h"
+#include "strtab.h"
+
+// Aggregation of gRPC calls for the metrics channel (statsd), so that
+// busy services aren't reported a call at a time.  Used like httpagg.h:
+//   Create
+//   AddCall (for each call that has finished)
+//   SendReport (sends a summary of all calls added before it)
+//   Reset (returns to a state similar to Create)
+//
+// Calls are counted by method (the :path, /package.Service/Method), side
+// and grpc-status.  Durations are also kept in a sketch per method, side
+// and outcome (ok or error) for p50, p90, p99 and max metrics.  Messages
+// are counted in each direction, along with the sizes from the length
+// prefix in front of each one.  Methods are kept as ids in the strtab_t
+// given to Create, which must outlive the grpc_agg_t; Reset releases
+// them for the owner of the table to reclaim.  Once a period has
+// seen GRPC_MAX_METHODS methods, new ones are reported together with a
+// grpc.method of "other".
+
+#define GRPC_MAX_METHODS 256
+
+// Canonical status codes; grpc-status is one of these
+#define GRPC_STATUS_OK       0
+#define GRPC_STATUS_UNKNOWN  2
+#define GRPC_STATUSES        17
+
+typedef struct {
+    const char *method;     // the :path of the request
+    int status;             // grpc-status
+    int isServer;
+    uint64_t duration;      // milliseconds, from the request to the end
+    uint64_t msgs[2];       // messages in the request [0] and response [1]
+    uint64_t bytes[2];      //   and their total size
+} grpc_call_t;
+
+typedef struct _grpc_agg_t grpc_agg_t;
+
+grpc_agg_t *grpcAggCreate(strtab_t *);
+void grpcAggDestroy(grpc_agg_t **);
+void grpcAggAddCall(grpc_agg_t *, const grpc_call_t *);
+void grpcAggSendReport(grpc_agg_t *, mtc_t *);
+void grpcAggReset(grpc_agg_t *);
+
+#endif // __GRPCAGG_H__
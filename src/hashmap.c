@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "hashmap.h"
+
+#define CACHE_LINE 64
+#define READER_SHARD_BITS 4
+#define READER_SHARDS (1 << READER_SHARD_BITS)
+#define MIN_SLOTS 16            // a power of 2
+
+enum {
+    SLOT_EMPTY,
+    SLOT_FULL,
+    SLOT_DELETED,
+};
+
+typedef struct {
+    list_key_t key;
+    void *data;
+    int state;
+} slot_t;
+
+typedef struct {
+    uint64_t nslots;            // a power of 2
+    slot_t slot[];
+} table_t;
+
+// Readers in each epoch parity; a cache line per shard
+typedef struct {
+    uint64_t count[2];
+    char pad[CACHE_LINE - 2 * sizeof(uint64_t)];
+} reader_t;
+
+// Something removed that a reader may still be looking at
+typedef struct retired_t {
+    void *ptr;
+    int is_table;
+    struct retired_t *next;
+} retired_t;
+
+struct _hashmap_t {
+    delete_fn_t delete_fn;
+    table_t *table;             // what readers search
+    int lock;                   // held by writers
+    uint64_t count;             // full slots
+    uint64_t used;              // full and deleted slots
+    uint64_t epoch;
+    retired_t *pending;         // removed in this epoch
+    retired_t *limbo;           // removed in the epoch before
+    int limbo_parity;
+    reader_t *reader;           // READER_SHARDS of them, cache line aligned
+};
+
+static uint64_t
+hashKey(list_key_t key)
+{
+    // keys are often small sequence numbers or aligned addresses
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Each thread runs on its own stack, so the stack address picks a shard.
+// A thread local would be nicer, but Go threads don't have ours set up.
+static int
+readerShard(void)
+{
+    uintptr_t sp = (uintptr_t)&sp;
+    return ((sp >> 16) * 0x9E3779B97F4A7C15ULL) >> (64 - READER_SHARD_BITS);
+}
+
+static table_t *
+tableCreate(uint64_t nslots)
+{
+    table_t *table = calloc(1, sizeof(table_t) + nslots * sizeof(slot_t));
+    if (!table) {
+        DBG(NULL);
+        return NULL;
+    }
+    table->nslots = nslots;
+    return table;
+}
+
+// Returns the slot holding key, or NULL if there isn't one
+static slot_t *
+tableFind(table_t *table, list_key_t key)
+{
+    uint64_t mask = table->nslots - 1;
+    uint64_t i = hashKey(key) & mask;
+    uint64_t n;
+
+    for (n = 0; n < table->nslots; n++, i = (i + 1) & mask) {
+        slot_t *slot = &table->slot[i];
+        int state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EMPTY) return NULL;
+        if ((state == SLOT_FULL) && (slot->key == key)) return slot;
+    }
+    return NULL;
+}
+
+// Deleted slots are never reused; a reader that saw one full may still
+// read its key and data.  They go away when the table is rebuilt.
+static void
+tablePut(table_t *table, list_key_t key, void *data)
+{
+    uint64_t mask = table->nslots - 1;
+    uint64_t i = hashKey(key) & mask;
+
+    while (table->slot[i].state != SLOT_EMPTY) i = (i + 1) & mask;
+
+    slot_t *slot = &table->slot[i];
+    slot->key = key;
+    slot->data = data;
+    __atomic_store_n(&slot->state, SLOT_FULL, __ATOMIC_RELEASE);
+}
+
+static void
+lockMap(hashmap_t *map)
+{
+    while (!atomicCas32(&map->lock, 0, 1)) sched_yield();
+}
+
+static void
+unlockMap(hashmap_t *map)
+{
+    atomicCas32(&map->lock, 1, 0);
+}
+
+static void
+freeRetired(hashmap_t *map, retired_t *list)
+{
+    while (list) {
+        retired_t *next = list->next;
+        if (list->is_table) {
+            free(list->ptr);
+        } else {
+            map->delete_fn(list->ptr);
+        }
+        free(list);
+        list = next;
+    }
+}
+
+static void
+retire(hashmap_t *map, void *ptr, int is_table)
+{
+    if (!is_table && !map->delete_fn) return;
+
+    retired_t *r = malloc(sizeof(*r));
+    if (!r) {
+        // Leaking it is better than freeing it under a reader
+        DBG(NULL);
+        return;
+    }
+    r->ptr = ptr;
+    r->is_table = is_table;
+    r->next = map->pending;
+    map->pending = r;
+}
+
+static uint64_t
+readersIn(hashmap_t *map, int parity)
+{
+    uint64_t sum = 0;
+    int i;
+    for (i = 0; i < READER_SHARDS; i++) {
+        sum += __atomic_load_n(&map->reader[i].count[parity], __ATOMIC_SEQ_CST);
+    }
+    return sum;
+}
+
+// Called with the lock held.  What was removed in one epoch is freed
+// once the readers counted in that epoch have all left.  The epoch only
+// moves on when nothing is waiting in limbo, so readers are never more
+// than one epoch behind.
+static void
+reclaim(hashmap_t *map)
+{
+    if (map->limbo && !readersIn(map, map->limbo_parity)) {
+        freeRetired(map, map->limbo);
+        map->limbo = NULL;
+    }
+
+    if (!map->limbo && map->pending) {
+        map->limbo_parity = map->epoch & 1;
+        map->limbo = map->pending;
+        map->pending = NULL;
+        __sync_add_and_fetch(&map->epoch, 1);
+
+        // Often no one was reading at all
+        if (!readersIn(map, map->limbo_parity)) {
+            freeRetired(map, map->limbo);
+            map->limbo = NULL;
+        }
+    }
+}
+
+// Called with the lock held.  Makes room for one more element.
+static int
+reserve(hashmap_t *map)
+{
+    table_t *old = map->table;
+    if ((map->used + 1) * 2 <= old->nslots) return TRUE;
+
+    // Sized for the live elements only; dropping the deleted slots
+    // can shrink the table as well as grow it
+    uint64_t nslots = MIN_SLOTS;
+    while (nslots < (map->count + 1) * 4) nslots <<= 1;
+
+    table_t *table = tableCreate(nslots);
+    if (!table) return FALSE;
+
+    uint64_t i;
+    for (i = 0; i < old->nslots; i++) {
+        if (old->slot[i].state == SLOT_FULL) {
+            tablePut(table, old->slot[i].key, old->slot[i].data);
+        }
+    }
+
+    __atomic_store_n(&map->table, table, __ATOMIC_RELEASE);
+    map->used = map->count;
+    retire(map, old, TRUE);
+    return TRUE;
+}
+
+// Called with the lock held
+static void
+removeSlot(hashmap_t *map, slot_t *slot)
+{
+    __atomic_store_n(&slot->state, SLOT_DELETED, __ATOMIC_RELEASE);
+    map->count--;
+    retire(map, slot->data, FALSE);
+}
+
+hashmap_t *
+hmapCreate(delete_fn_t delete_fn)
+{
+    hashmap_t *map = calloc(1, sizeof(hashmap_t));
+    if (!map) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    void *reader = NULL;
+    if (posix_memalign(&reader, CACHE_LINE, READER_SHARDS * sizeof(reader_t))) {
+        DBG(NULL);
+        free(map);
+        return NULL;
+    }
+    memset(reader, 0, READER_SHARDS * sizeof(reader_t));
+    map->reader = reader;
+
+    if (!(map->table = tableCreate(MIN_SLOTS))) {
+        free(map->reader);
+        free(map);
+        return NULL;
+    }
+
+    map->delete_fn = delete_fn;
+    return map;
+}
+
+int
+hmapInsert(hashmap_t *map, list_key_t key, void *data)
+{
+    if (!map) return FALSE;
+
+    int rv = FALSE;
+    lockMap(map);
+    if (!tableFind(map->table, key) && reserve(map)) {
+        tablePut(map->table, key, data);
+        map->count++;
+        map->used++;
+        rv = TRUE;
+    }
+    reclaim(map);
+    unlockMap(map);
+    return rv;
+}
+
+int
+hmapDelete(hashmap_t *map, list_key_t key)
+{
+    if (!map) return FALSE;
+
+    int rv = FALSE;
+    lockMap(map);
+    slot_t *slot = tableFind(map->table, key);
+    if (slot) {
+        removeSlot(map, slot);
+        rv = TRUE;
+    }
+    reclaim(map);
+    unlockMap(map);
+    return rv;
+}
+
+unsigned int
+hmapDeleteIf(hashmap_t *map, int (*fn)(list_key_t, void *, void *), void *arg)
+{
+    if (!map || !fn) return 0;
+
+    unsigned int removed = 0;
+    lockMap(map);
+    table_t *table = map->table;
+    uint64_t i;
+    for (i = 0; i < table->nslots; i++) {
+        slot_t *slot = &table->slot[i];
+        if ((slot->state == SLOT_FULL) && fn(slot->key, slot->data, arg)) {
+            removeSlot(map, slot);
+            removed++;
+        }
+    }
+    reclaim(map);
+    unlockMap(map);
+    return removed;
+}
+
+void *
+hmapFind(hashmap_t *map, list_key_t key)
+{
+    if (!map) return NULL;
+
+    int token = hmapEnter(map);
+    slot_t *slot = tableFind(__atomic_load_n(&map->table, __ATOMIC_ACQUIRE), key);
+    void *data = (slot) ? slot->data : NULL;
+    hmapExit(map, token);
+    return data;
+}
+
+uint64_t
+hmapCount(hashmap_t *map)
+{
+    return (map) ? __atomic_load_n(&map->count, __ATOMIC_RELAXED) : 0;
+}
+
+int
+hmapEnter(hashmap_t *map)
+{
+    if (!map) return 0;
+
+    int shard = readerShard();
+    while (1) {
+        uint64_t epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+        int parity = epoch & 1;
+        __sync_add_and_fetch(&map->reader[shard].count[parity], 1);
+
+        // If the epoch moved on before we were counted, the writer may
+        // not have seen us; count ourselves in the new one instead
+        if (__atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST) == epoch) {
+            return (shard << 1) | parity;
+        }
+        __sync_sub_and_fetch(&map->reader[shard].count[parity], 1);
+    }
+}
+
+void
+hmapExit(hashmap_t *map, int token)
+{
+    if (!map) return;
+    __sync_sub_and_fetch(&map->reader[token >> 1].count[token & 1], 1);
+}
+
+void
+hmapDestroy(hashmap_t **map)
+{
+    if (!map || !*map) return;
+    hashmap_t *m = *map;
+
+    uint64_t i;
+    for (i = 0; i < m->table->nslots; i++) {
+        if ((m->table->slot[i].state == SLOT_FULL) && m->delete_fn) {
+            m->delete_fn(m->table->slot[i].data);
+        }
+    }
+    freeRetired(m, m->limbo);
+    freeRetired(m, m->pending);
+    free(m->table);
+    free(m->reader);
+    free(m);
+    *map = NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef __HASHMAP_H__
+#define __HASHMAP_H__
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include "linklist.h"
+
+typedef struct _hashmap_t hashmap_t;
+
+//
+// A concurrent hash map of (key, data) elements, for when a list_t is
+// searched often enough that its O(n) finds show.
+//
+// Elements are kept in an open addressing table with linear probing.
+// Finds take no lock and are safe from any number of threads; inserts
+// and deletes take a spin lock, so they are safe too but one at a time.
+//
+// Deleted data, and tables left behind when the table grows, are not
+// freed right away; a find in another thread may still be looking at
+// them.  They are freed (with delete_fn for data) once every find that
+// started before they were removed has finished.  Each reader counts
+// itself in and out of the current epoch; there is nothing to register
+// and no thread local storage is used, so finds work from Go threads.
+//
+// Data returned by hmapFind can be deleted by another thread as soon as
+// hmapFind returns.  Callers that need it to stay put while they use it
+// should bracket the find and the use with hmapEnter() and hmapExit().
+//
+// Returns NULL if the object can not be created.
+hashmap_t *hmapCreate(delete_fn_t delete_fn);
+
+// Stores the (key, data) pair, provided key isn't already in the map.
+// Returns true if (key, data) were successfully inserted.
+int hmapInsert(hashmap_t *map, list_key_t key, void *data);
+
+// Removes the element identified by key.  delete_fn, if any, is called
+// with its data once no find can still be using it.
+// Returns true if a matching (key, data) pair was found and removed.
+int hmapDelete(hashmap_t *map, list_key_t key);
+
+// Removes every element for which fn returns true, as hmapDelete would.
+// fn is called with the map locked; it must not call into the map.
+// Returns the number of elements removed.
+unsigned int hmapDeleteIf(hashmap_t *map, int (*fn)(list_key_t, void *, void *), void *arg);
+
+// Returns data if (key, data) are found in the map.
+void *hmapFind(hashmap_t *map, list_key_t key);
+
+// Returns the number of elements in the map.
+uint64_t hmapCount(hashmap_t *map);
+
+// Keeps data found between these two calls from being freed.  Pass
+// the value from hmapEnter to hmapExit.  They can be nested.
+int hmapEnter(hashmap_t *map);
+void hmapExit(hashmap_t *map, int);
+
+// Destroys a map and all its contents, calling delete_fn on the data
+// of every element.  No other thread can be using the map.
+void hmapDestroy(hashmap_t **map);
+
+#endif // __HASHMAP_H__
@@ -0,0 +1,227 @@
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "atomic.h"
+#include "dbg.h"
+#include "hostcache.h"
+#include "scopetypes.h"
+
+#define NONE UINT32_MAX
+
+typedef struct {
+    int family;
+    unsigned char addr[16];
+    uint32_t hnext;           // next in the same hash bucket
+    uint32_t prev;            // towards the most recently used
+    uint32_t next;            // towards the least recently used
+    char name[HOSTCACHE_MAX_NAME];
+} host_entry_t;
+
+struct _hostcache_t {
+    int lock;
+    unsigned int size;
+    unsigned int count;
+    uint32_t mask;
+    uint32_t *bucket;
+    uint32_t head;            // most recently used
+    uint32_t tail;            // least recently used; evicted first
+    host_entry_t *entry;
+};
+
+static const unsigned char v4mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+
+hostcache_t *
+hostCacheCreate(unsigned int entries)
+{
+    if (!entries) return NULL;
+
+    hostcache_t *hc = calloc(1, sizeof(*hc));
+    if (!hc) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    unsigned int buckets = 1;
+    while (buckets < entries) buckets <<= 1;
+
+    hc->entry = calloc(entries, sizeof(host_entry_t));
+    hc->bucket = malloc(buckets * sizeof(uint32_t));
+    if (!hc->entry || !hc->bucket) {
+        DBG(NULL);
+        hostCacheDestroy(&hc);
+        return NULL;
+    }
+    memset(hc->bucket, 0xff, buckets * sizeof(uint32_t));
+
+    hc->size = entries;
+    hc->mask = buckets - 1;
+    hc->head = hc->tail = NONE;
+    return hc;
+}
+
+void
+hostCacheDestroy(hostcache_t **hc_ptr)
+{
+    if (!hc_ptr || !*hc_ptr) return;
+
+    hostcache_t *hc = *hc_ptr;
+    if (hc->entry) free(hc->entry);
+    if (hc->bucket) free(hc->bucket);
+    free(hc);
+    *hc_ptr = NULL;
+}
+
+static void
+cacheLock(hostcache_t *hc)
+{
+    while (!atomicCas32(&hc->lock, 0, 1)) ;
+}
+
+static void
+cacheUnlock(hostcache_t *hc)
+{
+    atomicCas32(&hc->lock, 1, 0);
+}
+
+// IPv4-mapped IPv6 addresses are kept as IPv4.  Returns the length
+// of the address, or 0 if it's not one we keep.
+static size_t
+addrKey(int *family, const void **addr)
+{
+    switch (*family) {
+        case AF_INET:
+            return 4;
+        case AF_INET6:
+            if (!memcmp(*addr, v4mapped, sizeof(v4mapped))) {
+                *family = AF_INET;
+                *addr = (const unsigned char *)*addr + sizeof(v4mapped);
+                return 4;
+            }
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+static uint32_t
+addrHash(int family, const unsigned char *addr, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U ^ (uint32_t)family;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ addr[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static uint32_t
+lookup(hostcache_t *hc, uint32_t b, int family, const void *addr, size_t len)
+{
+    uint32_t i;
+    for (i = hc->bucket[b]; i != NONE; i = hc->entry[i].hnext) {
+        host_entry_t *e = &hc->entry[i];
+        if ((e->family == family) && !memcmp(e->addr, addr, len)) return i;
+    }
+    return NONE;
+}
+
+static void
+unlinkUse(hostcache_t *hc, uint32_t i)
+{
+    host_entry_t *e = &hc->entry[i];
+    if (e->prev != NONE) hc->entry[e->prev].next = e->next; else hc->head = e->next;
+    if (e->next != NONE) hc->entry[e->next].prev = e->prev; else hc->tail = e->prev;
+}
+
+static void
+linkFirst(hostcache_t *hc, uint32_t i)
+{
+    host_entry_t *e = &hc->entry[i];
+    e->prev = NONE;
+    e->next = hc->head;
+    if (hc->head != NONE) hc->entry[hc->head].prev = i;
+    hc->head = i;
+    if (hc->tail == NONE) hc->tail = i;
+}
+
+static void
+unlinkBucket(hostcache_t *hc, uint32_t i)
+{
+    host_entry_t *e = &hc->entry[i];
+    uint32_t b = addrHash(e->family, e->addr, (e->family == AF_INET) ? 4 : 16) & hc->mask;
+    uint32_t *link;
+    for (link = &hc->bucket[b]; *link != NONE; link = &hc->entry[*link].hnext) {
+        if (*link == i) {
+            *link = e->hnext;
+            return;
+        }
+    }
+    DBG(NULL);
+}
+
+void
+hostCacheAdd(hostcache_t *hc, int family, const void *addr, const char *name)
+{
+    if (!hc || !addr || !name || !name[0]) return;
+
+    size_t len = addrKey(&family, &addr);
+    if (!len) return;
+    uint32_t b = addrHash(family, addr, len) & hc->mask;
+
+    cacheLock(hc);
+    uint32_t i = lookup(hc, b, family, addr, len);
+    if (i != NONE) {
+        unlinkUse(hc, i);
+    } else {
+        if (hc->count < hc->size) {
+            i = hc->count++;
+        } else {
+            i = hc->tail;
+            unlinkUse(hc, i);
+            unlinkBucket(hc, i);
+        }
+        host_entry_t *e = &hc->entry[i];
+        e->family = family;
+        memset(e->addr, 0, sizeof(e->addr));
+        memcpy(e->addr, addr, len);
+        e->hnext = hc->bucket[b];
+        hc->bucket[b] = i;
+    }
+    strncpy(hc->entry[i].name, name, HOSTCACHE_MAX_NAME - 1);
+    hc->entry[i].name[HOSTCACHE_MAX_NAME - 1] = '\0';
+    linkFirst(hc, i);
+    cacheUnlock(hc);
+}
+
+int
+hostCacheFind(hostcache_t *hc, int family, const void *addr, char *name, size_t len)
+{
+    if (!hc || !addr || !name || !len) return FALSE;
+
+    size_t alen = addrKey(&family, &addr);
+    if (!alen) return FALSE;
+    uint32_t b = addrHash(family, addr, alen) & hc->mask;
+
+    cacheLock(hc);
+    uint32_t i = lookup(hc, b, family, addr, alen);
+    if (i != NONE) {
+        unlinkUse(hc, i);
+        linkFirst(hc, i);
+        strncpy(name, hc->entry[i].name, len - 1);
+        name[len - 1] = '\0';
+    }
+    cacheUnlock(hc);
+
+    return (i != NONE);
+}
+
+unsigned int
+hostCacheCount(hostcache_t *hc)
+{
+    return (hc) ? hc->count : 0;
+}
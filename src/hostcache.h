@@ -0,0 +1,31 @@
+#ifndef __HOSTCACHE_H__
+#define __HOSTCACHE_H__
+
+#include <stddef.h>
+
+//
+// This remembers the name each address was looked up by, so that
+// connections to the address can be reported with the name and nothing
+// downstream has to do a reverse lookup for it.  It's filled from what
+// the process resolves: getaddrinfo() results and DNS answers.
+//
+// It holds at most the number of entries it's created with; once full,
+// the least recently used entry makes way for the new one.  An address
+// added again takes the newer name.  Addresses are AF_INET (4 bytes) or
+// AF_INET6 (16 bytes); an IPv4-mapped AF_INET6 address is the same as
+// the AF_INET one.  Any thread may add or find at any time.
+//
+
+#define HOSTCACHE_MAX_NAME 256
+
+typedef struct _hostcache_t hostcache_t;
+
+hostcache_t *   hostCacheCreate(unsigned int entries);
+void            hostCacheDestroy(hostcache_t **);
+
+void            hostCacheAdd(hostcache_t *, int family, const void *addr, const char *name);
+// Returns TRUE, with the name in name, if addr is there
+int             hostCacheFind(hostcache_t *, int family, const void *addr, char *name, size_t len);
+unsigned int    hostCacheCount(hostcache_t *);
+
+#endif // __HOSTCACHE_H__
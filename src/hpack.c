@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "hpack.h"
+#include "scopetypes.h"
+
+#define HPACK_STATIC_ENTRIES 61
+#define HPACK_DEFAULT_SIZE 4096     // SETTINGS_HEADER_TABLE_SIZE until changed
+#define HPACK_ENTRY_OVERHEAD 32
+#define HPACK_MIN_SLOTS 16
+#define HUFF_MAX_BITS 30
+#define HUFF_EOS 256
+
+struct _hpack_t {
+    size_t maxsize;         // the most a size update can ask for
+    size_t capacity;        // the size the encoder set
+    size_t size;            // of the entries in the table
+    hpack_field_t *ent;     // ring; newest entry just before head
+    unsigned int slots;     // a power of 2
+    unsigned int head;
+    unsigned int count;
+    char *scratch[2];       // huffman decoded name and value
+    size_t scratchlen[2];
+};
+
+// RFC 7541 Appendix A
+static const hpack_field_t staticTable[HPACK_STATIC_ENTRIES] = {
+    {":authority", 10, "", 0},
+    {":method", 7, "GET", 3},
+    {":method", 7, "POST", 4},
+    {":path", 5, "/", 1},
+    {":path", 5, "/index.html", 11},
+    {":scheme", 7, "http", 4},
+    {":scheme", 7, "https", 5},
+    {":status", 7, "200", 3},
+    {":status", 7, "204", 3},
+    {":status", 7, "206", 3},
+    {":status", 7, "304", 3},
+    {":status", 7, "400", 3},
+    {":status", 7, "404", 3},
+    {":status", 7, "500", 3},
+    {"accept-charset", 14, "", 0},
+    {"accept-encoding", 15, "gzip, deflate", 13},
+    {"accept-language", 15, "", 0},
+    {"accept-ranges", 13, "", 0},
+    {"accept", 6, "", 0},
+    {"access-control-allow-origin", 27, "", 0},
+    {"age", 3, "", 0},
+    {"allow", 5, "", 0},
+    {"authorization", 13, "", 0},
+    {"cache-control", 13, "", 0},
+    {"content-disposition", 19, "", 0},
+    {"content-encoding", 16, "", 0},
+    {"content-language", 16, "", 0},
+    {"content-length", 14, "", 0},
+    {"content-location", 16, "", 0},
+    {"content-range", 13, "", 0},
+    {"content-type", 12, "", 0},
+    {"cookie", 6, "", 0},
+    {"date", 4, "", 0},
+    {"etag", 4, "", 0},
+    {"expect", 6, "", 0},
+    {"expires", 7, "", 0},
+    {"from", 4, "", 0},
+    {"host", 4, "", 0},
+    {"if-match", 8, "", 0},
+    {"if-modified-since", 17, "", 0},
+    {"if-none-match", 13, "", 0},
+    {"if-range", 8, "", 0},
+    {"if-unmodified-since", 19, "", 0},
+    {"last-modified", 13, "", 0},
+    {"link", 4, "", 0},
+    {"location", 8, "", 0},
+    {"max-forwards", 12, "", 0},
+    {"proxy-authenticate", 18, "", 0},
+    {"proxy-authorization", 19, "", 0},
+    {"range", 5, "", 0},
+    {"referer", 7, "", 0},
+    {"refresh", 7, "", 0},
+    {"retry-after", 11, "", 0},
+    {"server", 6, "", 0},
+    {"set-cookie", 10, "", 0},
+    {"strict-transport-security", 25, "", 0},
+    {"transfer-encoding", 17, "", 0},
+    {"user-agent", 10, "", 0},
+    {"vary", 4, "", 0},
+    {"via", 3, "", 0},
+    {"www-authenticate", 16, "", 0},
+};
+
+// RFC 7541 Appendix B.  The code is canonical, so it can be decoded from
+// how many codes there are of each length, and the symbols in code order.
+static const uint16_t huffCount[HUFF_MAX_BITS + 1] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+static const uint16_t huffSym[HUFF_EOS + 1] = {
+     48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,
+     45,  46,  47,  51,  52,  53,  54,  55,  56,  57,  61,  65,
+     95,  98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+     58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+     77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89,
+    106, 107, 113, 118, 119, 120, 121, 122,  38,  42,  44,  59,
+     88,  90,  33,  34,  40,  41,  63,  39,  43, 124,  35,  62,
+      0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239,   9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254,   2,   3,   4,   5,
+      6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+     21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220,
+    249,  10,  13,  22, 256,
+};
+
+static int
+decodeInt(const uint8_t **pos, const uint8_t *end, int prefix, uint64_t *val)
+{
+    if (*pos >= end) return -1;
+
+    uint64_t max = (1U << prefix) - 1;
+    uint64_t v = *(*pos)++ & max;
+    if (v < max) {
+        *val = v;
+        return 0;
+    }
+
+    int shift = 0;
+    while (*pos < end) {
+        uint8_t b = *(*pos)++;
+        v += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *val = v;
+            return 0;
+        }
+        // Nothing we decode needs more than 32 bits
+        if ((shift += 7) > 28) return -1;
+    }
+    return -1;
+}
+
+static int
+huffDecode(const uint8_t *in, size_t len, char *out, size_t max)
+{
+    size_t num = 0;
+    int code = 0, first = 0, index = 0, bits = 0, ones = TRUE;
+
+    size_t i;
+    int b;
+    for (i = 0; i < len; i++) {
+        for (b = 7; b >= 0; b--) {
+            int bit = (in[i] >> b) & 1;
+            code |= bit;
+            ones &= bit;
+            bits++;
+
+            int count = huffCount[bits];
+            if (code - first < count) {
+                int sym = huffSym[index + code - first];
+                if ((sym == HUFF_EOS) || (num >= max)) return -1;
+                out[num++] = sym;
+                code = first = index = bits = 0;
+                ones = TRUE;
+                continue;
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+            if (bits >= HUFF_MAX_BITS) return -1;
+        }
+    }
+
+    // Whatever is left is padding; a prefix of EOS, so under 8 ones
+    if ((bits > 7) || !ones) return -1;
+    return num;
+}
+
+static int
+decodeStr(hpack_t *hp, int which, const uint8_t **pos, const uint8_t *end,
+          const char **str, size_t *len)
+{
+    if (*pos >= end) return -1;
+
+    int huff = **pos & 0x80;
+    uint64_t num;
+    if (decodeInt(pos, end, 7, &num) || (num > (uint64_t)(end - *pos))) return -1;
+
+    if (!huff) {
+        *str = (const char *)*pos;
+        *len = num;
+        *pos += num;
+        return 0;
+    }
+
+    // The shortest code is 5 bits
+    size_t need = (num * 8) / 5 + 1;
+    if (need > hp->scratchlen[which]) {
+        char *temp = realloc(hp->scratch[which], need);
+        if (!temp) {
+            DBG(NULL);
+            return -1;
+        }
+        hp->scratch[which] = temp;
+        hp->scratchlen[which] = need;
+    }
+
+    int rv = huffDecode(*pos, num, hp->scratch[which], need);
+    if (rv < 0) return -1;
+
+    *str = hp->scratch[which];
+    *len = rv;
+    *pos += num;
+    return 0;
+}
+
+static void
+evictOldest(hpack_t *hp)
+{
+    hpack_field_t *old = &hp->ent[(hp->head - hp->count) & (hp->slots - 1)];
+    hp->size -= old->namelen + old->valuelen + HPACK_ENTRY_OVERHEAD;
+    // name and value share one allocation
+    free((char *)old->name);
+    old->name = NULL;
+    hp->count--;
+}
+
+static void
+evictTo(hpack_t *hp, size_t size)
+{
+    while (hp->count && (hp->size > size)) {
+        evictOldest(hp);
+    }
+}
+
+static int
+insertField(hpack_t *hp, const hpack_field_t *field)
+{
+    size_t size = field->namelen + field->valuelen + HPACK_ENTRY_OVERHEAD;
+
+    // Too big for the table empties it, and isn't an error
+    if (size > hp->capacity) {
+        evictTo(hp, 0);
+        return 0;
+    }
+
+    // The name can point into an entry we're about to evict; copy first
+    char *copy = malloc(field->namelen + field->valuelen + 2);
+    if (!copy) {
+        DBG(NULL);
+        return -1;
+    }
+    memcpy(copy, field->name, field->namelen);
+    copy[field->namelen] = '\0';
+    memcpy(&copy[field->namelen + 1], field->value, field->valuelen);
+    copy[field->namelen + 1 + field->valuelen] = '\0';
+
+    evictTo(hp, hp->capacity - size);
+
+    if (hp->count == hp->slots) {
+        unsigned int slots = (hp->slots) ? hp->slots * 2 : HPACK_MIN_SLOTS;
+        hpack_field_t *ent = calloc(slots, sizeof(hpack_field_t));
+        if (!ent) {
+            DBG(NULL);
+            free(copy);
+            return -1;
+        }
+        // Oldest first, so head is count
+        unsigned int i;
+        for (i = 0; i < hp->count; i++) {
+            ent[i] = hp->ent[(hp->head - hp->count + i) & (hp->slots - 1)];
+        }
+        free(hp->ent);
+        hp->ent = ent;
+        hp->slots = slots;
+        hp->head = hp->count;
+    }
+
+    hpack_field_t *new = &hp->ent[hp->head & (hp->slots - 1)];
+    new->name = copy;
+    new->namelen = field->namelen;
+    new->value = &copy[field->namelen + 1];
+    new->valuelen = field->valuelen;
+    hp->head++;
+    hp->count++;
+    hp->size += size;
+    return 0;
+}
+
+static const hpack_field_t *
+lookup(hpack_t *hp, uint64_t index)
+{
+    if (index == 0) return NULL;
+    if (index <= HPACK_STATIC_ENTRIES) return &staticTable[index - 1];
+
+    // Dynamic entries count up from the newest
+    index -= HPACK_STATIC_ENTRIES;
+    if (index > hp->count) return NULL;
+    return &hp->ent[(hp->head - index) & (hp->slots - 1)];
+}
+
+hpack_t *
+hpackCreate(size_t maxsize)
+{
+    hpack_t *hp = calloc(1, sizeof(hpack_t));
+    if (!hp) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    hp->maxsize = maxsize;
+    hp->capacity = (maxsize < HPACK_DEFAULT_SIZE) ? maxsize : HPACK_DEFAULT_SIZE;
+    return hp;
+}
+
+void
+hpackDestroy(hpack_t **hp_ptr)
+{
+    if (!hp_ptr || !*hp_ptr) return;
+    hpack_t *hp = *hp_ptr;
+
+    evictTo(hp, 0);
+    free(hp->ent);
+    free(hp->scratch[0]);
+    free(hp->scratch[1]);
+    free(hp);
+    *hp_ptr = NULL;
+}
+
+int
+hpackDecode(hpack_t *hp, const uint8_t *block, size_t len, hpack_field_fn fn, void *arg)
+{
+    if (!hp || (!block && len)) return -1;
+
+    const uint8_t *pos = block;
+    const uint8_t *end = block + len;
+
+    while (pos < end) {
+        uint8_t b = *pos;
+        uint64_t index;
+        hpack_field_t field;
+
+        if (b & 0x80) {
+            // Indexed Header Field
+            const hpack_field_t *ent;
+            if (decodeInt(&pos, end, 7, &index) ||
+                ((ent = lookup(hp, index)) == NULL)) return -1;
+            if (fn) fn(arg, ent);
+            continue;
+        }
+
+        if ((b & 0xe0) == 0x20) {
+            // Dynamic Table Size Update
+            if (decodeInt(&pos, end, 5, &index) || (index > hp->maxsize)) return -1;
+            hp->capacity = index;
+            evictTo(hp, hp->capacity);
+            continue;
+        }
+
+        // The literals; with incremental indexing, without, or never
+        int indexing = ((b & 0xc0) == 0x40);
+        if (decodeInt(&pos, end, (indexing) ? 6 : 4, &index)) return -1;
+
+        if (index) {
+            const hpack_field_t *ent = lookup(hp, index);
+            if (!ent) return -1;
+            field.name = ent->name;
+            field.namelen = ent->namelen;
+        } else if (decodeStr(hp, 0, &pos, end, &field.name, &field.namelen)) {
+            return -1;
+        }
+        if (decodeStr(hp, 1, &pos, end, &field.value, &field.valuelen)) return -1;
+
+        if (fn) fn(arg, &field);
+        if (indexing && insertField(hp, &field)) return -1;
+    }
+
+    return 0;
+}
+
+size_t
+hpackTableSize(hpack_t *hp)
+{
+    return (hp) ? hp->size : 0;
+}
+
+unsigned int
+hpackTableCount(hpack_t *hp)
+{
+    return (hp) ? hp->count : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// HPACK (RFC 7541) header block decoder, for HTTP/2.
+//
+// One hpack_t follows one direction of one connection; the dynamic table
+// it keeps has to see every header block sent that way, in order, or the
+// blocks after a missed one can't be decoded.  After hpackDecode() fails
+// the table can't be trusted, and the hpack_t should be thrown away.
+//
+// Names and values handed to the callback aren't NUL terminated, and are
+// only good until the callback returns.
+//
+
+typedef struct {
+    const char *name;
+    size_t namelen;
+    const char *value;
+    size_t valuelen;
+} hpack_field_t;
+
+typedef struct _hpack_t hpack_t;
+typedef void (*hpack_field_fn)(void *arg, const hpack_field_t *);
+
+// Constructors Destructors
+hpack_t *       hpackCreate(size_t maxsize);    // most the table may grow to
+void            hpackDestroy(hpack_t **);
+
+// Returns 0, or -1 if the block is malformed or out of step with the table
+int             hpackDecode(hpack_t *, const uint8_t *, size_t, hpack_field_fn, void *);
+
+// Accessors
+size_t          hpackTableSize(hpack_t *);      // bytes, as RFC 7541 counts them
+unsigned int    hpackTableCount(hpack_t *);
+
+#endif // __HPACK_H__
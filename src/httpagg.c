@@ -1,13 +1,23 @@
 #include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include "com.h"
 #include "dbg.h"
 #include "httpagg.h"
+#include "sketch.h"
 
 
 #define DEFAULT_TARGET_LEN ( 128 )
 #define MAX_CODE_ENTRIES ( 64 )
+#define MAX_TARGET_LEN ( 1024 )
+#define OTHER_TARGET "other"
+#define ID_SEGMENT "{id}"
+#define UUID_LEN ( 36 )
+#define MIN_HEX_ID_LEN ( 8 )
+#define STATUS_CLASSES ( 5 )  // 1xx to 5xx
+#define DURATION_FIELDS ( CLIENT_TRANSFER + 1 )
+#define MAX_SKETCHES ( 256 )  // a period's, over all targets
 
 typedef struct {
     const char* str;
@@ -35,19 +45,30 @@ valToStr(enum_map_t map[], unsigned val)
 }
 
 
+// Each server field is followed by its client one
 typedef enum {
     SERVER_DURATION,
     CLIENT_DURATION,
+    SERVER_TTFB,
+    CLIENT_TTFB,
+    SERVER_TRANSFER,
+    CLIENT_TRANSFER,
     REQUEST_BYTES,
     RESPONSE_BYTES,
+    REUSED_REQUESTS,
     FIELD_MAX
 } counter_field_enum;
 
 enum_map_t fieldMap[] = {
     {"http.server.duration",          SERVER_DURATION},
     {"http.client.duration",          CLIENT_DURATION},
+    {"http.server.ttfb",              SERVER_TTFB},
+    {"http.client.ttfb",              CLIENT_TTFB},
+    {"http.server.transfer",          SERVER_TRANSFER},
+    {"http.client.transfer",          CLIENT_TRANSFER},
     {"http.request.content_length",   REQUEST_BYTES},
     {"http.response.content_length",  RESPONSE_BYTES},
+    {"http.requests.reused",          REUSED_REQUESTS},
     {NULL,                    -1}
 };
 
@@ -61,38 +82,82 @@ typedef struct {
     uint64_t num_entries; // number of entries, to support average calculation
 } agg_counter_t;
 
+// What the duration sketches report
+static const struct {
+    const char *name;
+    double quantile;
+} quantileMap[] = {
+    {"p50",   0.50},
+    {"p90",   0.90},
+    {"p99",   0.99},
+    {"max",   1.00},
+};
+
+static const char *statusClass[STATUS_CLASSES] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
 typedef struct {
-    char * uri;           // the key that comes from http.target
+    strtab_id_t uri;      // the key that comes from http.target
+    uint64_t hash;        // of the uri
     status_code_t status[MAX_CODE_ENTRIES];
     agg_counter_t field[FIELD_MAX];
+    // durations by status class; created when first needed
+    sketch_t *latency[DURATION_FIELDS][STATUS_CLASSES];
 } target_agg_t;
 
 struct _http_agg_t {
-    target_agg_t** target;
+    strtab_t *names;
+    target_agg_t** target; // in the order they were first seen
     uint64_t count;
     uint64_t alloc;
+    uint32_t *slot;        // open addressing; index into target + 1, 0 if empty
+    uint64_t nslots;       // a power of 2, kept at most half full
+    target_agg_t *other;   // for everything past max_targets
+    unsigned max_targets;
+    unsigned normalize;
+    unsigned sketches;     // created this period
 };
 
 
 http_agg_t *
-httpAggCreate()
+httpAggCreate(strtab_t *names)
 {
     http_agg_t* agg = calloc(1, sizeof(*agg));
     target_agg_t** target_lst = calloc(1, sizeof(*target_lst) * DEFAULT_TARGET_LEN);
-    if (!agg || !target_lst) {
+    uint32_t *slot = calloc(1, sizeof(*slot) * DEFAULT_TARGET_LEN * 2);
+    if (!agg || !target_lst || !slot) {
         if (agg) free(agg);
         if (target_lst) free(target_lst);
-        DBG("agg = %p, target_lst = %p", agg, target_lst);
+        if (slot) free(slot);
+        DBG("agg = %p, target_lst = %p, slot = %p", agg, target_lst, slot);
         return NULL;
     }
 
+    agg->names = names;
     agg->target = target_lst;
     agg->count = 0;
     agg->alloc = DEFAULT_TARGET_LEN;
+    agg->slot = slot;
+    agg->nslots = DEFAULT_TARGET_LEN * 2;
+    agg->max_targets = DEFAULT_HTTP_MAX_TARGETS;
+    agg->normalize = DEFAULT_HTTP_NORMALIZE;
 
     return agg;
 }
 
+void
+httpAggMaxTargetsSet(http_agg_t *http_agg, unsigned max_targets)
+{
+    if (!http_agg || !max_targets) return;
+    http_agg->max_targets = max_targets;
+}
+
+void
+httpAggNormalizeSet(http_agg_t *http_agg, unsigned normalize)
+{
+    if (!http_agg) return;
+    http_agg->normalize = normalize;
+}
+
 void
 httpAggDestroy(http_agg_t **http_agg_ptr)
 {
@@ -103,6 +168,7 @@ httpAggDestroy(http_agg_t **http_agg_ptr)
     httpAggReset(http_agg);
 
     free(http_agg->target);
+    free(http_agg->slot);
     free(http_agg);
 
     *http_agg_ptr = NULL;
@@ -140,6 +206,139 @@ num_value(event_t *evt, const char *name)
     return LLONG_MIN;
 }
 
+static int
+isHex(char c)
+{
+    return ((c >= '0') && (c <= '9')) ||
+           ((c >= 'a') && (c <= 'f')) ||
+           ((c >= 'A') && (c <= 'F'));
+}
+
+// True for path segments that look like ids: 8812,
+// 123e4567-e89b-12d3-a456-426614174000 or 5f518a6c
+static int
+isIdSegment(const char *seg, size_t len)
+{
+    if (!len) return FALSE;
+
+    size_t i, digits = 0, hex = 0;
+    for (i = 0; i < len; i++) {
+        if ((seg[i] >= '0') && (seg[i] <= '9')) digits++;
+        if (isHex(seg[i])) hex++;
+    }
+    if (digits == len) return TRUE;
+
+    if (len == UUID_LEN) {
+        for (i = 0; i < len; i++) {
+            int dash = (i == 8) || (i == 13) || (i == 18) || (i == 23);
+            if (dash ? (seg[i] != '-') : !isHex(seg[i])) break;
+        }
+        if (i == len) return TRUE;
+    }
+
+    // Needing a digit keeps words like "deadbeef" and "facade"
+    return (len >= MIN_HEX_ID_LEN) && (hex == len) && digits;
+}
+
+static void
+append(char *out, size_t *olen, size_t outlen, const char *src, size_t len)
+{
+    if (len > outlen - *olen) len = outlen - *olen;
+    memcpy(&out[*olen], src, len);
+    *olen += len;
+}
+
+// Puts target in out with any id segments replaced by {id}.  Returns
+// the length of out, which is cut short at outlen.
+static size_t
+normalizeTarget(const char *target, size_t len, char *out, size_t outlen)
+{
+    size_t olen = 0;
+    const char *seg = target;
+    const char *end = target + len;
+
+    while (seg < end) {
+        const char *slash = memchr(seg, '/', end - seg);
+        const char *seg_end = (slash) ? slash : end;
+
+        if (isIdSegment(seg, seg_end - seg)) {
+            append(out, &olen, outlen, ID_SEGMENT, strlen(ID_SEGMENT));
+        } else {
+            append(out, &olen, outlen, seg, seg_end - seg);
+        }
+        if (slash) append(out, &olen, outlen, "/", 1);
+
+        seg = seg_end + 1;
+    }
+
+    return olen;
+}
+
+static uint64_t
+hashTarget(const char *str, size_t len)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Where uri is in the slots, or the empty slot it would go in
+static uint64_t
+find_slot(http_agg_t *http_agg, uint64_t hash, const char *uri, size_t uri_len)
+{
+    uint64_t mask = http_agg->nslots - 1;
+    uint64_t i = hash & mask;
+
+    while (http_agg->slot[i]) {
+        target_agg_t *entry = http_agg->target[http_agg->slot[i] - 1];
+        if (entry->hash == hash) {
+            const char *str = strtabStr(http_agg->names, entry->uri);
+            if (!strncmp(str, uri, uri_len) && (str[uri_len] == '\0')) break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int
+grow_slots(http_agg_t *http_agg)
+{
+    uint64_t nslots = http_agg->nslots * 2;
+    uint32_t *slot = calloc(1, sizeof(*slot) * nslots);
+    if (!slot) {
+        DBG(NULL);
+        return -1;
+    }
+
+    uint64_t i;
+    for (i = 0; i < http_agg->count; i++) {
+        uint64_t j = http_agg->target[i]->hash & (nslots - 1);
+        while (slot[j]) j = (j + 1) & (nslots - 1);
+        slot[j] = i + 1;
+    }
+
+    free(http_agg->slot);
+    http_agg->slot = slot;
+    http_agg->nslots = nslots;
+    return 0;
+}
+
+static target_agg_t *
+get_other_entry(http_agg_t *http_agg)
+{
+    if (!http_agg->other) {
+        if ((http_agg->other = calloc(1, sizeof(*http_agg->other))) == NULL) {
+            DBG(NULL);
+        }
+    }
+    return http_agg->other;
+}
+
 static target_agg_t *
 get_target_entry(http_agg_t *http_agg, const char* target_val)
 {
@@ -149,23 +348,26 @@ get_target_entry(http_agg_t *http_agg, const char* target_val)
     // https://example.com/over/there?name=ferret
     // if a target_val has a query string ignore that part of the uri.
     // This is done as just one small way to manage the cardiality.
-    char *temp_uri = strdup(target_val);
-    if (!temp_uri) {
-        DBG(NULL);
-        return NULL;
+    // Ids in the path are another; /users/8812/orders is /users/{id}/orders.
+    size_t uri_len = strcspn(target_val, "?");
+    const char *uri = target_val;
+    char normal[MAX_TARGET_LEN];
+    if (http_agg->normalize) {
+        uri_len = normalizeTarget(target_val, uri_len, normal, sizeof(normal));
+        uri = normal;
     }
-    char *query_ptr = strchr(temp_uri, '?');
-    if (query_ptr) *query_ptr = '\0';
 
-
-    // look to see if target already exists in list
+    // look to see if target already exists
     // if so, return a pointer to it.
-    int i;
-    for (i=0; i<http_agg->count; i++) {
-        if (!strcmp(http_agg->target[i]->uri, temp_uri)) {
-            free(temp_uri);
-            return http_agg->target[i];
-        }
+    uint64_t hash = hashTarget(uri, uri_len);
+    uint64_t i = find_slot(http_agg, hash, uri, uri_len);
+    if (http_agg->slot[i]) {
+        return http_agg->target[http_agg->slot[i] - 1];
+    }
+
+    // Past the limit, new targets all count as one
+    if (http_agg->count >= http_agg->max_targets) {
+        return get_other_entry(http_agg);
     }
 
     // if not, and we're out of room, realloc
@@ -173,7 +375,6 @@ get_target_entry(http_agg_t *http_agg, const char* target_val)
         uint64_t new_size = http_agg->alloc << 2; // same as multiplying by 4
         target_agg_t **temp_target = realloc(http_agg->target, sizeof(*temp_target) * new_size);
         if (!temp_target) {
-            free(temp_uri);
             DBG(NULL);
             return NULL;
         }
@@ -182,22 +383,65 @@ get_target_entry(http_agg_t *http_agg, const char* target_val)
         http_agg->target = temp_target;
         http_agg->alloc = new_size;
     }
+    if ((http_agg->count + 1) * 2 > http_agg->nslots) {
+        if (grow_slots(http_agg)) return NULL;
+        i = find_slot(http_agg, hash, uri, uri_len);
+    }
+
+    // A full strtab is a limit too
+    strtab_id_t id = strtabInternLen(http_agg->names, uri, uri_len);
+    if (id == STRTAB_NONE) {
+        return get_other_entry(http_agg);
+    }
 
     // Now create the new target entry
     target_agg_t *temp_target = calloc(1, sizeof(*temp_target));
     if (!temp_target) {
-        free(temp_uri);
         DBG(NULL);
+        strtabRelease(http_agg->names, id);
         return NULL;
     }
 
     // Add the new target entry
-    temp_target->uri = temp_uri;
+    temp_target->uri = id;
+    temp_target->hash = hash;
     http_agg->target[http_agg->count++] = temp_target;
+    http_agg->slot[i] = http_agg->count;
 
     return temp_target;
 }
 
+static void
+free_target(target_agg_t *target)
+{
+    if (!target) return;
+
+    int i, j;
+    for (i = 0; i < DURATION_FIELDS; i++) {
+        for (j = 0; j < STATUS_CLASSES; j++) {
+            sketchDestroy(&target->latency[i][j]);
+        }
+    }
+    free(target);
+}
+
+static void
+add_latency(http_agg_t *http_agg, target_agg_t *entry, counter_field_enum field,
+            long long status, long long value)
+{
+    int class = status / 100 - 1;
+    if ((class < 0) || (class >= STATUS_CLASSES) || (value < 0)) return;
+
+    // Past the limit, durations are only in the totals
+    sketch_t **sketch = &entry->latency[field][class];
+    if (!*sketch) {
+        if (http_agg->sketches >= MAX_SKETCHES) return;
+        if ((*sketch = sketchCreate()) == NULL) return;
+        http_agg->sketches++;
+    }
+    sketchAdd(*sketch, value);
+}
+
 static void
 add_counter(agg_counter_t *counter, long long value)
 {
@@ -246,17 +490,31 @@ httpAggAddMetric(http_agg_t *http_agg,
     target_agg_t *target_entry = get_target_entry(http_agg, target_val);
     if (!target_entry) return;
 
-    // Record the status in the target_entry
     long long status_val = num_value(duration, "http.status_code");
+    counter_field_enum dur_field = strToVal(fieldMap, duration->name);
+
+    // A transfer time comes once the body is done, after its request
+    // was counted
+    if ((dur_field == SERVER_TRANSFER) || (dur_field == CLIENT_TRANSFER)) {
+        if (duration->value.type == FMT_INT) {
+            add_counter(&target_entry->field[dur_field], duration->value.integer);
+            add_latency(http_agg, target_entry, dur_field, status_val, duration->value.integer);
+        } else {
+            DBG(NULL);
+        }
+        return;
+    }
+
+    // Record the status in the target_entry
     add_status(target_entry, status_val);
 
     // Record the field data in the target_entry
-    counter_field_enum dur_field = strToVal(fieldMap, duration->name);
     switch (dur_field) {
         case SERVER_DURATION:
         case CLIENT_DURATION:
             if (duration->value.type == FMT_INT) {
                 add_counter(&target_entry->field[dur_field], duration->value.integer);
+                add_latency(http_agg, target_entry, dur_field, status_val, duration->value.integer);
             } else {
                 DBG(NULL);
             }
@@ -264,6 +522,22 @@ httpAggAddMetric(http_agg_t *http_agg,
         default:
             DBG(NULL);
     }
+
+    // The first part of the duration, when the event has it
+    if ((dur_field == SERVER_DURATION) || (dur_field == CLIENT_DURATION)) {
+        int side = dur_field - SERVER_DURATION;
+        long long ttfb = num_value(duration, "http.ttfb");
+        if (ttfb >= 0) {
+            add_counter(&target_entry->field[SERVER_TTFB + side], ttfb);
+            add_latency(http_agg, target_entry, SERVER_TTFB + side, status_val, ttfb);
+        }
+    }
+
+    // A connection's second and later requests reuse it (keep-alive)
+    if (num_value(duration, "http.connection.requests") > 1) {
+        add_counter(&target_entry->field[REUSED_REQUESTS], 1);
+    }
+
     if (request_len != -1) {
         add_counter(&target_entry->field[REQUEST_BYTES], request_len);
     }
@@ -273,7 +547,7 @@ httpAggAddMetric(http_agg_t *http_agg,
 }
 
 static void
-report_target(mtc_t *mtc, target_agg_t *target)
+report_target(mtc_t *mtc, target_agg_t *target, const char *uri)
 {
     {
         int i;
@@ -281,7 +555,7 @@ report_target(mtc_t *mtc, target_agg_t *target)
             if (target->status[i].code == 0) break;
 
             event_field_t fields[] = {
-                STRFIELD("http.target", target->uri, 4, TRUE),
+                STRFIELD("http.target", uri, 4, TRUE),
                 NUMFIELD("http.status_code", target->status[i].code, 1, TRUE),
                 STRFIELD("proc",        g_proc.procname, 4, TRUE),
                 NUMFIELD("pid",         g_proc.pid,      4, TRUE),
@@ -301,14 +575,16 @@ report_target(mtc_t *mtc, target_agg_t *target)
             if (target->field[i].num_entries == 0) continue;
             char *unit;
 
-            if ((i == SERVER_DURATION) || (i == CLIENT_DURATION)) {
+            if (i < DURATION_FIELDS) {
                 unit = "millisecond";
+            } else if (i == REUSED_REQUESTS) {
+                unit = "request";
             } else {
                 unit = "byte";
             }
 
             event_field_t fields[] = {
-                STRFIELD("http.target", target->uri,     4, TRUE),
+                STRFIELD("http.target", uri,             4, TRUE),
                 NUMFIELD("numops",      target->field[i].num_entries, 8, TRUE),
                 STRFIELD("proc",        g_proc.procname, 4, TRUE),
                 NUMFIELD("pid",         g_proc.pid,      4, TRUE),
@@ -323,6 +599,74 @@ report_target(mtc_t *mtc, target_agg_t *target)
     }
 }
 
+static void
+report_latency(mtc_t *mtc, sketch_t *sketch, counter_field_enum field,
+               const char *uri, const char *class)
+{
+    const char *field_name = valToStr(fieldMap, field);
+    char name[64];
+
+    int i;
+    for (i = 0; i < sizeof(quantileMap) / sizeof(quantileMap[0]); i++) {
+        event_field_t fields[] = {
+            STRFIELD("http.target", uri,             4, TRUE),
+            STRFIELD("http.status_class", class,     1, TRUE),
+            STRFIELD("proc",        g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",         g_proc.pid,      4, TRUE),
+            STRFIELD("host",        g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",        "millisecond",   4, TRUE),
+            FIELDEND
+        };
+        snprintf(name, sizeof(name), "%s.%s", field_name, quantileMap[i].name);
+        event_t metric = INT_EVENT(name,
+                                   sketchQuantile(sketch, quantileMap[i].quantile),
+                                   CURRENT, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+
+    // The bucket counts, a bucket to a power of two of durations.  As in
+    // a prometheus histogram, each counts every duration up to le, so
+    // they're cumulative; a bucket with nothing new in it isn't sent.
+    snprintf(name, sizeof(name), "%s.bucket", field_name);
+    uint64_t count = 0, added = 0, high = 0;
+    for (i = 0; i < SKETCH_BUCKETS; i++) {
+        added += sketchBucket(sketch, i, NULL, &high);
+
+        int last = (i == SKETCH_BUCKETS - 1) ||
+            ((i >> SKETCH_SUB_BITS) != ((i + 1) >> SKETCH_SUB_BITS));
+        if (!last || !added) continue;
+        count += added;
+        added = 0;
+
+        event_field_t fields[] = {
+            STRFIELD("http.target", uri,             4, TRUE),
+            STRFIELD("http.status_class", class,     1, TRUE),
+            NUMFIELD("le",          high,            1, TRUE),
+            STRFIELD("proc",        g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",         g_proc.pid,      4, TRUE),
+            STRFIELD("host",        g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",        "request",       4, TRUE),
+            FIELDEND
+        };
+        event_t metric = INT_EVENT(name, count, DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+}
+
+static void
+report_latencies(mtc_t *mtc, target_agg_t *target, const char *uri)
+{
+    counter_field_enum field;
+    for (field = SERVER_DURATION; field < DURATION_FIELDS; field++) {
+        int class;
+        for (class = 0; class < STATUS_CLASSES; class++) {
+            sketch_t *sketch = target->latency[field][class];
+            if (!sketchCount(sketch)) continue;
+            report_latency(mtc, sketch, field, uri, statusClass[class]);
+        }
+    }
+}
+
 void
 httpAggSendReport(http_agg_t *http_agg, mtc_t *mtc)
 {
@@ -331,7 +675,13 @@ httpAggSendReport(http_agg_t *http_agg, mtc_t *mtc)
     int i;
     for (i=0; i<http_agg->count; i++) {
         target_agg_t *target = http_agg->target[i];
-        report_target(mtc, target);
+        const char *uri = strtabStr(http_agg->names, target->uri);
+        report_target(mtc, target, uri);
+        report_latencies(mtc, target, uri);
+    }
+    if (http_agg->other) {
+        report_target(mtc, http_agg->other, OTHER_TARGET);
+        report_latencies(mtc, http_agg->other, OTHER_TARGET);
     }
 }
 
@@ -342,14 +692,16 @@ httpAggReset(http_agg_t *http_agg)
 
     int i;
     for (i=0; i<http_agg->count; i++) {
-        target_agg_t *target = http_agg->target[i];
-        if (target) {
-            if (target->uri) free(target->uri);
-            free(target);
-        }
+        strtabRelease(http_agg->names, http_agg->target[i]->uri);
+        free_target(http_agg->target[i]);
         http_agg->target[i] = NULL;
     }
     http_agg->count = 0;
+    memset(http_agg->slot, 0, sizeof(*http_agg->slot) * http_agg->nslots);
+
+    free_target(http_agg->other);
+    http_agg->other = NULL;
+    http_agg->sketches = 0;
 }
 
 
@@ -1,6 +1,7 @@
 #ifndef __HTTPREPORT_H__
 #define __HTTPREPORT_H__
 #include "mtc.h"
+#include "strtab.h"
 
 // This was written to do aggregation of http for the metrics channel (statsd)
 //
@@ -11,11 +12,31 @@
 //   AddMetric
 //   SendReport (sends a summary of all Metrics received before it)
 //   Reset (returns to a state similar to Create)
+//
+// Targets are kept as ids in the strtab_t given to Create, which must
+// outlive the http_agg_t; Reset releases them for the owner of the table
+// to reclaim.  Path segments that look like ids are reported
+// as {id} (/users/8812/orders is /users/{id}/orders) unless normalize is
+// turned off.  Once a period has seen max targets, any new ones are
+// reported together with an http.target of "other".
+//
+// Durations are also kept in a sketch per target and status class, for
+// p50, p90, p99 and max metrics and bucket counts.  So is the first part,
+// when the event has http.ttfb (end of request to first byte of
+// response).  The rest, the transfer (first to last byte of response),
+// is known later; it's added as an http.server.transfer or
+// http.client.transfer metric with http.target and http.status_code
+// fields, and isn't counted as another request.  A period makes at most
+// 256 sketches; past that, durations without one are only counted in
+// the totals.  Requests with an http.connection.requests past 1 are
+// counted as http.requests.reused.
 
 typedef struct _http_agg_t http_agg_t;
 
-http_agg_t *httpAggCreate();
+http_agg_t *httpAggCreate(strtab_t *);
 void httpAggDestroy(http_agg_t **);
+void httpAggMaxTargetsSet(http_agg_t *, unsigned);
+void httpAggNormalizeSet(http_agg_t *, unsigned);
 void httpAggAddMetric(http_agg_t *, event_t *, size_t, size_t);
 void httpAggSendReport(http_agg_t *, mtc_t *);
 void httpAggReset(http_agg_t *);
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include "httphdr.h"
+#include "scopetypes.h"
+
+#define HTTP_VERSION "HTTP/"
+
+// Names of the fields in http_fld_t order
+static const struct {
+    const char *name;
+    size_t len;
+} g_fld_name[HTTP_FLD_MAX] = {
+    {"Host", 4},
+    {"User-Agent", 10},
+    {"X-Forwarded-For", 15},
+    {"Content-Length", 14},
+};
+
+static http_span_t
+span(const char *buf, const char *start, const char *end)
+{
+    http_span_t s = {.off = start - buf, .len = end - start};
+    return s;
+}
+
+// The CR (or a bare LF) that ends the line, or NULL if it doesn't end
+static const char *
+lineEnd(const char *line, const char *end)
+{
+    const char *nl = memchr(line, '\n', end - line);
+    if (!nl) return NULL;
+    return ((nl > line) && (nl[-1] == '\r')) ? nl - 1 : nl;
+}
+
+static const char *
+nextLine(const char *eol)
+{
+    return (*eol == '\r') ? eol + 2 : eol + 1;
+}
+
+static int
+fieldFromName(const char *name, size_t len)
+{
+    int i;
+    for (i = 0; i < HTTP_FLD_MAX; i++) {
+        // From RFC 2616 Section 4.2 "Field names are case-insensitive."
+        if ((len == g_fld_name[i].len) && !strncasecmp(name, g_fld_name[i].name, len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int
+parseFirstLine(const char *buf, const char *line, const char *eol, http_hdr_t *hdr)
+{
+    const char *sp1 = memchr(line, ' ', eol - line);
+    const char *sp2 = (sp1) ? memchr(sp1 + 1, ' ', eol - sp1 - 1) : NULL;
+    size_t vlen = strlen(HTTP_VERSION);
+
+    if (((eol - line) > vlen) && !strncmp(line, HTTP_VERSION, vlen)) {
+        // ex: HTTP/1.1 200 OK
+        if (!sp1) return -1;
+        hdr->isResponse = TRUE;
+        hdr->flavor = span(buf, line + vlen, sp1);
+
+        const char *code;
+        for (code = sp1 + 1; (code < eol) && (*code >= '0') && (*code <= '9'); code++) {
+            hdr->status = hdr->status * 10 + (*code - '0');
+            if (hdr->status > 999) return -1;
+        }
+        if (sp2) hdr->reason = span(buf, sp2 + 1, eol);
+        return 0;
+    }
+
+    // ex: GET /index.html HTTP/1.1
+    if (!sp1 || (sp1 == line)) return -1;
+    hdr->method = span(buf, line, sp1);
+    if (!sp2) {
+        hdr->target = span(buf, sp1 + 1, eol);
+        return 0;
+    }
+    hdr->target = span(buf, sp1 + 1, sp2);
+    if (((eol - sp2 - 1) >= vlen) && !strncmp(sp2 + 1, HTTP_VERSION, vlen)) {
+        hdr->flavor = span(buf, sp2 + 1 + vlen, eol);
+    }
+    return 0;
+}
+
+int
+httpHdrParse(const char *buf, size_t len, http_hdr_t *hdr)
+{
+    if (!buf || !hdr) return -1;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->clen = -1;
+
+    // The headers we're handed are null terminated; don't look past that
+    const char *end = memchr(buf, '\0', len);
+    if (!end) end = buf + len;
+
+    const char *eol = lineEnd(buf, end);
+    if (!eol || (eol == buf)) return -1;
+    if (parseFirstLine(buf, buf, eol, hdr)) return -1;
+
+    const char *line;
+    for (line = nextLine(eol); line < end; line = nextLine(eol)) {
+        if ((eol = lineEnd(line, end)) == NULL) break;
+
+        const char *colon = memchr(line, ':', eol - line);
+        if (!colon) continue;
+
+        int fld = fieldFromName(line, colon - line);
+        if ((fld == -1) || httpHdrHas(hdr, fld)) continue;
+
+        // Without the whitespace around it
+        const char *val = colon + 1;
+        const char *vend = eol;
+        while ((val < vend) && ((*val == ' ') || (*val == '\t'))) val++;
+        while ((vend > val) && ((vend[-1] == ' ') || (vend[-1] == '\t'))) vend--;
+
+        hdr->fld[fld] = span(buf, val, vend);
+        hdr->found |= 1U << fld;
+
+        if (fld == HTTP_FLD_CONTENT_LENGTH) {
+            size_t clen = 0;
+            const char *digit;
+            for (digit = val; digit < vend; digit++) {
+                if ((*digit < '0') || (*digit > '9') || (clen > (SIZE_MAX / 10) - 10)) break;
+                clen = clen * 10 + (*digit - '0');
+            }
+            // A length of zero is reported as no length at all
+            hdr->clen = ((digit == vend) && clen) ? clen : -1;
+        }
+    }
+
+    return 0;
+}
+
+char *
+httpHdrStr(char *buf, http_span_t s)
+{
+    if (!buf || !s.len) return "";
+    buf[s.off + s.len] = '\0';
+    return &buf[s.off];
+}
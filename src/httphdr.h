@@ -0,0 +1,55 @@
+#ifndef __HTTPHDR_H__
+#define __HTTPHDR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// A one pass parser for the HTTP/1.X headers httpstate.c posts.
+//
+// httpHdrParse() walks a header once and records where the request or
+// status line parts and the few fields we report are, as spans over the
+// header.  Field names are matched without regard to case.  Nothing is
+// copied or allocated.
+//
+// httpHdrStr() turns a span into a string by writing a NUL over the
+// byte after it, which is always a separator (a space or the CR ending
+// the line) and never part of another span.  So the header itself is
+// changed; parse it first, then take strings from it.
+//
+
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} http_span_t;
+
+typedef enum {
+    HTTP_FLD_HOST,
+    HTTP_FLD_USER_AGENT,
+    HTTP_FLD_X_FORWARDED_FOR,
+    HTTP_FLD_CONTENT_LENGTH,
+    HTTP_FLD_MAX
+} http_fld_t;
+
+typedef struct {
+    int isResponse;
+    // Request-Line; Method SP Request-URI SP HTTP-Version
+    http_span_t method;
+    http_span_t target;
+    // Status-Line; HTTP-Version SP Status-Code SP Reason-Phrase
+    int status;
+    http_span_t reason;
+    // Both; the part of HTTP-Version after "HTTP/"
+    http_span_t flavor;
+    unsigned int found;         // bit per http_fld_t that's present
+    http_span_t fld[HTTP_FLD_MAX];
+    size_t clen;                // Content-Length, or -1
+} http_hdr_t;
+
+// Returns 0, or -1 if there's no request or status line
+int     httpHdrParse(const char *, size_t, http_hdr_t *);
+char *  httpHdrStr(char *, http_span_t);
+
+#define httpHdrHas(hdr, fld) ((hdr)->found & (1U << (fld)))
+
+#endif // __HTTPHDR_H__
@@ -1,7 +1,12 @@
+#define _GNU_SOURCE
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include "com.h"
 #include "dbg.h"
+#include "evtpool.h"
+#include "grpcagg.h"
+#include "hpack.h"
 #include "httpstate.h"
 #include "plattime.h"
 #include "search.h"
@@ -11,19 +16,139 @@
 #define MIN_HDR_ALLOC (4  * 1024)
 #define MAX_HDR_ALLOC (16 * 1024)
 
+// Header buffers are blocks from two pools, of MIN_HDR_ALLOC and
+// MAX_HDR_ALLOC bytes.  A connection borrows one while it collects a
+// header; it goes with the header to the reporting thread, which gives
+// it back.  Between them the pools never hold more than HDR_POOL_MEM;
+// past that, headers are dropped rather than use more memory.
+#define HDR_POOL_MEM (16 * 1024 * 1024)
+static evt_pool_t *g_hdrpool[2];
+
 #define HTTP_START "HTTP/"
 #define HTTP_END "\r\n"
+#define HDR_END "\r\n\r\n"
+#define HDR_END_LEN (sizeof(HDR_END) - 1)
 #define CONTENT_LENGTH "Content-Length:"
+#define TRANSFER_ENCODING "Transfer-Encoding:"
+#define MAX_CHUNK_LINE 1024         // chunk extensions and trailer fields
 static search_t* g_http_start = NULL;
-static search_t* g_http_end = NULL;
-static search_t* g_http_clen = NULL;
+static search_t* g_http_hdr_end = NULL;
+
+// What a request needs remembered until its response; see http_state_t
+#define HTTP_REQ_HEAD    0x1
+#define HTTP_REQ_CONNECT 0x2
+#define HTTP_REQ_BITS    2
+#define HTTP_REQ_MAX     (64 / HTTP_REQ_BITS)
+
+// What a header says about the body after it
+typedef struct {
+    int isResponse;
+    int status;
+    int req;                // HTTP_REQ_*
+    size_t clen;            // -1 without a Content-Length
+    int encoded;            // has a Transfer-Encoding
+    int chunked;            //   and chunked is the last one
+} http_framing_t;
+
+// HTTP/2 (RFC 7540)
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN (sizeof(H2_PREFACE) - 1)
+#define H2_FRAME_HDR_LEN 9
+#define H2_MAX_BLOCK (64 * 1024)    // most header block we'll collect
+#define H2_MAX_TABLE (64 * 1024)    // most an encoder may grow its HPACK table to
+
+#define H2_DATA          0x0
+#define H2_HEADERS       0x1
+#define H2_RST_STREAM    0x3
+#define H2_PUSH_PROMISE  0x5
+#define H2_CONTINUATION  0x9
+
+#define H2_END_STREAM    0x1
+#define H2_END_HEADERS   0x4
+#define H2_PADDED        0x8
+#define H2_PRIORITY      0x20
+
+#define H2_RST_LEN       4          // the error code is all there is
+#define H2_REFUSED_STREAM  0x7
+#define H2_CANCEL          0x8
+
+// gRPC over HTTP/2 (PROTOCOL-HTTP2.md in the gRPC repo)
+#define GRPC_CONTENT_TYPE "application/grpc"
+#define GRPC_PREFIX_LEN 5           // compressed flag, then a 4 byte length
+#define GRPC_MAX_CALLS 32           // most calls followed at once on a connection
+#define GRPC_STATUS_CANCELLED    1
+#define GRPC_STATUS_INTERNAL     13
+#define GRPC_STATUS_UNAVAILABLE  14
+
+// Where we are in one direction's messages of a gRPC call
+typedef struct {
+    uint8_t prefix[GRPC_PREFIX_LEN];
+    int prefixlen;          // bytes of prefix we have
+    uint32_t left;          // bytes of the message after it still to come
+} grpc_msgs_t;
+
+// A gRPC call on an HTTP/2 stream
+typedef struct {
+    uint32_t stream;        // 0 if this slot is free
+    int reqdir;             // the http2_dir_t its request came in on
+    uint64_t start;         // when the request header was done
+    char *method;
+    grpc_call_t call;       // what's reported when it's over
+    grpc_msgs_t msgs[2];    // request, response
+} grpc_stream_t;
+
+// One direction of an HTTP/2 connection
+typedef struct {
+    size_t skip;            // preface bytes still to pass over
+    uint8_t fhdr[H2_FRAME_HDR_LEN];
+    int fhdrlen;            // bytes of fhdr we have
+    uint32_t need;          // payload bytes of this frame still to come
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream;
+    size_t framestart;      // where this frame's part of block starts
+    uint8_t *block;         // header block, over HEADERS and CONTINUATIONs
+    size_t blocklen;
+    size_t blockalloc;
+    uint32_t blockstream;   // 0 when no block is open
+    int promise;            // the open block is a PUSH_PROMISE
+    int blockend;           // the open block ends its stream
+    grpc_stream_t *data;    // the gRPC call a DATA frame is part of
+    int padded;             //   its pad length is still to come
+    uint32_t pad;           //   bytes of padding at its end
+    uint8_t rst[H2_RST_LEN];    // the error code of a RST_STREAM
+    hpack_t *hpack;
+} http2_dir_t;
+
+typedef struct http2_state_t {
+    int isSsl;
+    int broken;             // lost our place; ignore the rest
+    uint32_t nreq;          // requests (streams) seen
+    http2_dir_t dir[2];     // indexed by httpDir()
+    grpc_stream_t *grpc;    // GRPC_MAX_CALLS of them, once there's a call
+} http2_state_t;
+
+// What one header block says, rewritten as an HTTP/1.x header
+typedef struct {
+    char *method;
+    char *path;
+    char *authority;
+    char *status;
+    int grpc;               // the content-type is gRPC
+    int grpcstatus;         // -1 if there's no grpc-status
+    char *hdr;              // "name: value\r\n" for the rest
+    size_t hdrlen;
+    size_t hdralloc;
+} http2_msg_t;
 
 static void setHttpState(http_state_t *httpstate, http_enum_t toState);
 static void appendHeader(http_state_t *httpstate, char* buf, size_t len);
-static size_t getContentLength(char *header, size_t len);
-static size_t bytesToSkipForContentLength(http_state_t *httpstate, size_t len);
+static void getFraming(char *header, http_framing_t *framing);
+static size_t skipBody(http_body_t *body, char *buf, size_t len);
 static bool setHttpId(httpId_t *httpId, net_info *net, int sockfd, uint64_t id, metric_t src);
-static int reportHttp(http_state_t *httpstate);
+static protocol_info *newHttpPost(httpId_t *httpId, char *hdr, size_t len, uint32_t stream);
+static int sendHttp(protocol_info *proto);
+static void http2Destroy(http2_state_t **h2_ptr);
 static bool scanForHttpHeader(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId);
 
 extern int      g_http_guard_enabled;
@@ -35,12 +160,13 @@ setHttpState(http_state_t *httpstate, http_enum_t toState)
     if (!httpstate) return;
     switch (toState) {
         case HTTP_NONE:
-            if (httpstate->hdr) free(httpstate->hdr);
-            memset(httpstate, 0, sizeof(*httpstate));
+            // Only the header goes; body framing lasts across headers
+            if (httpstate->hdr) evtPoolFree(httpstate->hdr);
+            httpstate->hdr = NULL;
+            httpstate->hdrlen = 0;
+            httpstate->hdralloc = 0;
             break;
         case HTTP_HDR:
-        case HTTP_HDREND:
-        case HTTP_DATA:
             break;
         default:
             DBG(NULL);
@@ -49,34 +175,45 @@ setHttpState(http_state_t *httpstate, http_enum_t toState)
     httpstate->state = toState;
 }
 
+// A block that holds size bytes; NULL if there's no room for it
+static char *
+hdrAlloc(size_t size, size_t *alloc)
+{
+    if (size > MAX_HDR_ALLOC) return NULL;
+
+    evt_pool_t *pool = g_hdrpool[size > MIN_HDR_ALLOC];
+    char *hdr = evtPoolTryAlloc(pool);
+    if (hdr && alloc) *alloc = evtPoolBlockSize(pool);
+    return hdr;
+}
+
 static void
 appendHeader(http_state_t *httpstate, char* buf, size_t len)
 {
     if (!httpstate || !buf) return;
 
-    // make sure we have enough allocated space
-    size_t content_size = httpstate->hdrlen+len;
-    size_t alloc_size = (!httpstate->hdralloc) ? MIN_HDR_ALLOC : httpstate->hdralloc;
-    while (alloc_size < content_size) {
-        alloc_size = alloc_size << 2; // same as multiplying by 4
-        if (alloc_size > MAX_HDR_ALLOC) {
+    // Leave room for the null that ends a complete header, so a header
+    // that arrives in one buffer is one block and one copy
+    size_t content_size = httpstate->hdrlen + len;
+    if (content_size + 1 > httpstate->hdralloc) {
+        if (content_size + 1 > MAX_HDR_ALLOC) {
              DBG(NULL);
              // More than we're willing to allocate for one header.
              // We might have missed the end of the header???
              setHttpState(httpstate, HTTP_NONE);
              return;
         }
-    }
 
-    // If we need more space, realloc
-    if (alloc_size != httpstate->hdralloc) {
-        char* temp = realloc(httpstate->hdr, alloc_size);
+        size_t alloc_size;
+        char *temp = hdrAlloc(content_size + 1, &alloc_size);
         if (!temp) {
-            DBG(NULL);
-            // Don't return partial headers...  All or nothing.
+            // The pools are at their cap.  Don't return partial
+            // headers...  All or nothing.
             setHttpState(httpstate, HTTP_NONE);
             return;
         }
+        if (httpstate->hdrlen) memcpy(temp, httpstate->hdr, httpstate->hdrlen);
+        if (httpstate->hdr) evtPoolFree(httpstate->hdr);
         httpstate->hdr = temp;
         httpstate->hdralloc = alloc_size;
     }
@@ -86,46 +223,149 @@ appendHeader(http_state_t *httpstate, char* buf, size_t len)
     httpstate->hdrlen += len;
 }
 
-static size_t
-getContentLength(char *header, size_t len)
+static int
+getLineValue(char *line, const char *name, char **val)
 {
-    size_t ix;
-    size_t rc;
-    char *val;
-
-    // ex: Content-Length: 559\r\n
-    if ((ix = searchExec(g_http_clen, header, len)) == -1) return -1;
+    size_t namelen = strlen(name);
+    if (strncasecmp(line, name, namelen)) return FALSE;
+    *val = &line[namelen + strspn(&line[namelen], " \t")];
+    return TRUE;
+}
 
-    if ((ix <= 0) || (ix > len) || ((ix + searchLen(g_http_clen)) > len)) return -1;
+// header is null terminated, one "\r\n" ended line after another
+static void
+getFraming(char *header, http_framing_t *framing)
+{
+    memset(framing, 0, sizeof(*framing));
+    framing->clen = -1;
+
+    // ex: HTTP/1.1 200 OK\r\n or HEAD /index.html HTTP/1.1\r\n
+    if (!strncmp(header, HTTP_START, strlen(HTTP_START))) {
+        framing->isResponse = TRUE;
+        char *code = strchr(header, ' ');
+        if (code) framing->status = strtol(code, NULL, 10);
+    } else if (!strncmp(header, "HEAD ", 5)) {
+        framing->req = HTTP_REQ_HEAD;
+    } else if (!strncmp(header, "CONNECT ", 8)) {
+        framing->req = HTTP_REQ_CONNECT;
+    }
 
-    val = &header[ix + searchLen(g_http_clen)];
+    char *line = strstr(header, HTTP_END);
+    while (line && line[2]) {
+        char *val;
+        line += 2;
+
+        if (getLineValue(line, CONTENT_LENGTH, &val)) {
+            errno = 0;
+            size_t clen = strtoull(val, NULL, 10);
+            if (!errno) framing->clen = clen;
+        } else if (getLineValue(line, TRANSFER_ENCODING, &val)) {
+            // ex: Transfer-Encoding: gzip, chunked\r\n
+            framing->encoded = TRUE;
+            char *end = strstr(val, HTTP_END);
+            if (!end) end = val + strlen(val);
+            while ((end > val) && ((end[-1] == ' ') || (end[-1] == '\t'))) end--;
+            framing->chunked = ((end - val) >= 7) && !strncasecmp(end - 7, "chunked", 7);
+        }
 
-    errno = 0;
-    rc = strtoull(val, NULL, 0);
-    if ((errno != 0) || (rc == 0)) {
-        return -1;
+        line = strstr(line, HTTP_END);
     }
-    return rc;
 }
 
+// Consumes the body in buf, and returns how much of buf that was.
+// Data is skipped over without looking at it; only the chunk-size lines
+// and trailers of a chunked body are read.
 static size_t
-bytesToSkipForContentLength(http_state_t *httpstate, size_t len)
+skipBody(http_body_t *body, char *buf, size_t len)
 {
-    // don't skip anything because we don't know anything about it
-    // or because content length skipping is off
-    if (!httpstate || (httpstate->clen == 0)) return 0;
+    size_t pos = 0;
+
+    while ((pos < len) && (body->state != HTTP_BODY_NONE)) {
+        switch (body->state) {
+            case HTTP_BODY_CLOSE:
+                return len;
+
+            case HTTP_BODY_LENGTH:
+            case HTTP_BODY_CHUNK_DATA:
+            {
+                size_t num = (len - pos < body->left) ? len - pos : body->left;
+                pos += num;
+                body->left -= num;
+                if (body->left) break;
+                if (body->state == HTTP_BODY_LENGTH) {
+                    body->state = HTTP_BODY_NONE;
+                } else {
+                    body->state = HTTP_BODY_CHUNK_SIZE;
+                    body->size = 0;
+                    body->linelen = 0;
+                    body->ext = FALSE;
+                }
+                break;
+            }
 
-    // skip the rest of the remaining content length
-    // and turn off content length skipping
-    if (len > httpstate->clen) {
-        size_t rv = httpstate->clen;
-        httpstate->clen = 0;
-        return rv;
+            case HTTP_BODY_CHUNK_SIZE:
+            {
+                // ex: 1a2b;name=value\r\n
+                char c = buf[pos++];
+                if (c == '\n') {
+                    if (!body->linelen) {
+                        // No size; we've lost our place
+                        body->state = HTTP_BODY_NONE;
+                    } else if (body->size) {
+                        body->state = HTTP_BODY_CHUNK_DATA;
+                        body->left = body->size + strlen(HTTP_END);
+                    } else {
+                        body->state = HTTP_BODY_TRAILER;
+                        body->linelen = 0;
+                    }
+                    break;
+                }
+                if (c == '\r') break;
+                if (!body->ext && isxdigit((unsigned char)c)) {
+                    if (body->size >= ((size_t)1 << 56)) {
+                        body->state = HTTP_BODY_NONE;
+                        break;
+                    }
+                    int digit = (c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+                    body->size = (body->size << 4) | digit;
+                } else if (!body->linelen) {
+                    // Doesn't start with a size
+                    body->state = HTTP_BODY_NONE;
+                    break;
+                } else {
+                    body->ext = TRUE;
+                }
+                if (++body->linelen > MAX_CHUNK_LINE) body->state = HTTP_BODY_NONE;
+                break;
+            }
+
+            case HTTP_BODY_TRAILER:
+            {
+                // Trailer fields, if any, then an empty line
+                char c = buf[pos++];
+                if (c == '\n') {
+                    if (!body->linelen) body->state = HTTP_BODY_NONE;
+                    body->linelen = 0;
+                } else if ((c != '\r') && (++body->linelen > MAX_CHUNK_LINE)) {
+                    body->state = HTTP_BODY_NONE;
+                }
+                break;
+            }
+
+            default:
+                DBG("%d", body->state);
+                body->state = HTTP_BODY_NONE;
+                break;
+        }
     }
 
-    // skip this whole buf and maintain content length
-    httpstate->clen -= len;
-    return len;
+    return pos;
+}
+
+static int
+httpDir(metric_t src)
+{
+    return ((src == NETRX) || (src == TLSRX)) ? 0 : 1;
 }
 
 static bool
@@ -155,35 +395,41 @@ setHttpId(httpId_t *httpId, net_info *net, int sockfd, uint64_t id, metric_t src
     return TRUE;
 }
 
-// For now, only doing HTTP/1.X headers
-static int
-reportHttp(http_state_t *httpstate)
+// Takes ownership of hdr, which holds an HTTP/1.X header, and returns
+// it in a record ready for sendHttp(); NULL if that couldn't be done
+static protocol_info *
+newHttpPost(httpId_t *httpId, char *hdr, size_t len, uint32_t stream)
 {
-    if (!httpstate || !httpstate->hdr || !httpstate->hdrlen) return -1;
+    if (!httpId || !hdr || !len) {
+        if (hdr) evtPoolFree(hdr);
+        return NULL;
+    }
 
-    protocol_info *proto = calloc(1, sizeof(struct protocol_info_t));
+    protocol_info *proto = evtAlloc(EVT_POOL_PROTO);
     http_post *post = calloc(1, sizeof(struct http_post_t));
     if (!proto || !post) {
         // Bummer!  We're losing info.  At least make sure we clean up.
         DBG(NULL);
         if (post) free(post);
-        if (proto) free(proto);
-        return -1;
+        evtPoolFree(proto);
+        evtPoolFree(hdr);
+        return NULL;
     }
+    memset(proto, 0, sizeof(struct protocol_info_t));
 
     // If the first 5 chars are HTTP/, it's a response header
     int isResponse =
-      (searchExec(g_http_start, httpstate->hdr, searchLen(g_http_start)) != -1);
-    int isSend = (httpstate->id.src == NETTX) || (httpstate->id.src == TLSTX);
+      (searchExec(g_http_start, hdr, searchLen(g_http_start)) != -1);
+    int isSend = (httpId->src == NETTX) || (httpId->src == TLSTX);
 
     // Set proto info
     proto->evtype = EVT_PROTO;
     proto->ptype = (isResponse) ? EVT_HRES : EVT_HREQ;
     // We're a server if we 1) sent a response or 2) received a request
     proto->isServer = (isSend && isResponse) || (!isSend && !isResponse);
-    proto->len = httpstate->hdrlen;
-    proto->fd = httpstate->id.sockfd;
-    proto->uid = httpstate->id.uid;
+    proto->len = len;
+    proto->fd = httpId->sockfd;
+    proto->uid = httpId->uid;
 
     net_info *net;
     if ((net = getNetEntry(proto->fd))) {
@@ -206,40 +452,723 @@ reportHttp(http_state_t *httpstate)
 
     // Set post info
     proto->data = (char *)post;
-    post->ssl = httpstate->id.isSsl;
+    post->ssl = httpId->isSsl;
     post->start_duration = getTime();
-    post->id = httpstate->id.uid;
+    post->id = httpId->uid;
+    post->stream = stream;
+    post->hdr = hdr;
 
-    // "transfer ownership" of dynamically allocated header from
-    // httpstate object to post object
-    post->hdr = httpstate->hdr;
+    return proto;
+}
+
+static int
+sendHttp(protocol_info *proto)
+{
+    if (!proto) return -1;
+
+    if (cmdPostEvent(g_ctl, (char *)proto) == -1) {
+        http_post *post = (http_post *)proto->data;
+        if (post->hdr) evtPoolFree(post->hdr);
+        free(post);
+        evtPoolFree(proto);
+        return -1;
+    }
+
+    return 0;
+}
+
+static protocol_info *
+takeHttpHeader(http_state_t *httpstate)
+{
+    if (!httpstate || !httpstate->hdr || !httpstate->hdrlen) return NULL;
+
+    // "transfer ownership" of the header block from httpstate object
+    // to post object
+    protocol_info *proto = newHttpPost(&httpstate->id, httpstate->hdr, httpstate->hdrlen, 0);
     httpstate->hdr = NULL;
     httpstate->hdrlen = 0;
+    httpstate->hdralloc = 0;
+
+    if (proto) {
+        http_post *post = (http_post *)proto->data;
+        post->first_byte = httpstate->first_byte;
+        post->conn_req = httpstate->nreq;
+    }
+    return proto;
+}
+
+// The body after a response is done (or the connection is); tell the
+// periodic thread when, for the response's transfer time
+static void
+endHttpBody(http_body_t *body)
+{
+    if (!body->timed) return;
+    body->timed = FALSE;
+
+    protocol_info *proto = evtAlloc(EVT_POOL_PROTO);
+    http_post *post = calloc(1, sizeof(struct http_post_t));
+    if (!proto || !post) {
+        DBG(NULL);
+        if (post) free(post);
+        evtPoolFree(proto);
+        return;
+    }
+    memset(proto, 0, sizeof(struct protocol_info_t));
+
+    proto->evtype = EVT_PROTO;
+    proto->ptype = EVT_HBODY;
+    proto->fd = body->id.sockfd;
+    proto->uid = body->id.uid;
+    proto->data = (char *)post;
+    post->ssl = body->id.isSsl;
+    post->id = body->id.uid;
+    post->last_byte = getTime();
+    sendHttp(proto);
+}
+
+static void
+http2Destroy(http2_state_t **h2_ptr)
+{
+    if (!h2_ptr || !*h2_ptr) return;
+    http2_state_t *h2 = *h2_ptr;
 
-    cmdPostEvent(g_ctl, (char *)proto);
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (h2->dir[i].block) free(h2->dir[i].block);
+        hpackDestroy(&h2->dir[i].hpack);
+    }
+    // Calls still open when the connection goes aren't reported
+    if (h2->grpc) {
+        for (i = 0; i < GRPC_MAX_CALLS; i++) {
+            if (h2->grpc[i].method) free(h2->grpc[i].method);
+        }
+        free(h2->grpc);
+    }
+    free(h2);
+    *h2_ptr = NULL;
+}
+
+static http2_state_t *
+http2Create(httpId_t *httpId)
+{
+    http2_state_t *h2 = calloc(1, sizeof(http2_state_t));
+    if (!h2) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        if ((h2->dir[i].hpack = hpackCreate(H2_MAX_TABLE)) == NULL) {
+            http2Destroy(&h2);
+            return NULL;
+        }
+    }
+    h2->isSsl = httpId->isSsl;
+    return h2;
+}
+
+static void
+http2MsgAppend(http2_msg_t *msg, const char *str, size_t len)
+{
+    if (!msg->hdr && !(msg->hdr = malloc(MIN_HDR_ALLOC))) return;
+    if (!msg->hdralloc) msg->hdralloc = MIN_HDR_ALLOC;
+
+    // Past this many header lines there's nothing we'd report anyway
+    if (msg->hdrlen + len > msg->hdralloc) {
+        if (msg->hdralloc >= MAX_HDR_ALLOC) return;
+        size_t alloc = msg->hdralloc;
+        while ((alloc < msg->hdrlen + len) && (alloc < MAX_HDR_ALLOC)) alloc <<= 1;
+        if (msg->hdrlen + len > alloc) return;
+        char *temp = realloc(msg->hdr, alloc);
+        if (!temp) return;
+        msg->hdr = temp;
+        msg->hdralloc = alloc;
+    }
+    memcpy(&msg->hdr[msg->hdrlen], str, len);
+    msg->hdrlen += len;
+}
+
+// grpc-status is a decimal number; anything else is UNKNOWN
+static int
+grpcStatus(const char *value, size_t len)
+{
+    if (!len || (len > 3)) return GRPC_STATUS_UNKNOWN;
+
+    int status = 0;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)value[i])) return GRPC_STATUS_UNKNOWN;
+        status = status * 10 + (value[i] - '0');
+    }
+    return status;
+}
+
+static void
+http2MsgField(void *arg, const hpack_field_t *field)
+{
+    http2_msg_t *msg = arg;
+
+    if (field->namelen && (field->name[0] == ':')) {
+        char **pseudo = NULL;
+        if ((field->namelen == 7) && !strncmp(field->name, ":method", 7)) {
+            pseudo = &msg->method;
+        } else if ((field->namelen == 5) && !strncmp(field->name, ":path", 5)) {
+            pseudo = &msg->path;
+        } else if ((field->namelen == 10) && !strncmp(field->name, ":authority", 10)) {
+            pseudo = &msg->authority;
+        } else if ((field->namelen == 7) && !strncmp(field->name, ":status", 7)) {
+            pseudo = &msg->status;
+        }
+        if (pseudo && !*pseudo) *pseudo = strndup(field->value, field->valuelen);
+        return;
+    }
+
+    if ((field->namelen == 12) && !strncmp(field->name, "content-type", 12)) {
+        // application/grpc, or with a +proto or +json after it
+        size_t len = strlen(GRPC_CONTENT_TYPE);
+        msg->grpc = (field->valuelen >= len) &&
+            !strncmp(field->value, GRPC_CONTENT_TYPE, len) &&
+            ((field->valuelen == len) || (field->value[len] == '+') ||
+             (field->value[len] == ';'));
+    } else if ((field->namelen == 11) && !strncmp(field->name, "grpc-status", 11)) {
+        msg->grpcstatus = grpcStatus(field->value, field->valuelen);
+    }
+
+    http2MsgAppend(msg, field->name, field->namelen);
+    http2MsgAppend(msg, ": ", 2);
+    http2MsgAppend(msg, field->value, field->valuelen);
+    http2MsgAppend(msg, HTTP_END, 2);
+}
+
+// Turn a decoded header block into the HTTP/1.X header report.c expects
+static char *
+http2MsgHeader(http2_msg_t *msg, size_t *len)
+{
+    char *line = NULL;
+    int rv;
+
+    if (msg->status) {
+        // Interim (1xx) responses aren't the answer; wait for the real one
+        if (msg->status[0] == '1') return NULL;
+        // HTTP/2 has no reason phrase
+        rv = asprintf(&line, "HTTP/2.0 %s \r\n", msg->status);
+    } else if (msg->method && msg->path) {
+        if (msg->authority) {
+            rv = asprintf(&line, "%s %s HTTP/2.0\r\nhost: %s\r\n",
+                          msg->method, msg->path, msg->authority);
+        } else {
+            rv = asprintf(&line, "%s %s HTTP/2.0\r\n", msg->method, msg->path);
+        }
+    } else {
+        // Trailers, or a CONNECT; nothing to report
+        return NULL;
+    }
+    if (rv == -1) return NULL;
+
+    // Null terminated, like the HTTP/1.X headers scanForHttpHeader() posts
+    size_t linelen = strlen(line);
+    size_t total = linelen + msg->hdrlen + 1;
+    char *hdr = hdrAlloc(total, NULL);
+    if (!hdr) {
+        free(line);
+        return NULL;
+    }
+    memcpy(hdr, line, linelen);
+    if (msg->hdrlen) memcpy(&hdr[linelen], msg->hdr, msg->hdrlen);
+    hdr[total - 1] = '\0';
+    free(line);
+
+    *len = total;
+    return hdr;
+}
+
+static void
+http2MsgFree(http2_msg_t *msg)
+{
+    if (msg->method) free(msg->method);
+    if (msg->path) free(msg->path);
+    if (msg->authority) free(msg->authority);
+    if (msg->status) free(msg->status);
+    if (msg->hdr) free(msg->hdr);
+}
+
+// Returns the call on stream, or with a stream of 0, a free slot
+static grpc_stream_t *
+grpcFind(http2_state_t *h2, uint32_t stream)
+{
+    if (!h2->grpc) return NULL;
+
+    int i;
+    for (i = 0; i < GRPC_MAX_CALLS; i++) {
+        if (h2->grpc[i].stream == stream) return &h2->grpc[i];
+    }
+    return NULL;
+}
+
+static void
+grpcFree(grpc_stream_t *gs)
+{
+    if (gs->method) free(gs->method);
+    memset(gs, 0, sizeof(*gs));
+}
+
+// A request with a gRPC content-type; takes ownership of method
+static void
+grpcStart(http2_state_t *h2, int reqdir, uint32_t stream, char *method)
+{
+    if (!h2->grpc && !(h2->grpc = calloc(GRPC_MAX_CALLS, sizeof(grpc_stream_t)))) {
+        DBG(NULL);
+        free(method);
+        return;
+    }
+
+    // Streams aren't reused, but a new request on one replaces the old
+    grpc_stream_t *gs = grpcFind(h2, stream);
+    if (!gs) gs = grpcFind(h2, 0);
+    if (!gs) {
+        // More calls at once than we follow; this one isn't counted
+        free(method);
+        return;
+    }
+    grpcFree(gs);
+
+    gs->stream = stream;
+    gs->reqdir = reqdir;
+    gs->start = getTime();
+    gs->method = method;
+    gs->call.isServer = (reqdir == httpDir(NETRX));
+}
+
+// The call is over; post it for grpcagg, and free its slot
+static void
+grpcEnd(grpc_stream_t *gs, int status, httpId_t *httpId)
+{
+    size_t len = strlen(gs->method) + 1;
+    protocol_info *proto = evtAlloc(EVT_POOL_PROTO);
+    // The method goes on the end, so freeing the call frees it too
+    grpc_call_t *call = malloc(sizeof(grpc_call_t) + len);
+    if (!proto || !call) {
+        DBG(NULL);
+        if (call) free(call);
+        evtPoolFree(proto);
+        grpcFree(gs);
+        return;
+    }
+    memset(proto, 0, sizeof(struct protocol_info_t));
 
+    uint64_t now = getTime();
+    *call = gs->call;
+    call->method = memcpy(&call[1], gs->method, len);
+    call->status = status;
+    call->duration = (now > gs->start) ? getDurationNow(now, gs->start) / 1000000 : 0;
+
+    proto->evtype = EVT_PROTO;
+    proto->ptype = EVT_GRPC;
+    proto->isServer = call->isServer;
+    proto->len = sizeof(grpc_call_t) + len;
+    proto->fd = httpId->sockfd;
+    proto->uid = httpId->uid;
+    proto->sock_type = -1;
+    proto->localConn.ss_family = -1;
+    proto->remoteConn.ss_family = -1;
+    proto->data = (char *)call;
+
+    if (cmdPostEvent(g_ctl, (char *)proto) == -1) {
+        free(call);
+        evtPoolFree(proto);
+    }
+    grpcFree(gs);
+}
+
+// What a client sees when its call's stream is reset with code
+static int
+grpcResetStatus(const uint8_t *code)
+{
+    uint32_t err = ((uint32_t)code[0] << 24) | (code[1] << 16) | (code[2] << 8) | code[3];
+    switch (err) {
+        case H2_CANCEL:
+            return GRPC_STATUS_CANCELLED;
+        case H2_REFUSED_STREAM:
+            return GRPC_STATUS_UNAVAILABLE;
+        default:
+            return GRPC_STATUS_INTERNAL;
+    }
+}
+
+// Count the messages in a call's DATA, by the length prefix on each
+static void
+grpcMessages(grpc_stream_t *gs, int m, uint8_t *data, size_t len)
+{
+    grpc_msgs_t *msgs = &gs->msgs[m];
+
+    while (len) {
+        if (msgs->left) {
+            size_t num = (len < msgs->left) ? len : msgs->left;
+            msgs->left -= num;
+            data += num;
+            len -= num;
+            continue;
+        }
+
+        msgs->prefix[msgs->prefixlen++] = *data++;
+        len--;
+        if (msgs->prefixlen < GRPC_PREFIX_LEN) continue;
+
+        uint8_t *p = msgs->prefix;
+        msgs->left = ((uint32_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+        msgs->prefixlen = 0;
+        gs->call.msgs[m]++;
+        gs->call.bytes[m] += msgs->left;
+    }
+}
+
+// num bytes of a DATA frame's payload, of the dir->need still to come
+static void
+grpcData(http2_state_t *h2, http2_dir_t *dir, uint8_t *data, size_t num)
+{
+    grpc_stream_t *gs = dir->data;
+
+    // The call could have ended from the other direction
+    if (gs->stream != dir->stream) {
+        dir->data = NULL;
+        return;
+    }
+
+    size_t need = dir->need;
+    if (dir->padded && num) {
+        dir->pad = data[0];
+        dir->padded = FALSE;
+        data++;
+        num--;
+        need--;
+    }
+
+    // The padding is at the end
+    if (need <= dir->pad) return;
+    if (num > need - dir->pad) num = need - dir->pad;
+
+    int m = ((dir - h2->dir) == gs->reqdir) ? 0 : 1;
+    grpcMessages(gs, m, data, num);
+}
+
+// A whole header block has arrived
+static void
+http2Block(http2_state_t *h2, http2_dir_t *dir, httpId_t *httpId)
+{
+    http2_msg_t msg = {0};
+    msg.grpcstatus = -1;
+
+    // Every block has to go through the decoder to keep its table right,
+    // even the ones we won't report.
+    if (hpackDecode(dir->hpack, dir->block, dir->blocklen, http2MsgField, &msg)) {
+        h2->broken = TRUE;
+    } else if (!dir->promise) {
+        size_t len;
+        char *hdr = http2MsgHeader(&msg, &len);
+        protocol_info *proto = newHttpPost(httpId, hdr, len, dir->blockstream);
+        if (proto) {
+            // DATA frames aren't followed by stream, so there's no transfer
+            // time; the header counts as arriving when its block was done
+            http_post *post = (http_post *)proto->data;
+            if (!msg.status) h2->nreq++;
+            post->first_byte = post->start_duration;
+            post->conn_req = h2->nreq;
+            sendHttp(proto);
+        }
+
+        // A gRPC call starts with its request, and ends with the trailers
+        // on its response (or just a header, if there's no response)
+        int d = dir - h2->dir;
+        grpc_stream_t *gs = grpcFind(h2, dir->blockstream);
+        if (msg.grpc && msg.method && msg.path && !msg.status) {
+            grpcStart(h2, d, dir->blockstream, msg.path);
+            msg.path = NULL;
+        } else if (gs && (d != gs->reqdir) && dir->blockend) {
+            grpcEnd(gs, msg.grpcstatus, httpId);
+        }
+    }
+
+    http2MsgFree(&msg);
+    dir->blocklen = 0;
+    dir->blockstream = 0;
+    dir->promise = FALSE;
+    dir->blockend = FALSE;
+}
+
+// The payload of a frame in the header block is in; drop its padding and
+// the fields that aren't part of the block
+static int
+http2BlockFrame(http2_dir_t *dir)
+{
+    uint8_t *payload = &dir->block[dir->framestart];
+    size_t len = dir->blocklen - dir->framestart;
+    size_t skip = 0, pad = 0;
+
+    if ((dir->type != H2_CONTINUATION) && (dir->flags & H2_PADDED)) {
+        if (len < 1) return -1;
+        pad = payload[0];
+        skip = 1;
+    }
+    if ((dir->type == H2_HEADERS) && (dir->flags & H2_PRIORITY)) skip += 5;
+    if (dir->type == H2_PUSH_PROMISE) skip += 4;   // promised stream id
+
+    if (skip + pad > len) return -1;
+    memmove(payload, &payload[skip], len - skip - pad);
+    dir->blocklen -= skip + pad;
     return 0;
 }
 
+static void
+http2Frame(http2_state_t *h2, http2_dir_t *dir, httpId_t *httpId)
+{
+    switch (dir->type) {
+        case H2_HEADERS:
+        case H2_PUSH_PROMISE:
+        case H2_CONTINUATION:
+            if (http2BlockFrame(dir)) {
+                h2->broken = TRUE;
+                return;
+            }
+            if (dir->flags & H2_END_HEADERS) http2Block(h2, dir, httpId);
+            break;
+        case H2_RST_STREAM: {
+            grpc_stream_t *gs = grpcFind(h2, dir->stream);
+            if (gs) grpcEnd(gs, grpcResetStatus(dir->rst), httpId);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static int
+http2FrameStart(http2_state_t *h2, http2_dir_t *dir)
+{
+    uint8_t *f = dir->fhdr;
+    dir->need = (f[0] << 16) | (f[1] << 8) | f[2];
+    dir->type = f[3];
+    dir->flags = f[4];
+    dir->stream = ((f[5] & 0x7f) << 24) | (f[6] << 16) | (f[7] << 8) | f[8];
+
+    // Nothing may come between a header block's frames
+    int inblock = (dir->blockstream != 0);
+    int isblock = (dir->type == H2_HEADERS) || (dir->type == H2_PUSH_PROMISE) ||
+                  (dir->type == H2_CONTINUATION);
+    if (inblock != (dir->type == H2_CONTINUATION)) return -1;
+    if (inblock && (dir->stream != dir->blockstream)) return -1;
+
+    dir->data = NULL;
+    if (dir->type == H2_RST_STREAM) {
+        if (!dir->stream || (dir->need != H2_RST_LEN)) return -1;
+    } else if ((dir->type == H2_DATA) && dir->stream) {
+        dir->data = grpcFind(h2, dir->stream);
+        dir->padded = (dir->flags & H2_PADDED) != 0;
+        dir->pad = 0;
+    }
+    if (!isblock) return 0;
+    if (!dir->stream) return -1;
+
+    if (!inblock) {
+        dir->blockstream = dir->stream;
+        dir->promise = (dir->type == H2_PUSH_PROMISE);
+        dir->blockend = (dir->flags & H2_END_STREAM) != 0;
+    }
+
+    // Collect the payload on the end of the block
+    size_t want = dir->blocklen + dir->need;
+    if (want > H2_MAX_BLOCK) return -1;
+    if (want > dir->blockalloc) {
+        size_t alloc = (dir->blockalloc) ? dir->blockalloc : MIN_HDR_ALLOC;
+        while (alloc < want) alloc <<= 1;
+        uint8_t *temp = realloc(dir->block, alloc);
+        if (!temp) {
+            DBG(NULL);
+            return -1;
+        }
+        dir->block = temp;
+        dir->blockalloc = alloc;
+    }
+    dir->framestart = dir->blocklen;
+    return 0;
+}
+
+static bool
+scanForHttp2(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId)
+{
+    http2_state_t *h2 = httpstate->h2;
+
+    // Same "double interception" concern as HTTP/1.X; see scanForHttpHeader
+    if (h2->isSsl != httpId->isSsl) return FALSE;
+    if (h2->broken) return TRUE;
+
+    http2_dir_t *dir = &h2->dir[httpDir(httpId->src)];
+    uint8_t *data = (uint8_t *)buf;
+
+    while (len && !h2->broken) {
+        if (dir->skip) {
+            size_t num = (len < dir->skip) ? len : dir->skip;
+            dir->skip -= num;
+            data += num;
+            len -= num;
+            continue;
+        }
+
+        if (dir->fhdrlen < H2_FRAME_HDR_LEN) {
+            size_t num = H2_FRAME_HDR_LEN - dir->fhdrlen;
+            if (num > len) num = len;
+            memcpy(&dir->fhdr[dir->fhdrlen], data, num);
+            dir->fhdrlen += num;
+            data += num;
+            len -= num;
+            if (dir->fhdrlen < H2_FRAME_HDR_LEN) break;
+
+            if (http2FrameStart(h2, dir)) {
+                h2->broken = TRUE;
+                break;
+            }
+        }
+
+        size_t num = (len < dir->need) ? len : dir->need;
+        if (dir->blockstream && num) {
+            memcpy(&dir->block[dir->blocklen], data, num);
+            dir->blocklen += num;
+        } else if (dir->type == H2_RST_STREAM) {
+            memcpy(&dir->rst[H2_RST_LEN - dir->need], data, num);
+        } else if (dir->data && num) {
+            grpcData(h2, dir, data, num);
+        }
+        dir->need -= num;
+        data += num;
+        len -= num;
+
+        if (!dir->need) {
+            http2Frame(h2, dir, httpId);
+            dir->fhdrlen = 0;
+        }
+    }
+
+    if (h2->broken) {
+        // Don't hold on to what we can't use
+        scopeLog("WARN: HTTP/2 decoding stopped", httpId->sockfd, CFG_LOG_WARN);
+        int i;
+        for (i = 0; i < 2; i++) {
+            hpackDestroy(&h2->dir[i].hpack);
+        }
+    }
+
+    // Either way, this is HTTP/2; nothing else should look at it
+    return TRUE;
+}
+
+// A whole header is in httpstate->hdr; report it and set up for its body
+static void
+endHttpHeader(http_state_t *httpstate, httpId_t *httpId)
+{
+    http_framing_t framing;
+    getFraming(httpstate->hdr, &framing);
+
+    http_body_t *body = &httpstate->body[httpDir(httpId->src)];
+    endHttpBody(body);
+    memset(body, 0, sizeof(*body));
+    body->isSsl = httpId->isSsl;
+
+    if (!framing.isResponse) {
+        httpstate->nreq++;
+
+        // Remember what its response needs to know; past HTTP_REQ_MAX
+        // requests in the pipe, the oldest are forgotten
+        if (httpstate->npending == HTTP_REQ_MAX) {
+            httpstate->pending >>= HTTP_REQ_BITS;
+            httpstate->npending--;
+        }
+        httpstate->pending |= (uint64_t)framing.req << (httpstate->npending * HTTP_REQ_BITS);
+        httpstate->npending++;
+
+        if (framing.chunked) {
+            body->state = HTTP_BODY_CHUNK_SIZE;
+        } else if ((framing.clen != -1) && framing.clen) {
+            body->state = HTTP_BODY_LENGTH;
+            body->left = framing.clen;
+        }
+        sendHttp(takeHttpHeader(httpstate));
+        return;
+    }
+
+    // Interim responses (100 Continue, 103 Early Hints) have no body and
+    // aren't the answer to the request; the real response follows.
+    if ((framing.status >= 100) && (framing.status < 200)) {
+        if (framing.status == 101) {
+            // Switching Protocols; what follows in both directions isn't
+            // HTTP/1.X any more
+            httpstate->body[0].state = HTTP_BODY_CLOSE;
+            httpstate->body[1].state = HTTP_BODY_CLOSE;
+            httpstate->body[0].isSsl = httpstate->body[1].isSsl = httpId->isSsl;
+        }
+        setHttpState(httpstate, HTTP_NONE);
+        return;
+    }
+
+    int req = 0;
+    if (httpstate->npending) {
+        req = httpstate->pending & ((1 << HTTP_REQ_BITS) - 1);
+        httpstate->pending >>= HTTP_REQ_BITS;
+        httpstate->npending--;
+    }
+
+    // RFC 7230 3.3.3, in order
+    int tunnel = FALSE;
+    if ((req & HTTP_REQ_HEAD) || (framing.status == 204) || (framing.status == 304)) {
+        body->state = HTTP_BODY_NONE;
+    } else if ((req & HTTP_REQ_CONNECT) && (framing.status < 300)) {
+        // A tunnel
+        httpstate->body[0].state = HTTP_BODY_CLOSE;
+        httpstate->body[1].state = HTTP_BODY_CLOSE;
+        httpstate->body[0].isSsl = httpstate->body[1].isSsl = httpId->isSsl;
+        tunnel = TRUE;
+    } else if (framing.chunked) {
+        body->state = HTTP_BODY_CHUNK_SIZE;
+    } else if (framing.encoded) {
+        body->state = HTTP_BODY_CLOSE;
+    } else if (framing.clen != -1) {
+        body->state = (framing.clen) ? HTTP_BODY_LENGTH : HTTP_BODY_NONE;
+        body->left = framing.clen;
+    } else {
+        body->state = HTTP_BODY_CLOSE;
+    }
+
+    // The response goes now; when its body ends, that follows it for
+    // the transfer time
+    protocol_info *proto = takeHttpHeader(httpstate);
+    if (proto && (body->state != HTTP_BODY_NONE) && !tunnel) {
+        ((http_post *)proto->data)->timed = TRUE;
+        body->timed = TRUE;
+        body->id = *httpId;
+    }
+    sendHttp(proto);
+}
 
 /*
  * If we have an fd check for TCP
  * If we don't have a socket it can mean we are
  * called from certain TLS sessions; not an error
  *
- * If we are working down a content length, no
- * need to scan for a header
+ * Each direction of a connection is framed on its own: a header, then
+ * its body, then the next header.  Bodies are skipped over by length
+ * or by chunk without being searched, and pipelined messages in one
+ * buffer are each found.
  *
  * Note that, at this point, we are not able to
- * use a content length optimization with gnutls
- * because it does not return a file descriptor
- * that is usable
+ * frame bodies with gnutls because it does not
+ * return a file descriptor that is usable
 */
 static bool
 scanForHttpHeader(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId)
 {
     if (!buf) return FALSE;
 
+    http_body_t *body = &httpstate->body[httpDir(httpId->src)];
+
     // We need to handle "double interception" when ssl is involved, e.g.
     // intercepting an SSL_write(), then intercepting the write() it calls.
     // We use the isSSL flag to prevent interleaving ssl and non-ssl data.
@@ -247,88 +1176,139 @@ scanForHttpHeader(http_state_t *httpstate, char *buf, size_t len, httpId_t *http
         int headerCaptureInProgress = httpstate->state != HTTP_NONE;
         int isSslIsConsistent = httpstate->id.isSsl == httpId->isSsl;
         if (headerCaptureInProgress && !isSslIsConsistent) return FALSE;
-    }
 
-    // Skip data if instructed to do so by previous content length
-    if (httpstate->state == HTTP_DATA) {
-        size_t bts = bytesToSkipForContentLength(httpstate, len);
-        if (bts == len) return FALSE;
-        buf = &buf[bts];
-        len = len - bts;
-        setHttpState(httpstate, HTTP_NONE);
+        int bodyInProgress = body->state != HTTP_BODY_NONE;
+        if (bodyInProgress && (body->isSsl != httpId->isSsl)) return FALSE;
     }
 
-    // Look for start of http header
-    if (httpstate->state == HTTP_NONE) {
+    int found_header = FALSE;
+    size_t pos = 0;
 
-        // find the start of http header data
-        if (searchExec(g_http_start, buf, len) == -1) return FALSE;
+    while (pos < len) {
 
-        setHttpState(httpstate, HTTP_HDR);
-        httpstate->id = *httpId;
-    }
+        // Skip the body of the last header
+        if (body->state != HTTP_BODY_NONE) {
+            pos += skipBody(body, &buf[pos], len - pos);
+            if (body->state == HTTP_BODY_NONE) endHttpBody(body);
+            continue;
+        }
+
+        // Look for start of http header
+        if (httpstate->state == HTTP_NONE) {
 
-    // Look for header data
-    size_t header_start = 0;
-    size_t header_end = -1;
-    int found_end_of_all_headers = FALSE;
-    while ((httpstate->state == HTTP_HDR || httpstate->state == HTTP_HDREND) &&
-           (header_start < len)) {
+            // find the start of http header data
+            size_t ix = searchExec(g_http_start, &buf[pos], len - pos);
+            if (ix == -1) break;
 
-        header_end =
-            searchExec(g_http_end, &buf[header_start], len-header_start);
+            // and back up to the start of its line
+            char *nl = memrchr(&buf[pos], '\n', ix);
+            if (nl) pos = nl - buf + 1;
 
-        if (header_end == -1) {
-            // We didn't find an end in this buffer, append the rest of the
-            // buffer to what we've found before.
             setHttpState(httpstate, HTTP_HDR);
-            appendHeader(httpstate, &buf[header_start], len-header_start);
-            break;
-        } else {
-            found_end_of_all_headers =
-                ((httpstate->state == HTTP_HDREND) && (header_end == 0));
-            if (found_end_of_all_headers) break;
-
-            // We found a complete header!
-            setHttpState(httpstate, HTTP_HDREND);
-            header_end += header_start;  // was measured from header_start
-            header_end += searchLen(g_http_end);
-            appendHeader(httpstate, &buf[header_start], header_end-header_start);
-            header_start = header_end;
+            httpstate->id = *httpId;
+            httpstate->first_byte = getTime();
         }
-    }
 
-    // Found the end of all headers!  Time to report something!
-    if (found_end_of_all_headers) {
+        // Look for the blank line at the end of the header.  It may have
+        // started at the end of the last buffer.
+        int found_end_of_all_headers = FALSE;
+        size_t k;
+        for (k = HDR_END_LEN - 1; k > 0; k--) {
+            if ((httpstate->hdrlen >= k) && (len - pos >= HDR_END_LEN - k) &&
+                !memcmp(&httpstate->hdr[httpstate->hdrlen - k], HDR_END, k) &&
+                !memcmp(&buf[pos], &HDR_END[k], HDR_END_LEN - k)) {
+                // Keep through the CRLF of the last line, and no further
+                if (k >= 2) {
+                    httpstate->hdrlen -= k - 2;
+                } else {
+                    appendHeader(httpstate, &buf[pos], 2 - k);
+                }
+                pos += HDR_END_LEN - k;
+                found_end_of_all_headers = TRUE;
+                break;
+            }
+        }
 
-        // append a null terminator to allow us to treat it as a string
-        appendHeader(httpstate, "\0", 1);
+        if (!found_end_of_all_headers) {
+            size_t header_end =
+                searchExec(g_http_hdr_end, &buf[pos], len - pos);
+
+            if (header_end == -1) {
+                // We didn't find an end in this buffer, append the rest of the
+                // buffer to what we've found before.
+                appendHeader(httpstate, &buf[pos], len - pos);
+                pos = len;
+            } else {
+                appendHeader(httpstate, &buf[pos], header_end + strlen(HTTP_END));
+                pos += header_end + HDR_END_LEN;
+                found_end_of_all_headers = TRUE;
+            }
+        }
 
-        // check to see if there is a Content-Length in the header
-        size_t clen = getContentLength(httpstate->hdr, httpstate->hdrlen);
-        size_t content_in_this_buf = len - header_end;
+        // Found the end of all headers!  Time to report something!
+        // (Unless appendHeader gave up on a header that's too big.)
+        if (found_end_of_all_headers && (httpstate->state == HTTP_HDR)) {
 
-        // post and event containing the header we found
-        reportHttp(httpstate);
+            // append a null terminator to allow us to treat it as a string
+            appendHeader(httpstate, "\0", 1);
 
-        // change httpstate to HTTP_DATA per Content-Length or HTTP_NONE
-        if ((clen != -1) && (clen >= content_in_this_buf)) {
-            httpstate->clen = clen - content_in_this_buf;
-            setHttpState(httpstate, HTTP_DATA);
-        } else {
+            if (httpstate->state == HTTP_HDR) {
+                endHttpHeader(httpstate, httpId);
+                found_header = TRUE;
+            }
             setHttpState(httpstate, HTTP_NONE);
         }
     }
 
-    return (found_end_of_all_headers);
+    return found_header;
+}
+
+static bool
+scanForHttp(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId, int persistent)
+{
+    if (!buf) return FALSE;
+
+    if (httpstate->h2) return scanForHttp2(httpstate, buf, len, httpId);
+
+    // A client starts an HTTP/2 connection with the preface.  Following
+    // the connection takes state that lasts longer than one buffer.
+    if (persistent && (httpstate->state == HTTP_NONE) &&
+        (len >= H2_PREFACE_LEN) && !memcmp(buf, H2_PREFACE, H2_PREFACE_LEN)) {
+        if ((httpstate->h2 = http2Create(httpId)) == NULL) return FALSE;
+        httpstate->h2->dir[httpDir(httpId->src)].skip = H2_PREFACE_LEN;
+        return scanForHttp2(httpstate, buf, len, httpId);
+    }
+
+    return scanForHttpHeader(httpstate, buf, len, httpId);
 }
 
 void
 initHttpState(void)
 {
     g_http_start = searchComp(HTTP_START);
-    g_http_end = searchComp(HTTP_END);
-    g_http_clen = searchComp(CONTENT_LENGTH);
+    g_http_hdr_end = searchComp(HDR_END);
+
+    // Blocks out may still be on their way back; keep the pools we have
+    if (!g_hdrpool[0]) {
+        g_hdrpool[0] = evtPoolCreate(MIN_HDR_ALLOC, HDR_POOL_MEM / 2 / MIN_HDR_ALLOC);
+    }
+    if (!g_hdrpool[1]) {
+        g_hdrpool[1] = evtPoolCreate(MAX_HDR_ALLOC, HDR_POOL_MEM / 2 / MAX_HDR_ALLOC);
+    }
+}
+
+void
+httpHdrPoolStats(evt_pool_stats_t *stats)
+{
+    if (!stats) return;
+
+    evt_pool_stats_t small, big;
+    evtPoolStats(g_hdrpool[0], &small);
+    evtPoolStats(g_hdrpool[1], &big);
+    stats->allocs = small.allocs + big.allocs;
+    stats->exhausted = small.exhausted + big.exhausted;
+    stats->failed = small.failed + big.failed;
+    stats->slabbytes = small.slabbytes + big.slabbytes;
 }
 
 // allow all ports if they appear to have an HTTP header
@@ -344,7 +1324,7 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
     if (!setHttpId(&httpId, net, sockfd, id, src)) return FALSE;
 
     int guard_enabled = g_http_guard_enabled && net;
-    if (guard_enabled) while (!atomicCasU64(&g_http_guard[sockfd], 0ULL, 1ULL));
+    if (guard_enabled) while (!atomicCasU64(&g_http_guard[HTTP_GUARD_INDEX(sockfd)], 0ULL, 1ULL));
 
     int http_header_found = FALSE;
 
@@ -360,7 +1340,7 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
     switch (dtype) {
         case BUF:
         {
-            http_header_found = scanForHttpHeader(httpstate, buf, len, &httpId);
+            http_header_found = scanForHttp(httpstate, buf, len, &httpId, (net != NULL));
             break;
         }
 
@@ -373,7 +1353,7 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
             for (i = 0; i < msg->msg_iovlen; i++) {
                 iov = &msg->msg_iov[i];
                 if (iov && iov->iov_base) {
-                    if (scanForHttpHeader(httpstate, iov->iov_base, iov->iov_len, &httpId)) {
+                    if (scanForHttp(httpstate, iov->iov_base, iov->iov_len, &httpId, (net != NULL))) {
                         http_header_found = TRUE;
                         // stay in loop to count down content length
                     }
@@ -391,7 +1371,7 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
 
             for (i = 0; i < iovcnt; i++) {
                 if (iov[i].iov_base) {
-                    if (scanForHttpHeader(httpstate, iov[i].iov_base, iov[i].iov_len, &httpId)) {
+                    if (scanForHttp(httpstate, iov[i].iov_base, iov[i].iov_len, &httpId, (net != NULL))) {
                         http_header_found = TRUE;
                         // stay in loop to count down content length
                     }
@@ -405,12 +1385,14 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
             break;
     }
 
-    // If our state is temporary, clean up after each doHttp call
+    // If our state is temporary, clean up after each doHttp call; a body
+    // it's in the middle of hasn't ended
     if (httpstate == &tempstate) {
-        setHttpState(httpstate, HTTP_NONE);
+        tempstate.body[0].timed = tempstate.body[1].timed = FALSE;
+        resetHttp(httpstate);
     }
 
-    if (guard_enabled) while (!atomicCasU64(&g_http_guard[sockfd], 1ULL, 0ULL));
+    if (guard_enabled) while (!atomicCasU64(&g_http_guard[HTTP_GUARD_INDEX(sockfd)], 1ULL, 0ULL));
 
     return http_header_found;
 }
@@ -418,6 +1400,11 @@ doHttp(uint64_t id, int sockfd, net_info *net, char *buf, size_t len, metric_t s
 void
 resetHttp(http_state_t *httpstate)
 {
+    if (!httpstate) return;
     setHttpState(httpstate, HTTP_NONE);
+    endHttpBody(&httpstate->body[0]);
+    endHttpBody(&httpstate->body[1]);
+    http2Destroy(&httpstate->h2);
+    memset(httpstate, 0, sizeof(*httpstate));
 }
 
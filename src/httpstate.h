@@ -1,6 +1,7 @@
 #ifndef __HTTPSTATE_H__
 #define __HTTPSTATE_H__
 
+#include "evtpool.h"
 #include "report.h"
 #include "state.h"
 #include "state_private.h"
@@ -8,5 +9,8 @@
 void initHttpState(void);
 bool doHttp(uint64_t, int, net_info*, char*, size_t, metric_t, src_data_t);
 void resetHttp(http_state_t *httpstate);
+// Header buffers handed out, what the pools hold, and headers dropped
+// because they were full (failed)
+void httpHdrPoolStats(evt_pool_stats_t *);
 
 #endif // __HTTPSTATE_H__
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "mpsearch.h"
+#include "scopetypes.h"
+
+#define ROOT 0
+#define NO_ID -1
+
+// Node 0 is the root, which is never anyone's child, so 0 also means none
+typedef struct {
+    uint32_t child;       // first child
+    uint32_t sibling;     // next child of the same parent
+    uint32_t fail;        // longest proper suffix of this one in the trie
+    uint32_t out;         // this or the nearest node on the fail chain
+                          //   that ends strings
+    int32_t id;           // first string that ends here
+    unsigned char c;      // byte on the way in from the parent
+} node_t;
+
+typedef struct {
+    node_t *node;
+    uint32_t count;
+    uint32_t size;
+    uint32_t root[256];   // children of the root; set by build
+} trie_t;
+
+struct _mpsearch_t {
+    trie_t anchored;
+    trie_t floating;
+    int32_t next[MPSEARCH_MAX_STRINGS]; // next string ending at the same node
+    unsigned int count;
+    int built;
+};
+
+
+static int
+trieInit(trie_t *trie)
+{
+    trie->size = 64;
+    if ((trie->node = calloc(trie->size, sizeof(node_t))) == NULL) {
+        DBG(NULL);
+        return FALSE;
+    }
+    trie->node[ROOT].id = NO_ID;
+    trie->count = 1;
+    return TRUE;
+}
+
+static uint32_t
+childOf(trie_t *trie, uint32_t n, unsigned char c)
+{
+    uint32_t child;
+    for (child = trie->node[n].child; child; child = trie->node[child].sibling) {
+        if (trie->node[child].c == c) return child;
+    }
+    return 0;
+}
+
+static uint32_t
+addChild(trie_t *trie, uint32_t n, unsigned char c)
+{
+    if (trie->count == trie->size) {
+        node_t *node = realloc(trie->node, trie->size * 2 * sizeof(node_t));
+        if (!node) {
+            DBG(NULL);
+            return 0;
+        }
+        trie->node = node;
+        trie->size *= 2;
+    }
+
+    uint32_t child = trie->count++;
+    node_t *new = &trie->node[child];
+    memset(new, 0, sizeof(*new));
+    new->id = NO_ID;
+    new->c = c;
+    new->sibling = trie->node[n].child;
+    trie->node[n].child = child;
+    return child;
+}
+
+mpsearch_t *
+mpsearchCreate(void)
+{
+    mpsearch_t *mps = calloc(1, sizeof(*mps));
+    if (!mps) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    if (!trieInit(&mps->anchored) || !trieInit(&mps->floating)) {
+        mpsearchDestroy(&mps);
+        return NULL;
+    }
+    return mps;
+}
+
+void
+mpsearchDestroy(mpsearch_t **mps_ptr)
+{
+    if (!mps_ptr || !*mps_ptr) return;
+
+    mpsearch_t *mps = *mps_ptr;
+    if (mps->anchored.node) free(mps->anchored.node);
+    if (mps->floating.node) free(mps->floating.node);
+    free(mps);
+    *mps_ptr = NULL;
+}
+
+int
+mpsearchAdd(mpsearch_t *mps, const unsigned char *str, size_t len, int anchored)
+{
+    if (!mps || !str || !len || mps->built ||
+        (mps->count >= MPSEARCH_MAX_STRINGS)) return -1;
+
+    trie_t *trie = (anchored) ? &mps->anchored : &mps->floating;
+    uint32_t n = ROOT;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        uint32_t child = childOf(trie, n, str[i]);
+        if (!child && ((child = addChild(trie, n, str[i])) == 0)) return -1;
+        n = child;
+    }
+
+    int id = mps->count++;
+    mps->next[id] = trie->node[n].id;
+    trie->node[n].id = id;
+    return id;
+}
+
+static int
+trieBuild(trie_t *trie)
+{
+    uint32_t *queue = malloc(trie->count * sizeof(uint32_t));
+    if (!queue) {
+        DBG(NULL);
+        return FALSE;
+    }
+
+    // Breadth first, so that a node's fail is done before its children's
+    uint32_t head = 0, tail = 0;
+    uint32_t child;
+    node_t *node = trie->node;
+    for (child = node[ROOT].child; child; child = node[child].sibling) {
+        trie->root[node[child].c] = child;
+        node[child].fail = ROOT;
+        node[child].out = (node[child].id != NO_ID) ? child : 0;
+        queue[tail++] = child;
+    }
+
+    while (head < tail) {
+        uint32_t n = queue[head++];
+        for (child = node[n].child; child; child = node[child].sibling) {
+            unsigned char c = node[child].c;
+            uint32_t f = node[n].fail;
+            while (f && !childOf(trie, f, c)) f = node[f].fail;
+            uint32_t fail = (f) ? childOf(trie, f, c) : trie->root[c];
+            node[child].fail = fail;
+            node[child].out = (node[child].id != NO_ID) ? child : node[fail].out;
+            queue[tail++] = child;
+        }
+    }
+
+    free(queue);
+    return TRUE;
+}
+
+int
+mpsearchBuild(mpsearch_t *mps)
+{
+    if (!mps) return FALSE;
+
+    // The anchored trie is only walked from the root; no fail links
+    trie_t *anchored = &mps->anchored;
+    uint32_t child;
+    for (child = anchored->node[ROOT].child; child; child = anchored->node[child].sibling) {
+        anchored->root[anchored->node[child].c] = child;
+    }
+
+    if (!trieBuild(&mps->floating)) return FALSE;
+
+    mps->built = TRUE;
+    return TRUE;
+}
+
+unsigned int
+mpsearchCount(mpsearch_t *mps)
+{
+    return (mps) ? mps->count : 0;
+}
+
+static int
+addHits(mpsearch_t *mps, int32_t id, uint64_t *hits)
+{
+    int found = 0;
+    for (; id != NO_ID; id = mps->next[id]) {
+        uint64_t bit = 1ULL << (id % 64);
+        if (hits[id / 64] & bit) continue;
+        hits[id / 64] |= bit;
+        found++;
+    }
+    return found;
+}
+
+int
+mpsearchExec(mpsearch_t *mps, const unsigned char *buf, size_t len, uint64_t *hits)
+{
+    if (!mps || !mps->built || !hits) return -1;
+
+    memset(hits, 0, MPSEARCH_WORDS(mps->count) * sizeof(uint64_t));
+    if (!buf || !mps->count) return 0;
+
+    int found = 0;
+    size_t i;
+
+    // Strings that have to be at the start
+    node_t *node = mps->anchored.node;
+    uint32_t n = ROOT;
+    for (i = 0; i < len; i++) {
+        n = (n == ROOT) ? mps->anchored.root[buf[i]] : childOf(&mps->anchored, n, buf[i]);
+        if (!n) break;
+        found += addHits(mps, node[n].id, hits);
+    }
+
+    // And the ones that can be anywhere
+    trie_t *trie = &mps->floating;
+    if (!trie->node[ROOT].child) return found;
+
+    node = trie->node;
+    n = ROOT;
+    for (i = 0; i < len; i++) {
+        unsigned char c = buf[i];
+        uint32_t next = 0;
+        while (n && ((next = childOf(trie, n, c)) == 0)) n = node[n].fail;
+        if (!n) next = trie->root[c];
+        n = next;
+
+        uint32_t out;
+        for (out = node[n].out; out; out = node[node[out].fail].out) {
+            found += addHits(mps, node[out].id, hits);
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,44 @@
+#ifndef __MPSEARCH_H__
+#define __MPSEARCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// This searches data for many literal strings at once, in one pass over
+// the data, where a search_t per string would take a pass per string.
+//
+// The lifecycle:
+//    mpsearchCreate()
+//    mpsearchAdd() for each string, which returns the id it's known by
+//    mpsearchBuild()
+//    mpsearchExec() as often as needed, from any number of threads
+//    mpsearchDestroy()
+//
+// Ids are given out from 0, in the order strings are added.  A string
+// added as anchored is only found at the start of the data; the others
+// are found anywhere in it (Aho-Corasick).  Matching is on bytes and is
+// case sensitive; NUL bytes are data like any other.
+//
+// mpsearchExec() clears hits, then sets bit (id % 64) of hits[id / 64]
+// for every string it finds.  hits needs MPSEARCH_WORDS(mpsearchCount())
+// elements.  It returns the number of different strings found, or -1 if
+// the object hasn't been built.
+//
+
+#define MPSEARCH_MAX_STRINGS 1024
+#define MPSEARCH_WORDS(n) (((n) + 63) / 64)
+
+typedef struct _mpsearch_t mpsearch_t;
+
+mpsearch_t*   mpsearchCreate(void);
+void          mpsearchDestroy(mpsearch_t **);
+
+// Returns the id of the string, or -1 if it can't be added
+int           mpsearchAdd(mpsearch_t *, const unsigned char *, size_t, int anchored);
+int           mpsearchBuild(mpsearch_t *);
+unsigned int  mpsearchCount(mpsearch_t *);
+
+int           mpsearchExec(mpsearch_t *, const unsigned char *, size_t, uint64_t *hits);
+
+#endif // __MPSEARCH_H__
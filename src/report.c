@@ -4,6 +4,7 @@
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <fcntl.h>
@@ -11,14 +12,17 @@
 #include "atomic.h"
 #include "com.h"
 #include "dbg.h"
+#include "dnsresp.h"
+#include "evtpool.h"
 #include "fn.h"
+#include "grpcagg.h"
 #include "httpagg.h"
+#include "httpstate.h"
 #include "mtcformat.h"
 #include "plattime.h"
 #include "report.h"
-#include "search.h"
 #include "state_private.h"
-#include "linklist.h"
+#include "hashmap.h"
 #include "dns.h"
 
 #ifndef AF_NETLINK
@@ -29,6 +33,8 @@
 #define DATA_FIELD(val)         STRFIELD("data",           (val), 1, TRUE)
 #define UNIT_FIELD(val)         STRFIELD("unit",           (val), 1, TRUE)
 #define CLASS_FIELD(val)        STRFIELD("class",          (val), 2, TRUE)
+#define QUEUE_FIELD(val)        STRFIELD("queue",          (val), 2, TRUE)
+#define POOL_FIELD(val)         STRFIELD("pool",           (val), 2, TRUE)
 #define PROTO_FIELD(val)        STRFIELD("proto",          (val), 2, TRUE)
 #define OP_FIELD(val)           STRFIELD("op",             (val), 3, TRUE)
 #define PID_FIELD(val)          NUMFIELD("pid",            (val), 4, TRUE)
@@ -39,6 +45,9 @@
 #define PROC_FIELD(val)         STRFIELD("proc",           (val), 4, TRUE)
 #define HTTPSTAT_FIELD(val)     NUMFIELD("http_status",    (val), 4, TRUE)
 #define DOMAIN_FIELD(val)       STRFIELD("domain",         (val), 5, TRUE)
+#define RCODE_FIELD(val)        STRFIELD("rcode",          (val), 5, TRUE)
+#define ANSWERS_FIELD(val)      NUMFIELD("answers",        (val), 5, TRUE)
+#define TTL_FIELD(val)          NUMFIELD("ttl",            (val), 5, TRUE)
 
 #define FILE_FIELD(val)      STRFIELD("file",              (val), 5, TRUE)
 #define FILE_EV_NAME(val)    STRFIELD("file.name",         (val), 5, TRUE)
@@ -57,6 +66,7 @@
 #define LOCALN_FIELD(val)       NUMFIELD("localn",         (val), 6, TRUE)
 #define PORT_FIELD(val)         NUMFIELD("port",           (val), 6, TRUE)
 #define REMOTEP_FIELD(val)      NUMFIELD("remotep",        (val), 6, TRUE)
+#define REMOTEHOST_FIELD(val)   STRFIELD("remotehost",     (val), 6, TRUE)
 #define REMOTEN_FIELD(val)      NUMFIELD("remoten",        (val), 6, TRUE)
 #define FD_FIELD(val)           NUMFIELD("fd",             (val), 7, TRUE)
 #define ARGS_FIELD(val)         STRFIELD("args",           (val), 7, TRUE)
@@ -68,7 +78,7 @@
 #define DETECT_PROTO(val)       STRFIELD("protocol",       (val), 8, TRUE)
 
 #define EVENT_ONLY_ATTR (CFG_MAX_VERBOSITY+1)
-#define HTTP_MAX_FIELDS 30
+#define HTTP_MAX_FIELDS 34
 #define NET_MAX_FIELDS 16
 #define H_ATTRIB(field, att, val, verbosity) \
     field.name = att; \
@@ -87,12 +97,12 @@
 #define HTTP_NEXT_FLD(n) if (n < HTTP_MAX_FIELDS-1) {n++;}else{DBG(NULL);}
 #define NEXT_FLD(n, max) if (n < max-1) {n+=1;}else{DBG(NULL);}
 
-#define HTTP_STATUS "HTTP/1."
+// doEvent() works through the event queue this many at a time
+#define EVT_BATCH_MIN 1024
+#define EVT_BATCH_MAX DEFAULT_CBUF_SIZE
+#define PAYLOAD_BATCH_SIZE 64
 
 typedef struct http_report_t {
-    char *hreq;
-    char *hres;
-    metric_t ptype;
     int ix;
     size_t clen;
     char rport[8];
@@ -105,9 +115,18 @@ typedef struct http_report_t {
 // and replace it with a measured value.  It'd be one less dependency
 // and could be more accurate.
 int g_interval = DEFAULT_SUMMARY_PERIOD;
-static list_t *g_maplist;
-static search_t *g_http_status = NULL;
+
+// Seconds a request waits for its response before we give up on it
+#define HTTP_MAP_TTL 300
+#define AGG_NAMES_MAX (64 * 1024)
+#define AGG_NAMES_BYTES (8 * 1024 * 1024)
+static hashmap_t *g_maplist;
+static hashmap_t *g_xferlist;
 static http_agg_t *g_http_agg;
+static grpc_agg_t *g_grpc_agg;
+// Targets and methods only live for a period; they're kept out of
+// g_strtab and reclaimed after each report
+static strtab_t *g_aggnames;
 
 static void
 destroyHttpMap(void *data)
@@ -116,16 +135,25 @@ destroyHttpMap(void *data)
     http_map *map = (http_map *)data;
 
     if (map->req) free(map->req);
-    if (map->resp) free(map->resp);
+    if (map->resp) evtPoolFree(map->resp);
     if (map) free(map);
 }
 
 void
 initReporting()
 {
-    g_maplist = lstCreate(destroyHttpMap);
-    g_http_status = searchComp(HTTP_STATUS);
-    g_http_agg = httpAggCreate();
+    g_maplist = hmapCreate(destroyHttpMap);
+    g_xferlist = hmapCreate(free);
+    if (!g_aggnames) g_aggnames = strtabCreate(AGG_NAMES_MAX, AGG_NAMES_BYTES);
+    g_http_agg = httpAggCreate(g_aggnames);
+    g_grpc_agg = grpcAggCreate(g_aggnames);
+}
+
+void
+setHttpAggregation(unsigned max_targets, unsigned normalize)
+{
+    httpAggMaxTargetsSet(g_http_agg, max_targets);
+    httpAggNormalizeSet(g_http_agg, normalize);
 }
 
 void
@@ -309,35 +337,14 @@ getNetInternals(net_info *net, int type,
     if (net && net->dnsName[0]) {
         H_ATTRIB(fields[*ix], "net.peer.name", net->dnsName, 1);
         NEXT_FLD(*ix, maxfld);
+    } else if (net && (net->peerName != STRTAB_NONE)) {
+        H_ATTRIB(fields[*ix], "net.peer.name", strtabStr(g_strtab, net->peerName), 1);
+        NEXT_FLD(*ix, maxfld);
     }
 
     return TRUE;
 }
 
-static size_t
-getHttpStatus(char *header, size_t len, char **stext)
-{
-    size_t ix;
-    size_t rc;
-    char *val;
-
-    // ex: HTTP/1.1 200 OK\r\n
-    if ((ix = searchExec(g_http_status, header, len)) == -1) return -1;
-
-    if ((ix < 0) || (ix > len) || ((ix + strlen(HTTP_STATUS) + 1) > len)) return -1;
-
-    val = &header[ix + strlen(HTTP_STATUS) + 1];
-    // note that the spec defines the status code to be exactly 3 chars/digits
-    *stext = &header[ix + strlen(HTTP_STATUS) + 6];
-
-    errno = 0;
-    rc = strtoull(val, NULL, 0);
-    if ((errno != 0) || (rc == 0)) {
-        return -1;
-    }
-    return rc;
-}
-
 static void
 httpFieldEnd(event_field_t *fields, http_report *hreport)
 {
@@ -348,49 +355,24 @@ httpFieldEnd(event_field_t *fields, http_report *hreport)
 }
 
 static bool
-httpFields(event_field_t *fields, http_report *hreport, char *hdr, size_t hdr_len, protocol_info *proto)
+httpFields(event_field_t *fields, http_report *hreport, char *hdr, http_hdr_t *parsed, protocol_info *proto)
 {
-    if (!fields || !hreport || !proto || !hdr) return FALSE;
+    if (!fields || !hreport || !proto || !hdr || !parsed) return FALSE;
 
     // Start with fields from the header
-    char *savea = NULL, *header;
-    hreport->clen = -1;
-
-    if ((hreport->ptype == EVT_HREQ) && (hreport->hreq)) {
-        strncpy(hreport->hreq, hdr, hdr_len);
-        header = hreport->hreq;
-    } else if ((hreport->ptype == EVT_HRES) && (hreport->hres)) {
-        strncpy(hreport->hres, hdr, hdr_len);
-        header = hreport->hres;
-    } else {
-        scopeLog("WARN: httpFields: proto ptype is not req or resp", proto->fd, CFG_LOG_WARN);
-        return FALSE;
+    if (httpHdrHas(parsed, HTTP_FLD_HOST)) {
+        H_ATTRIB(fields[hreport->ix], "http.host", httpHdrStr(hdr, parsed->fld[HTTP_FLD_HOST]), 1);
+        HTTP_NEXT_FLD(hreport->ix);
     }
-
-    char *reqh = strtok_r(header, "\r\n", &savea);
-    if (!reqh) {
-        scopeLog("WARN: httpFields: parse an http request header", proto->fd, CFG_LOG_WARN);
-        return FALSE;
+    if (httpHdrHas(parsed, HTTP_FLD_USER_AGENT)) {
+        H_ATTRIB(fields[hreport->ix], "http.user_agent", httpHdrStr(hdr, parsed->fld[HTTP_FLD_USER_AGENT]), 5);
+        HTTP_NEXT_FLD(hreport->ix);
     }
-
-    while ((reqh = strtok_r(NULL, "\r\n", &savea)) != NULL) {
-        // From RFC 2616 Section 4.2 "Field names are case-insensitive."
-        if (strcasestr(reqh, "Host:")) {
-            H_ATTRIB(fields[hreport->ix], "http.host", strchr(reqh, ':') + 2, 1);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if (strcasestr(reqh, "User-Agent:")) {
-            H_ATTRIB(fields[hreport->ix], "http.user_agent", strchr(reqh, ':') + 2, 5);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if(strcasestr(reqh, "X-Forwarded-For:")) {
-            H_ATTRIB(fields[hreport->ix], "http.client_ip", strchr(reqh, ':') + 2, 5);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if(strcasestr(reqh, "Content-Length:")) {
-            errno = 0;
-            if (((hreport->clen = strtoull(strchr(reqh, ':') + 2, NULL, 0)) == 0) || (errno != 0)) {
-                hreport->clen = -1;
-            }
-        }
+    if (httpHdrHas(parsed, HTTP_FLD_X_FORWARDED_FOR)) {
+        H_ATTRIB(fields[hreport->ix], "http.client_ip", httpHdrStr(hdr, parsed->fld[HTTP_FLD_X_FORWARDED_FOR]), 5);
+        HTTP_NEXT_FLD(hreport->ix);
     }
+    hreport->clen = parsed->clen;
     return TRUE;
 }
 
@@ -443,15 +425,22 @@ doHttpHeader(protocol_info *proto)
     http_post *post = (http_post *)proto->data;
     http_map *map;
 
-    if ((map = lstFind(g_maplist, post->id)) == NULL) {
+    // HTTP/2 runs many requests at once on a connection; pair each
+    // request with its response by stream as well
+    uint64_t key = (post->stream) ?
+        post->id ^ (post->stream * 0x9E3779B97F4A7C15ULL) : post->id;
+
+    if ((map = hmapFind(g_maplist, key)) == NULL) {
         // lazy open
         if ((map = calloc(1, sizeof(http_map))) == NULL) {
+            evtPoolFree(post->hdr);
             destroyProto(proto);
             return;
         }
 
-        if (lstInsert(g_maplist, post->id, map) == FALSE) {
+        if (hmapInsert(g_maplist, key, map) == FALSE) {
             destroyHttpMap(map);
+            evtPoolFree(post->hdr);
             destroyProto(proto);
             return;
         }
@@ -465,8 +454,6 @@ doHttpHeader(protocol_info *proto)
     map->frequency++;
     ssl = (post->ssl) ? "https" : "http";
     hreport.ix = 0;
-    hreport.hreq = NULL;
-    hreport.hres = NULL;
 
  /*
      * RFC 2616 Section 5 Request
@@ -475,66 +462,65 @@ doHttpHeader(protocol_info *proto)
      * by SP characters. No CR or LF is allowed except in the final CRLF sequence.
      *
      *  Request-Line   = Method SP Request-URI SP HTTP-Version CRLF
+     *
+     * The request is parsed once, here, as it arrives.  The fields are
+     * taken from it in place, for its own event and again for the
+     * response's.  It can wait a long time for that, so it waits in a
+     * copy of its own size and the pool block goes back right away.
      */
     if (proto->ptype == EVT_HREQ) {
+        // a request that never saw a response
+        if (map->req) free(map->req);
+        map->req = malloc(proto->len + 1);
+        if (!map->req) {
+            DBG(NULL);
+            evtPoolFree(post->hdr);
+            if (hmapDelete(g_maplist, key) == FALSE) DBG(NULL);
+            destroyProto(proto);
+            return;
+        }
+        memcpy(map->req, post->hdr, proto->len);
+        map->req[proto->len] = '\0';
+        evtPoolFree(post->hdr);
+        post->hdr = NULL;
+
         map->start_time = post->start_duration;
-        map->req = (char *)post->hdr;
+        map->conn_req = post->conn_req;
         map->req_len = proto->len;
+        if (httpHdrParse(map->req, map->req_len, &map->reqhdr) ||
+            map->reqhdr.isResponse) {
+            scopeLog("WARN: doHttpHeader: parse an http request header", proto->fd, CFG_LOG_WARN);
+            memset(&map->reqhdr, 0, sizeof(map->reqhdr));
+            map->reqhdr.clen = -1;
+        }
     }
 
-    char header[map->req_len];
     // we're either building a new req or we have a previous req
     if (map->req) {
-        if ((hreport.hreq = calloc(1, map->req_len)) == NULL) {
-            scopeLog("ERROR: doHttpHeader: hreq memory allocation failure", proto->fd, CFG_LOG_ERROR);
-            return;
-        }
-
-        char *savea = NULL;
-        strncpy(header, map->req, map->req_len);
-
-        char *headertok = strtok_r(header, "\r\n", &savea);
-        if (!headertok) {
-            scopeLog("WARN: doHttpHeader: parse an http request header", proto->fd, CFG_LOG_WARN);
-            return;
-        }
+        http_hdr_t *reqhdr = &map->reqhdr;
 
         // The request specific values from Request-Line
-        char *method_str = strtok_r(headertok, " ", &savea);
-        if (method_str) {
-            H_ATTRIB(fields[hreport.ix], "http.method", method_str, 1);
+        if (reqhdr->method.len) {
+            H_ATTRIB(fields[hreport.ix], "http.method", httpHdrStr(map->req, reqhdr->method), 1);
             HTTP_NEXT_FLD(hreport.ix);
-        } else {
-            scopeLog("WARN: doHttpHeader: no method in an http request header", proto->fd, CFG_LOG_WARN);
         }
 
-        char *target_str = strtok_r(NULL, " ", &savea);
-        if (target_str) {
-            H_ATTRIB(fields[hreport.ix], "http.target", target_str, 4);
+        if (reqhdr->target.len) {
+            H_ATTRIB(fields[hreport.ix], "http.target", httpHdrStr(map->req, reqhdr->target), 4);
             HTTP_NEXT_FLD(hreport.ix);
-        } else {
-            scopeLog("WARN: doHttpHeader: no target in an http request header", proto->fd, CFG_LOG_WARN);
         }
 
-        char *flavor_str = strtok_r(NULL, " ", &savea);
-        if (flavor_str &&
-            ((flavor_str = strtok_r(flavor_str, "/", &savea))) &&
-            ((flavor_str = strtok_r(NULL, "\r", &savea)))) {
-            if (proto->ptype == EVT_HREQ) {
-                H_ATTRIB(fields[hreport.ix], "http.flavor", flavor_str, 1);
-                HTTP_NEXT_FLD(hreport.ix);
-            }
-        } else {
-            scopeLog("WARN: doHttpHeader: no http version in an http request header", proto->fd, CFG_LOG_WARN);
+        if ((proto->ptype == EVT_HREQ) && reqhdr->flavor.len) {
+            H_ATTRIB(fields[hreport.ix], "http.flavor", httpHdrStr(map->req, reqhdr->flavor), 1);
+            HTTP_NEXT_FLD(hreport.ix);
         }
 
         H_ATTRIB(fields[hreport.ix], "http.scheme", ssl, 1);
         HTTP_NEXT_FLD(hreport.ix);
 
         if (proto->ptype == EVT_HREQ) {
-            hreport.ptype = EVT_HREQ;
             // Fields common to request & response
-            httpFields(fields, &hreport, map->req, map->req_len, proto);
+            httpFields(fields, &hreport, map->req, reqhdr, proto);
             httpFieldsInternal(fields, &hreport, proto);
 
             if (hreport.clen != -1) {
@@ -543,6 +529,11 @@ doHttpHeader(protocol_info *proto)
             }
             map->clen = hreport.clen;
 
+            if (map->conn_req) {
+                H_VALUE(fields[hreport.ix], "http.connection.requests", map->conn_req, EVENT_ONLY_ATTR);
+                HTTP_NEXT_FLD(hreport.ix);
+            }
+
             httpFieldEnd(fields, &hreport);
 
             event_t sendEvent = INT_EVENT("http-req", proto->len, SET, fields);
@@ -564,11 +555,6 @@ doHttpHeader(protocol_info *proto)
     * Status-Line = HTTP-Version SP Status-Code SP Reason-Phrase CRLF
     */
     if (proto->ptype == EVT_HRES) {
-        if ((hreport.hres = calloc(1, proto->len)) == NULL) {
-            scopeLog("ERROR: doHttpHeader: hres memory allocation failure", proto->fd, CFG_LOG_ERROR);
-            return;
-        }
-
         int rps = map->frequency;
         int sec = (map->first_time > 0) ? (int)time(NULL) - map->first_time : 1;
         if (sec > 0) {
@@ -584,42 +570,46 @@ doHttpHeader(protocol_info *proto)
             map->duration = map->duration / 1000000;
         }
 
-        char *stext;
-        size_t status = getHttpStatus((char *)map->resp, proto->len, &stext);
+        http_hdr_t reshdr;
+        if (httpHdrParse(map->resp, proto->len, &reshdr) || !reshdr.isResponse) {
+            scopeLog("WARN: doHttpHeader: parse an http response header", proto->fd, CFG_LOG_WARN);
+            memset(&reshdr, 0, sizeof(reshdr));
+            reshdr.clen = -1;
+        }
+        size_t status = (reshdr.status) ? reshdr.status : -1;
 
         // The response specific values from Status-Line
-        char *savea;
-        char reqheader[proto->len];
-        strncpy(reqheader, map->resp, proto->len);
-
-        char *headertok = strtok_r(reqheader, "\r\n", &savea);
-        char *flavor_str = strtok_r(headertok, " ", &savea);
-        if (flavor_str &&
-            ((flavor_str = strtok_r(flavor_str, "/", &savea))) &&
-            ((flavor_str = strtok_r(NULL, "", &savea)))) {
-            H_ATTRIB(fields[hreport.ix], "http.flavor", flavor_str, 1);
+        if (reshdr.flavor.len) {
+            H_ATTRIB(fields[hreport.ix], "http.flavor", httpHdrStr(map->resp, reshdr.flavor), 1);
             HTTP_NEXT_FLD(hreport.ix);
-        } else {
-            scopeLog("WARN: doHttpHeader: no version string in an http request header", proto->fd, CFG_LOG_WARN);
         }
 
         H_VALUE(fields[hreport.ix], "http.status_code", status, 1);
         HTTP_NEXT_FLD(hreport.ix);
 
-        // point past the status code
-        char st[strlen(stext)];
-        strncpy(st, stext, strlen(stext));
-        char *status_str = strtok_r(st, "\r", &savea);
-        H_ATTRIB(fields[hreport.ix], "http.status_text", status_str, 1);
+        // HTTP/2 has no status text
+        H_ATTRIB(fields[hreport.ix], "http.status_text", httpHdrStr(map->resp, reshdr.reason), 1);
         HTTP_NEXT_FLD(hreport.ix);
 
         H_VALUE(fields[hreport.ix], "http.server.duration", map->duration, EVENT_ONLY_ATTR);
         HTTP_NEXT_FLD(hreport.ix);
 
+        // Where the time went: from the end of the request to the first
+        // byte of the response (the server thinking), then from there to
+        // the last byte of the response (the transfer)
+        if (map->req && (post->first_byte > map->start_time)) {
+            H_VALUE(fields[hreport.ix], "http.ttfb",
+                    getDurationNow(post->first_byte, map->start_time) / 1000000, EVENT_ONLY_ATTR);
+            HTTP_NEXT_FLD(hreport.ix);
+        }
+        if (map->conn_req) {
+            H_VALUE(fields[hreport.ix], "http.connection.requests", map->conn_req, EVENT_ONLY_ATTR);
+            HTTP_NEXT_FLD(hreport.ix);
+        }
+
         // Fields common to request & response
         if (map->req) {
-            hreport.ptype = EVT_HREQ;
-            httpFields(fields, &hreport, map->req, map->req_len, proto);
+            httpFields(fields, &hreport, map->req, &map->reqhdr, proto);
             if (hreport.clen != -1) {
                 H_VALUE(fields[hreport.ix], "http.request_content_length", hreport.clen, EVENT_ONLY_ATTR);
                 HTTP_NEXT_FLD(hreport.ix);
@@ -627,8 +617,7 @@ doHttpHeader(protocol_info *proto)
             map->clen = hreport.clen;
         }
 
-        hreport.ptype = EVT_HRES;
-        httpFields(fields, &hreport, map->resp, proto->len, proto);
+        httpFields(fields, &hreport, map->resp, &reshdr, proto);
         httpFieldsInternal(fields, &hreport, proto);
         if (hreport.clen != -1) {
             H_VALUE(fields[hreport.ix], "http.response_content_length", hreport.clen, EVENT_ONLY_ATTR);
@@ -663,6 +652,25 @@ doHttpHeader(protocol_info *proto)
             // TBD AGG Only cmdSendMetric(g_mtc, &http_dur);
             httpAggAddMetric(g_http_agg, &http_dur, map->clen, hreport.clen);
 
+            // The body is still coming; its transfer time is added when
+            // it's done (doHttpBody())
+            if (post->timed && post->first_byte && map->req && map->reqhdr.target.len) {
+                const char *target = httpHdrStr(map->req, map->reqhdr.target);
+                size_t tlen = strlen(target) + 1;
+                http_xfer *xfer = malloc(sizeof(http_xfer) + tlen);
+                if (xfer) {
+                    xfer->first_time = time(NULL);
+                    xfer->first_byte = post->first_byte;
+                    xfer->status = status;
+                    xfer->isServer = proto->isServer;
+                    memcpy(xfer->target, target, tlen);
+                    hmapDelete(g_xferlist, key);
+                    if (hmapInsert(g_xferlist, key, xfer) == FALSE) free(xfer);
+                } else {
+                    DBG(NULL);
+                }
+            }
+
             /* TBD AGG Only
             if (map->clen != -1) {
                 event_t http_req_len = INT_EVENT("http.request.content_length", map->clen, DELTA, fields);
@@ -677,12 +685,35 @@ doHttpHeader(protocol_info *proto)
 
         }
 
-        // Done; we remove the list entry; complete when reported
-        if (lstDelete(g_maplist, post->id) == FALSE) DBG(NULL);
+        // Done; we remove the map entry; complete when reported
+        if (hmapDelete(g_maplist, key) == FALSE) DBG(NULL);
+    }
+
+    destroyProto(proto);
+}
+
+// The body of a response reported earlier has ended
+static void
+doHttpBody(protocol_info *proto)
+{
+    http_post *post = (http_post *)proto->data;
+    http_xfer *xfer;
+
+    if (post && ((xfer = hmapFind(g_xferlist, post->id)) != NULL)) {
+        if (post->last_byte > xfer->first_byte) {
+            event_field_t fields[] = {
+                STRFIELD("http.target", xfer->target, 4, TRUE),
+                NUMFIELD("http.status_code", xfer->status, 1, TRUE),
+                FIELDEND
+            };
+            char *mtx_name = (xfer->isServer) ? "http.server.transfer" : "http.client.transfer";
+            event_t transfer = INT_EVENT(mtx_name,
+                getDurationNow(post->last_byte, xfer->first_byte) / 1000000, DELTA, fields);
+            httpAggAddMetric(g_http_agg, &transfer, -1, -1);
+        }
+        if (hmapDelete(g_xferlist, post->id) == FALSE) DBG(NULL);
     }
 
-    if (hreport.hreq) free(hreport.hreq);
-    if (hreport.hres) free(hreport.hres);
     destroyProto(proto);
 }
 
@@ -713,6 +744,66 @@ doDetection(protocol_info *proto)
     destroyProto(proto);
 }
 
+// One per DNS response matched with its query, from a resolver
+// we saw on the wire.  The latency and NXDOMAIN/SERVFAIL errors are
+// counted with the others, as DNS_DURATION and NET_ERR_DNS.
+static void
+doDNSAnswer(protocol_info *proto)
+{
+    dns_answer_t *ans = (dns_answer_t *)proto->data;
+    if (!ans) {
+        destroyProto(proto);
+        return;
+    }
+
+    const char *rcode = dnsRcodeName(ans->rcode);
+    uint64_t duration = ans->duration / 1000000; // convert ns to ms.
+
+    event_field_t evfield[] = {
+        DOMAIN_FIELD(ans->name),
+        DURATION_FIELD(duration),
+        RCODE_FIELD(rcode),
+        ANSWERS_FIELD(ans->answers),
+        TTL_FIELD(ans->ttl),
+        FIELDEND
+    };
+    event_t dnsEvent = INT_EVENT("net.dns.answer", ans->answers, SET, evfield);
+    dnsEvent.src = CFG_SRC_DNS;
+    cmdSendEvent(g_ctl, &dnsEvent, proto->uid, &g_proc);
+
+    if (!g_summary.net.dns && mtcEnabled(g_mtc)) {
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            DOMAIN_FIELD(ans->name),
+            RCODE_FIELD(rcode),
+            DURATION_FIELD(duration),
+            UNIT_FIELD("response"),
+            FIELDEND
+        };
+        event_t answer = INT_EVENT("net.dns.answer", 1, DELTA, fields);
+        cmdSendMetric(g_mtc, &answer);
+
+        // Nothing to say about how long to cache no answers
+        if (ans->answers) {
+            event_field_t tfields[] = {
+                PROC_FIELD(g_proc.procname),
+                PID_FIELD(g_proc.pid),
+                HOST_FIELD(g_proc.hostname),
+                DOMAIN_FIELD(ans->name),
+                ANSWERS_FIELD(ans->answers),
+                UNIT_FIELD("second"),
+                FIELDEND
+            };
+            event_t ttl = INT_EVENT("net.dns.ttl", ans->ttl, CURRENT, tfields);
+            cmdSendMetric(g_mtc, &ttl);
+        }
+    }
+
+    destroyProto(proto);
+}
+
 void
 doProtocolMetric(protocol_info *proto)
 {
@@ -720,8 +811,16 @@ doProtocolMetric(protocol_info *proto)
 
     if ((proto->ptype == EVT_HREQ) || (proto->ptype == EVT_HRES)) {
         doHttpHeader(proto);
+    } else if (proto->ptype == EVT_HBODY) {
+        doHttpBody(proto);
+    } else if (proto->ptype == EVT_GRPC) {
+        // Too many calls to report one at a time; they're summarized
+        grpcAggAddCall(g_grpc_agg, (grpc_call_t *)proto->data);
+        destroyProto(proto);
     } else if (proto->ptype == EVT_DETECT) {
         doDetection(proto);
+    } else if (proto->ptype == EVT_DNSRESP) {
+        doDNSAnswer(proto);
     }
 }
 
@@ -1333,7 +1432,7 @@ doNetCloseEvent(net_info *net, uint64_t dur)
                     lport, rport, sizeof(rport),
                     nevent, &nix, NET_MAX_FIELDS);
 
-    if (net->http.state != HTTP_NONE) {
+    if ((net->http.state != HTTP_NONE) || net->http.h2) {
         H_ATTRIB(nevent[nix], "net.protocol", "http", 1);
         NEXT_FLD(nix, NET_MAX_FIELDS);
     }
@@ -1419,10 +1518,10 @@ doFSOpenEvent(fs_info *fs, const char *op)
     counters_element_t *numops = &fs->numOpen;
 
     if (ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) &&
-        (fs->fd > 2) && strncmp(fs->path, "std", 3)) {
+        (fs->fd > 2) && strncmp(strtabStr(g_strtab, fs->path), "std", 3)) {
 
         event_field_t fevent[] = {
-            FILE_EV_NAME(fs->path),
+            FILE_EV_NAME(strtabStr(g_strtab, fs->path)),
             PROC_UID(g_proc.uid),
             PROC_GID(g_proc.gid),
             PROC_CGROUP(g_proc.cgroup),
@@ -1445,10 +1544,10 @@ doFSCloseEvent(fs_info *fs, const char *op)
     const char *metric = "fs.close";
 
     if (ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) &&
-        (fs->fd > 2) && strncmp(fs->path, "std", 3)) {
+        (fs->fd > 2) && strncmp(strtabStr(g_strtab, fs->path), "std", 3)) {
 
         event_field_t fevent[] = {
-            FILE_EV_NAME(fs->path),
+            FILE_EV_NAME(strtabStr(g_strtab, fs->path)),
             PROC_UID(g_proc.uid),
             PROC_GID(g_proc.gid),
             PROC_CGROUP(g_proc.cgroup),
@@ -1477,6 +1576,8 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
 {
     if (!fs) return;
 
+    const char *file = strtabStr(g_strtab, fs->path);
+
     switch (type) {
     case FS_DURATION:
     {
@@ -1496,7 +1597,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
                 FD_FIELD(fs->fd),
                 HOST_FIELD(g_proc.hostname),
                 OP_FIELD(op),
-                FILE_FIELD(fs->path),
+                FILE_FIELD(file),
                 NUMOPS_FIELD(cachedDurationNum),
                 UNIT_FIELD("microsecond"),
                 FIELDEND
@@ -1531,7 +1632,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             FD_FIELD(fs->fd),
             HOST_FIELD(g_proc.hostname),
             OP_FIELD(op),
-            FILE_FIELD(fs->path),
+            FILE_FIELD(file),
             NUMOPS_FIELD(cachedDurationNum),
             UNIT_FIELD("microsecond"),
             FIELDEND
@@ -1555,21 +1656,21 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         const char* metric = "UNKNOWN";
         counters_element_t* numops = NULL;
         counters_element_t* sizebytes = NULL;
-        counters_element_t* global_counter = NULL;
+        shard_ctr_t global_counter = SHARD_MAX;
         const char* err_str = "UNKNOWN";
         switch (type) {
             case FS_READ:
                 metric = "fs.read";
                 numops = &fs->numRead;
                 sizebytes = &fs->readBytes;
-                global_counter = &g_ctrs.readBytes;
+                global_counter = SHARD_READ_BYTES;
                 err_str = "ERROR: doFSMetric:FS_READ:cmdSendMetric";
                 break;
             case FS_WRITE:
                 metric = "fs.write";
                 numops = &fs->numWrite;
                 sizebytes = &fs->writeBytes;
-                global_counter = &g_ctrs.writeBytes;
+                global_counter = SHARD_WRITE_BYTES;
                 err_str = "ERROR: doFSMetric:FS_WRITE:cmdSendMetric";
                 break;
             default:
@@ -1585,7 +1686,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
                 FD_FIELD(fs->fd),
                 HOST_FIELD(g_proc.hostname),
                 OP_FIELD(op),
-                FILE_FIELD(fs->path),
+                FILE_FIELD(file),
                 NUMOPS_FIELD(numops->evt),
                 UNIT_FIELD("byte"),
                 FIELDEND
@@ -1612,7 +1713,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             FD_FIELD(fs->fd),
             HOST_FIELD(g_proc.hostname),
             OP_FIELD(op),
-            FILE_FIELD(fs->path),
+            FILE_FIELD(file),
             NUMOPS_FIELD(numops->mtc),
             UNIT_FIELD("byte"),
             FIELDEND
@@ -1623,7 +1724,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         if (cmdSendMetric(g_mtc, &rwMetric)) {
             scopeLog(err_str, fs->fd, CFG_LOG_ERROR);
         }
-        subFromInterfaceCounts(global_counter, sizebytes->mtc);
+        subFromShardedCounts(global_counter, sizebytes->mtc);
         atomicSwapU64(&numops->mtc, 0);
         atomicSwapU64(&sizebytes->mtc, 0);
 
@@ -1657,7 +1758,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             case FS_SEEK:
                 metric = "fs.op.seek";
                 numops = &fs->numSeek;
-                global_counter = &g_ctrs.numSeek;
+                global_counter = NULL;      // sharded, see below
                 summarize = &g_summary.fs.seek;
                 err_str = "ERROR: doFSMetric:FS_SEEK:cmdSendMetric";
                 break;
@@ -1672,7 +1773,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             FD_FIELD(fs->fd),
             HOST_FIELD(g_proc.hostname),
             OP_FIELD(op),
-            FILE_FIELD(fs->path),
+            FILE_FIELD(file),
             UNIT_FIELD("operation"),
             FIELDEND
         };
@@ -1714,7 +1815,11 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         if (cmdSendMetric(g_mtc, &evt)) {
             scopeLog(err_str, fs->fd, CFG_LOG_ERROR);
         }
-        subFromInterfaceCounts(global_counter, numops->mtc);
+        if (type == FS_SEEK) {
+            subFromShardedCounts(SHARD_SEEK, numops->mtc);
+        } else {
+            subFromInterfaceCounts(global_counter, numops->mtc);
+        }
         atomicSwapU64(&numops->mtc, 0);
         break;
     }
@@ -1740,15 +1845,18 @@ doTotalNetRxTx(metric_t type)
     counters_element_t (*value)[SOCK_NUM_BUCKETS] = NULL;
     const char* err_str = "UNKNOWN";
     const char* units = "byte";
+    shard_ctr_t shard = SHARD_MAX;
     switch (type) {
         case TOT_RX:
             metric = "net.rx";
             value = &g_ctrs.netrxBytes;
+            shard = SHARD_NETRX_BYTES;
             err_str = "ERROR: doTotal:TOT_RX:cmdSendMetric";
             break;
         case TOT_TX:
             metric = "net.tx";
             value = &g_ctrs.nettxBytes;
+            shard = SHARD_NETTX_BYTES;
             err_str = "ERROR: doTotal:TOT_TX:cmdSendMetric";
             break;
         default:
@@ -1759,6 +1867,8 @@ doTotalNetRxTx(metric_t type)
     sock_summary_bucket_t bucket;
     for (bucket = INET_TCP; bucket < SOCK_NUM_BUCKETS; bucket++) {
 
+        foldShardedCounts(shard + bucket);
+
         // Don't report zeros.
         if ((*value)[bucket].mtc == 0) continue;
 
@@ -1795,11 +1905,13 @@ doTotal(metric_t type)
         case TOT_READ:
             metric = "fs.read";
             value = &g_ctrs.readBytes;
+            foldShardedCounts(SHARD_READ_BYTES);
             err_str = "ERROR: doTotal:TOT_READ:cmdSendMetric";
             break;
         case TOT_WRITE:
             metric = "fs.write";
             value = &g_ctrs.writeBytes;
+            foldShardedCounts(SHARD_WRITE_BYTES);
             err_str = "ERROR: doTotal:TOT_WRITE:cmdSendMetric";
             break;
         case TOT_RX:
@@ -1809,6 +1921,7 @@ doTotal(metric_t type)
         case TOT_SEEK:
             metric = "fs.seek";
             value = &g_ctrs.numSeek;
+            foldShardedCounts(SHARD_SEEK);
             err_str = "ERROR: doTotal:TOT_SEEK:cmdSendMetric";
             units = "operation";
             break;
@@ -1904,6 +2017,8 @@ doTotalDuration(metric_t type)
             metric = "fs.duration";
             value = &g_ctrs.fsDurationTotal;
             num = &g_ctrs.fsDurationNum;
+            foldShardedCounts(SHARD_FS_DURATION_TOTAL);
+            foldShardedCounts(SHARD_FS_DURATION_NUM);
             aggregation_type = HISTOGRAM;
             units = "microsecond";
             factor = 1000;
@@ -1960,6 +2075,146 @@ doTotalDuration(metric_t type)
     atomicSwapU64(&num->mtc, 0);
 }
 
+void
+doQueueMetrics(void)
+{
+    static const char *names[CFG_QUEUE_MAX] = {
+        [CFG_QUEUE_EVENTS] =   "events",
+        [CFG_QUEUE_MSGS] =     "messages",
+        [CFG_QUEUE_PAYLOADS] = "payloads",
+    };
+    cfg_queue_t q;
+
+    for (q = CFG_QUEUE_EVENTS; q < CFG_QUEUE_MAX; q++) {
+        cbuf_stats_t stats;
+        ctlQueueStats(g_ctl, q, &stats);
+
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            QUEUE_FIELD(names[q]),
+            UNIT_FIELD("entry"),
+            FIELDEND
+        };
+
+        // These go straight to metrics; as events they'd land on the
+        // queues they describe.
+        event_t enq = INT_EVENT("scope.queue.enqueued", stats.enqueued, DELTA, fields);
+        event_t drop = INT_EVENT("scope.queue.dropped", stats.dropped, DELTA, fields);
+        event_t high = INT_EVENT("scope.queue.highwater", stats.highwater, CURRENT, fields);
+        if (cmdSendMetric(g_mtc, &enq) || cmdSendMetric(g_mtc, &drop) ||
+            cmdSendMetric(g_mtc, &high)) {
+            scopeLog("ERROR: doQueueMetrics:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+    }
+}
+
+void
+doEvtPoolMetrics(void)
+{
+    static const char *names[EVT_POOL_MAX] = {
+        [EVT_POOL_FS] =       "fs",
+        [EVT_POOL_NET] =      "net",
+        [EVT_POOL_STAT_ERR] = "stat_err",
+        [EVT_POOL_PROTO] =    "proto",
+        [EVT_POOL_PAYLOAD] =  "payload",
+        [EVT_POOL_DELTA] =    "delta",
+    };
+    static evt_pool_stats_t last[EVT_POOL_MAX];
+    evt_pool_class_t class;
+
+    for (class = 0; class < EVT_POOL_MAX; class++) {
+        evt_pool_stats_t stats;
+        evtAllocStats(class, &stats);
+
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            POOL_FIELD(names[class]),
+            UNIT_FIELD("record"),
+            FIELDEND
+        };
+        event_field_t byte_fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            POOL_FIELD(names[class]),
+            UNIT_FIELD("byte"),
+            FIELDEND
+        };
+
+        // exhausted records came from malloc; failed ones were never posted
+        event_t exhausted = INT_EVENT("scope.pool.exhausted",
+                                      stats.exhausted - last[class].exhausted, DELTA, fields);
+        event_t failed = INT_EVENT("scope.pool.failed",
+                                   stats.failed - last[class].failed, DELTA, fields);
+        event_t mem = INT_EVENT("scope.pool.memory", stats.slabbytes, CURRENT, byte_fields);
+        if (cmdSendMetric(g_mtc, &exhausted) || cmdSendMetric(g_mtc, &failed) ||
+            cmdSendMetric(g_mtc, &mem)) {
+            scopeLog("ERROR: doEvtPoolMetrics:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+        last[class] = stats;
+    }
+}
+
+static int
+isStaleHttpMap(list_key_t key, void *data, void *arg)
+{
+    http_map *map = (http_map *)data;
+    return (map->first_time < *(time_t *)arg);
+}
+
+static int
+isStaleHttpXfer(list_key_t key, void *data, void *arg)
+{
+    http_xfer *xfer = (http_xfer *)data;
+    return (xfer->first_time < *(time_t *)arg);
+}
+
+void
+doHttpMetrics(void)
+{
+    // A request whose response never shows up (the connection went away,
+    // or we missed it) would otherwise hold its map entry forever
+    time_t oldest = time(NULL) - HTTP_MAP_TTL;
+    unsigned int stale = hmapDeleteIf(g_maplist, isStaleHttpMap, &oldest);
+    // Likewise a body that never ends, as when its connection is left open
+    hmapDeleteIf(g_xferlist, isStaleHttpXfer, &oldest);
+
+    // What header buffers hold, and headers dropped to stay under that
+    static uint64_t last_failed = 0;
+    evt_pool_stats_t hdrs;
+    httpHdrPoolStats(&hdrs);
+    uint64_t dropped = hdrs.failed - last_failed;
+    last_failed = hdrs.failed;
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD("request"),
+        FIELDEND
+    };
+    event_field_t byte_fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD("byte"),
+        FIELDEND
+    };
+
+    event_t evicted = INT_EVENT("scope.http.evicted", stale, DELTA, fields);
+    event_t pending = INT_EVENT("scope.http.pending", hmapCount(g_maplist), CURRENT, fields);
+    event_t hdr_mem = INT_EVENT("scope.http.header.memory", hdrs.slabbytes, CURRENT, byte_fields);
+    event_t hdr_drop = INT_EVENT("scope.http.header.dropped", dropped, DELTA, fields);
+    if (cmdSendMetric(g_mtc, &evicted) || cmdSendMetric(g_mtc, &pending) ||
+        cmdSendMetric(g_mtc, &hdr_mem) || cmdSendMetric(g_mtc, &hdr_drop)) {
+        scopeLog("ERROR: doHttpMetrics:cmdSendMetric", -1, CFG_LOG_ERROR);
+    }
+}
+
 void
 doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 {
@@ -2206,8 +2461,13 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
                 DATA_FIELD(data),
                 NUMOPS_FIELD(net->numRX.evt),
                 UNIT_FIELD("byte"),
+                REMOTEHOST_FIELD(strtabStr(g_strtab, net->peerName)),
                 FIELDEND
             };
+            // The name is last, so it's left off by ending the fields
+            // one sooner when we don't know it
+            size_t last = sizeof(fields) / sizeof(fields[0]) - 1;
+            if (net->peerName == STRTAB_NONE) fields[last - 1] = fields[last];
             memmove(&rxFields, &fields, sizeof(fields));
             event_t rxNetMetric = INT_EVENT("net.rx", net->rxBytes.evt, DELTA, rxFields);
             memmove(&rxMetric, &rxNetMetric, sizeof(event_t));
@@ -2240,7 +2500,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 
         // Reset the info if we tried to report
         sock_summary_bucket_t bucket = getNetRxTxBucket(net);
-        subFromInterfaceCounts(&g_ctrs.netrxBytes[bucket], net->rxBytes.mtc);
+        subFromShardedCounts(SHARD_NETRX_BYTES + bucket, net->rxBytes.mtc);
         atomicSwapU64(&net->numRX.mtc, 0);
         atomicSwapU64(&net->rxBytes.mtc, 0);
         break;
@@ -2337,8 +2597,13 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
                 DATA_FIELD(data),
                 NUMOPS_FIELD(net->numTX.evt),
                 UNIT_FIELD("byte"),
+                REMOTEHOST_FIELD(strtabStr(g_strtab, net->peerName)),
                 FIELDEND
             };
+            // The name is last, so it's left off by ending the fields
+            // one sooner when we don't know it
+            size_t last = sizeof(fields) / sizeof(fields[0]) - 1;
+            if (net->peerName == STRTAB_NONE) fields[last - 1] = fields[last];
             memmove(&txFields, &fields, sizeof(fields));
             event_t txNetMetric = INT_EVENT("net.tx", net->txBytes.evt, DELTA, txFields);
             memmove(&txMetric, &txNetMetric, sizeof(event_t));
@@ -2367,7 +2632,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 
         // Reset the info if we tried to report
         sock_summary_bucket_t bucket = getNetRxTxBucket(net);
-        subFromInterfaceCounts(&g_ctrs.nettxBytes[bucket], net->txBytes.mtc);
+        subFromShardedCounts(SHARD_NETTX_BYTES + bucket, net->txBytes.mtc);
         atomicSwapU64(&net->numTX.mtc, 0);
         atomicSwapU64(&net->txBytes.mtc, 0);
 
@@ -2393,30 +2658,224 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
     }
 }
 
+// Index of the full fs and net records in one batch, by uid.
+typedef struct {
+    uint64_t uid;
+    evt_type *rec;
+} evt_index_t;
+
+typedef struct {
+    evt_index_t *slot;
+    size_t mask;
+} evt_batch_index_t;
+
+static uint64_t *g_evtbatch = NULL;
+static size_t g_evtbatch_size = 0;
+
+static size_t
+eventBatchFill(size_t max)
+{
+    size_t num = 0;
+    int got;
+
+    while (num < max) {
+        if (num == g_evtbatch_size) {
+            size_t newsize = (g_evtbatch_size) ? g_evtbatch_size * 2 : EVT_BATCH_MIN;
+            uint64_t *temp = realloc(g_evtbatch, newsize * sizeof(uint64_t));
+            if (!temp) {
+                // Can't hold more; process what we have and pick up from here
+                DBG(NULL);
+                break;
+            }
+            g_evtbatch = temp;
+            g_evtbatch_size = newsize;
+        }
+
+        // Take as much as fits straight off the queue
+        size_t room = MIN(g_evtbatch_size, max) - num;
+        if ((got = msgEventGetBatch(g_ctl, &g_evtbatch[num], room)) <= 0) break;
+        num += got;
+    }
+
+    return num;
+}
+
+static void
+eventBatchIndex(evt_batch_index_t *index, size_t num)
+{
+    size_t i, nfull = 0;
+
+    index->slot = NULL;
+    index->mask = 0;
+
+    for (i = 0; i < num; i++) {
+        evt_type *event = (evt_type *)g_evtbatch[i];
+        if ((event->evtype == EVT_FS) || (event->evtype == EVT_NET)) nfull++;
+    }
+    if (!nfull) return;
+
+    size_t size = 16;
+    while (size < nfull * 2) size <<= 1;
+    if ((index->slot = calloc(size, sizeof(evt_index_t))) == NULL) {
+        DBG(NULL);
+        return;
+    }
+    index->mask = size - 1;
+
+    // Later records replace earlier ones; they are more complete
+    for (i = 0; i < num; i++) {
+        evt_type *event = (evt_type *)g_evtbatch[i];
+        uint64_t uid;
+
+        if (event->evtype == EVT_FS) {
+            uid = ((fs_info *)event)->uid;
+        } else if (event->evtype == EVT_NET) {
+            uid = ((net_info *)event)->uid;
+        } else {
+            continue;
+        }
+        if (!uid) continue;
+
+        size_t pos = (uid * 0x9e3779b97f4a7c15ULL) & index->mask;
+        while (index->slot[pos].rec && (index->slot[pos].uid != uid)) {
+            pos = (pos + 1) & index->mask;
+        }
+        index->slot[pos].uid = uid;
+        index->slot[pos].rec = event;
+    }
+}
+
+static evt_type *
+eventBatchLookup(evt_batch_index_t *index, uint64_t uid, metric_t evtype)
+{
+    if (!index->slot || !uid) return NULL;
+
+    size_t pos = (uid * 0x9e3779b97f4a7c15ULL) & index->mask;
+    while (index->slot[pos].rec) {
+        if ((index->slot[pos].uid == uid) &&
+            (index->slot[pos].rec->evtype == evtype)) {
+            return index->slot[pos].rec;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+    return NULL;
+}
+
+static void
+doDeltaMetric(delta_info *delta, evt_batch_index_t *index)
+{
+    switch (delta->data_type) {
+    case FS_READ:
+    case FS_WRITE:
+    case FS_DURATION:
+    case FS_SEEK:
+    {
+        fs_info fs;
+        // Not getFSEntry(); it would open stdin, stdout or stderr
+        fs_info *src = fdTableGet(g_fsinfo, delta->fd);
+
+        if (!src || !src->active || (src->uid != delta->uid)) {
+            src = (fs_info *)eventBatchLookup(index, delta->uid, EVT_FS);
+        }
+        if (src) {
+            memmove(&fs, src, sizeof(fs));
+        } else {
+            memset(&fs, 0, sizeof(fs));
+        }
+        fs.fd = delta->fd;
+        fs.uid = delta->uid;
+
+        switch (delta->data_type) {
+        case FS_READ:
+            fs.numRead = delta->num;
+            fs.readBytes = delta->bytes;
+            break;
+        case FS_WRITE:
+            fs.numWrite = delta->num;
+            fs.writeBytes = delta->bytes;
+            break;
+        case FS_DURATION:
+            fs.numDuration = delta->num;
+            fs.totalDuration = delta->bytes;
+            break;
+        default:
+            fs.numSeek = delta->num;
+            break;
+        }
+
+        doFSMetric(delta->data_type, &fs, EVENT_BASED, delta->funcop, 0, strtabStr(g_strtab, fs.path));
+        break;
+    }
+    case NETRX:
+    case NETTX:
+    {
+        net_info net;
+        net_info *src = getNetEntry(delta->fd);
+
+        if (!src || (src->uid != delta->uid)) {
+            src = (net_info *)eventBatchLookup(index, delta->uid, EVT_NET);
+        }
+        if (src) {
+            memmove(&net, src, sizeof(net));
+        } else {
+            memset(&net, 0, sizeof(net));
+        }
+        net.fd = delta->fd;
+        net.uid = delta->uid;
+
+        if (delta->data_type == NETRX) {
+            net.numRX = delta->num;
+            net.rxBytes = delta->bytes;
+        } else {
+            net.numTX = delta->num;
+            net.txBytes = delta->bytes;
+        }
+
+        doNetMetric(delta->data_type, &net, EVENT_BASED, 0);
+        break;
+    }
+    default:
+        DBG("%d", delta->data_type);
+        break;
+    }
+}
+
 void
 doEvent()
 {
-    uint64_t data;
-    while ((data = msgEventGet(g_ctl)) != -1) {
-        if (data) {
+    size_t num, i;
+
+    do {
+        num = eventBatchFill(EVT_BATCH_MAX);
+        if (!num) break;
+
+        // A delta only refers to its fd. If that fd was closed before
+        // we got here, the close record in this batch has what we need.
+        evt_batch_index_t index;
+        eventBatchIndex(&index, num);
+
+        for (i = 0; i < num; i++) {
+            uint64_t data = g_evtbatch[i];
             evt_type *event = (evt_type *)data;
             net_info *net;
             fs_info *fs;
             stat_err_info *staterr;
             protocol_info *proto;
 
-            if (event->evtype == EVT_NET) {
+            if (event->evtype == EVT_DELTA) {
+                doDeltaMetric((delta_info *)data, &index);
+            } else if (event->evtype == EVT_NET) {
                 net = (net_info *)data;
                 doNetMetric(net->data_type, net, EVENT_BASED, 0);
             } else if (event->evtype == EVT_FS) {
                 fs = (fs_info *)data;
-                doFSMetric(fs->data_type, fs, EVENT_BASED, fs->funcop, 0, fs->path);
+                doFSMetric(fs->data_type, fs, EVENT_BASED, fs->funcop, 0, strtabStr(g_strtab, fs->path));
             } else if (event->evtype == EVT_ERR) {
                 staterr = (stat_err_info *)data;
-                doErrorMetric(staterr->data_type, EVENT_BASED, staterr->funcop, staterr->name, &staterr->counters);
+                doErrorMetric(staterr->data_type, EVENT_BASED, staterr->funcop, strtabStr(g_strtab, staterr->name), &staterr->counters);
             } else if (event->evtype == EVT_STAT) {
                 staterr = (stat_err_info *)data;
-                doStatMetric(staterr->funcop, staterr->name, &staterr->counters);
+                doStatMetric(staterr->funcop, strtabStr(g_strtab, staterr->name), &staterr->counters);
             } else if (event->evtype == EVT_DNS) {
                 net = (net_info *)data;
                 doDNSMetricName(net->data_type, net->dnsName, &net->totalDuration, &net->counters);
@@ -2425,25 +2884,53 @@ doEvent()
                 doProtocolMetric(proto);
             } else {
                 DBG(NULL);
-                return;
             }
+        }
 
-            free(event);
+        // Deltas can refer to any full record in the batch; free at the end
+        for (i = 0; i < num; i++) {
+            evtReleaseNames(g_evtbatch[i]);
+            evtPoolFree((void *)g_evtbatch[i]);
         }
-    }
+        if (index.slot) free(index.slot);
+
+    } while (num == EVT_BATCH_MAX);
+
     httpAggSendReport(g_http_agg, g_mtc);
     httpAggReset(g_http_agg);
+    grpcAggSendReport(g_grpc_agg, g_mtc);
+    grpcAggReset(g_grpc_agg);
+    strtabReclaim(g_aggnames);
     ctlFlush(g_ctl);
 }
 
+// Around fork(); the periodic thread may be in doEvent()
+void
+lockReporting(void)
+{
+    strtabLockAll(g_aggnames);
+}
+
+void
+unlockReporting(void)
+{
+    strtabUnlockAll(g_aggnames);
+}
+
 void
 doPayload()
 {
     bool lsbin = FALSE;
     bool filebin = TRUE;
-    uint64_t data;
+    uint64_t batch[PAYLOAD_BATCH_SIZE];
+    int num = 0, i = 0;
 
-    while ((data = msgPayloadGet(g_ctl)) != -1) {
+    for (;;) {
+        if (i == num) {
+            if ((num = msgPayloadGetBatch(g_ctl, batch, PAYLOAD_BATCH_SIZE)) <= 0) break;
+            i = 0;
+        }
+        uint64_t data = batch[i++];
         if (data) {
             payload_info *pinfo = (payload_info *)data;
             net_info *net = &pinfo->net;
@@ -2490,9 +2977,9 @@ doPayload()
             if (rc < 0) {
                 // unlikley
                 if (pinfo->data) free(pinfo->data);
-                if (pinfo) free(pinfo);
+                evtPoolFree(pinfo);
                 DBG(NULL);
-                return;
+                continue;
             }
 
             if (rc < hlen) {
@@ -2546,7 +3033,7 @@ doPayload()
 
             if (bdata) free(bdata);
             if (pinfo->data) free(pinfo->data);
-            if (pinfo) free(pinfo);
+            evtPoolFree(pinfo);
         }
     }
 }
@@ -66,8 +66,12 @@ typedef enum {
     EVT_PROTO,
     EVT_HREQ,
     EVT_HRES,
+    EVT_HBODY,
+    EVT_GRPC,
     EVT_DETECT,
+    EVT_DNSRESP,
     EVT_PAYLOAD,
+    EVT_DELTA,
     TLSRX,
     TLSTX
 } metric_t;
@@ -85,13 +89,19 @@ extern ctl_t *g_ctl;
 
 void initReporting(void);
 void setReportingInterval(int);
+void setHttpAggregation(unsigned, unsigned);
 void sendProcessStartMetric();
 void doErrorMetric(metric_t, control_type_t, const char *, const char *, void *);
 void doProcMetric(metric_t, long long);
 void doStatMetric(const char *, const char *, void *);
 void doTotal(metric_t);
 void doTotalDuration(metric_t);
+void doQueueMetrics(void);
+void doEvtPoolMetrics(void);
+void doHttpMetrics(void);
 void doEvent(void);
 void doPayload(void);
+void lockReporting(void);
+void unlockReporting(void);
 
 #endif // __REPORT_H__
@@ -32,9 +32,6 @@
 #define _MFD_CLOEXEC		0x0001U
 #define SHM_NAME            "libscope"
 #define PARENT_PROC_NAME "start_scope"
-#define GO_ENV_VAR "GODEBUG"
-#define GO_ENV_SERVER_VALUE "http2server"
-#define GO_ENV_CLIENT_VALUE "http2client"
 
 extern unsigned char _binary___lib_linux_libscope_so_start;
 extern unsigned char _binary___lib_linux_libscope_so_end;
@@ -186,54 +183,6 @@ err:
     return info;
 }
 
-// If possible, we want to set GODEBUG=http2server=0,http2client=0
-// This tells go not to upgrade to http2, which allows
-// our http1 protocol capture stuff to do it's thing.
-// We consider this temporary, because when we support http2
-// it will not be necessary.
-static void
-setGoHttpEnvVariable(void)
-{
-    char *cur_val = getenv(GO_ENV_VAR);
-
-    // If GODEBUG isn't set, try to set it to http2server=0,http2client=0
-    if (!cur_val) {
-        if (setenv(GO_ENV_VAR, GO_ENV_SERVER_VALUE "=0," GO_ENV_CLIENT_VALUE "=0", 1)) {
-            perror("setGoHttpEnvVariable:setenv");
-        }
-        return;
-    }
-
-    // GODEBUG is set.
-    // If http2server wasn't specified, let's append ",http2server=0"
-    if (!strstr(cur_val, GO_ENV_SERVER_VALUE)) {
-        char *new_val = NULL;
-        if ((asprintf(&new_val, "%s,%s=0", cur_val, GO_ENV_SERVER_VALUE) == -1)) {
-            perror("setGoHttpEnvVariable:asprintf");
-            return;
-        }
-        if (setenv(GO_ENV_VAR, new_val, 1)) {
-            perror("setGoHttpEnvVariable:setenv");
-        }
-        if (new_val) free(new_val);
-    }
-
-    cur_val = getenv(GO_ENV_VAR);
-
-    // If http2client wasn't specified, let's append ",http2client=0"
-    if (!strstr(cur_val, GO_ENV_CLIENT_VALUE)) {
-        char *new_val = NULL;
-        if ((asprintf(&new_val, "%s,%s=0", cur_val, GO_ENV_CLIENT_VALUE) == -1)) {
-            perror("setGoHttpEnvVariable:asprintf");
-            return;
-        }
-        if (setenv(GO_ENV_VAR, new_val, 1)) {
-            perror("setGoHttpEnvVariable:setenv");
-        }
-        if (new_val) free(new_val);
-    }
-}
-
 int
 main(int argc, char **argv, char **env)
 {
@@ -280,9 +229,6 @@ main(int argc, char **argv, char **env)
             perror("setenv");
             goto err;
         }
-
-        setGoHttpEnvVariable();
-
     } else {
         if (setenv("SCOPE_APP_TYPE", "native", 1) == -1) {
             perror("setenv");
@@ -24,6 +24,13 @@ typedef enum {CFG_SRC_FILE,
               CFG_SRC_FS,
               CFG_SRC_DNS,
               CFG_SRC_MAX} watch_t;
+typedef enum {CFG_QUEUE_EVENTS,
+              CFG_QUEUE_MSGS,
+              CFG_QUEUE_PAYLOADS,
+              CFG_QUEUE_MAX} cfg_queue_t;
+typedef enum {CFG_DROP_NEWEST,
+              CFG_DROP_OLDEST,
+              CFG_SAMPLE} cfg_overflow_t;
 
 #define ROUND_DOWN(num, unit) ((num) & ~((unit) - 1))
 #define ROUND_UP(num, unit) (((num) + (unit) - 1) & ~((unit) - 1))
@@ -124,6 +131,10 @@ typedef unsigned int bool;
 #define DEFAULT_PROCESS_START_MSG TRUE
 #define DEFAULT_PAYLOAD_ENABLE FALSE
 #define DEFAULT_PAYLOAD_DIR "/tmp"
+#define DEFAULT_QUEUE_OVERFLOW CFG_DROP_NEWEST
+#define DEFAULT_QUEUE_SAMPLE_RATE 10
+#define DEFAULT_HTTP_MAX_TARGETS 1000
+#define DEFAULT_HTTP_NORMALIZE TRUE
 
 /*
  * This calculation is not what we need in the long run.
@@ -3,7 +3,12 @@
 #include "scopetypes.h"
 #include "search.h"
 
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
 #define ASIZE 256
+#define EXACT_MAX 4     // needles this short are compared a byte at a time
 
 struct _search_t
 {
@@ -12,18 +17,201 @@ struct _search_t
     int bmBc[ASIZE];
 };
 
+typedef int (*search_fn)(search_t *, char *, int);
+
+static int searchHorspool(search_t *, char *, int);
+static search_impl_t g_impl = SEARCH_SCALAR;
+static search_fn g_exec = searchHorspool;
+static int g_impl_chosen = FALSE;
+
 /*
  * This is an implementation of the Horspool
  * string search algorithm.
  * ref: https://www-igm.univ-mlv.fr/~lecroq/string/node18.html
  *
- * Pre-compute the array from the input_str.
+ * It's used where there's no SIMD, and for whatever is left at the end
+ * of a buffer after the SIMD loops.
+ */
+static int
+searchHorspool(search_t *handle, char *haystack, int hlen)
+{
+    int j;
+    unsigned char c;
+
+    /* Searching */
+    j = 0;
+    while (j <= hlen - handle->nlen) {
+        c = haystack[j + handle->nlen - 1];
+        if (handle->str[handle->nlen - 1] == c &&
+            memcmp(handle->str, haystack + j, handle->nlen - 1) == 0) {
+            return j;
+        }
+
+        j += handle->bmBc[c];
+    }
+
+    return -1;
+}
+
+#ifdef __x86_64__
+
+/*
+ * The SIMD searches compare a block of haystack against the first byte
+ * of the needle, and the block nlen - 1 bytes further on against the last
+ * byte.  Where both match there may be a match, which memcmp() settles.
+ * ref: http://0x80.pl/articles/simd-strfind.html
+ *
+ * For needles of EXACT_MAX bytes or less, like "\r\n" and "\r\n\r\n",
+ * every byte gets its own compare and no memcmp() is needed.
+ */
+static int
+searchSse2(search_t *handle, char *haystack, int hlen)
+{
+    int nlen = handle->nlen;
+    int last = nlen - 1;
+    int exact = (nlen <= EXACT_MAX);
+    int i = 0;
+
+    const __m128i first = _mm_set1_epi8(handle->str[0]);
+    const __m128i lastc = _mm_set1_epi8(handle->str[last]);
+    const __m128i mid1 = _mm_set1_epi8(handle->str[(nlen > 2) ? 1 : 0]);
+    const __m128i mid2 = _mm_set1_epi8(handle->str[(nlen > 3) ? 2 : 0]);
+
+    for (; i + last + 16 <= hlen; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(haystack + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(haystack + i + last));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, lastc));
+
+        if (exact && (nlen > 2)) {
+            const __m128i c = _mm_loadu_si128((const __m128i *)(haystack + i + 1));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(c, mid1));
+        }
+        if (exact && (nlen > 3)) {
+            const __m128i d = _mm_loadu_si128((const __m128i *)(haystack + i + 2));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(d, mid2));
+        }
+
+        unsigned int mask = _mm_movemask_epi8(eq);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (exact || !memcmp(haystack + i + bit + 1, handle->str + 1, nlen - 2)) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    int rv = searchHorspool(handle, haystack + i, hlen - i);
+    return (rv == -1) ? -1 : i + rv;
+}
+
+__attribute__((target("avx2")))
+static int
+searchAvx2(search_t *handle, char *haystack, int hlen)
+{
+    int nlen = handle->nlen;
+    int last = nlen - 1;
+    int exact = (nlen <= EXACT_MAX);
+    int i = 0;
+
+    const __m256i first = _mm256_set1_epi8(handle->str[0]);
+    const __m256i lastc = _mm256_set1_epi8(handle->str[last]);
+    const __m256i mid1 = _mm256_set1_epi8(handle->str[(nlen > 2) ? 1 : 0]);
+    const __m256i mid2 = _mm256_set1_epi8(handle->str[(nlen > 3) ? 2 : 0]);
+
+    for (; i + last + 32 <= hlen; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(haystack + i + last));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, lastc));
+
+        if (exact && (nlen > 2)) {
+            const __m256i c = _mm256_loadu_si256((const __m256i *)(haystack + i + 1));
+            eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(c, mid1));
+        }
+        if (exact && (nlen > 3)) {
+            const __m256i d = _mm256_loadu_si256((const __m256i *)(haystack + i + 2));
+            eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(d, mid2));
+        }
+
+        unsigned int mask = _mm256_movemask_epi8(eq);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (exact || !memcmp(haystack + i + bit + 1, handle->str + 1, nlen - 2)) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    // Less than a block left; the SSE2 loop can still take some of it
+    int rv = searchSse2(handle, haystack + i, hlen - i);
+    return (rv == -1) ? -1 : i + rv;
+}
+
+static int
+cpuHasAvx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // __x86_64__
+
+static void
+chooseImpl(void)
+{
+    if (g_impl_chosen) return;
+    g_impl_chosen = TRUE;
+
+#ifdef __x86_64__
+    // SSE2 is part of x86_64, so there's always that
+    searchSetImpl(cpuHasAvx2() ? SEARCH_AVX2 : SEARCH_SSE2);
+#endif
+}
+
+int
+searchSetImpl(search_impl_t impl)
+{
+    g_impl_chosen = TRUE;
+
+    switch (impl) {
+        case SEARCH_SCALAR:
+            g_exec = searchHorspool;
+            break;
+#ifdef __x86_64__
+        case SEARCH_SSE2:
+            g_exec = searchSse2;
+            break;
+        case SEARCH_AVX2:
+            if (!cpuHasAvx2()) return -1;
+            g_exec = searchAvx2;
+            break;
+#endif
+        default:
+            return -1;
+    }
+
+    g_impl = impl;
+    return 0;
+}
+
+search_impl_t
+searchImpl(void)
+{
+    chooseImpl();
+    return g_impl;
+}
+
+/*
+ * Pre-compute the Horspool shift table from the input_str.
  */
 search_t*
 searchComp(const char *input_str)
 {
     if (!input_str) return NULL;
 
+    chooseImpl();
+
     search_t* handle = calloc(1, sizeof(search_t));
     if (!handle) goto failed;
     handle->nlen = strlen(input_str);
@@ -64,22 +252,7 @@ searchLen(search_t *handle)
 int
 searchExec(search_t *handle, char *haystack, int hlen)
 {
-    int j;
-    unsigned char c;
-
     if (!handle || !haystack || hlen < 0) return -1;
 
-    /* Searching */
-    j = 0;
-    while (j <= hlen - handle->nlen) {
-        c = haystack[j + handle->nlen - 1];
-        if (handle->str[handle->nlen - 1] == c &&
-            memcmp(handle->str, haystack + j, handle->nlen - 1) == 0) {
-            return j;
-        }
-
-        j += handle->bmBc[c];
-    }
-
-    return -1;
+    return g_exec(handle, haystack, hlen);
 }
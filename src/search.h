@@ -18,13 +18,26 @@
 // searching if it sees NULL characters/bytes.  If a match is found, it
 // returns the offset of the first match, otherwise it returns -1.
 //
+// searchExec() uses SSE2 or AVX2 where it can, picked from what the CPU
+// supports the first time it's needed.  searchSetImpl() is there to
+// compare them; it returns -1 if the CPU can't do the one asked for.
+//
 
 typedef struct _search_t search_t;
 
+typedef enum {
+    SEARCH_SCALAR,
+    SEARCH_SSE2,
+    SEARCH_AVX2,
+} search_impl_t;
+
 search_t*     searchComp(const char *);
 void          searchFree(search_t**);
 int           searchLen(search_t*);
 
 int           searchExec(search_t*, char *, int);
 
+search_impl_t searchImpl(void);
+int           searchSetImpl(search_impl_t);
+
 #endif // __SEARCH_H__
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "sketch.h"
+
+#define SUB_COUNT (1U << SKETCH_SUB_BITS)
+#define SUB_MASK (SUB_COUNT - 1)
+
+struct _sketch_t {
+    uint64_t count;
+    uint64_t max;
+    uint32_t bucket[SKETCH_BUCKETS];
+};
+
+static int
+bucketOf(uint64_t value)
+{
+    if (value > UINT32_MAX) value = UINT32_MAX;
+    if (value < SUB_COUNT) return value;
+
+    // The top SKETCH_SUB_BITS + 1 bits pick the bucket
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SKETCH_SUB_BITS;
+    return ((shift + 1) << SKETCH_SUB_BITS) + ((value >> shift) & SUB_MASK);
+}
+
+static void
+bucketRange(int i, uint64_t *low, uint64_t *high)
+{
+    if (i < SUB_COUNT) {
+        *low = *high = i;
+        return;
+    }
+
+    int shift = (i >> SKETCH_SUB_BITS) - 1;
+    *low = (uint64_t)(SUB_COUNT + (i & SUB_MASK)) << shift;
+    *high = *low + (1ULL << shift) - 1;
+}
+
+sketch_t *
+sketchCreate(void)
+{
+    sketch_t *sketch = calloc(1, sizeof(*sketch));
+    if (!sketch) DBG(NULL);
+    return sketch;
+}
+
+void
+sketchDestroy(sketch_t **sketch)
+{
+    if (!sketch || !*sketch) return;
+    free(*sketch);
+    *sketch = NULL;
+}
+
+void
+sketchAdd(sketch_t *sketch, uint64_t value)
+{
+    if (!sketch) return;
+
+    int i = bucketOf(value);
+    if (sketch->bucket[i] == UINT32_MAX) return;
+
+    sketch->bucket[i]++;
+    sketch->count++;
+    if (value > sketch->max) sketch->max = value;
+}
+
+void
+sketchMerge(sketch_t *sketch, const sketch_t *other)
+{
+    if (!sketch || !other) return;
+
+    int i;
+    for (i = 0; i < SKETCH_BUCKETS; i++) {
+        uint32_t add = other->bucket[i];
+        if (add > UINT32_MAX - sketch->bucket[i]) add = UINT32_MAX - sketch->bucket[i];
+        sketch->bucket[i] += add;
+        sketch->count += add;
+    }
+    if (other->max > sketch->max) sketch->max = other->max;
+}
+
+void
+sketchReset(sketch_t *sketch)
+{
+    if (!sketch) return;
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+uint64_t
+sketchCount(const sketch_t *sketch)
+{
+    return (sketch) ? sketch->count : 0;
+}
+
+uint64_t
+sketchMax(const sketch_t *sketch)
+{
+    return (sketch) ? sketch->max : 0;
+}
+
+uint64_t
+sketchQuantile(const sketch_t *sketch, double q)
+{
+    if (!sketch || !sketch->count) return 0;
+    if (q <= 0.0) q = 0.0;
+    if (q >= 1.0) return sketch->max;
+
+    // The rank of the value we want, counting from 1
+    uint64_t rank = (uint64_t)(q * sketch->count) + 1;
+    if (rank > sketch->count) rank = sketch->count;
+
+    uint64_t seen = 0;
+    int i;
+    for (i = 0; i < SKETCH_BUCKETS; i++) {
+        seen += sketch->bucket[i];
+        if (seen >= rank) break;
+    }
+    if (i == SKETCH_BUCKETS) return sketch->max;
+
+    // The middle of the bucket is never more than half of it away
+    uint64_t low, high;
+    bucketRange(i, &low, &high);
+    uint64_t value = low + (high - low) / 2;
+    return (value > sketch->max) ? sketch->max : value;
+}
+
+uint64_t
+sketchBucket(const sketch_t *sketch, int i, uint64_t *low, uint64_t *high)
+{
+    if (!sketch || (i < 0) || (i >= SKETCH_BUCKETS)) return 0;
+
+    uint64_t lo, hi;
+    bucketRange(i, &lo, &hi);
+    if (low) *low = lo;
+    if (high) *high = hi;
+    return sketch->bucket[i];
+}
@@ -0,0 +1,42 @@
+#ifndef __SKETCH_H__
+#define __SKETCH_H__
+
+#include <stdint.h>
+
+//
+// A fixed size quantile sketch for latencies.
+//
+// Values are counted in log-linear buckets, as in HdrHistogram: values
+// under 2^SKETCH_SUB_BITS each have a bucket, and every power of two
+// above that is split into 2^SKETCH_SUB_BITS buckets.  A quantile is
+// found by walking the counts, so nothing is kept in order and nothing
+// is sorted, and it is within 1/2^SKETCH_SUB_BITS of the true value.
+// Values past UINT32_MAX are counted in the last bucket; the max is
+// kept exactly.
+//
+// Sketches with the same layout merge by adding their counts, so one
+// can be kept per thread, or per period, and combined later.
+//
+
+#define SKETCH_SUB_BITS 4
+#define SKETCH_BUCKETS ((32 - SKETCH_SUB_BITS + 1) << SKETCH_SUB_BITS)
+
+typedef struct _sketch_t sketch_t;
+
+// Constructors Destructors
+sketch_t *      sketchCreate(void);
+void            sketchDestroy(sketch_t **);
+
+void            sketchAdd(sketch_t *, uint64_t);
+void            sketchMerge(sketch_t *, const sketch_t *);
+void            sketchReset(sketch_t *);
+
+// Accessors
+uint64_t        sketchCount(const sketch_t *);
+uint64_t        sketchMax(const sketch_t *);
+// The value below which a fraction q (0 to 1) of the values fall
+uint64_t        sketchQuantile(const sketch_t *, double q);
+// The count of bucket i, and the range of values it holds
+uint64_t        sketchBucket(const sketch_t *, int i, uint64_t *low, uint64_t *high);
+
+#endif // __SKETCH_H__
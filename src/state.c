@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
 #include <netinet/in.h>
@@ -9,12 +10,19 @@
 #include <sys/stat.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "atomic.h"
 #include "com.h"
+#include "ctrshard.h"
 #include "dbg.h"
+#include "dnsresp.h"
 #include "dns.h"
+#include "evtpool.h"
+#include "hashmap.h"
+#include "hostcache.h"
 #include "httpstate.h"
+#include "mpsearch.h"
 #include "mtcformat.h"
 #include "plattime.h"
 #include "search.h"
@@ -24,29 +32,76 @@
 #include "fn.h"
 #include "os.h"
 
-#define NET_ENTRIES 1024
-#define FS_ENTRIES 1024
+#define MAX_FDS (1024 * 1024)
 #define NUM_ATTEMPTS 100
 #define MAX_CONVERT (size_t)256
+#define EVT_POOL_BLOCKS 4096
+#define STRTAB_MAX_STRINGS (256 * 1024)
+#define STRTAB_MAX_BYTES (32 * 1024 * 1024)
+#define CTR_SHARDS 64
+#define MAX_LITERAL 32
 
 extern rtconfig g_cfg;
 
-int g_numNinfo = NET_ENTRIES;
-int g_numFSinfo = FS_ENTRIES;
 int g_http_guard_enabled = TRUE;
-uint64_t g_http_guard[NET_ENTRIES];
+uint64_t g_http_guard[HTTP_GUARD_ENTRIES];
 
 // These would all be declared static, but the some functions that need
 // this data have been moved into report.c.  This is managed with the
 // include of state_private.h above.
 summary_t g_summary = {{0}};
-net_info *g_netinfo;
-fs_info *g_fsinfo;
+fd_table_t *g_netinfo;
+fd_table_t *g_fsinfo;
 metric_counters g_ctrs = {{0}};
+strtab_t *g_strtab = NULL;
 int g_mtc_addr_output = TRUE;
+unsigned int g_op_enable = OP_READ | OP_WRITE | OP_SEEK;
 static search_t* g_http_redirect = NULL;
-static list_t *g_protlist;
+static hashmap_t *g_protlist;
 static unsigned int g_prot_sequence = 0;
+static evt_pool_t *g_evtpool[EVT_POOL_MAX];
+static ctr_shard_t *g_ctrshard = NULL;
+
+// Match data for the protocol regexes, one per thread, kept for the
+// life of the thread.  We only ask whether there's a match, so it holds
+// one pair of offsets whatever the pattern.
+static pthread_key_t g_match_key;
+static int g_match_key_ok = FALSE;
+
+// The start of a buffer as hex, for binary protocols; made once for all
+// the protocols that look at the same buffer
+typedef struct {
+    const char *buf;        // what hex is of; NULL until it's made
+    char hex[MAX_CONVERT * 2];
+} hex_buf_t;
+
+static const char hexDigit[] = "0123456789abcdef";
+
+// What detectProtocol tries on a new connection.  A protocol's regex
+// usually starts with (or has to contain) some literal bytes; those are
+// searched for in one pass over the buffer, and only the protocols whose
+// literal is there, plus the ones without one, have their regex run.
+// Made again whenever a protocol is added or deleted.  Protocols are
+// kept by type, not pointer; one can be deleted while this is in use.
+typedef struct {
+    mpsearch_t *search;
+    unsigned int count;
+    unsigned int *type;     // of each protocol, in the order they're tried
+    int *id;                // of its literal in search; -1 to always try it
+} prot_matcher_t;
+
+// The current matcher is the one with the key g_protmatch_gen.  The
+// hashmap frees the ones it replaces once nobody can be using them.
+static hashmap_t *g_protmatch;
+static uint64_t g_protmatch_gen = 0;
+
+// DNS queries sent, by socket and id, until their response shows up
+#define DNS_PENDING_MAX 256
+static dns_pending_t *g_dnspending;
+
+// The name each address the process resolved was looked up by
+#define HOSTCACHE_MAX 512
+static hostcache_t *g_hostcache;
 
 // interfaces
 mtc_t *g_mtc = NULL;
@@ -78,29 +133,25 @@ ctl_t *g_ctl = NULL;
 #define DURATION_FIELD(val)     NUMFIELD("duration",       (val),        8)
 #define NUMOPS_FIELD(val)       NUMFIELD("numops",         (val),        8)
 
+// Entries for fds we haven't seen yet are allocated on demand
+static net_info *
+netSlot(int fd)
+{
+    return fdTableSlot(g_netinfo, fd);
+}
+
+static fs_info *
+fsSlot(int fd)
+{
+    return fdTableSlot(g_fsinfo, fd);
+}
+
 int
 get_port(int fd, int type, control_type_t which) {
-    in_port_t port;
-    switch (type) {
-    case AF_INET:
-        if (which == LOCAL) {
-            port = ((struct sockaddr_in *)&g_netinfo[fd].localConn)->sin_port;
-        } else {
-            port = ((struct sockaddr_in *)&g_netinfo[fd].remoteConn)->sin_port;
-        }
-        break;
-    case AF_INET6:
-        if (which == LOCAL) {
-            port = ((struct sockaddr_in6 *)&g_netinfo[fd].localConn)->sin6_port;
-        } else {
-            port = ((struct sockaddr_in6 *)&g_netinfo[fd].remoteConn)->sin6_port;
-        }
-        break;
-    default:
-        port = (in_port_t)0;
-        break;
-    }
-    return htons(port);
+    net_info *net = fdTableGet(g_netinfo, fd);
+    if (!net) return 0;
+
+    return get_port_net(net, type, which);
 }
 
 int
@@ -128,6 +179,218 @@ get_port_net(net_info *net, int type, control_type_t which) {
     return htons(port);
 }
 
+static unsigned char
+hexValue(unsigned char c)
+{
+    return (isdigit(c)) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+// The literal that text matching regex has to start with, if it's
+// anchored, or contain otherwise; its length, 0 if there isn't one.
+// Anything we aren't sure of ends the literal; a shorter one, or none,
+// only means more regexes are run.  For a binary protocol, the regex is
+// over the buffer as hex, so the literal is the bytes the hex stands for,
+// and only an anchored one is known to start on a byte.
+static size_t
+regexLiteral(const char *regex, bool binary, unsigned char *lit, size_t max,
+             int *anchored)
+{
+    unsigned char text[MAX_LITERAL * 2];
+    const char *p;
+    int depth = 0;
+    size_t len = 0;
+
+    if (!regex) return 0;
+
+    // With an alternative at the top level, the regex can start with anything
+    for (p = regex; *p; p++) {
+        if (*p == '\\') {
+            if (*++p == '\0') return 0;
+        } else if (*p == '[') {
+            // a ] first in the class is part of it
+            if (*++p == '^') p++;
+            if (*p == ']') p++;
+            while (*p && (*p != ']')) {
+                if ((*p == '\\') && p[1]) p++;
+                p++;
+            }
+            if (*p == '\0') return 0;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if ((*p == '|') && (depth == 0)) {
+            return 0;
+        }
+    }
+
+    p = regex;
+    *anchored = (*p == '^');
+    if (*anchored) p++;
+
+    size_t tmax = (binary) ? max * 2 : max;
+    if (tmax > sizeof(text)) tmax = sizeof(text);
+    while (*p && (len < tmax)) {
+        const char *next = p + 1;
+        unsigned char c = *p;
+
+        if (*p == '\\') {
+            next = p + 2;
+            switch (p[1]) {
+                case 'r': c = '\r'; break;
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'f': c = '\f'; break;
+                case 'e': c = 0x1b; break;
+                case 'a': c = 0x07; break;
+                case 'x':
+                    if (!isxdigit((unsigned char)p[2]) ||
+                        !isxdigit((unsigned char)p[3])) goto done;
+                    c = (hexValue(p[2]) << 4) | hexValue(p[3]);
+                    next = p + 4;
+                    break;
+                default:
+                    // Escaped punctuation is itself; escaped letters and
+                    // digits are classes, anchors, back references...
+                    if (!ispunct((unsigned char)p[1])) goto done;
+                    c = p[1];
+                    break;
+            }
+        } else if (strchr(".[](){}|?*+^$", *p)) {
+            break;
+        }
+
+        // A quantifier can make this one optional, or repeat it
+        if (*next && strchr("?*{", *next)) break;
+        text[len++] = c;
+        if (*next == '+') break;
+        p = next;
+    }
+done:
+
+    if (!binary) {
+        memcpy(lit, text, len);
+        return len;
+    }
+
+    // Only whole bytes, and only the hex we make (lower case)
+    if (!*anchored) return 0;
+    size_t i;
+    for (i = 0; (i + 1 < len) && isxdigit(text[i]) && isxdigit(text[i + 1]) &&
+                !isupper(text[i]) && !isupper(text[i + 1]); i += 2) {
+        lit[i / 2] = (hexValue(text[i]) << 4) | hexValue(text[i + 1]);
+    }
+    return i / 2;
+}
+
+// The bytes a signature has to start with, from a pattern at offset 0;
+// they stop at the first one that's masked.
+static size_t
+signatureLiteral(protocol_def_t *pre, unsigned char *lit, size_t max, int *anchored)
+{
+    unsigned int i;
+    size_t len = 0;
+
+    for (i = 0; i < pre->npatterns; i++) {
+        prot_bytes_t *pattern = &pre->pattern[i];
+        if (pattern->offset != 0) continue;
+
+        while ((len < pattern->len) && (len < max) && (pattern->mask[len] == 0xff)) {
+            lit[len] = pattern->value[len];
+            len++;
+        }
+        break;
+    }
+
+    *anchored = TRUE;
+    return len;
+}
+
+static void
+protMatcherDestroy(void *data)
+{
+    prot_matcher_t *matcher = data;
+    if (!matcher) return;
+
+    mpsearchDestroy(&matcher->search);
+    if (matcher->type) free(matcher->type);
+    if (matcher->id) free(matcher->id);
+    free(matcher);
+}
+
+static prot_matcher_t *
+protMatcherCreate(void)
+{
+    unsigned int ptype;
+    unsigned int max = g_prot_sequence + 1;
+    protocol_def_t *pre;
+
+    prot_matcher_t *matcher = calloc(1, sizeof(*matcher));
+    if (!matcher ||
+        ((matcher->type = calloc(max, sizeof(unsigned int))) == NULL) ||
+        ((matcher->id = calloc(max, sizeof(int))) == NULL) ||
+        ((matcher->search = mpsearchCreate()) == NULL)) {
+        DBG(NULL);
+        protMatcherDestroy(matcher);
+        return NULL;
+    }
+
+    for (ptype = 0; ptype <= g_prot_sequence; ptype++) {
+        if ((pre = hmapFind(g_protlist, ptype)) == NULL) continue;
+
+        unsigned char lit[MAX_LITERAL];
+        int anchored = FALSE;
+        size_t len = signatureLiteral(pre, lit, sizeof(lit), &anchored);
+        if (!len && pre->re) {
+            len = regexLiteral(pre->regex, pre->binary, lit, sizeof(lit), &anchored);
+        }
+
+        // Past what the search can hold, a protocol is always tried
+        matcher->type[matcher->count] = ptype;
+        matcher->id[matcher->count] =
+            (len) ? mpsearchAdd(matcher->search, lit, len, anchored) : -1;
+        matcher->count++;
+    }
+
+    if (!mpsearchBuild(matcher->search)) {
+        protMatcherDestroy(matcher);
+        return NULL;
+    }
+    return matcher;
+}
+
+// Called when the protocols change.  If a new matcher can't be made,
+// the old one goes anyway and every protocol is tried.
+static void
+updateProtMatcher(void)
+{
+    if (!g_protmatch) return;
+
+    uint64_t gen = g_protmatch_gen;
+    prot_matcher_t *matcher = protMatcherCreate();
+    if (matcher && !hmapInsert(g_protmatch, gen + 1, matcher)) {
+        protMatcherDestroy(matcher);
+    }
+    __atomic_store_n(&g_protmatch_gen, gen + 1, __ATOMIC_RELEASE);
+    hmapDelete(g_protmatch, gen);
+}
+
+// The current matcher; NULL to try every protocol.  The caller has to be
+// in g_protmatch (hmapEnter) for as long as it uses what's returned.
+static prot_matcher_t *
+protMatcher(void)
+{
+    prot_matcher_t *matcher;
+    int i;
+
+    // A second look, for when it was replaced between the load and the find
+    for (i = 0; i < 2; i++) {
+        uint64_t gen = __atomic_load_n(&g_protmatch_gen, __ATOMIC_ACQUIRE);
+        if ((matcher = hmapFind(g_protmatch, gen)) != NULL) return matcher;
+    }
+    return NULL;
+}
+
 bool
 delProtocol(request_t *req)
 {
@@ -139,13 +402,14 @@ delProtocol(request_t *req)
     protoreq = req->protocol;
 
     for (ptype = 0; ptype <= g_prot_sequence; ptype++) {
-        if ((protolist = lstFind(g_protlist, ptype)) != NULL) {
+        if ((protolist = hmapFind(g_protlist, ptype)) != NULL) {
             if (strncmp(protoreq->protname, protolist->protname, strlen(protolist->protname)) == 0) {
                 // decrement g_prot_sequence?: values are assigned to an entry, used as a key
-                lstDelete(g_protlist, ptype);
+                hmapDelete(g_protlist, ptype);
             }
         }
     }
+    updateProtMatcher();
 
     if (protoreq && protoreq->protname) free(protoreq->protname);
     if (protoreq) free(protoreq);
@@ -163,21 +427,29 @@ addProtocol(request_t *req)
 
     proto = req->protocol;
 
-    proto->re = pcre2_compile((PCRE2_SPTR)proto->regex, PCRE2_ZERO_TERMINATED,
-                              0, &errornumber, &erroroffset, NULL);
+    // A byte signature can do without a regex
+    if (proto->regex || (!proto->npatterns && !proto->length.size)) {
+        proto->re = pcre2_compile((PCRE2_SPTR)proto->regex, PCRE2_ZERO_TERMINATED,
+                                  0, &errornumber, &erroroffset, NULL);
 
-    if (proto->re == NULL) {
-        destroyProtEntry(proto);
-        return FALSE;
+        if (proto->re == NULL) {
+            destroyProtEntry(proto);
+            return FALSE;
+        }
+
+        // Every protocol is tried on every new connection.  If JIT isn't
+        // available, pcre2_match() interprets the pattern as before.
+        pcre2_jit_compile(proto->re, PCRE2_JIT_COMPLETE);
     }
 
     proto->type = ++g_prot_sequence;
 
-    if (lstInsert(g_protlist, proto->type, proto) == FALSE) {
+    if (hmapInsert(g_protlist, proto->type, proto) == FALSE) {
         destroyProtEntry(proto);
         --g_prot_sequence;
         return FALSE;
     }
+    updateProtMatcher();
 
     return TRUE;
 }
@@ -217,32 +489,148 @@ initProtocolDetection()
     lstDestroy(&plist);
 }
 
+static void
+initEvtPools()
+{
+    const size_t blksize[EVT_POOL_MAX] = {
+        [EVT_POOL_FS] =       sizeof(struct fs_info_t),
+        [EVT_POOL_NET] =      sizeof(struct net_info_t),
+        [EVT_POOL_STAT_ERR] = sizeof(struct stat_err_info_t),
+        [EVT_POOL_PROTO] =    sizeof(struct protocol_info_t),
+        [EVT_POOL_PAYLOAD] =  sizeof(struct payload_info_t),
+        [EVT_POOL_DELTA] =    sizeof(struct delta_info_t),
+    };
+    evt_pool_class_t class;
+
+    for (class = 0; class < EVT_POOL_MAX; class++) {
+        // Deltas are small and make up most of the traffic
+        unsigned int blocks = (class == EVT_POOL_DELTA) ?
+            EVT_POOL_BLOCKS * 4 : EVT_POOL_BLOCKS;
+
+        if (g_evtpool[class]) continue;
+        if ((g_evtpool[class] = evtPoolCreate(blksize[class], blocks)) == NULL) {
+            scopeLog("ERROR: initEvtPools:evtPoolCreate", -1, CFG_LOG_ERROR);
+        }
+    }
+}
+
+void *
+evtAlloc(evt_pool_class_t class)
+{
+    if (class >= EVT_POOL_MAX) return NULL;
+    return evtPoolAlloc(g_evtpool[class]);
+}
+
 void
-initState()
+evtAllocStats(evt_pool_class_t class, evt_pool_stats_t *stats)
+{
+    if (!stats) return;
+    if (class >= EVT_POOL_MAX) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    evtPoolStats(g_evtpool[class], stats);
+}
+
+// A record posted to the periodic thread holds a reference to each name
+// in g_strtab it has; this gives them back, before the record is freed
+void
+evtReleaseNames(uint64_t data)
 {
-    net_info *netinfoLocal;
-    fs_info *fsinfoLocal;
-    if ((netinfoLocal = (net_info *)malloc(sizeof(struct net_info_t) * NET_ENTRIES)) == NULL) {
-        scopeLog("ERROR: Constructor:Malloc", -1, CFG_LOG_ERROR);
+    evt_type *event = (evt_type *)data;
+    if (!event) return;
+
+    switch (event->evtype) {
+        case EVT_FS:
+            strtabRelease(g_strtab, ((fs_info *)event)->path);
+            break;
+        case EVT_ERR:
+        case EVT_STAT:
+            strtabRelease(g_strtab, ((stat_err_info *)event)->name);
+            break;
+        case EVT_NET:
+        case EVT_DNS:
+            strtabRelease(g_strtab, ((net_info *)event)->peerName);
+            break;
+        default:
+            break;
     }
+}
 
-    if (netinfoLocal) memset(netinfoLocal, 0, sizeof(struct net_info_t) * NET_ENTRIES);
+// Free a record the periodic thread will never see; the ctl calls this
+// with what it evicts from a full queue.
+void
+evtDiscard(uint64_t data)
+{
+    evt_type *event = (evt_type *)data;
+    if (!event) return;
+
+    evtReleaseNames(data);
+    if (event->evtype == EVT_PROTO) {
+        protocol_info *proto = (protocol_info *)event;
+        if ((proto->ptype == EVT_HREQ) || (proto->ptype == EVT_HRES)) {
+            http_post *post = (http_post *)proto->data;
+            if (post && post->hdr) evtPoolFree(post->hdr);
+        }
+        if (proto->data) free(proto->data);
+    } else if (event->evtype == EVT_PAYLOAD) {
+        payload_info *pinfo = (payload_info *)event;
+        if (pinfo->data) free(pinfo->data);
+    }
+
+    evtPoolFree(event);
+}
+
+// On failure, the event still belongs to us
+static void
+postEvent(char *event)
+{
+    if (cmdPostEvent(g_ctl, event) == -1) {
+        evtReleaseNames((uint64_t)event);
+        evtPoolFree(event);
+    }
+}
+
+// pthread key destructor; the thread is going away
+static void
+freeMatchData(void *data)
+{
+    pcre2_match_data_free(data);
+}
+
+void
+initState()
+{
+    fd_table_t *netinfoLocal;
+    fd_table_t *fsinfoLocal;
+
+    // Pages of entries are added as fds show up; nothing is ever moved,
+    // so other threads can keep using entries while the tables grow.
+    if ((netinfoLocal = fdTableCreate(sizeof(struct net_info_t), MAX_FDS)) == NULL) {
+        scopeLog("ERROR: Constructor:fdTableCreate", -1, CFG_LOG_ERROR);
+    }
 
     // Per a Read Update & Change (RUC) model; now that the object is ready assign the global
     g_netinfo = netinfoLocal;
 
-    if ((fsinfoLocal = (fs_info *)malloc(sizeof(struct fs_info_t) * FS_ENTRIES)) == NULL) {
-        scopeLog("ERROR: Constructor:Malloc", -1, CFG_LOG_ERROR);
+    if ((fsinfoLocal = fdTableCreate(sizeof(struct fs_info_t), MAX_FDS)) == NULL) {
+        scopeLog("ERROR: Constructor:fdTableCreate", -1, CFG_LOG_ERROR);
     }
 
-    if (fsinfoLocal) memset(fsinfoLocal, 0, sizeof(struct fs_info_t) * FS_ENTRIES);
-
     // Per RUC...
     g_fsinfo = fsinfoLocal;
 
+    initEvtPools();
+    if (!g_ctrshard &&
+        ((g_ctrshard = ctrShardCreate(SHARD_MAX, CTR_SHARDS)) == NULL)) {
+        scopeLog("ERROR: initState:ctrShardCreate", -1, CFG_LOG_ERROR);
+    }
+    if (!g_strtab &&
+        ((g_strtab = strtabCreate(STRTAB_MAX_STRINGS, STRTAB_MAX_BYTES)) == NULL)) {
+        scopeLog("ERROR: initState:strtabCreate", -1, CFG_LOG_ERROR);
+    }
     initHttpState();
-    // the http guard array is static while the net fs array is dynamically allocated
-    // will need to change if we want to re-size at runtime
+    // the http guard array is fixed size; fds share entries modulo its size
     memset(g_http_guard, 0, sizeof(g_http_guard));
     {
         // g_http_guard_enable is always false unless
@@ -253,18 +641,119 @@ initState()
 
     g_http_redirect = searchComp(REDIRECTURL);
 
-    g_protlist = lstCreate(destroyProtEntry);
+    if (!g_match_key_ok) {
+        g_match_key_ok = !pthread_key_create(&g_match_key, freeMatchData);
+        if (!g_match_key_ok) DBG(NULL);
+    }
+    g_protlist = hmapCreate(destroyProtEntry);
+    g_protmatch = hmapCreate(protMatcherDestroy);
     initProtocolDetection();
+    if (!g_dnspending &&
+        ((g_dnspending = dnsPendingCreate(DNS_PENDING_MAX)) == NULL)) {
+        scopeLog("ERROR: initState:dnsPendingCreate", -1, CFG_LOG_ERROR);
+    }
+    if (!g_hostcache &&
+        ((g_hostcache = hostCacheCreate(HOSTCACHE_MAX)) == NULL)) {
+        scopeLog("ERROR: initState:hostCacheCreate", -1, CFG_LOG_ERROR);
+    }
 
     initReporting();
 }
 
+// Called by the periodic thread once it's been through everything
+// that was posted
+void
+reclaimState()
+{
+    strtabReclaim(g_strtab);
+}
+
+// Around fork(), so the child doesn't inherit a held table lock
+void
+lockState()
+{
+    strtabLockAll(g_strtab);
+}
+
+void
+unlockState()
+{
+    strtabUnlockAll(g_strtab);
+}
+
 void
 resetState()
 {
+    // Throw away anything the shards are still holding, too
+    shard_ctr_t ctr;
+    for (ctr = 0; ctr < SHARD_MAX; ctr++) {
+        ctrShardFold(g_ctrshard, ctr);
+    }
     memset(&g_ctrs, 0, sizeof(struct metric_counters_t));
 }
 
+static counters_element_t *
+shardedElement(shard_ctr_t ctr)
+{
+    switch (ctr) {
+        case SHARD_READ_BYTES:
+            return &g_ctrs.readBytes;
+        case SHARD_WRITE_BYTES:
+            return &g_ctrs.writeBytes;
+        case SHARD_SEEK:
+            return &g_ctrs.numSeek;
+        case SHARD_FS_DURATION_NUM:
+            return &g_ctrs.fsDurationNum;
+        case SHARD_FS_DURATION_TOTAL:
+            return &g_ctrs.fsDurationTotal;
+        default:
+            break;
+    }
+
+    if ((ctr >= SHARD_NETRX_BYTES) && (ctr < SHARD_NETTX_BYTES)) {
+        return &g_ctrs.netrxBytes[ctr - SHARD_NETRX_BYTES];
+    }
+    if ((ctr >= SHARD_NETTX_BYTES) && (ctr < SHARD_SEEK)) {
+        return &g_ctrs.nettxBytes[ctr - SHARD_NETTX_BYTES];
+    }
+
+    DBG("%d", ctr);
+    return NULL;
+}
+
+void
+addToShardedCounts(shard_ctr_t ctr, uint64_t val)
+{
+    if (!g_ctrshard) {
+        addToInterfaceCounts(shardedElement(ctr), val);
+        return;
+    }
+    ctrShardAdd(g_ctrshard, ctr, (int64_t)val);
+}
+
+void
+subFromShardedCounts(shard_ctr_t ctr, uint64_t val)
+{
+    if (!g_ctrshard) {
+        subFromInterfaceCounts(shardedElement(ctr), val);
+        return;
+    }
+    ctrShardAdd(g_ctrshard, ctr, -(int64_t)val);
+}
+
+void
+foldShardedCounts(shard_ctr_t ctr)
+{
+    counters_element_t *value = shardedElement(ctr);
+    int64_t delta = ctrShardFold(g_ctrshard, ctr);
+
+    if (delta > 0) {
+        addToInterfaceCounts(value, (uint64_t)delta);
+    } else if (delta < 0) {
+        subFromInterfaceCounts(value, (uint64_t)-delta);
+    }
+}
+
 // DEBUG
 #if 0
 static void
@@ -273,22 +762,25 @@ dumpAddrs(int sd)
     in_port_t port;
     char ip[INET6_ADDRSTRLEN];
     char buf[1024];
+    net_info *net = getNetEntry(sd);
+
+    if (!net) return;
 
     inet_ntop(AF_INET,
-              &((struct sockaddr_in *)&g_netinfo[sd].localConn)->sin_addr,
+              &((struct sockaddr_in *)&net->localConn)->sin_addr,
               ip, sizeof(ip));
-    port = get_port(sd, g_netinfo[sd].localConn.ss_family, LOCAL);
+    port = get_port(sd, net->localConn.ss_family, LOCAL);
     snprintf(buf, sizeof(buf), "%s:%d LOCAL: %s:%d", __FUNCTION__, __LINE__, ip, port);
     scopeLog(buf, sd, CFG_LOG_DEBUG);
 
     inet_ntop(AF_INET,
-              &((struct sockaddr_in *)&g_netinfo[sd].remoteConn)->sin_addr,
+              &((struct sockaddr_in *)&net->remoteConn)->sin_addr,
               ip, sizeof(ip));
-    port = get_port(sd, g_netinfo[sd].remoteConn.ss_family, REMOTE);
+    port = get_port(sd, net->remoteConn.ss_family, REMOTE);
     snprintf(buf, sizeof(buf), "%s:%d REMOTE:%s:%d", __FUNCTION__, __LINE__, ip, port);
     scopeLog(buf, sd, CFG_LOG_DEBUG);
 
-    if (get_port(sd, g_netinfo[sd].localConn.ss_family, REMOTE) == DNS_PORT) {
+    if (get_port(sd, net->localConn.ss_family, REMOTE) == DNS_PORT) {
         scopeLog("DNS", sd, CFG_LOG_DEBUG);
     }
 }
@@ -354,16 +846,14 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
-    size_t len = sizeof(struct stat_err_info_t);
-    stat_err_info *sep = calloc(1, len);
+    stat_err_info *sep = evtAlloc(EVT_POOL_STAT_ERR);
     if (!sep) return FALSE;
 
+    memset(sep, 0, sizeof(struct stat_err_info_t));
     sep->evtype = stat_err;
     sep->data_type = type;
 
-    if (pathname) {
-        strncpy(sep->name, pathname, strnlen(pathname, sizeof(sep->name)));
-    }
+    sep->name = strtabIntern(g_strtab, pathname);
 
     if (funcop) {
         strncpy(sep->funcop, funcop, strnlen(funcop, sizeof(sep->funcop)));
@@ -371,11 +861,34 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
 
     memmove(&sep->counters, &g_ctrs, sizeof(g_ctrs));
 
-    cmdPostEvent(g_ctl, (char *)sep);
+    postEvent((char *)sep);
 
     return mtc_needs_reporting;
 }
 
+static bool
+postDelta(int fd, metric_t type, uint64_t uid, const char *funcop,
+          counters_element_t *num, counters_element_t *bytes)
+{
+    delta_info *dp = evtAlloc(EVT_POOL_DELTA);
+    if (!dp) return FALSE;
+
+    dp->evtype = EVT_DELTA;
+    dp->data_type = type;
+    dp->fd = fd;
+    dp->uid = uid;
+    dp->funcop = funcop;
+    dp->num = *num;
+    if (bytes) {
+        dp->bytes = *bytes;
+    } else {
+        dp->bytes = (counters_element_t){.mtc=0, .evt=0};
+    }
+
+    postEvent((char *)dp);
+    return TRUE;
+}
+
 static int
 postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *pathname)
 {
@@ -405,24 +918,42 @@ postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
-    size_t len = sizeof(struct fs_info_t);
-    fs_info *fsp = calloc(1, len);
+    switch (type) {
+        case FS_READ:
+            return postDelta(fd, type, fs->uid, funcop, &fs->numRead,
+                             &fs->readBytes) && mtc_needs_reporting;
+        case FS_WRITE:
+            return postDelta(fd, type, fs->uid, funcop, &fs->numWrite,
+                             &fs->writeBytes) && mtc_needs_reporting;
+        case FS_DURATION:
+            return postDelta(fd, type, fs->uid, funcop, &fs->numDuration,
+                             &fs->totalDuration) && mtc_needs_reporting;
+        case FS_SEEK:
+            return postDelta(fd, type, fs->uid, funcop, &fs->numSeek,
+                             NULL) && mtc_needs_reporting;
+        default:
+            break;
+    }
+
+    fs_info *fsp = evtAlloc(EVT_POOL_FS);
     if (!fsp) return FALSE;
 
-    memmove(fsp, fs, len);
+    memmove(fsp, fs, sizeof(struct fs_info_t));
     fsp->fd = fd;
     fsp->evtype = EVT_FS;
     fsp->data_type = type;
 
-    if (pathname && (fs->path[0] == '\0')) {
-        strncpy(fsp->path, pathname, strnlen(pathname, sizeof(fsp->path)));
+    if (pathname && (fs->path == STRTAB_NONE)) {
+        fsp->path = strtabIntern(g_strtab, pathname);
+    } else {
+        strtabRef(g_strtab, fsp->path);
     }
 
     if (funcop && (fs->funcop[0] == '\0')) {
         strncpy(fsp->funcop, funcop, strnlen(funcop, sizeof(fsp->funcop)));
     }
 
-    cmdPostEvent(g_ctl, (char *)fsp);
+    postEvent((char *)fsp);
 
     return mtc_needs_reporting;
 }
@@ -438,11 +969,15 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
-    size_t len = sizeof(struct net_info_t);
-    net_info *netp = calloc(1, len);
+    net_info *netp = evtAlloc(EVT_POOL_NET);
     if (!netp) return FALSE;
 
-    if (net) memmove(netp, net, len);
+    if (net) {
+        memmove(netp, net, sizeof(struct net_info_t));
+        strtabRef(g_strtab, netp->peerName);
+    } else {
+        memset(netp, 0, sizeof(struct net_info_t));
+    }
     netp->fd = fd;
     netp->evtype = EVT_DNS;
     netp->data_type = type;
@@ -457,7 +992,7 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
 
     memmove(&netp->counters, &g_ctrs, sizeof(g_ctrs));
 
-    cmdPostEvent(g_ctl, (char *)netp);
+    postEvent((char *)netp);
 
     return mtc_needs_reporting;
 }
@@ -488,36 +1023,50 @@ postNetState(int fd, metric_t type, net_info *net)
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
-    size_t len = sizeof(struct net_info_t);
-    net_info *netp = calloc(1, len);
+    switch (type) {
+        case NETRX:
+            return postDelta(fd, type, net->uid, NULL, &net->numRX,
+                             &net->rxBytes) && mtc_needs_reporting;
+        case NETTX:
+            return postDelta(fd, type, net->uid, NULL, &net->numTX,
+                             &net->txBytes) && mtc_needs_reporting;
+        default:
+            break;
+    }
+
+    net_info *netp = evtAlloc(EVT_POOL_NET);
     if (!netp) return FALSE;
 
-    memmove(netp, net, len);
+    memmove(netp, net, sizeof(struct net_info_t));
+    strtabRef(g_strtab, netp->peerName);
     netp->fd = fd;
     netp->evtype = EVT_NET;
     netp->data_type = type;
 
-    cmdPostEvent(g_ctl, (char *)netp);
+    postEvent((char *)netp);
     return mtc_needs_reporting;
 }
 
 void
 doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const char *pathname)
 {
+    net_info *net;
+    fs_info *fs;
+
     switch (type) {
     case OPEN_PORTS:
     {
-        if (!checkNetEntry(fd)) break;
+        if ((net = netSlot(fd)) == NULL) break;
         if (size < 0) {
             subFromInterfaceCounts(&g_ctrs.openPorts, labs(size));
         } else if (size > 0) {
             addToInterfaceCounts(&g_ctrs.openPorts, size);
         }
 
-        if (size && !g_netinfo[fd].startTime) {
-            g_netinfo[fd].startTime = getTime();
+        if (size && !net->startTime) {
+            net->startTime = getTime();
         }
-        if (postNetState(fd, type, &g_netinfo[fd])) {
+        if (postNetState(fd, type, net)) {
             // Don't reset the info.  It's a gauge.
         }
         break;
@@ -525,12 +1074,12 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
 
     case NET_CONNECTIONS:
     {
-        if (!checkNetEntry(fd)) break;
+        if ((net = netSlot(fd)) == NULL) break;
         counters_element_t* value = NULL;
 
-        if (g_netinfo[fd].type == SOCK_STREAM) {
+        if (net->type == SOCK_STREAM) {
             value = &g_ctrs.netConnectionsTcp;
-        } else if (g_netinfo[fd].type == SOCK_DGRAM) {
+        } else if (net->type == SOCK_DGRAM) {
             value = &g_ctrs.netConnectionsUdp;
         } else {
             value = &g_ctrs.netConnectionsOther;
@@ -542,10 +1091,10 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
             addToInterfaceCounts(value, size);
         }
 
-        if (size && !g_netinfo[fd].startTime) {
-            g_netinfo[fd].startTime = getTime();
+        if (size && !net->startTime) {
+            net->startTime = getTime();
         }
-        if (postNetState(fd, type, &g_netinfo[fd])) {
+        if (postNetState(fd, type, net)) {
             // Don't reset the info.  It's a gauge.
         }
         break;
@@ -553,74 +1102,74 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
 
     case CONNECTION_DURATION:
     {
-        if (!checkNetEntry(fd)) break;
+        if ((net = netSlot(fd)) == NULL) break;
         uint64_t new_duration = 0ULL;
-        if (g_netinfo[fd].startTime != 0ULL) {
-            new_duration = getDuration(g_netinfo[fd].startTime);
-            g_netinfo[fd].startTime = 0ULL;
+        if (net->startTime != 0ULL) {
+            new_duration = getDuration(net->startTime);
+            net->startTime = 0ULL;
         }
 
         if (new_duration) {
-            addToInterfaceCounts(&g_netinfo[fd].numDuration, 1);
-            addToInterfaceCounts(&g_netinfo[fd].totalDuration, new_duration);
+            addToInterfaceCounts(&net->numDuration, 1);
+            addToInterfaceCounts(&net->totalDuration, new_duration);
             addToInterfaceCounts(&g_ctrs.connDurationNum, 1);
             addToInterfaceCounts(&g_ctrs.connDurationTotal, new_duration);
         }
 
-        if ((g_netinfo[fd].rxBytes.evt > 0) || (g_netinfo[fd].txBytes.evt > 0) ||
-            (g_netinfo[fd].rxBytes.mtc > 0) || (g_netinfo[fd].txBytes.mtc > 0)) {
-            postNetState(fd, type, &g_netinfo[fd]);
-            atomicSwapU64(&g_netinfo[fd].numDuration.mtc, 0);
-            atomicSwapU64(&g_netinfo[fd].totalDuration.mtc, 0);
+        if ((net->rxBytes.evt > 0) || (net->txBytes.evt > 0) ||
+            (net->rxBytes.mtc > 0) || (net->txBytes.mtc > 0)) {
+            postNetState(fd, type, net);
+            atomicSwapU64(&net->numDuration.mtc, 0);
+            atomicSwapU64(&net->totalDuration.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.connDurationNum, 1);
             //subFromInterfaceCounts(&g_ctrs.connDurationTotal, new_duration);
         }
-        atomicSwapU64(&g_netinfo[fd].numDuration.evt, 0);
-        atomicSwapU64(&g_netinfo[fd].totalDuration.evt, 0);
+        atomicSwapU64(&net->numDuration.evt, 0);
+        atomicSwapU64(&net->totalDuration.evt, 0);
         break;
     }
 
     case CONNECTION_OPEN:
     {
-        if (checkNetEntry(fd) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) &&
-            (((g_netinfo[fd].addrSetRemote == TRUE) && (g_netinfo[fd].addrSetLocal == TRUE)) ||
+        if ((net = netSlot(fd)) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) &&
+            (((net->addrSetRemote == TRUE) && (net->addrSetLocal == TRUE)) ||
              (funcop && !strncmp(funcop, "dup", 3)))) {
-                postNetState(fd, type, &g_netinfo[fd]);
+                postNetState(fd, type, net);
         }
         break;
     }
 
     case NETRX:
     {
-        if (!checkNetEntry(fd)) break;
-        addToInterfaceCounts(&g_netinfo[fd].numRX, 1);
-        addToInterfaceCounts(&g_netinfo[fd].rxBytes, size);
-        sock_summary_bucket_t bucket = getNetRxTxBucket(&g_netinfo[fd]);
-        addToInterfaceCounts(&g_ctrs.netrxBytes[bucket], size);
-        if (postNetState(fd, type, &g_netinfo[fd])) {
-            atomicSwapU64(&g_netinfo[fd].numRX.mtc, 0);
-            atomicSwapU64(&g_netinfo[fd].rxBytes.mtc, 0);
+        if ((net = netSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&net->numRX, 1);
+        addToInterfaceCounts(&net->rxBytes, size);
+        sock_summary_bucket_t bucket = getNetRxTxBucket(net);
+        addToShardedCounts(SHARD_NETRX_BYTES + bucket, size);
+        if (postNetState(fd, type, net)) {
+            atomicSwapU64(&net->numRX.mtc, 0);
+            atomicSwapU64(&net->rxBytes.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.netrxBytes, size);
         }
-        //atomicSwapU64(&g_netinfo[fd].numRX.evt, 0);
-        //atomicSwapU64(&g_netinfo[fd].rxBytes.evt, 0);
+        //atomicSwapU64(&net->numRX.evt, 0);
+        //atomicSwapU64(&net->rxBytes.evt, 0);
         break;
     }
 
     case NETTX:
     {
-        if (!checkNetEntry(fd)) break;
-        addToInterfaceCounts(&g_netinfo[fd].numTX, 1);
-        addToInterfaceCounts(&g_netinfo[fd].txBytes, size);
-        sock_summary_bucket_t bucket = getNetRxTxBucket(&g_netinfo[fd]);
-        addToInterfaceCounts(&g_ctrs.nettxBytes[bucket], size);
-        if (postNetState(fd, type, &g_netinfo[fd])) {
-            atomicSwapU64(&g_netinfo[fd].numTX.mtc, 0);
-            atomicSwapU64(&g_netinfo[fd].txBytes.mtc, 0);
+        if ((net = netSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&net->numTX, 1);
+        addToInterfaceCounts(&net->txBytes, size);
+        sock_summary_bucket_t bucket = getNetRxTxBucket(net);
+        addToShardedCounts(SHARD_NETTX_BYTES + bucket, size);
+        if (postNetState(fd, type, net)) {
+            atomicSwapU64(&net->numTX.mtc, 0);
+            atomicSwapU64(&net->txBytes.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.nettxBytes, size);
         }
-        //atomicSwapU64(&g_netinfo[fd].numTX.evt, 0);
-        //atomicSwapU64(&g_netinfo[fd].txBytes.evt, 0);
+        //atomicSwapU64(&net->numTX.evt, 0);
+        //atomicSwapU64(&net->txBytes.evt, 0);
         break;
     }
 
@@ -635,8 +1184,8 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
             addToInterfaceCounts(&g_ctrs.numDNS, 1);
         }
 
-        if (checkNetEntry(fd)) {
-            rc = postDNSState(fd, type, &g_netinfo[fd], (uint64_t)size, pathname);
+        if ((net = netSlot(fd))) {
+            rc = postDNSState(fd, type, net, (uint64_t)size, pathname);
         } else {
             rc = postDNSState(fd, type, NULL, (uint64_t)size, pathname);
         }
@@ -653,8 +1202,8 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
         addToInterfaceCounts(&g_ctrs.dnsDurationNum, 1);
         addToInterfaceCounts(&g_ctrs.dnsDurationTotal, 0);
 
-        if (checkNetEntry(fd)) {
-            rc = postDNSState(fd, type, &g_netinfo[fd], size, pathname);
+        if ((net = netSlot(fd))) {
+            rc = postDNSState(fd, type, net, size, pathname);
         } else {
             rc = postDNSState(fd, type, NULL, size, pathname);
         }
@@ -671,88 +1220,88 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
 
     case FS_DURATION:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numDuration, 1);
-        addToInterfaceCounts(&g_fsinfo[fd].totalDuration, size);
-        addToInterfaceCounts(&g_ctrs.fsDurationNum, 1);
-        addToInterfaceCounts(&g_ctrs.fsDurationTotal, size);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numDuration.mtc, 0);
-            atomicSwapU64(&g_fsinfo[fd].totalDuration.mtc, 0);
-        }
-        //atomicSwapU64(&g_fsinfo[fd].numDuration.evt, 0);
-        //atomicSwapU64(&g_fsinfo[fd].totalDuration.evt, 0);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numDuration, 1);
+        addToInterfaceCounts(&fs->totalDuration, size);
+        addToShardedCounts(SHARD_FS_DURATION_NUM, 1);
+        addToShardedCounts(SHARD_FS_DURATION_TOTAL, size);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numDuration.mtc, 0);
+            atomicSwapU64(&fs->totalDuration.mtc, 0);
+        }
+        //atomicSwapU64(&fs->numDuration.evt, 0);
+        //atomicSwapU64(&fs->totalDuration.evt, 0);
         break;
     }
 
     case FS_READ:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numRead, 1);
-        addToInterfaceCounts(&g_fsinfo[fd].readBytes, size);
-        addToInterfaceCounts(&g_ctrs.readBytes, size);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numRead.mtc, 0);
-            atomicSwapU64(&g_fsinfo[fd].readBytes.mtc, 0);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numRead, 1);
+        addToInterfaceCounts(&fs->readBytes, size);
+        addToShardedCounts(SHARD_READ_BYTES, size);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numRead.mtc, 0);
+            atomicSwapU64(&fs->readBytes.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.readBytes, size);
         }
-        //atomicSwapU64(&g_fsinfo[fd].numRead.evt, 0);
-        //atomicSwapU64(&g_fsinfo[fd].readBytes.evt, 0);
+        //atomicSwapU64(&fs->numRead.evt, 0);
+        //atomicSwapU64(&fs->readBytes.evt, 0);
         break;
     }
 
     case FS_WRITE:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numWrite, 1);
-        addToInterfaceCounts(&g_fsinfo[fd].writeBytes, size);
-        addToInterfaceCounts(&g_ctrs.writeBytes, size);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numWrite.mtc, 0);
-            atomicSwapU64(&g_fsinfo[fd].writeBytes.mtc, 0);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numWrite, 1);
+        addToInterfaceCounts(&fs->writeBytes, size);
+        addToShardedCounts(SHARD_WRITE_BYTES, size);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numWrite.mtc, 0);
+            atomicSwapU64(&fs->writeBytes.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.writeBytes, size);
         }
-        //atomicSwapU64(&g_fsinfo[fd].numWrite.evt, 0);
-        //atomicSwapU64(&g_fsinfo[fd].writeBytes.evt, 0);
+        //atomicSwapU64(&fs->numWrite.evt, 0);
+        //atomicSwapU64(&fs->writeBytes.evt, 0);
         break;
     }
 
     case FS_OPEN:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numOpen, 1);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numOpen, 1);
         addToInterfaceCounts(&g_ctrs.numOpen, 1);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numOpen.mtc, 0);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numOpen.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.numOpen, 1);
         }
-        atomicSwapU64(&g_fsinfo[fd].numOpen.evt, 0);
+        atomicSwapU64(&fs->numOpen.evt, 0);
         break;
     }
 
     case FS_CLOSE:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numClose, 1);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numClose, 1);
         addToInterfaceCounts(&g_ctrs.numClose, 1);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numClose.mtc, 0);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numClose.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.numClose, 1);
         }
-        atomicSwapU64(&g_fsinfo[fd].numClose.evt, 0);
+        atomicSwapU64(&fs->numClose.evt, 0);
         break;
     }
 
     case FS_SEEK:
     {
-        if (!checkFSEntry(fd)) break;
-        addToInterfaceCounts(&g_fsinfo[fd].numSeek, 1);
-        addToInterfaceCounts(&g_ctrs.numSeek, 1);
-        if (postFSState(fd, type, &g_fsinfo[fd], funcop, pathname)) {
-            atomicSwapU64(&g_fsinfo[fd].numSeek.mtc, 0);
+        if ((fs = fsSlot(fd)) == NULL) break;
+        addToInterfaceCounts(&fs->numSeek, 1);
+        addToShardedCounts(SHARD_SEEK, 1);
+        if (postFSState(fd, type, fs, funcop, pathname)) {
+            atomicSwapU64(&fs->numSeek.mtc, 0);
             //subFromInterfaceCounts(&g_ctrs.numSeek, 1);
         }
-        atomicSwapU64(&g_fsinfo[fd].numSeek.evt, 0);
+        atomicSwapU64(&fs->numSeek.evt, 0);
         break;
     }
 
@@ -830,22 +1379,111 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
     }
 }
 
+static void
+hexEncode(const unsigned char *src, size_t len, char *dst)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        *dst++ = hexDigit[src[i] >> 4];
+        *dst++ = hexDigit[src[i] & 0xf];
+    }
+}
+
+// This thread's match data; NULL if it can't be had
+static pcre2_match_data *
+matchData(void)
+{
+    if (!g_match_key_ok) return NULL;
+
+    pcre2_match_data *match_data = pthread_getspecific(g_match_key);
+    if (match_data) return match_data;
+
+    if ((match_data = pcre2_match_data_create(1, NULL)) == NULL) {
+        DBG(NULL);
+        return NULL;
+    }
+    if (pthread_setspecific(g_match_key, match_data)) {
+        DBG(NULL);
+        pcre2_match_data_free(match_data);
+        return NULL;
+    }
+    return match_data;
+}
+
+// The byte patterns and length field of pre, checked on buf as it is
 static bool
-setProtocol(int sockfd, protocol_def_t *pre, net_info *net, char *buf, size_t len)
+matchSignature(protocol_def_t *pre, const unsigned char *buf, size_t len)
 {
-    char *data, *cpdata = NULL;
+    unsigned int i, j;
+
+    for (i = 0; i < pre->npatterns; i++) {
+        prot_bytes_t *pattern = &pre->pattern[i];
+        if ((size_t)pattern->offset + pattern->len > len) return FALSE;
+
+        const unsigned char *bytes = &buf[pattern->offset];
+        for (j = 0; j < pattern->len; j++) {
+            if ((bytes[j] & pattern->mask[j]) != pattern->value[j]) return FALSE;
+        }
+    }
+
+    prot_length_t *length = &pre->length;
+    if (!length->size) return TRUE;
+    if ((size_t)length->offset + length->size > len) return FALSE;
+
+    int64_t field = 0;
+    for (j = 0; j < length->size; j++) {
+        unsigned int at = (length->bigendian) ? j : length->size - 1 - j;
+        field = (field << 8) | buf[length->offset + at];
+    }
+    field += length->adjust;
+
+    if (field < 0) return FALSE;
+    if (length->max && (field > length->max)) return FALSE;
+    if (length->exact && (field != len)) return FALSE;
+    return TRUE;
+}
+
+// Returns TRUE if buf is pre's protocol; net->protocol is set to it
+static bool
+setProtocol(int sockfd, protocol_def_t *pre, net_info *net, char *buf, size_t len,
+            hex_buf_t *hexbuf)
+{
+    char *data;
     pcre2_match_data *match_data;
     protocol_info *proto;
 
     // nothing we can do; don't risk reading past end of a buffer
     size_t cvlen = (len < MAX_CONVERT) ? len : MAX_CONVERT;
     if (((len <= 0) && (pre->len <= 0)) ||   // no len
-        !pre->re ||                          // no regex
         (pre->len > cvlen)) {                // not enough buf for pre->len
-        net->protocol = -1;
         return FALSE;
     }
 
+    // A signature is checked first; it's cheap, and it may be all there is
+    if ((pre->npatterns || pre->length.size) &&
+        !matchSignature(pre, (unsigned char *)buf, len)) {
+        return FALSE;
+    }
+
+    if (!pre->re) {
+        if (!pre->npatterns && !pre->length.size) return FALSE;
+        goto found;
+    }
+
+    if ((match_data = matchData()) == NULL) {
+        return FALSE;
+    }
+
+    if (pre->binary == FALSE) {
+        data = buf;
+    } else {
+        if (hexbuf->buf != buf) {
+            hexEncode((unsigned char *)buf, cvlen, hexbuf->hex);
+            hexbuf->buf = buf;
+        }
+        data = hexbuf->hex;
+    }
+
     /*
      * precedence to a len defined with the protocol definition
      * if a len was not provided in the definition use the one passed
@@ -854,58 +1492,77 @@ setProtocol(int sockfd, protocol_def_t *pre, net_info *net, char *buf, size_t le
     if (pre->len > 0) {
         cvlen = pre->len;
     }
+    if (pre->binary == TRUE) {
+        cvlen = cvlen * 2;
+    }
 
-    if (pre->binary == FALSE) {
-        data = buf;
-    } else {
-        int i;
-        size_t alen = (cvlen * 2) + 1;
-        char sstr[4];
+    // With one pair of offsets, a match with captures returns 0
+    if (pcre2_match_wrapper(pre->re, (PCRE2_SPTR)data, (PCRE2_SIZE)cvlen, 0, 0,
+                            match_data, NULL) < 0) {
+        return FALSE;
+    }
 
-        if ((cpdata = calloc(1, alen)) == NULL) {
-            net->protocol = -1;
-            return FALSE;
-        }
+found:
+    //DEBUG
+    //scopeLog("setProtocol: SUCCESS", sockfd, CFG_LOG_ERROR);
+    net->protocol = pre->type;
 
-        for (i = 0; i < cvlen; i++) {
-            snprintf(sstr, sizeof(sstr), "%02x", (unsigned char)buf[i]);
-            strncat(cpdata, sstr, alen);
-        }
+    if ((proto = evtAlloc(EVT_POOL_PROTO)) == NULL) {
+        net->protocol = -1;
+        return TRUE;
+    }
 
-        data = cpdata;
-        cvlen = cvlen * 2;
+    memset(proto, 0, sizeof(struct protocol_info_t));
+    proto->evtype = EVT_PROTO;
+    proto->ptype = EVT_DETECT;
+    proto->len = sizeof(protocol_def_t);
+    proto->fd = sockfd;
+    proto->uid = net->uid;
+    proto->data = (char *)strdup(pre->protname);
+    if (cmdPostEvent(g_ctl, (char *)proto) == -1) {
+        if (proto->data) free(proto->data);
+        evtPoolFree(proto);
     }
+    return TRUE;
+}
 
-    match_data = pcre2_match_data_create_from_pattern(pre->re, NULL);
-    if (pcre2_match_wrapper(pre->re, (PCRE2_SPTR)data, (PCRE2_SIZE)cvlen, 0, 0,
-                            match_data, NULL) > 0) {
-        //DEBUG
-        //scopeLog("setProtocol: SUCCESS", sockfd, CFG_LOG_ERROR);
-        net->protocol = pre->type;
-
-        if ((proto = calloc(1, sizeof(struct protocol_info_t))) == NULL) {
-            if (cpdata) free(cpdata);
-            if (match_data) pcre2_match_data_free(match_data);
-            net->protocol = -1;
-            return FALSE;
+// The protocols that could be in buf are tried in the order they were
+// added, until one matches.  With no matcher, they're all tried.
+static bool
+matchProtocols(int sockfd, net_info *net, prot_matcher_t *matcher,
+               char *buf, size_t len, hex_buf_t *hexbuf)
+{
+    protocol_def_t *pre;
+
+    if (!matcher) {
+        unsigned int ptype;
+        for (ptype = 0; ptype <= g_prot_sequence; ptype++) {
+            if (((pre = hmapFind(g_protlist, ptype)) != NULL) &&
+                setProtocol(sockfd, pre, net, buf, len, hexbuf)) {
+                return TRUE;
+            }
         }
+        return FALSE;
+    }
 
-        proto->evtype = EVT_PROTO;
-        proto->ptype = EVT_DETECT;
-        proto->len = sizeof(protocol_def_t);
-        proto->fd = sockfd;
-        proto->uid = net->uid;
-        proto->data = (char *)strdup(pre->protname);
-        cmdPostEvent(g_ctl, (char *)proto);
-    } else {
-        net->protocol = -1;
+    // One pass over the start of buf for every protocol's literal
+    uint64_t hits[MPSEARCH_WORDS(MPSEARCH_MAX_STRINGS)];
+    size_t cvlen = (len < MAX_CONVERT) ? len : MAX_CONVERT;
+    if (mpsearchExec(matcher->search, (unsigned char *)buf, cvlen, hits) == -1) {
+        return FALSE;
     }
 
-    if (match_data) pcre2_match_data_free(match_data);
-    if (cpdata) free(cpdata);
+    unsigned int i;
+    for (i = 0; i < matcher->count; i++) {
+        int id = matcher->id[i];
+        if ((id != -1) && !(hits[id / 64] & (1ULL << (id % 64)))) continue;
 
-    // return true implies no error and not a match; completed a scan
-    return TRUE;
+        if (((pre = hmapFind(g_protlist, matcher->type[i])) != NULL) &&
+            setProtocol(sockfd, pre, net, buf, len, hexbuf)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
 
 static int
@@ -913,19 +1570,23 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
 {
     if (!buf || (len <= 0)) return -1;
 
-    payload_info *pinfo = calloc(1, sizeof(struct payload_info_t));
+    payload_info *pinfo = evtAlloc(EVT_POOL_PAYLOAD);
     if (!pinfo) {
         return -1;
     }
 
     pinfo->data = calloc(1, len);
     if (!pinfo->data) {
-        free(pinfo);
+        evtPoolFree(pinfo);
         return -1;
     }
 
     memmove(pinfo->data, buf, len);
-    if (net) memmove(&pinfo->net, net, sizeof(net_info));
+    if (net) {
+        memmove(&pinfo->net, net, sizeof(net_info));
+    } else {
+        memset(&pinfo->net, 0, sizeof(net_info));
+    }
 
     pinfo->evtype = EVT_PAYLOAD;
     pinfo->src = src;
@@ -934,7 +1595,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
 
     if (cmdPostPayload(g_ctl, (char *)pinfo) == -1) {
         if (pinfo->data) free(pinfo->data);
-        if (pinfo) free(pinfo);
+        evtPoolFree(pinfo);
         return -1;
     }
 
@@ -944,55 +1605,63 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
 static void
 detectProtocol(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_data_t dtype)
 {
-    unsigned int ptype;
-    protocol_def_t *pre;
+    bool found = FALSE;
+    hex_buf_t hexbuf = {0};
 
     // check once per connection
     if (!buf || !net || (net->protocol != 0)) return;
 
-    for (ptype = 0; ptype <= g_prot_sequence; ptype++) {
-        if ((pre = lstFind(g_protlist, ptype)) != NULL) {
-            switch (dtype) {
-            case BUF:
-                setProtocol(sockfd, pre, net, buf, len);
-                break;
-
-            case MSG:
-            {
-                int i;
-                struct msghdr *msg = (struct msghdr *)buf;
-                struct iovec *iov;
-
-                for (i = 0; i < msg->msg_iovlen; i++) {
-                    iov = &msg->msg_iov[i];
-                    if (iov && iov->iov_base && (iov->iov_len > 0)) {
-                        // check every vector?
-                        setProtocol(sockfd, pre, net, iov->iov_base, iov->iov_len);
-                    }
-                }
-                break;
-            }
+    // Keep protocols, and the matcher, from being freed while we use them
+    int token = hmapEnter(g_protlist);
+    int mtoken = hmapEnter(g_protmatch);
+    prot_matcher_t *matcher = protMatcher();
 
-            case IOV:
-            {
-                int i;
-                struct iovec *iov = (struct iovec *)buf;
+    switch (dtype) {
+    case BUF:
+        found = matchProtocols(sockfd, net, matcher, buf, len, &hexbuf);
+        break;
 
-                // len is expected to be an iovcnt for an IOV data type
-                for (i = 0; i < len; i++) {
-                    if (iov[i].iov_base && (iov[i].iov_len > 0)) {
-                        // check every vector?
-                        setProtocol(sockfd, pre, net, iov[i].iov_base, iov[i].iov_len);
-                    }
-                }
-                break;
+    case MSG:
+    {
+        int i;
+        struct msghdr *msg = (struct msghdr *)buf;
+        struct iovec *iov;
+
+        for (i = 0; (i < msg->msg_iovlen) && !found; i++) {
+            iov = &msg->msg_iov[i];
+            if (iov && iov->iov_base && (iov->iov_len > 0)) {
+                // check every vector?
+                found = matchProtocols(sockfd, net, matcher, iov->iov_base,
+                                       iov->iov_len, &hexbuf);
             }
+        }
+        break;
+    }
 
-            default:
-                break;
+    case IOV:
+    {
+        int i;
+        struct iovec *iov = (struct iovec *)buf;
+
+        // len is expected to be an iovcnt for an IOV data type
+        for (i = 0; (i < len) && !found; i++) {
+            if (iov[i].iov_base && (iov[i].iov_len > 0)) {
+                // check every vector?
+                found = matchProtocols(sockfd, net, matcher, iov[i].iov_base,
+                                       iov[i].iov_len, &hexbuf);
             }
         }
+        break;
+    }
+
+    default:
+        break;
     }
+
+    hmapExit(g_protmatch, mtoken);
+    hmapExit(g_protlist, token);
+
+    if (!found) net->protocol = -1;
 }
 
 int
@@ -1021,6 +1690,28 @@ doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_dat
     return 0;
 }
 
+void
+setOpEnable(void)
+{
+    // Anything below that reads or writes on a descriptor checks one of these
+    int mtc = mtcEnabled(g_mtc);
+    int metric = ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC);
+    int fs = mtc || metric || ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS);
+    int net = mtc || metric ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_DNS) ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_HTTP) ||
+        ctlPayEnable(g_ctl);
+    int logs = ctlEvtSourceEnabled(g_ctl, CFG_SRC_FILE) ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_CONSOLE);
+
+    unsigned int enable = 0;
+    if (fs || net) enable |= OP_READ;
+    if (fs || net || logs) enable |= OP_WRITE;
+    if (fs) enable |= OP_SEEK;
+    g_op_enable = enable;
+}
+
 void
 setVerbosity(unsigned verbosity)
 {
@@ -1043,7 +1734,7 @@ setVerbosity(unsigned verbosity)
 bool
 checkNetEntry(int fd)
 {
-    if (g_netinfo && (fd >= 0) && (fd < g_numNinfo)) {
+    if (g_netinfo && (fd >= 0) && (fd < fdTableMaxFds(g_netinfo))) {
         return TRUE;
     }
 
@@ -1053,7 +1744,7 @@ checkNetEntry(int fd)
 bool
 checkFSEntry(int fd)
 {
-    if (g_fsinfo && (fd >= 0) && (fd < g_numFSinfo)) {
+    if (g_fsinfo && (fd >= 0) && (fd < fdTableMaxFds(g_fsinfo))) {
         return TRUE;
     }
 
@@ -1063,9 +1754,9 @@ checkFSEntry(int fd)
 net_info *
 getNetEntry(int fd)
 {
-    if (g_netinfo && (fd >= 0) && (fd < g_numNinfo) &&
-        g_netinfo[fd].active) {
-        return &g_netinfo[fd];
+    net_info *net = fdTableGet(g_netinfo, fd);
+    if (net && net->active) {
+        return net;
     }
     return NULL;
 }
@@ -1073,9 +1764,9 @@ getNetEntry(int fd)
 fs_info *
 getFSEntry(int fd)
 {
-    if (g_fsinfo && (fd >= 0) && (fd < g_numFSinfo) &&
-        g_fsinfo[fd].active) {
-        return &g_fsinfo[fd];
+    fs_info *fs = fdTableGet(g_fsinfo, fd);
+    if (fs && fs->active) {
+        return fs;
     }
 
     const char* name;
@@ -1101,7 +1792,7 @@ getFSEntry(int fd)
 
         doOpen(fd, name, FD, description);
 
-        return &g_fsinfo[fd];
+        return fdTableGet(g_fsinfo, fd);
     }
 
     return NULL;
@@ -1120,49 +1811,26 @@ setRemoteClose(int sd, int err)
 void
 addSock(int fd, int type, int family)
 {
-    if (checkNetEntry(fd) == TRUE) {
-        if (g_netinfo[fd].active) {
+    net_info *net;
+
+    if ((net = netSlot(fd)) != NULL) {
+        if (net->active) {
 
             doClose(fd, "close: DuplicateSocket");
 
         }
-/*
- * We need to do this realloc.
- * However, it needs to be done in such a way as to not
- * free the previous object that may be in use by a thread.
- * Possibly not use realloc. Leaving the code in place and this
- * comment as a reminder.
-        if ((fd > g_numNinfo) && (fd < MAX_FDS))  {
-            int increase;
-            net_info *temp;
-
-            if (fd < (MAX_FDS / 2)) {
-                increase = MAX_FDS / 2;
-            } else {
-                increase = MAX_FDS;
-            }
 
-            // Need to realloc
-            if ((temp = realloc(g_netinfo, sizeof(struct net_info_t) * increase)) == NULL) {
-                scopeLog("ERROR: addSock:realloc", fd, CFG_LOG_ERROR);
-                DBG("re-alloc on Net table failed");
-            } else {
-                memset(&temp[g_numNinfo], 0, sizeof(struct net_info_t) * (increase - g_numNinfo));
-                g_numNinfo = increase;
-                g_netinfo = temp;
-            }
-        }
-*/
-        memset(&g_netinfo[fd], 0, sizeof(struct net_info_t));
-        g_netinfo[fd].active = TRUE;
-        g_netinfo[fd].type = type;
-        g_netinfo[fd].localConn.ss_family = family;
-        g_netinfo[fd].uid = getTime();
+        memset(net, 0, sizeof(struct net_info_t));
+        net->active = TRUE;
+        net->type = type;
+        net->localConn.ss_family = family;
+        net->uid = getTime();
 #ifdef __LINUX__
         // Clear these bits so comparisons of type will work
-        g_netinfo[fd].type &= ~SOCK_CLOEXEC;
-        g_netinfo[fd].type &= ~SOCK_NONBLOCK;
+        net->type &= ~SOCK_CLOEXEC;
+        net->type &= ~SOCK_NONBLOCK;
 #endif // __LINUX__
+        fdTableSetActive(g_netinfo, fd);
     }
 }
 
@@ -1178,10 +1846,11 @@ doBlockConnection(int fd, const struct sockaddr *addr_arg)
     // null, we will use addressing from the local side of the
     // accept fd.
     const struct sockaddr* addr;
+    net_info *net;
     if (addr_arg) {
         addr = addr_arg;
-    } else if (checkNetEntry(fd)) {
-        addr = (struct sockaddr*)&g_netinfo[fd].localConn;
+    } else if ((net = fdTableGet(g_netinfo, fd)) != NULL) {
+        addr = (struct sockaddr*)&net->localConn;
     } else {
         return 0;
     }
@@ -1202,6 +1871,34 @@ doBlockConnection(int fd, const struct sockaddr *addr_arg)
     return 0;
 }
 
+static const void *
+inetAddr(const struct sockaddr *sa)
+{
+    switch (sa->sa_family) {
+        case AF_INET:
+            return &((struct sockaddr_in *)sa)->sin_addr;
+        case AF_INET6:
+            return &((struct sockaddr_in6 *)sa)->sin6_addr;
+        default:
+            return NULL;
+    }
+}
+
+static void
+setPeerName(net_info *net)
+{
+    char name[HOSTCACHE_MAX_NAME];
+    const struct sockaddr *sa = (struct sockaddr *)&net->remoteConn;
+    const void *addr = inetAddr(sa);
+
+    strtabRelease(g_strtab, net->peerName);
+    if (addr && hostCacheFind(g_hostcache, sa->sa_family, addr, name, sizeof(name))) {
+        net->peerName = strtabIntern(g_strtab, name);
+    } else {
+        net->peerName = STRTAB_NONE;
+    }
+}
+
 void
 doSetConnection(int sd, const struct sockaddr *addr, socklen_t len, control_type_t endp)
 {
@@ -1215,15 +1912,19 @@ doSetConnection(int sd, const struct sockaddr *addr, socklen_t len, control_type
     if (((net = getNetEntry(sd)) != NULL) && addr && (len > 0)) {
         if (endp == LOCAL) {
             if ((net->type == SOCK_STREAM) && (net->addrSetLocal == TRUE)) return;
-            memmove(&g_netinfo[sd].localConn, addr, len);
+            memmove(&net->localConn, addr, len);
             if (net->type == SOCK_STREAM) net->addrSetLocal = TRUE;
         } else {
             if ((net->type == SOCK_STREAM) && (net->addrSetRemote == TRUE)) return;
-            memmove(&g_netinfo[sd].remoteConn, addr, len);
+            // A datagram socket's peer can change with every send;
+            // only look for its name when it does
+            int changed = memcmp(&net->remoteConn, addr, len);
+            memmove(&net->remoteConn, addr, len);
             if (net->type == SOCK_STREAM) net->addrSetRemote = TRUE;
+            if (changed) setPeerName(net);
         }
 
-        if (addrIsNetDomain(&g_netinfo[sd].localConn)) {
+        if (addrIsNetDomain(&net->localConn)) {
             doUpdateState(CONNECTION_OPEN, sd, 1, NULL, NULL);
         }
     }
@@ -1354,11 +2055,19 @@ getDNSName(int sd, void *pkt, int pktlen)
     char *dname;
     char dnsName[MAX_HOSTNAME+1];
     int dnsNameBytesUsed = 0;
+    net_info *net;
 
-    if (getNetEntry(sd) == NULL) {
+    if ((net = getNetEntry(sd)) == NULL) {
         return -1;
     }
 
+    // So that the response can be matched with it
+    int id;
+    if ((net->type == SOCK_DGRAM) && (pktlen > 0) &&
+        ((id = dnsQueryId(pkt, pktlen)) != -1)) {
+        dnsPendingAdd(g_dnspending, sd, (uint16_t)id, getTime());
+    }
+
     query = (struct dns_query_t *)pkt;
     header = &query->qhead;
     if ((dname = (char *)&query->name) == NULL) {
@@ -1444,39 +2153,58 @@ getDNSName(int sd, void *pkt, int pktlen)
 
     dnsName[dnsNameBytesUsed-1] = '\0'; // overwrite the last period
 
-    if (strncmp(dnsName, g_netinfo[sd].dnsName, dnsNameBytesUsed) == 0) {
+    if (strncmp(dnsName, net->dnsName, dnsNameBytesUsed) == 0) {
         // Already sent this from an interposed function
-        g_netinfo[sd].dnsSend = FALSE;
+        net->dnsSend = FALSE;
     } else {
-        strncpy(g_netinfo[sd].dnsName, dnsName, dnsNameBytesUsed);
-        g_netinfo[sd].dnsSend = TRUE;
+        strncpy(net->dnsName, dnsName, dnsNameBytesUsed);
+        net->dnsSend = TRUE;
     }
 
     return 0;
 }
 
+// What getaddrinfo() resolved node to, for the host cache.  A node
+// that's already an address says nothing about names.
+void
+doHostAddrInfo(const char *node, const struct addrinfo *res)
+{
+    struct in6_addr num;
+
+    if (!node || !node[0] || (inet_pton(AF_INET, node, &num) == 1) ||
+        (inet_pton(AF_INET6, node, &num) == 1)) return;
+
+    for (; res; res = res->ai_next) {
+        const void *addr;
+        if (res->ai_addr && ((addr = inetAddr(res->ai_addr)) != NULL)) {
+            hostCacheAdd(g_hostcache, res->ai_addr->sa_family, addr, node);
+        }
+    }
+}
+
 int
 doURL(int sockfd, const void *buf, size_t len, metric_t src)
 {
     if (g_cfg.urls == 0) return 0;
 
-    if (checkNetEntry(sockfd) == TRUE) {
-        if (!g_netinfo[sockfd].active) {
-            doAddNewSock(sockfd);
-        }
+    net_info *net = netSlot(sockfd);
+    if (!net) return 0;
 
-        doSetAddrs(sockfd);
+    if (!net->active) {
+        doAddNewSock(sockfd);
     }
 
+    doSetAddrs(sockfd);
+
 
     if ((src == NETTX) && (searchExec(g_http_redirect, (char *)buf, len) != -1)) {
-        g_netinfo[sockfd].urlRedirect = TRUE;
+        net->urlRedirect = TRUE;
         return 0;
     }
 
-    if ((src == NETRX) && (g_netinfo[sockfd].urlRedirect == TRUE) &&
+    if ((src == NETRX) && (net->urlRedirect == TRUE) &&
         (len >= strlen(OVERURL))) {
-        g_netinfo[sockfd].urlRedirect = FALSE;
+        net->urlRedirect = FALSE;
         // explicit vars as it's nice to have in the debugger
         //char *sbuf = (char *)buf;
         char *url = OVERURL;
@@ -1487,11 +2215,99 @@ doURL(int sockfd, const void *buf, size_t len, metric_t src)
     return 0;
 }
 
+static void
+postDNSAnswer(int sockfd, net_info *net, dns_resp_t *resp, uint64_t duration)
+{
+    int need_to_post =
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_DNS) ||
+        (mtcEnabled(g_mtc) && !g_summary.net.dns);
+    if (!need_to_post) return;
+
+    size_t len = strlen(resp->name) + 1;
+    protocol_info *proto = evtAlloc(EVT_POOL_PROTO);
+    // The name goes on the end, so freeing the answer frees it too
+    dns_answer_t *ans = malloc(sizeof(dns_answer_t) + len);
+    if (!proto || !ans) {
+        DBG(NULL);
+        if (ans) free(ans);
+        evtPoolFree(proto);
+        return;
+    }
+    memset(proto, 0, sizeof(struct protocol_info_t));
+
+    ans->rcode = resp->rcode;
+    ans->answers = resp->answers;
+    ans->ttl = resp->ttl;
+    ans->duration = duration;
+    memcpy(ans->name, resp->name, len);
+
+    proto->evtype = EVT_PROTO;
+    proto->ptype = EVT_DNSRESP;
+    proto->len = sizeof(dns_answer_t) + len;
+    proto->fd = sockfd;
+    proto->uid = net->uid;
+    proto->sock_type = -1;
+    proto->localConn.ss_family = -1;
+    proto->remoteConn.ss_family = -1;
+    proto->data = (char *)ans;
+
+    if (cmdPostEvent(g_ctl, (char *)proto) == -1) {
+        free(ans);
+        evtPoolFree(proto);
+    }
+}
+
+// A response from a resolver we're watching on the wire.  Only one that
+// matches a query we saw sent is reported; others may not even be DNS.
+// Returns TRUE if it was.
+static int
+doDNSResponse(int sockfd, net_info *net, const void *buf, size_t len, src_data_t src)
+{
+    const void *pkt = buf;
+    uint64_t start;
+    dns_resp_t resp;
+
+    if (net->type != SOCK_DGRAM) return FALSE;
+
+    if (src == MSG) {
+        // A datagram's header is all in the first iov, in practice
+        const struct msghdr *msg = buf;
+        if (!msg || !msg->msg_iov || (msg->msg_iovlen < 1)) return FALSE;
+        pkt = msg->msg_iov[0].iov_base;
+        len = MIN(len, msg->msg_iov[0].iov_len);
+    } else if (src != BUF) {
+        return FALSE;
+    }
+
+    if (!dnsParseResponse(pkt, len, &resp) ||
+        !dnsPendingTake(g_dnspending, sockfd, resp.id, &start)) return FALSE;
+
+    uint64_t duration = getDurationNow(getTime(), start);
+    if (!resp.name[0]) strncpy(resp.name, net->dnsName, sizeof(resp.name) - 1);
+
+    if (resp.rcode == DNS_RCODE_NOERROR) {
+        unsigned int i;
+        for (i = 0; i < resp.naddrs; i++) {
+            hostCacheAdd(g_hostcache, resp.addr[i].family, resp.addr[i].addr, resp.name);
+        }
+    }
+
+    doUpdateState(DNS, sockfd, (ssize_t)duration, NULL, resp.name);
+    doUpdateState(DNS_DURATION, sockfd, (ssize_t)duration, NULL, resp.name);
+    if ((resp.rcode == DNS_RCODE_NXDOMAIN) || (resp.rcode == DNS_RCODE_SERVFAIL)) {
+        doUpdateState(NET_ERR_DNS, sockfd, 0, dnsRcodeName(resp.rcode), resp.name);
+    }
+    postDNSAnswer(sockfd, net, &resp, duration);
+    return TRUE;
+}
+
 int
 doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
 {
-    if (checkNetEntry(sockfd) == TRUE) {
-        if (!g_netinfo[sockfd].active) {
+    net_info *net;
+
+    if ((net = netSlot(sockfd)) != NULL) {
+        if (!net->active) {
             doAddNewSock(sockfd);
         }
 
@@ -1503,15 +2319,16 @@ doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
          * This is the the traditional "end-of-file"
          */
         if (len == 0) {
-            g_netinfo[sockfd].remoteClose = TRUE;
+            net->remoteClose = TRUE;
             // Seems that returning here makes sense with a len of 0
             return 0;
         }
 
         doUpdateState(NETRX, sockfd, rc, NULL, NULL);
 
-        if (remotePortIsDNS(sockfd) && (g_netinfo[sockfd].dnsName[0])) {
-            doUpdateState(DNS, sockfd, (ssize_t)1, NULL, g_netinfo[sockfd].dnsName);
+        if (remotePortIsDNS(sockfd) &&
+            !doDNSResponse(sockfd, net, buf, len, src) && (net->dnsName[0])) {
+            doUpdateState(DNS, sockfd, (ssize_t)1, NULL, net->dnsName);
         }
 
         if ((sockfd != -1) && buf) {
@@ -1524,16 +2341,18 @@ doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
 int
 doSend(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
 {
-    if (checkNetEntry(sockfd) == TRUE) {
-        if (!g_netinfo[sockfd].active) {
+    net_info *net;
+
+    if ((net = netSlot(sockfd)) != NULL) {
+        if (!net->active) {
             doAddNewSock(sockfd);
         }
 
         doSetAddrs(sockfd);
         doUpdateState(NETTX, sockfd, rc, NULL, NULL);
 
-        if (get_port(sockfd, g_netinfo[sockfd].remoteConn.ss_family, REMOTE) == DNS_PORT) {
-            if (g_netinfo[sockfd].dnsName[0]) {
+        if (get_port_net(net, net->remoteConn.ss_family, REMOTE) == DNS_PORT) {
+            if (net->dnsName[0]) {
                 doUpdateState(DNS, sockfd, (ssize_t)0, NULL, NULL);
             }
         }
@@ -1605,9 +2424,27 @@ reportFD(int fd, control_type_t source)
 void
 reportAllFds(control_type_t source)
 {
-    int i;
-    for (i = 0; i < MAX(g_numNinfo, g_numFSinfo); i++) {
-        reportFD(i, source);
+    int fd;
+
+    // stdin, stdout and stderr are reported whether they've been seen or not
+    for (fd = 0; fd <= 2; fd++) {
+        reportFD(fd, source);
+    }
+
+    // Walk the union of active net and fs descriptors in fd order
+    int nfd = fdTableNextActive(g_netinfo, fd);
+    int ffd = fdTableNextActive(g_fsinfo, fd);
+    while ((nfd != -1) || (ffd != -1)) {
+        if ((nfd == -1) || ((ffd != -1) && (ffd < nfd))) {
+            fd = ffd;
+        } else {
+            fd = nfd;
+        }
+
+        reportFD(fd, source);
+
+        if (nfd == fd) nfd = fdTableNextActive(g_netinfo, fd + 1);
+        if (ffd == fd) ffd = fdTableNextActive(g_fsinfo, fd + 1);
     }
 }
 
@@ -1630,7 +2467,7 @@ doRead(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes
             }
         } else if (fs) {
             // Don't count data from stdin
-            if ((fd > 2) || strncmp(fs->path, "std", 3)) {
+            if ((fd > 2) || strncmp(strtabStr(g_strtab, fs->path), "std", 3)) {
                 uint64_t duration = getDuration(initialTime);
                 doUpdateState(FS_DURATION, fd, duration, func, NULL);
                 doUpdateState(FS_READ, fd, bytes, func, NULL);
@@ -1638,7 +2475,7 @@ doRead(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_READ_WRITE, fd, bytes, func, fs->path);
+            doUpdateState(FS_ERR_READ_WRITE, fd, bytes, func, strtabStr(g_strtab, fs->path));
         } else if (net) {
             doUpdateState(NET_ERR_RX_TX, fd, bytes, func, "nopath");
         }
@@ -1664,7 +2501,7 @@ doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t byte
             }
         } else if (fs) {
             // Don't count data from stdout, stderr
-            if ((fd > 2) || strncmp(fs->path, "std", 3)) {
+            if ((fd > 2) || strncmp(strtabStr(g_strtab, fs->path), "std", 3)) {
                 uint64_t duration = getDuration(initialTime);
                 doUpdateState(FS_DURATION, fd, duration, func, NULL);
                 doUpdateState(FS_WRITE, fd, bytes, func, NULL);
@@ -1676,18 +2513,18 @@ doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t byte
 
                 for (i = 0; i < cnt; i++) {
                     if (iov[i].iov_base) {
-                        ctlSendLog(g_ctl, fs->path, iov[i].iov_base, iov[i].iov_len, fs->uid, &g_proc);
+                        ctlSendLog(g_ctl, strtabStr(g_strtab, fs->path), iov[i].iov_base, iov[i].iov_len, fs->uid, &g_proc);
                     }
                 }
 
                 return;
             }
 
-            ctlSendLog(g_ctl, fs->path, buf, bytes, fs->uid, &g_proc);
+            ctlSendLog(g_ctl, strtabStr(g_strtab, fs->path), buf, bytes, fs->uid, &g_proc);
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_READ_WRITE, fd, bytes, func, fs->path);
+            doUpdateState(FS_ERR_READ_WRITE, fd, bytes, func, strtabStr(g_strtab, fs->path));
         } else if (net) {
             doUpdateState(NET_ERR_RX_TX, fd, bytes, func, "nopath");
         }
@@ -1705,7 +2542,7 @@ doSeek(int fd, int success, const char *func)
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_READ_WRITE, fd, (size_t)0, func, fs->path);
+            doUpdateState(FS_ERR_READ_WRITE, fd, (size_t)0, func, strtabStr(g_strtab, fs->path));
         }
     }
 }
@@ -1730,11 +2567,11 @@ doStatFd(int fd, int rc, const char* func)
     if (rc != -1) {
         scopeLog(func, fd, CFG_LOG_DEBUG);
         if (fs) {
-            doUpdateState(FS_STAT, fd, 0, func, fs->path);
+            doUpdateState(FS_STAT, fd, 0, func, strtabStr(g_strtab, fs->path));
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_STAT, fd, (size_t)0, func, fs->path);
+            doUpdateState(FS_ERR_STAT, fd, (size_t)0, func, strtabStr(g_strtab, fs->path));
         }
     }
 }
@@ -1743,30 +2580,39 @@ doStatFd(int fd, int rc, const char* func)
 int
 doDupFile(int newfd, int oldfd, const char *func)
 {
-    if (!checkFSEntry(newfd) || !checkFSEntry(oldfd)) {
+    fs_info *old;
+
+    if (!checkFSEntry(newfd) || ((old = fsSlot(oldfd)) == NULL)) {
         return -1;
     }
 
-    doOpen(newfd, g_fsinfo[oldfd].path, g_fsinfo[oldfd].type, func);
+    doOpen(newfd, strtabStr(g_strtab, old->path), old->type, func);
     return 0;
 }
 
 int
 doDupSock(int oldfd, int newfd)
 {
-    if (!checkNetEntry(newfd) || !checkNetEntry(oldfd)) {
+    net_info *new, *old;
+
+    if (((new = netSlot(newfd)) == NULL) || ((old = netSlot(oldfd)) == NULL)) {
         return -1;
     }
 
-    memmove(&g_netinfo[newfd], &g_netinfo[oldfd], sizeof(struct fs_info_t));
-    g_netinfo[newfd].active = TRUE;
-    g_netinfo[newfd].numTX = (counters_element_t){.mtc=0, .evt=0};
-    g_netinfo[newfd].numRX = (counters_element_t){.mtc=0, .evt=0};
-    g_netinfo[newfd].txBytes = (counters_element_t){.mtc=0, .evt=0};
-    g_netinfo[newfd].rxBytes = (counters_element_t){.mtc=0, .evt=0};
-    g_netinfo[newfd].startTime = 0ULL;
-    g_netinfo[newfd].totalDuration = (counters_element_t){.mtc=0, .evt=0};
-    g_netinfo[newfd].numDuration = (counters_element_t){.mtc=0, .evt=0};
+    strtabRelease(g_strtab, new->peerName);
+    memmove(new, old, sizeof(struct net_info_t));
+    strtabRef(g_strtab, new->peerName);
+    // The HTTP state, and the header buffer in it, belongs to the old socket
+    memset(&new->http, 0, sizeof(new->http));
+    new->active = TRUE;
+    new->numTX = (counters_element_t){.mtc=0, .evt=0};
+    new->numRX = (counters_element_t){.mtc=0, .evt=0};
+    new->txBytes = (counters_element_t){.mtc=0, .evt=0};
+    new->rxBytes = (counters_element_t){.mtc=0, .evt=0};
+    new->startTime = 0ULL;
+    new->totalDuration = (counters_element_t){.mtc=0, .evt=0};
+    new->numDuration = (counters_element_t){.mtc=0, .evt=0};
+    fdTableSetActive(g_netinfo, newfd);
 
     doUpdateState(CONNECTION_OPEN, newfd, 1, "dup", NULL);
     return 0;
@@ -1791,7 +2637,7 @@ doDup(int fd, int rc, const char *func, int copyNet)
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_OPEN_CLOSE, fd, (size_t)0, func, fs->path);
+            doUpdateState(FS_ERR_OPEN_CLOSE, fd, (size_t)0, func, strtabStr(g_strtab, fs->path));
         } else if (net) {
             doUpdateState(NET_ERR_CONN, fd, (size_t)0, func, "nopath");
         }
@@ -1819,7 +2665,7 @@ doDup2(int oldfd, int newfd, int rc, const char *func)
         }
     } else {
         if (fs) {
-            doUpdateState(FS_ERR_OPEN_CLOSE, oldfd, (size_t)0, func, fs->path);
+            doUpdateState(FS_ERR_OPEN_CLOSE, oldfd, (size_t)0, func, strtabStr(g_strtab, fs->path));
         } else if (net) {
             doUpdateState(NET_ERR_CONN, oldfd, (size_t)0, func, "nopath");
         }
@@ -1835,7 +2681,7 @@ doClose(int fd, const char *func)
     ninfo = getNetEntry(fd);
 
     int guard_enabled = g_http_guard_enabled && ninfo;
-    if (guard_enabled) while (!atomicCasU64(&g_http_guard[fd], 0ULL, 1ULL));
+    if (guard_enabled) while (!atomicCasU64(&g_http_guard[HTTP_GUARD_INDEX(fd)], 0ULL, 1ULL));
 
     if (ninfo != NULL) {
         doUpdateState(OPEN_PORTS, fd, -1, func, NULL);
@@ -1853,61 +2699,45 @@ doClose(int fd, const char *func)
     // report everything before the info is lost
     reportFD(fd, EVENT_BASED);
 
-    if (ninfo) memset(ninfo, 0, sizeof(struct net_info_t));
-    if (fsinfo) memset(fsinfo, 0, sizeof(struct fs_info_t));
+    if (ninfo) {
+        strtabRelease(g_strtab, ninfo->peerName);
+        memset(ninfo, 0, sizeof(struct net_info_t));
+        fdTableClearActive(g_netinfo, fd);
+    }
+    if (fsinfo) {
+        strtabRelease(g_strtab, fsinfo->path);
+        memset(fsinfo, 0, sizeof(struct fs_info_t));
+        fdTableClearActive(g_fsinfo, fd);
+    }
 
-    if (guard_enabled) while (!atomicCasU64(&g_http_guard[fd], 1ULL, 0ULL));
+    if (guard_enabled) while (!atomicCasU64(&g_http_guard[HTTP_GUARD_INDEX(fd)], 1ULL, 0ULL));
 }
 
 void
 doOpen(int fd, const char *path, fs_type_t type, const char *func)
 {
-    if (checkFSEntry(fd) == TRUE) {
-        if (g_fsinfo[fd].active) {
+    fs_info *fs;
+
+    if ((fs = fsSlot(fd)) != NULL) {
+        if (fs->active) {
             scopeLog("doOpen: duplicate", fd, CFG_LOG_DEBUG);
             DBG(NULL);
             doClose(fd, func);
         }
-/*
- * We need to do this realloc.
- * However, it needs to be done in such a way as to not
- * free the previous object that may be in use by a thread.
- * Possibly not use realloc. Leaving the code in place and this
- * comment as a reminder.
-
-        if ((fd > g_numFSinfo) && (fd < MAX_FDS))  {
-            int increase;
-            fs_info *temp;
-
-            if (fd < (MAX_FDS / 2)) {
-                increase = MAX_FDS / 2;
-            } else {
-                increase = MAX_FDS;
-            }
 
-            // Need to realloc
-            if ((temp = realloc(g_fsinfo, sizeof(struct fs_info_t) * increase)) == NULL) {
-                scopeLog("ERROR: doOpen:realloc", fd, CFG_LOG_ERROR);
-                DBG("re-alloc on FS table failed");
-            } else {
-                memset(&temp[g_numFSinfo], 0, sizeof(struct fs_info_t) * (increase - g_numFSinfo));
-                g_fsinfo = temp;
-                g_numFSinfo = increase;
-            }
-        }
-*/
-        memset(&g_fsinfo[fd], 0, sizeof(struct fs_info_t));
-        g_fsinfo[fd].active = TRUE;
-        g_fsinfo[fd].type = type;
-        g_fsinfo[fd].uid = getTime();
-        strncpy(g_fsinfo[fd].path, path, sizeof(g_fsinfo[fd].path));
+        memset(fs, 0, sizeof(struct fs_info_t));
+        fs->active = TRUE;
+        fs->type = type;
+        fs->uid = getTime();
+        fs->path = strtabIntern(g_strtab, path);
+        fdTableSetActive(g_fsinfo, fd);
 
         if (ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) && ctlEnhanceFs(g_ctl)) {
             struct stat sbuf;
-            if ((g_fn.__xstat) && (g_fn.__xstat(1, g_fsinfo[fd].path, &sbuf) == 0)) {
-                g_fsinfo[fd].fuid = sbuf.st_uid;
-                g_fsinfo[fd].fgid = sbuf.st_gid;
-                g_fsinfo[fd].mode = sbuf.st_mode;
+            if ((g_fn.__xstat) && (g_fn.__xstat(1, path, &sbuf) == 0)) {
+                fs->fuid = sbuf.st_uid;
+                fs->fgid = sbuf.st_gid;
+                fs->mode = sbuf.st_mode;
             }
         }
 
@@ -1941,7 +2771,7 @@ doSendFile(int out_fd, int in_fd, uint64_t initialTime, int rc, const char *func
          * We emit one metric with the input pathname
          */
         if (fsrd) {
-            doUpdateState(FS_ERR_READ_WRITE, in_fd, (size_t)0, func, fsrd->path);
+            doUpdateState(FS_ERR_READ_WRITE, in_fd, (size_t)0, func, strtabStr(g_strtab, fsrd->path));
         }
 
         if (nettx) {
@@ -1958,7 +2788,7 @@ doCloseAndReportFailures(int fd, int success, const char *func)
         doClose(fd, func);
     } else {
         if ((fs = getFSEntry(fd))) {
-            doUpdateState(FS_ERR_OPEN_CLOSE, fd, (size_t)0, func, fs->path);
+            doUpdateState(FS_ERR_OPEN_CLOSE, fd, (size_t)0, func, strtabStr(g_strtab, fs->path));
         }
     }
 }
@@ -1968,9 +2798,11 @@ doCloseAllStreams()
 {
     if (!g_fsinfo) return;
     int i;
-    for (i = 0; i < g_numFSinfo; i++) {
-        if ((g_fsinfo[i].active) &&
-            (g_fsinfo[i].type == STREAM)) {
+    for (i = fdTableNextActive(g_fsinfo, 0); i != -1;
+         i = fdTableNextActive(g_fsinfo, i + 1)) {
+        fs_info *fs = fdTableGet(g_fsinfo, i);
+        if (fs && (fs->active) &&
+            (fs->type == STREAM)) {
             doClose(i, "fcloseall");
         }
     }
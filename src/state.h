@@ -1,6 +1,7 @@
 #ifndef __STATE_H__
 #define __STATE_H__
 
+#include <netdb.h>
 #include <sys/socket.h>
 #include "pcre2posix.h"
 
@@ -23,15 +24,29 @@ typedef enum {
 } src_data_t;
 
 void initState();
+void reclaimState();
+void lockState();
+void unlockState();
 void resetState();
+void evtDiscard(uint64_t);
+
+// Interposed operations with any work to do under the current config.
+// A wrapper whose bit is clear goes straight to libc.
+#define OP_READ  0x1
+#define OP_WRITE 0x2
+#define OP_SEEK  0x4
+#define OP_ENABLED(op) (g_op_enable & (op))
+extern unsigned int g_op_enable;
 
 void setVerbosity(unsigned);
+void setOpEnable(void);
 void addSock(int, int, int);
 int doBlockConnection(int, const struct sockaddr *);
 void doSetConnection(int, const struct sockaddr *, socklen_t, control_type_t);
 int doSetAddrs(int);
 int doAddNewSock(int);
 int getDNSName(int, void *, int);
+void doHostAddrInfo(const char *, const struct addrinfo *);
 int doURL(int, const void *, size_t, metric_t);
 int doRecv(int, ssize_t, const void *, size_t, src_data_t);
 int doSend(int, ssize_t, const void *, size_t, src_data_t);
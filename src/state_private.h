@@ -3,11 +3,19 @@
 
 #include <limits.h>
 #include <sys/socket.h>
+#include "evtpool.h"
+#include "fdtable.h"
+#include "httphdr.h"
+#include "strtab.h"
 
 #define PROTOCOL_STR 16
 #define FUNC_MAX 24
 #define HDRTYPE_MAX 16
 
+// g_http_guard is fixed size; fds past the end share an entry
+#define HTTP_GUARD_ENTRIES 1024
+#define HTTP_GUARD_INDEX(fd) ((unsigned int)(fd) & (HTTP_GUARD_ENTRIES - 1))
+
 //
 // This file contains implementation details for state.c and reporting.c.
 // It is expected that state.c and report.c will both directly include
@@ -57,6 +65,20 @@ typedef struct metric_counters_t {
     counters_element_t  fsStatErrors;
 } metric_counters;
 
+// The g_ctrs fields that change on every read, write, send or recv.
+// Threads update these through per-thread shards (see ctrshard.h);
+// foldShardedCounts() brings g_ctrs up to date before it's read.
+typedef enum {
+    SHARD_READ_BYTES,           // readBytes
+    SHARD_WRITE_BYTES,          // writeBytes
+    SHARD_NETRX_BYTES,          // netrxBytes[], one per bucket
+    SHARD_NETTX_BYTES = SHARD_NETRX_BYTES + SOCK_NUM_BUCKETS,
+    SHARD_SEEK = SHARD_NETTX_BYTES + SOCK_NUM_BUCKETS,
+    SHARD_FS_DURATION_NUM,      // fsDurationNum
+    SHARD_FS_DURATION_TOTAL,    // fsDurationTotal
+    SHARD_MAX
+} shard_ctr_t;
+
 typedef struct {
     struct {
         int open_close;
@@ -82,7 +104,12 @@ typedef struct http_post_t {
     int ssl;
     uint64_t start_duration;
     uint64_t id;
+    uint32_t stream;    // HTTP/2 stream id; 0 for HTTP/1.x
     char *hdr;
+    uint64_t first_byte;    // when the header started to arrive
+    uint64_t last_byte;     // EVT_HBODY; when the body after a response ended
+    uint32_t conn_req;      // requests on the connection, through this one
+    int timed;              // a response whose body's end follows as EVT_HBODY
 } http_post;
 
 typedef struct http_map_t {
@@ -91,18 +118,27 @@ typedef struct http_map_t {
     uint64_t start_time;
     uint64_t duration;
     uint64_t id;
-    char *req;          // The whole original request
+    char *req;          // A copy of the whole original request
     size_t req_len;
-    char *method_str;   //   Method field from Request-Line
-    char *target_str;   //   Request-URI field from Request-Line
+    http_hdr_t reqhdr;  //   Where the fields of req are
     size_t clen;        //   Content-Length entity-header value from req
     char *resp;         // The whole original response
+    uint32_t conn_req;  // Requests on the connection, through req
 } http_map;
 
+// A response reported before its body ended, waiting for EVT_HBODY
+typedef struct http_xfer_t {
+    time_t first_time;
+    uint64_t first_byte;
+    size_t status;
+    int isServer;
+    char target[];      // of its request
+} http_xfer;
+
 typedef struct stat_err_info_t {
     metric_t evtype;
     metric_t data_type;
-    char name[PATH_MAX];
+    strtab_id_t name;          // in g_strtab; a posted record holds a reference
     char funcop[FUNC_MAX];
     metric_counters counters;
 } stat_err_info;
@@ -110,8 +146,6 @@ typedef struct stat_err_info_t {
 typedef enum {
     HTTP_NONE,
     HTTP_HDR,
-    HTTP_HDREND,
-    HTTP_DATA
 } http_enum_t;
 
 typedef struct
@@ -122,6 +156,27 @@ typedef struct
     metric_t src;
 } httpId_t;
 
+// Where we are in the body that follows a header (RFC 7230 3.3.3)
+typedef enum {
+    HTTP_BODY_NONE,         // no body; the next byte starts a header
+    HTTP_BODY_LENGTH,       // left bytes of a Content-Length body
+    HTTP_BODY_CHUNK_SIZE,   // in a chunk-size line
+    HTTP_BODY_CHUNK_DATA,   // left bytes of chunk data and its CRLF
+    HTTP_BODY_TRAILER,      // in the trailer after the last chunk
+    HTTP_BODY_CLOSE,        // the body runs until the connection closes
+} http_body_enum_t;
+
+typedef struct {
+    http_body_enum_t state;
+    int isSsl;
+    size_t left;
+    size_t size;            // chunk size read so far
+    unsigned int linelen;   // bytes of the chunk-size or trailer line
+    bool ext;               // past the chunk size digits
+    bool timed;             // a response's, whose end is posted for id
+    httpId_t id;
+} http_body_t;
+
 typedef struct protocol_info_t {
     metric_t evtype;
     metric_t ptype;
@@ -140,8 +195,13 @@ typedef struct {
     char *hdr;          // Used if state == HDR
     size_t hdrlen;
     size_t hdralloc;
-    size_t clen;        // Used if state==HTTP_DATA
     httpId_t id;
+    http_body_t body[2];        // rx, tx
+    uint64_t pending;           // HTTP_REQ_* of requests awaiting a response,
+    unsigned int npending;      //   two bits each, oldest in the low bits
+    uint64_t first_byte;        // when the header in hdr started
+    uint32_t nreq;              // requests seen on the connection
+    struct http2_state_t *h2;   // Set once the connection is HTTP/2
 } http_state_t;
 
 typedef struct net_info_t {
@@ -168,6 +228,8 @@ typedef struct net_info_t {
     uint64_t lnode;
     uint64_t rnode;
     char dnsName[MAX_HOSTNAME];
+    strtab_id_t peerName;      // in g_strtab; what remoteConn was looked up as.
+                               //   an fd's entry, or a record, holds a reference
     struct sockaddr_storage localConn;
     struct sockaddr_storage remoteConn;
     metric_counters counters;
@@ -193,10 +255,28 @@ typedef struct fs_info_t {
     uid_t fuid;
     gid_t fgid;
     mode_t mode;
-    char path[PATH_MAX];
+    strtab_id_t path;          // in g_strtab; an fd's entry, or a record, holds a reference
     char funcop[FUNC_MAX];
 } fs_info;
 
+//
+// fs_info and net_info are too big to copy for every read or write.
+// Those events are posted as a delta instead: just the counters that
+// changed, fd and uid.  The path or connection tuple is found when the
+// periodic thread drains the queue, from the fd table if the same uid
+// is still open there, or else from the close record later in the
+// queue.  funcop must point to static storage (a string literal).
+//
+typedef struct delta_info_t {
+    metric_t evtype;           // EVT_DELTA
+    metric_t data_type;        // FS_READ, FS_WRITE, FS_DURATION, FS_SEEK, NETRX, NETTX
+    int fd;
+    uint64_t uid;
+    const char *funcop;
+    counters_element_t num;    // numRead, numWrite, numDuration, numSeek, numRX, numTX
+    counters_element_t bytes;  // readBytes, writeBytes, totalDuration, rxBytes, txBytes
+} delta_info;
+
 typedef struct payload_info_t {
     metric_t evtype;
     metric_t src;
@@ -206,6 +286,18 @@ typedef struct payload_info_t {
     char *data;
 } payload_info;
 
+// Records posted to the periodic thread come from one of these pools.
+// Anything allocated with evtAlloc() is released with evtPoolFree().
+typedef enum {
+    EVT_POOL_FS,          // fs_info
+    EVT_POOL_NET,         // net_info
+    EVT_POOL_STAT_ERR,    // stat_err_info
+    EVT_POOL_PROTO,       // protocol_info
+    EVT_POOL_PAYLOAD,     // payload_info
+    EVT_POOL_DELTA,       // delta_info
+    EVT_POOL_MAX
+} evt_pool_class_t;
+
 // Accessor functions defined in state.c, but used in report.c too.
 int get_port(int, int, control_type_t);
 int get_port_net(net_info *, int, control_type_t);
@@ -216,6 +308,9 @@ fs_info *getFSEntry(int);
 bool addrIsNetDomain(struct sockaddr_storage *);
 bool addrIsUnixDomain(struct sockaddr_storage *);
 sock_summary_bucket_t getNetRxTxBucket(net_info *);
+void *evtAlloc(evt_pool_class_t);
+void evtAllocStats(evt_pool_class_t, evt_pool_stats_t *);
+void evtReleaseNames(uint64_t);
 
 // The hiding of objects forces these to be defined here
 void doFSMetric(metric_t, struct fs_info_t *, control_type_t, const char *, ssize_t, const char *);
@@ -224,11 +319,15 @@ void doUnixEndpoint(int, net_info *);
 void resetInterfaceCounts(counters_element_t *);
 void addToInterfaceCounts(counters_element_t *, uint64_t);
 void subFromInterfaceCounts(counters_element_t *, uint64_t);
+void addToShardedCounts(shard_ctr_t, uint64_t);
+void subFromShardedCounts(shard_ctr_t, uint64_t);
+void foldShardedCounts(shard_ctr_t);
 
 // Data that lives in state.c, but is used in report.c too.
 extern summary_t g_summary;
-extern net_info *g_netinfo;
-extern fs_info *g_fsinfo;
+extern fd_table_t *g_netinfo;  // of net_info
+extern fd_table_t *g_fsinfo;   // of fs_info
 extern metric_counters g_ctrs;
+extern strtab_t *g_strtab;
 
 #endif // __STATE_PRIVATE_H__
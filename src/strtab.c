@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "scopetypes.h"
+#include "strtab.h"
+
+// ids map to strings through pages of this many entries
+#define STRTAB_PAGE_SHIFT 10
+#define STRTAB_PAGE_SIZE (1 << STRTAB_PAGE_SHIFT)
+#define STRTAB_PAGE_MASK (STRTAB_PAGE_SIZE - 1)
+
+// Chains average about this many entries when the table is full
+#define STRTAB_CHAIN_LEN 4
+#define STRTAB_MIN_BUCKETS 256
+
+// Chains share this many locks; no more than STRTAB_MIN_BUCKETS
+#define STRTAB_LOCKS 256
+
+typedef struct {
+    strtab_id_t next;       // next id in the bucket's chain
+    uint32_t hash;
+    uint32_t len;
+    uint32_t refs;          // under the chain's lock
+    int idle;               // the epoch refs went to 0 in
+    char str[];
+} strtab_rec_t;
+
+struct _strtab_t {
+    strtab_id_t *bucket;    // head of each chain, STRTAB_NONE if empty
+    uint32_t mask;
+    int lock[STRTAB_LOCKS]; // chain locks, by bucket
+    strtab_rec_t ***page;
+    unsigned int maxpages;
+    unsigned int maxstrings;
+    int epoch;              // strtabReclaim() calls so far
+
+    // These are under idlock
+    int idlock;
+    strtab_id_t nextid;     // the lowest id never handed out
+    strtab_id_t *freeids;   // reclaimed ids, to be handed out again
+    unsigned int nfree;
+    unsigned int freealloc;
+    unsigned int count;
+    uint64_t bytes;
+    uint64_t maxbytes;
+};
+
+// FNV-1a
+static uint32_t
+strHash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static void
+spinLock(int *lock)
+{
+    while (!atomicCas32(lock, 0, 1)) ;
+}
+
+static void
+spinUnlock(int *lock)
+{
+    atomicCas32(lock, 1, 0);
+}
+
+static int *
+chainLock(strtab_t *tab, uint32_t hash)
+{
+    return &tab->lock[hash & (STRTAB_LOCKS - 1)];
+}
+
+static strtab_rec_t *
+recAt(strtab_t *tab, strtab_id_t id)
+{
+    if ((id == STRTAB_NONE) || (id >= tab->maxstrings)) return NULL;
+    strtab_rec_t **page = tab->page[id >> STRTAB_PAGE_SHIFT];
+    return (page) ? page[id & STRTAB_PAGE_MASK] : NULL;
+}
+
+// With the chain's lock held
+static strtab_id_t
+findInChain(strtab_t *tab, strtab_id_t first, const char *str, size_t len, uint32_t hash)
+{
+    strtab_id_t id;
+    for (id = first; id != STRTAB_NONE; ) {
+        strtab_rec_t *rec = recAt(tab, id);
+        if (!rec) {
+            DBG(NULL);
+            break;
+        }
+        if ((rec->hash == hash) && (rec->len == len) &&
+            !memcmp(rec->str, str, len)) {
+            return id;
+        }
+        id = rec->next;
+    }
+    return STRTAB_NONE;
+}
+
+static bool
+setRec(strtab_t *tab, strtab_id_t id, strtab_rec_t *rec)
+{
+    unsigned int pnum = id >> STRTAB_PAGE_SHIFT;
+    strtab_rec_t **page = tab->page[pnum];
+
+    if (!page) {
+        strtab_rec_t **newpage = calloc(STRTAB_PAGE_SIZE, sizeof(strtab_rec_t *));
+        if (!newpage) return FALSE;
+        if (!atomicCasU64((uint64_t *)&tab->page[pnum], 0ULL, (uint64_t)newpage)) {
+            // someone else beat us to it
+            free(newpage);
+        }
+        page = tab->page[pnum];
+    }
+
+    page[id & STRTAB_PAGE_MASK] = rec;
+    return TRUE;
+}
+
+// Reserves an id and recsize bytes for a new string
+static strtab_id_t
+allocId(strtab_t *tab, size_t recsize)
+{
+    strtab_id_t id = STRTAB_NONE;
+
+    spinLock(&tab->idlock);
+    if (!tab->maxbytes || (tab->bytes + recsize <= tab->maxbytes)) {
+        if (tab->nfree) {
+            id = tab->freeids[--tab->nfree];
+        } else if (tab->nextid < tab->maxstrings) {
+            id = tab->nextid++;
+        }
+    }
+    if (id != STRTAB_NONE) {
+        tab->bytes += recsize;
+        tab->count++;
+    }
+    spinUnlock(&tab->idlock);
+
+    return id;
+}
+
+static void
+freeId(strtab_t *tab, strtab_id_t id, size_t recsize)
+{
+    spinLock(&tab->idlock);
+    if (tab->nfree == tab->freealloc) {
+        unsigned int alloc = (tab->freealloc) ? tab->freealloc * 2 : STRTAB_PAGE_SIZE;
+        strtab_id_t *ids = realloc(tab->freeids, alloc * sizeof(strtab_id_t));
+        if (ids) {
+            tab->freeids = ids;
+            tab->freealloc = alloc;
+        }
+    }
+    // Without room to remember it, the id is never handed out again
+    if (tab->nfree < tab->freealloc) {
+        tab->freeids[tab->nfree++] = id;
+    } else {
+        DBG(NULL);
+    }
+    tab->bytes -= recsize;
+    tab->count--;
+    spinUnlock(&tab->idlock);
+}
+
+strtab_t *
+strtabCreate(unsigned int maxstrings, size_t maxbytes)
+{
+    if (!maxstrings) return NULL;
+
+    strtab_t *tab = calloc(1, sizeof(strtab_t));
+    if (!tab) goto failed;
+
+    // id 0 is STRTAB_NONE, so make room for it
+    tab->maxstrings = maxstrings + 1;
+    tab->maxpages = (tab->maxstrings + STRTAB_PAGE_MASK) >> STRTAB_PAGE_SHIFT;
+    tab->maxbytes = maxbytes;
+    tab->nextid = 1;
+
+    uint32_t nbuckets = STRTAB_MIN_BUCKETS;
+    while ((nbuckets * STRTAB_CHAIN_LEN < maxstrings) && (nbuckets < (1U << 30))) {
+        nbuckets <<= 1;
+    }
+    tab->mask = nbuckets - 1;
+
+    tab->bucket = calloc(nbuckets, sizeof(strtab_id_t));
+    tab->page = calloc(tab->maxpages, sizeof(strtab_rec_t **));
+    if (!tab->bucket || !tab->page) goto failed;
+
+    return tab;
+
+failed:
+    DBG(NULL);
+    strtabDestroy(&tab);
+    return NULL;
+}
+
+void
+strtabDestroy(strtab_t **tab_ptr)
+{
+    if (!tab_ptr || !*tab_ptr) return;
+    strtab_t *tab = *tab_ptr;
+
+    if (tab->page) {
+        unsigned int i, j;
+        for (i = 0; i < tab->maxpages; i++) {
+            if (!tab->page[i]) continue;
+            for (j = 0; j < STRTAB_PAGE_SIZE; j++) {
+                if (tab->page[i][j]) free(tab->page[i][j]);
+            }
+            free(tab->page[i]);
+        }
+        free(tab->page);
+    }
+    if (tab->bucket) free(tab->bucket);
+    if (tab->freeids) free(tab->freeids);
+    free(tab);
+    *tab_ptr = NULL;
+}
+
+strtab_id_t
+strtabInternLen(strtab_t *tab, const char *str, size_t len)
+{
+    if (!tab || !str || (len > UINT32_MAX)) return STRTAB_NONE;
+
+    uint32_t hash = strHash(str, len);
+    strtab_id_t *bucket = &tab->bucket[hash & tab->mask];
+    int *lock = chainLock(tab, hash);
+    strtab_id_t id;
+
+    // The common case; it's already here
+    spinLock(lock);
+    if ((id = findInChain(tab, *bucket, str, len, hash))) {
+        recAt(tab, id)->refs++;
+        spinUnlock(lock);
+        return id;
+    }
+    spinUnlock(lock);
+
+    // Make the record without the lock held
+    size_t recsize = sizeof(strtab_rec_t) + len + 1;
+    strtab_rec_t *rec = malloc(recsize);
+    if (!rec) {
+        DBG(NULL);
+        return STRTAB_NONE;
+    }
+    rec->hash = hash;
+    rec->len = len;
+    rec->refs = 1;
+    rec->idle = 0;
+    memcpy(rec->str, str, len);
+    rec->str[len] = '\0';
+
+    // Someone may have added it in the meantime
+    spinLock(lock);
+    if ((id = findInChain(tab, *bucket, str, len, hash))) {
+        recAt(tab, id)->refs++;
+    } else if ((id = allocId(tab, recsize)) != STRTAB_NONE) {
+        if (setRec(tab, id, rec)) {
+            rec->next = *bucket;
+            *bucket = id;
+            rec = NULL;
+        } else {
+            DBG(NULL);
+            freeId(tab, id, recsize);
+            id = STRTAB_NONE;
+        }
+    }
+    spinUnlock(lock);
+
+    if (rec) free(rec);
+    return id;
+}
+
+strtab_id_t
+strtabIntern(strtab_t *tab, const char *str)
+{
+    if (!str) return STRTAB_NONE;
+    return strtabInternLen(tab, str, strlen(str));
+}
+
+void
+strtabRef(strtab_t *tab, strtab_id_t id)
+{
+    strtab_rec_t *rec;
+    if (!tab || !(rec = recAt(tab, id))) return;
+
+    int *lock = chainLock(tab, rec->hash);
+    spinLock(lock);
+    rec->refs++;
+    spinUnlock(lock);
+}
+
+void
+strtabRelease(strtab_t *tab, strtab_id_t id)
+{
+    strtab_rec_t *rec;
+    if (!tab || !(rec = recAt(tab, id))) return;
+
+    int *lock = chainLock(tab, rec->hash);
+    spinLock(lock);
+    if (!rec->refs) {
+        DBG("%u", id);
+    } else if (--rec->refs == 0) {
+        rec->idle = atomicAddFetch32(&tab->epoch, 0);
+    }
+    spinUnlock(lock);
+}
+
+unsigned int
+strtabReclaim(strtab_t *tab)
+{
+    if (!tab) return 0;
+
+    // A string released in epoch e - 1 was released before the call
+    // that ended it, and there's been a whole epoch since then
+    int epoch = atomicAddFetch32(&tab->epoch, 1);
+    unsigned int freed = 0;
+    uint32_t b;
+
+    for (b = 0; b <= tab->mask; b++) {
+        int *lock = &tab->lock[b & (STRTAB_LOCKS - 1)];
+        spinLock(lock);
+        strtab_id_t *link = &tab->bucket[b];
+        while (*link != STRTAB_NONE) {
+            strtab_id_t id = *link;
+            strtab_rec_t *rec = recAt(tab, id);
+            if (!rec) {
+                DBG(NULL);
+                break;
+            }
+            if (rec->refs || (rec->idle >= epoch - 1)) {
+                link = &rec->next;
+                continue;
+            }
+            *link = rec->next;
+            setRec(tab, id, NULL);
+            freeId(tab, id, sizeof(strtab_rec_t) + rec->len + 1);
+            free(rec);
+            freed++;
+        }
+        spinUnlock(lock);
+    }
+
+    return freed;
+}
+
+void
+strtabLockAll(strtab_t *tab)
+{
+    if (!tab) return;
+
+    // In the same order as everything else takes them
+    int i;
+    for (i = 0; i < STRTAB_LOCKS; i++) {
+        spinLock(&tab->lock[i]);
+    }
+    spinLock(&tab->idlock);
+}
+
+void
+strtabUnlockAll(strtab_t *tab)
+{
+    if (!tab) return;
+
+    int i;
+    spinUnlock(&tab->idlock);
+    for (i = STRTAB_LOCKS - 1; i >= 0; i--) {
+        spinUnlock(&tab->lock[i]);
+    }
+}
+
+const char *
+strtabStr(strtab_t *tab, strtab_id_t id)
+{
+    if (!tab) return "";
+    strtab_rec_t *rec = recAt(tab, id);
+    return (rec) ? rec->str : "";
+}
+
+unsigned int
+strtabCount(strtab_t *tab)
+{
+    return (tab) ? tab->count : 0;
+}
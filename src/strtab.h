@@ -0,0 +1,61 @@
+#ifndef __STRTAB_H__
+#define __STRTAB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// This provides a concurrent string intern table.
+//
+// strtabIntern() returns the same id for equal strings, so anything that
+// holds an id can compare strings with == and doesn't need a buffer of
+// its own.  Any thread may intern, look up, or release at any time.
+// Interning and releasing take a lock on one hash chain; strtabStr()
+// takes none.
+//
+// Each id from strtabIntern() or strtabRef() is a reference, given back
+// with strtabRelease().  A string nobody references isn't freed right
+// away; strtabReclaim() frees the ones that were released before the
+// call to it before this one.  So a copy of an id that was made while
+// the string was referenced can be read until the second strtabReclaim()
+// after the string was released, by a thread that raced with the
+// release.  Anything that keeps an id longer than that, like a record
+// queued for another thread, needs a reference of its own.  After that,
+// strtabStr() may return "" or, once the id is reused, another string.
+//
+// A table holds at most maxstrings strings and maxbytes bytes of string
+// data.  Once full, strtabIntern() still finds strings that are already
+// in the table, but new strings get STRTAB_NONE until some are
+// reclaimed.  strtabStr() returns "" for STRTAB_NONE.
+//
+
+typedef uint32_t strtab_id_t;
+#define STRTAB_NONE ((strtab_id_t)0)
+
+typedef struct _strtab_t strtab_t;
+
+// Constructors Destructors
+strtab_t *      strtabCreate(unsigned int maxstrings, size_t maxbytes);
+void            strtabDestroy(strtab_t **);
+
+// Returns the id of str, adding it if needed, with a reference held
+strtab_id_t     strtabIntern(strtab_t *, const char *str);
+strtab_id_t     strtabInternLen(strtab_t *, const char *str, size_t len);
+
+// Take another reference to id, or give one back
+void            strtabRef(strtab_t *, strtab_id_t);
+void            strtabRelease(strtab_t *, strtab_id_t);
+
+// Free what's been unreferenced since the last call; returns how many
+unsigned int    strtabReclaim(strtab_t *);
+
+// Hold every lock, e.g. across fork() so the child doesn't start
+// with one that a thread it won't have was holding
+void            strtabLockAll(strtab_t *);
+void            strtabUnlockAll(strtab_t *);
+
+// Accessors
+const char *    strtabStr(strtab_t *, strtab_id_t);
+unsigned int    strtabCount(strtab_t *);
+
+#endif // __STRTAB_H__
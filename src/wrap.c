@@ -416,6 +416,7 @@ doConfig(config_t *cfg)
 
     g_thread.interval = cfgMtcPeriod(cfg);
     setReportingInterval(cfgMtcPeriod(cfg));
+    setHttpAggregation(cfgMtcHttpMaxTargets(cfg), cfgMtcHttpNormalize(cfg));
     if (!g_thread.startTime) {
         g_thread.startTime = time(NULL) + g_thread.interval;
     }
@@ -428,6 +429,14 @@ doConfig(config_t *cfg)
     g_mtc = initMtc(cfg);
     ctlEvtSet(g_ctl, initEvtFormat(cfg));
 
+    cfg_queue_t q;
+    for (q = CFG_QUEUE_EVENTS; q < CFG_QUEUE_MAX; q++) {
+        ctlQueuePolicySet(g_ctl, q, cfgQueueOverflow(cfg, q), cfgQueueSampleRate(cfg));
+    }
+
+    // Which wrappers can skip straight to libc
+    setOpEnable();
+
     // Disconnect the old interfaces that were just replaced
     mtcDisconnect(g_prevmtc);
     logDisconnect(g_prevlog);
@@ -725,10 +734,25 @@ reportPeriodicStuff(void)
     // report net and file by descriptor
     reportAllFds(PERIODIC);
 
+    // Threads hold events they post; get them all on the queue
+    ctlFlushEvents(g_ctl);
+
+    // How our own queues kept up
+    doQueueMetrics();
+
+    // And the pools the records on them come from
+    doEvtPoolMetrics();
+
+    // Requests still waiting on a response, and their header buffers
+    doHttpMetrics();
+
     // Process any events that have been posted
     doEvent();
     doPayload();
 
+    // Names nothing has needed since the last period can go
+    reclaimState();
+
     mtcFlush(g_mtc);
 }
 
@@ -744,6 +768,7 @@ handleExit(void)
         while (!atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
             NSLEEP(&ts, &rem);
         }
+        ctlFlushEvents(g_ctl);
         doEvent();
     } else {
         reportPeriodicStuff();
@@ -1047,6 +1072,11 @@ init(void)
     cfgProcessEnvironment(cfg);
     doConfig(cfg);
     g_ctl = initCtl(cfg);
+    // Records posted by state.c are only freed by state.c
+    ctlQueueEvictSet(g_ctl, CFG_QUEUE_EVENTS, evtDiscard);
+    ctlQueueEvictSet(g_ctl, CFG_QUEUE_PAYLOADS, evtDiscard);
+    // doConfig() ran before there was a ctl to ask
+    setOpEnable();
     g_staticfg = cfg;
     if (path) free(path);
     if (!g_dbg) dbgInit();
@@ -1473,6 +1503,7 @@ EXPORTON ssize_t
 pread64(int fd, void *buf, size_t count, off_t offset)
 {
     WRAP_CHECK(pread64, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.pread64(fd, buf, count, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pread64(fd, buf, count, offset);
@@ -1486,6 +1517,7 @@ EXPORTON ssize_t
 preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
 {
     WRAP_CHECK(preadv, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.preadv(fd, iov, iovcnt, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.preadv(fd, iov, iovcnt, offset);
@@ -1499,6 +1531,7 @@ EXPORTON ssize_t
 preadv2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags)
 {
     WRAP_CHECK(preadv2, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.preadv2(fd, iov, iovcnt, offset, flags);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.preadv2(fd, iov, iovcnt, offset, flags);
@@ -1512,6 +1545,7 @@ EXPORTON ssize_t
 preadv64v2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags)
 {
     WRAP_CHECK(preadv64v2, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.preadv64v2(fd, iov, iovcnt, offset, flags);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.preadv64v2(fd, iov, iovcnt, offset, flags);
@@ -1526,6 +1560,7 @@ __pread_chk(int fd, void *buf, size_t nbytes, off_t offset, size_t buflen)
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__pread_chk, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__pread_chk(fd, buf, nbytes, offset, buflen);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.__pread_chk(fd, buf, nbytes, offset, buflen);
@@ -1540,6 +1575,7 @@ __read_chk(int fd, void *buf, size_t nbytes, size_t buflen)
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__read_chk, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__read_chk(fd, buf, nbytes, buflen);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.__read_chk(fd, buf, nbytes, buflen);
@@ -1554,6 +1590,7 @@ __fread_unlocked_chk(void *ptr, size_t ptrlen, size_t size, size_t nmemb, FILE *
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__fread_unlocked_chk, 0);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__fread_unlocked_chk(ptr, ptrlen, size, nmemb, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.__fread_unlocked_chk(ptr, ptrlen, size, nmemb, stream);
@@ -1567,6 +1604,7 @@ EXPORTON ssize_t
 pwrite64(int fd, const void *buf, size_t nbyte, off_t offset)
 {
     WRAP_CHECK(pwrite64, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwrite64(fd, buf, nbyte, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwrite64(fd, buf, nbyte, offset);
@@ -1580,6 +1618,7 @@ EXPORTON ssize_t
 pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
 {
     WRAP_CHECK(pwritev, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwritev(fd, iov, iovcnt, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwritev(fd, iov, iovcnt, offset);
@@ -1593,6 +1632,7 @@ EXPORTON ssize_t
 pwritev64(int fd, const struct iovec *iov, int iovcnt, off64_t offset)
 {
     WRAP_CHECK(pwritev64, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwritev64(fd, iov, iovcnt, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwritev64(fd, iov, iovcnt, offset);
@@ -1606,6 +1646,7 @@ EXPORTON ssize_t
 pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags)
 {
     WRAP_CHECK(pwritev2, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwritev2(fd, iov, iovcnt, offset, flags);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwritev2(fd, iov, iovcnt, offset, flags);
@@ -1619,6 +1660,7 @@ EXPORTON ssize_t
 pwritev64v2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags)
 {
     WRAP_CHECK(pwritev64v2, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwritev64v2(fd, iov, iovcnt, offset, flags);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwritev64v2(fd, iov, iovcnt, offset, flags);
@@ -1632,6 +1674,7 @@ EXPORTON off64_t
 lseek64(int fd, off64_t offset, int whence)
 {
     WRAP_CHECK(lseek64, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.lseek64(fd, offset, whence);
 
     off64_t rc = g_fn.lseek64(fd, offset, whence);
 
@@ -1644,6 +1687,7 @@ EXPORTON int
 fseeko64(FILE *stream, off64_t offset, int whence)
 {
     WRAP_CHECK(fseeko64, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fseeko64(stream, offset, whence);
 
     int rc = g_fn.fseeko64(stream, offset, whence);
 
@@ -1656,6 +1700,7 @@ EXPORTON off64_t
 ftello64(FILE *stream)
 {
     WRAP_CHECK(ftello64, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.ftello64(stream);
 
     off64_t rc = g_fn.ftello64(stream);
 
@@ -1690,6 +1735,7 @@ EXPORTON int
 fsetpos64(FILE *stream, const fpos64_t *pos)
 {
     WRAP_CHECK(fsetpos64, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fsetpos64(stream, pos);
     int rc = g_fn.fsetpos64(stream, pos);
 
     doSeek(fileno(stream), (rc == 0), "fsetpos64");
@@ -2066,6 +2112,7 @@ EXPORTON int
 __overflow(FILE *stream, int ch)
 {
     WRAP_CHECK(__overflow, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.__overflow(stream, ch);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.__overflow(stream, ch);
@@ -2161,6 +2208,7 @@ EXPORTON size_t
 fwrite_unlocked(const void *ptr, size_t size, size_t nitems, FILE *stream)
 {
     WRAP_CHECK(fwrite_unlocked, 0);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fwrite_unlocked(ptr, size, nitems, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.fwrite_unlocked(ptr, size, nitems, stream);
@@ -2979,6 +3027,7 @@ EXPORTON off_t
 lseek(int fd, off_t offset, int whence)
 {
     WRAP_CHECK(lseek, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.lseek(fd, offset, whence);
     off_t rc = g_fn.lseek(fd, offset, whence);
 
     doSeek(fd, (rc != -1), "lseek");
@@ -2990,6 +3039,7 @@ EXPORTON int
 fseek(FILE *stream, long offset, int whence)
 {
     WRAP_CHECK(fseek, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fseek(stream, offset, whence);
     int rc = g_fn.fseek(stream, offset, whence);
 
     doSeek(fileno(stream), (rc != -1), "fseek");
@@ -3001,6 +3051,7 @@ EXPORTON int
 fseeko(FILE *stream, off_t offset, int whence)
 {
     WRAP_CHECK(fseeko, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fseeko(stream, offset, whence);
     int rc = g_fn.fseeko(stream, offset, whence);
 
     doSeek(fileno(stream), (rc != -1), "fseeko");
@@ -3012,6 +3063,7 @@ EXPORTON long
 ftell(FILE *stream)
 {
     WRAP_CHECK(ftell, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.ftell(stream);
     long rc = g_fn.ftell(stream);
 
     doSeek(fileno(stream), (rc != -1), "ftell");
@@ -3023,6 +3075,7 @@ EXPORTON off_t
 ftello(FILE *stream)
 {
     WRAP_CHECK(ftello, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.ftello(stream);
     off_t rc = g_fn.ftello(stream);
 
     doSeek(fileno(stream), (rc != -1), "ftello"); 
@@ -3034,6 +3087,10 @@ EXPORTON void
 rewind(FILE *stream)
 {
     WRAP_CHECK_VOID(rewind);
+    if (!OP_ENABLED(OP_SEEK)) {
+        g_fn.rewind(stream);
+        return;
+    }
     g_fn.rewind(stream);
 
     doSeek(fileno(stream), TRUE, "rewind");
@@ -3045,6 +3102,7 @@ EXPORTON int
 fsetpos(FILE *stream, const fpos_t *pos)
 {
     WRAP_CHECK(fsetpos, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fsetpos(stream, pos);
     int rc = g_fn.fsetpos(stream, pos);
 
     doSeek(fileno(stream), (rc == 0), "fsetpos");
@@ -3056,6 +3114,7 @@ EXPORTON int
 fgetpos(FILE *stream,  fpos_t *pos)
 {
     WRAP_CHECK(fgetpos, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fgetpos(stream, pos);
     int rc = g_fn.fgetpos(stream, pos);
 
     doSeek(fileno(stream), (rc == 0), "fgetpos");
@@ -3067,6 +3126,7 @@ EXPORTON int
 fgetpos64(FILE *stream,  fpos64_t *pos)
 {
     WRAP_CHECK(fgetpos64, -1);
+    if (!OP_ENABLED(OP_SEEK)) return g_fn.fgetpos64(stream, pos);
     int rc = g_fn.fgetpos64(stream, pos);
 
     doSeek(fileno(stream), (rc == 0), "fgetpos64");
@@ -3078,6 +3138,7 @@ EXPORTON ssize_t
 write(int fd, const void *buf, size_t count)
 {
     WRAP_CHECK(write, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.write(fd, buf, count);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.write(fd, buf, count);
@@ -3091,6 +3152,7 @@ EXPORTON ssize_t
 pwrite(int fd, const void *buf, size_t nbyte, off_t offset)
 {
     WRAP_CHECK(pwrite, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.pwrite(fd, buf, nbyte, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pwrite(fd, buf, nbyte, offset);
@@ -3104,6 +3166,7 @@ EXPORTON ssize_t
 writev(int fd, const struct iovec *iov, int iovcnt)
 {
     WRAP_CHECK(writev, -1);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.writev(fd, iov, iovcnt);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.writev(fd, iov, iovcnt);
@@ -3117,6 +3180,7 @@ EXPORTON size_t
 fwrite(const void * ptr, size_t size, size_t nitems, FILE * stream)
 {
     WRAP_CHECK(fwrite, 0);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fwrite(ptr, size, nitems, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.fwrite(ptr, size, nitems, stream);
@@ -3130,6 +3194,7 @@ EXPORTON int
 puts(const char *s)
 {
     WRAP_CHECK(puts, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.puts(s);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.puts(s);
@@ -3143,6 +3208,7 @@ EXPORTON int
 putchar(int c)
 {
     WRAP_CHECK(putchar, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.putchar(c);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.putchar(c);
@@ -3156,6 +3222,7 @@ EXPORTON int
 fputs(const char *s, FILE *stream)
 {
     WRAP_CHECK(fputs, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fputs(s, stream);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fputs(s, stream);
@@ -3169,6 +3236,7 @@ EXPORTON int
 fputs_unlocked(const char *s, FILE *stream)
 {
     WRAP_CHECK(fputs_unlocked, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fputs_unlocked(s, stream);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fputs_unlocked(s, stream);
@@ -3182,6 +3250,7 @@ EXPORTON ssize_t
 read(int fd, void *buf, size_t count)
 {
     WRAP_CHECK(read, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.read(fd, buf, count);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.read(fd, buf, count);
@@ -3195,6 +3264,7 @@ EXPORTON ssize_t
 readv(int fd, const struct iovec *iov, int iovcnt)
 {
     WRAP_CHECK(readv, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.readv(fd, iov, iovcnt);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.readv(fd, iov, iovcnt);
@@ -3208,6 +3278,7 @@ EXPORTON ssize_t
 pread(int fd, void *buf, size_t count, off_t offset)
 {
     WRAP_CHECK(pread, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.pread(fd, buf, count, offset);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.pread(fd, buf, count, offset);
@@ -3221,6 +3292,7 @@ EXPORTON size_t
 fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
     WRAP_CHECK(fread, 0);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fread(ptr, size, nmemb, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.fread(ptr, size, nmemb, stream);
@@ -3235,6 +3307,7 @@ __fread_chk(void *ptr, size_t ptrlen, size_t size, size_t nmemb, FILE *stream)
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__fread_chk, 0);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__fread_chk(ptr, ptrlen, size, nmemb, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.__fread_chk(ptr, ptrlen, size, nmemb, stream);
@@ -3248,6 +3321,7 @@ EXPORTON size_t
 fread_unlocked(void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
     WRAP_CHECK(fread_unlocked, 0);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fread_unlocked(ptr, size, nmemb, stream);
     uint64_t initialTime = getTime();
 
     size_t rc = g_fn.fread_unlocked(ptr, size, nmemb, stream);
@@ -3261,6 +3335,7 @@ EXPORTON char *
 fgets(char *s, int n, FILE *stream)
 {
     WRAP_CHECK(fgets, NULL);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fgets(s, n, stream);
     uint64_t initialTime = getTime();
 
     char* rc = g_fn.fgets(s, n, stream);
@@ -3275,6 +3350,7 @@ __fgets_chk(char *s, size_t size, int strsize, FILE *stream)
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__fgets_chk, NULL);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__fgets_chk(s, size, strsize, stream);
     uint64_t initialTime = getTime();
 
     char* rc = g_fn.__fgets_chk(s, size, strsize, stream);
@@ -3288,6 +3364,7 @@ EXPORTON char *
 fgets_unlocked(char *s, int n, FILE *stream)
 {
     WRAP_CHECK(fgets_unlocked, NULL);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fgets_unlocked(s, n, stream);
     uint64_t initialTime = getTime();
 
     char* rc = g_fn.fgets_unlocked(s, n, stream);
@@ -3302,6 +3379,7 @@ __fgetws_chk(wchar_t *ws, size_t size, int strsize, FILE *stream)
 {
     // TODO: this function aborts & exits on error, add abort functionality
     WRAP_CHECK(__fgetws_chk, NULL);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__fgetws_chk(ws, size, strsize, stream);
     uint64_t initialTime = getTime();
 
     wchar_t* rc = g_fn.__fgetws_chk(ws, size, strsize, stream);
@@ -3315,6 +3393,7 @@ EXPORTON wchar_t *
 fgetws(wchar_t *ws, int n, FILE *stream)
 {
     WRAP_CHECK(fgetws, NULL);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fgetws(ws, n, stream);
     uint64_t initialTime = getTime();
 
     wchar_t* rc = g_fn.fgetws(ws, n, stream);
@@ -3328,6 +3407,7 @@ EXPORTON wint_t
 fgetwc(FILE *stream)
 {
     WRAP_CHECK(fgetwc, WEOF);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fgetwc(stream);
     uint64_t initialTime = getTime();
 
     wint_t rc = g_fn.fgetwc(stream);
@@ -3341,6 +3421,7 @@ EXPORTON int
 fgetc(FILE *stream)
 {
     WRAP_CHECK(fgetc, EOF);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fgetc(stream);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fgetc(stream);
@@ -3354,6 +3435,7 @@ EXPORTON int
 fputc(int c, FILE *stream)
 {
     WRAP_CHECK(fputc, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fputc(c, stream);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fputc(c, stream);
@@ -3367,6 +3449,7 @@ EXPORTON int
 fputc_unlocked(int c, FILE *stream)
 {
     WRAP_CHECK(fputc_unlocked, EOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fputc_unlocked(c, stream);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fputc_unlocked(c, stream);
@@ -3380,6 +3463,7 @@ EXPORTON wint_t
 putwc(wchar_t wc, FILE *stream)
 {
     WRAP_CHECK(putwc, WEOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.putwc(wc, stream);
     uint64_t initialTime = getTime();
 
     wint_t rc = g_fn.putwc(wc, stream);
@@ -3393,6 +3477,7 @@ EXPORTON wint_t
 fputwc(wchar_t wc, FILE *stream)
 {
     WRAP_CHECK(fputwc, WEOF);
+    if (!OP_ENABLED(OP_WRITE)) return g_fn.fputwc(wc, stream);
     uint64_t initialTime = getTime();
 
     wint_t rc = g_fn.fputwc(wc, stream);
@@ -3408,6 +3493,10 @@ fscanf(FILE *stream, const char *format, ...)
     struct FuncArgs fArgs;
     LOAD_FUNC_ARGS_VALIST(fArgs, format);
     WRAP_CHECK(fscanf, EOF);
+    if (!OP_ENABLED(OP_READ)) return g_fn.fscanf(stream, format,
+                                                 fArgs.arg[0], fArgs.arg[1],
+                                                 fArgs.arg[2], fArgs.arg[3],
+                                                 fArgs.arg[4], fArgs.arg[5]);
     uint64_t initialTime = getTime();
 
     int rc = g_fn.fscanf(stream, format,
@@ -3424,6 +3513,7 @@ EXPORTON ssize_t
 getline (char **lineptr, size_t *n, FILE *stream)
 {
     WRAP_CHECK(getline, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.getline(lineptr, n, stream);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.getline(lineptr, n, stream);
@@ -3438,6 +3528,7 @@ EXPORTON ssize_t
 getdelim (char **lineptr, size_t *n, int delimiter, FILE *stream)
 {
     WRAP_CHECK(getdelim, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.getdelim(lineptr, n, delimiter, stream);
     uint64_t initialTime = getTime();
 
     g_getdelim = 1;
@@ -3453,6 +3544,7 @@ EXPORTON ssize_t
 __getdelim (char **lineptr, size_t *n, int delimiter, FILE *stream)
 {
     WRAP_CHECK(__getdelim, -1);
+    if (!OP_ENABLED(OP_READ)) return g_fn.__getdelim(lineptr, n, delimiter, stream);
     uint64_t initialTime = getTime();
 
     ssize_t rc = g_fn.__getdelim(lineptr, n, delimiter, stream);
@@ -3545,7 +3637,12 @@ fork()
 
     WRAP_CHECK(fork, -1);
     scopeLog("fork", -1, CFG_LOG_DEBUG);
+    // The child gets only this thread; don't leave it a lock another holds
+    lockState();
+    lockReporting();
     rc = g_fn.fork();
+    unlockReporting();
+    unlockState();
     if (rc == 0) {
         // We are the child proc
         doReset();
@@ -3954,6 +4051,7 @@ getaddrinfo(const char *node, const char *service,
 
     if (rc == 0) {
         scopeLog("getaddrinfo", -1, CFG_LOG_DEBUG);
+        doHostAddrInfo(node, *res);
         doUpdateState(DNS, -1, time.duration, NULL, node);
         doUpdateState(DNS_DURATION, -1, time.duration, NULL, node);
     } else {
@@ -11,7 +11,7 @@
 #include "state.h"
 #include "gocontext.h"
 #include "../contrib/funchook/distorm/include/distorm.h"
-#include "linklist.h"
+#include "hashmap.h"
 
 #define SCOPE_STACK_SIZE (size_t)(32 * 1024)
 //#define ENABLE_SIGNAL_MASKING_IN_SYSEXEC 1
@@ -70,7 +70,7 @@ tap_t g_go_tap[] = {
 
 uint64_t g_glibc_guard = 0LL;
 uint64_t g_go_static = 0LL;
-static list_t *g_threadlist;
+static hashmap_t *g_threadlist;
 static void *g_stack;
 static bool g_switch_thread;
 static uint64_t go_tls_conn;
@@ -385,7 +385,7 @@ initGoHook(elf_buf_t *ebuf)
     char *go_runtime_version = NULL;
 
     g_stack = malloc(32 * 1024);
-    g_threadlist = lstCreate(NULL);
+    g_threadlist = hmapCreate(NULL);
 
     // A go app may need to expand stacks for some C functions
     g_need_stack_expand = TRUE;
@@ -595,7 +595,7 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
         }
 
         void *thread_fs = NULL;
-        if ((thread_fs = lstFind(g_threadlist, go_fs)) == NULL) {
+        if ((thread_fs = hmapFind(g_threadlist, go_fs)) == NULL) {
             // Switch to the main thread TCB
             if (arch_prctl(ARCH_SET_FS, scope_fs) == -1) {
                 scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
@@ -628,8 +628,8 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
                 goto out;
             }
 
-            if (lstInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
-                scopeLog("lstInsert failed", -1, CFG_LOG_ERROR);
+            if (hmapInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
+                scopeLog("hmapInsert failed", -1, CFG_LOG_ERROR);
                 goto out;
             }
 
@@ -718,7 +718,7 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
         }
 
         void *thread_fs = NULL;
-        if ((thread_fs = lstFind(g_threadlist, go_fs)) == NULL) {
+        if ((thread_fs = hmapFind(g_threadlist, go_fs)) == NULL) {
             // Switch to the main thread TCB
             if (arch_prctl(ARCH_SET_FS, scope_fs) == -1) {
                 scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
@@ -767,8 +767,8 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
              
             atomicCasU64(&g_glibc_guard, 1ULL, 0ULL);
 
-            if (lstInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
-                scopeLog("lstInsert failed", -1, CFG_LOG_ERROR);
+            if (hmapInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
+                scopeLog("hmapInsert failed", -1, CFG_LOG_ERROR);
                 goto out;
             }
         }
@@ -16,6 +16,8 @@ verifyDefaults(config_t* config)
     assert_string_equal    (cfgMtcStatsDPrefix(config), DEFAULT_STATSD_PREFIX);
     assert_int_equal       (cfgMtcStatsDMaxLen(config), DEFAULT_STATSD_MAX_LEN);
     assert_int_equal       (cfgMtcVerbosity(config), DEFAULT_MTC_VERBOSITY);
+    assert_int_equal       (cfgMtcHttpMaxTargets(config), DEFAULT_HTTP_MAX_TARGETS);
+    assert_int_equal       (cfgMtcHttpNormalize(config), DEFAULT_HTTP_NORMALIZE);
     assert_int_equal       (cfgMtcPeriod(config), DEFAULT_SUMMARY_PERIOD);
     assert_string_equal    (cfgCmdDir(config), DEFAULT_COMMAND_DIR);
     assert_int_equal       (cfgSendProcessStartMsg(config), DEFAULT_PROCESS_START_MSG);
@@ -75,6 +77,10 @@ verifyDefaults(config_t* config)
     assert_int_equal       (cfgLogLevel(config), DEFAULT_LOG_LEVEL);
     assert_int_equal       (cfgPayEnable(config), DEFAULT_PAYLOAD_ENABLE);
     assert_string_equal    (cfgPayDir(config), DEFAULT_PAYLOAD_DIR);
+    assert_int_equal       (cfgQueueOverflow(config, CFG_QUEUE_EVENTS), DEFAULT_QUEUE_OVERFLOW);
+    assert_int_equal       (cfgQueueOverflow(config, CFG_QUEUE_MSGS), DEFAULT_QUEUE_OVERFLOW);
+    assert_int_equal       (cfgQueueOverflow(config, CFG_QUEUE_PAYLOADS), DEFAULT_QUEUE_OVERFLOW);
+    assert_int_equal       (cfgQueueSampleRate(config), DEFAULT_QUEUE_SAMPLE_RATE);
 }
 
 static void
@@ -180,6 +186,24 @@ cfgMtcVerbositySetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgMtcHttpSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgMtcHttpMaxTargetsSet(config, 50);
+    assert_int_equal(cfgMtcHttpMaxTargets(config), 50);
+    cfgMtcHttpMaxTargetsSet(config, 0);
+    assert_int_equal(cfgMtcHttpMaxTargets(config), 50);
+
+    cfgMtcHttpNormalizeSet(config, FALSE);
+    assert_int_equal(cfgMtcHttpNormalize(config), FALSE);
+    cfgMtcHttpNormalizeSet(config, 2);
+    assert_int_equal(cfgMtcHttpNormalize(config), FALSE);
+    cfgMtcHttpNormalizeSet(config, TRUE);
+    assert_int_equal(cfgMtcHttpNormalize(config), TRUE);
+    cfgDestroy(&config);
+}
+
 static void
 cfgMtcPeriodSetAndGet(void** state)
 {
@@ -575,6 +599,28 @@ cfgPayDirSetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgQueueOverflowSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgQueueOverflowSet(config, CFG_QUEUE_EVENTS, CFG_DROP_OLDEST);
+    cfgQueueOverflowSet(config, CFG_QUEUE_PAYLOADS, CFG_SAMPLE);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_EVENTS), CFG_DROP_OLDEST);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_MSGS), CFG_DROP_NEWEST);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_PAYLOADS), CFG_SAMPLE);
+
+    // Out of range values should be ignored.
+    cfgQueueOverflowSet(config, CFG_QUEUE_EVENTS, CFG_SAMPLE + 1);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_EVENTS), CFG_DROP_OLDEST);
+    cfgQueueOverflowSet(config, CFG_QUEUE_MAX, CFG_SAMPLE);
+
+    cfgQueueSampleRateSet(config, 100);
+    assert_int_equal(cfgQueueSampleRate(config), 100);
+    cfgQueueSampleRateSet(config, 0);
+    assert_int_equal(cfgQueueSampleRate(config), 100);
+
+    cfgDestroy(&config);
+}
 
 int
 main(int argc, char* argv[])
@@ -602,6 +648,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgMtcStatsDPrefixSetAndGet),
         cmocka_unit_test(cfgMtcStatsDMaxLenSetAndGet),
         cmocka_unit_test(cfgMtcVerbositySetAndGet),
+        cmocka_unit_test(cfgMtcHttpSetAndGet),
         cmocka_unit_test(cfgMtcPeriodSetAndGet),
         cmocka_unit_test(cfgCmdDirSetAndGet),
         cmocka_unit_test(cfgSendProcessStartMsgSetAndGet),
@@ -662,6 +709,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgLogLevelSetAndGet),
         cmocka_unit_test(cfgPayEnableSetAndGet),
         cmocka_unit_test(cfgPayDirSetAndGet),
+        cmocka_unit_test(cfgQueueOverflowSetAndGet),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
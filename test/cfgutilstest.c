@@ -488,6 +488,63 @@ cfgProcessEnvironmentEnhanceFs(void** state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentHttp(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+
+    assert_int_equal(setenv("SCOPE_METRIC_HTTP_TARGETS", "200", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_HTTP_NORMALIZE", "false", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcHttpMaxTargets(cfg), 200);
+    assert_int_equal(cfgMtcHttpNormalize(cfg), FALSE);
+
+    // unrecognised values should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_HTTP_TARGETS", "0", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_HTTP_NORMALIZE", "maybe", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcHttpMaxTargets(cfg), 200);
+    assert_int_equal(cfgMtcHttpNormalize(cfg), FALSE);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_HTTP_TARGETS"), 0);
+    assert_int_equal(unsetenv("SCOPE_METRIC_HTTP_NORMALIZE"), 0);
+    cfgDestroy(&cfg);
+}
+
+static void
+cfgProcessEnvironmentQueue(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgQueueOverflow(cfg, CFG_QUEUE_EVENTS), CFG_DROP_NEWEST);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_QUEUE_EVENTS", "drop-oldest", 1), 0);
+    assert_int_equal(setenv("SCOPE_QUEUE_MESSAGES", "sample", 1), 0);
+    assert_int_equal(setenv("SCOPE_QUEUE_PAYLOADS", "drop-oldest", 1), 0);
+    assert_int_equal(setenv("SCOPE_QUEUE_SAMPLERATE", "25", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgQueueOverflow(cfg, CFG_QUEUE_EVENTS), CFG_DROP_OLDEST);
+    assert_int_equal(cfgQueueOverflow(cfg, CFG_QUEUE_MSGS), CFG_SAMPLE);
+    assert_int_equal(cfgQueueOverflow(cfg, CFG_QUEUE_PAYLOADS), CFG_DROP_OLDEST);
+    assert_int_equal(cfgQueueSampleRate(cfg), 25);
+
+    // unrecognised values should not affect cfg
+    assert_int_equal(setenv("SCOPE_QUEUE_EVENTS", "drop-some", 1), 0);
+    assert_int_equal(setenv("SCOPE_QUEUE_SAMPLERATE", "lots", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgQueueOverflow(cfg, CFG_QUEUE_EVENTS), CFG_DROP_OLDEST);
+    assert_int_equal(cfgQueueSampleRate(cfg), 25);
+
+    assert_int_equal(unsetenv("SCOPE_QUEUE_EVENTS"), 0);
+    assert_int_equal(unsetenv("SCOPE_QUEUE_MESSAGES"), 0);
+    assert_int_equal(unsetenv("SCOPE_QUEUE_PAYLOADS"), 0);
+    assert_int_equal(unsetenv("SCOPE_QUEUE_SAMPLERATE"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
 typedef struct
 {
     const char* env_name;
@@ -1122,6 +1179,8 @@ cfgReadGoodYaml(void** state)
         "    statsdprefix : 'cribl.scope'    # prepends each statsd metric\n"
         "    statsdmaxlen : 1024             # max size of a formatted statsd string\n"
         "    verbosity: 3                    # 0-9 (0 is least verbose, 9 is most)\n"
+        "    httptargets: 300\n"
+        "    httpnormalize: false\n"
         "    tags:\n"
         "      name1 : value1\n"
         "      name2 : value2\n"
@@ -1164,6 +1223,10 @@ cfgReadGoodYaml(void** state)
         "    transport:\n"
         "      buffering: full\n"
         "      type: syslog\n"
+        "  queue:\n"
+        "    events: sample\n"
+        "    payloads: drop-oldest\n"
+        "    samplerate: 4\n"
         "...\n";
     const char* path = CFG_FILE_NAME;
     writeFile(path, yamlText);
@@ -1174,6 +1237,8 @@ cfgReadGoodYaml(void** state)
     assert_string_equal(cfgMtcStatsDPrefix(config), "cribl.scope.");
     assert_int_equal(cfgMtcStatsDMaxLen(config), 1024);
     assert_int_equal(cfgMtcVerbosity(config), 3);
+    assert_int_equal(cfgMtcHttpMaxTargets(config), 300);
+    assert_int_equal(cfgMtcHttpNormalize(config), FALSE);
     assert_int_equal(cfgMtcPeriod(config), 11);
     assert_string_equal(cfgCmdDir(config), "/tmp");
     assert_int_equal(cfgSendProcessStartMsg(config), TRUE);
@@ -1213,6 +1278,10 @@ cfgReadGoodYaml(void** state)
     assert_int_equal(cfgLogLevel(config), CFG_LOG_DEBUG);
     assert_int_equal(cfgPayEnable(config), FALSE);
     assert_string_equal(cfgPayDir(config), "/my/dir");
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_EVENTS), CFG_SAMPLE);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_MSGS), CFG_DROP_NEWEST);
+    assert_int_equal(cfgQueueOverflow(config, CFG_QUEUE_PAYLOADS), CFG_DROP_OLDEST);
+    assert_int_equal(cfgQueueSampleRate(config), 4);
     cfgDestroy(&config);
     deleteFile(path);
 }
@@ -1864,6 +1933,90 @@ cfgReadProtocol(void **state)
     deleteFile(ppath);
 }
 
+static void
+cfgReadProtocolSignature(void **state)
+{
+    const char *yamlText =
+        "---\n"
+        "protocol:\n"
+        "  - name: Postgres\n"
+        "    binary: 'true'\n"
+        "    signature:\n"
+        "      - offset: 4\n"
+        "        value: '00 03 00 00'\n"
+        "    length:\n"
+        "      offset: 0\n"
+        "      size: 4\n"
+        "      exact: true\n"
+        "\n"
+        "  - name: bad mask\n"
+        "    signature:\n"
+        "      - value: '16 03'\n"
+        "        mask: 'ff'\n"
+        "\n"
+        "  - name: TLS\n"
+        "    binary: 'true'\n"
+        "    signature:\n"
+        "      - value: '16 03'\n"
+        "      - offset: 5\n"
+        "        value: '01'\n"
+        "        mask: '0f'\n"
+        "    length:\n"
+        "      offset: 3\n"
+        "      size: 2\n"
+        "      order: little\n"
+        "      adjust: 5\n"
+        "      max: 16389\n"
+        "\n"
+        "  - name: bad size\n"
+        "    length:\n"
+        "      size: 3\n"
+        "...\n";
+
+    list_t *plist = lstCreate(destroyProtEntry);
+    char *ppath = PROTOCOL_FILE_NAME;
+    protocol_def_t *prot;
+
+    writeFile(ppath, yamlText);
+    protocolRead(ppath, plist);
+
+    // The bad ones are left out
+    prot = lstFind(plist, 0);
+    assert_non_null(prot);
+    assert_string_equal(prot->protname, "Postgres");
+    assert_null(prot->regex);
+    assert_int_equal(prot->npatterns, 1);
+    assert_int_equal(prot->pattern[0].offset, 4);
+    assert_int_equal(prot->pattern[0].len, 4);
+    assert_memory_equal(prot->pattern[0].value, "\x00\x03\x00\x00", 4);
+    assert_memory_equal(prot->pattern[0].mask, "\xff\xff\xff\xff", 4);
+    assert_int_equal(prot->length.size, 4);
+    assert_int_equal(prot->length.offset, 0);
+    assert_true(prot->length.bigendian);
+    assert_true(prot->length.exact);
+
+    prot = lstFind(plist, 1);
+    assert_non_null(prot);
+    assert_string_equal(prot->protname, "TLS");
+    assert_int_equal(prot->npatterns, 2);
+    assert_int_equal(prot->pattern[0].offset, 0);
+    assert_memory_equal(prot->pattern[0].value, "\x16\x03", 2);
+    assert_int_equal(prot->pattern[1].offset, 5);
+    assert_int_equal(prot->pattern[1].value[0], 0x01);
+    assert_int_equal(prot->pattern[1].mask[0], 0x0f);
+    assert_int_equal(prot->length.size, 2);
+    assert_int_equal(prot->length.offset, 3);
+    assert_false(prot->length.bigendian);
+    assert_int_equal(prot->length.adjust, 5);
+    assert_int_equal(prot->length.max, 16389);
+    assert_false(prot->length.exact);
+
+    assert_null(lstFind(plist, 2));
+
+    lstDestroy(&plist);
+    deleteFile(ppath);
+}
+
 // Defined in src/cfgutils.c
 // This is not a proper test, it just exists to make valgrind output
 // more readable when analyzing this test, by deallocating the compiled
@@ -1903,6 +2056,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgProcessEnvironmentEventFormat),
         cmocka_unit_test(cfgProcessEnvironmentMaxEps),
         cmocka_unit_test(cfgProcessEnvironmentEnhanceFs),
+        cmocka_unit_test(cfgProcessEnvironmentHttp),
+        cmocka_unit_test(cfgProcessEnvironmentQueue),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &log),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &con),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &sys),
@@ -1939,6 +2094,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(initCtlReturnsPtr),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
         cmocka_unit_test(cfgReadProtocol),
+        cmocka_unit_test(cfgReadProtocolSignature),
         cmocka_unit_test(envRegexFree),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
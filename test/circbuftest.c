@@ -1,4 +1,6 @@
 #define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include "dbg.h"
 #include "circbuf.h"
@@ -28,9 +30,15 @@ circbufResetTest(void **state)
 static void
 circbufCapacityTest(void **state)
 {
+    // Capacity is rounded up to a power of 2
     cbuf_handle_t ch = cbufInit(10);
     assert_non_null(ch);
-    assert_int_equal(cbufCapacity(ch), 10);
+    assert_int_equal(cbufCapacity(ch), 16);
+    cbufFree(ch);
+
+    ch = cbufInit(16);
+    assert_non_null(ch);
+    assert_int_equal(cbufCapacity(ch), 16);
     cbufFree(ch);
 }
 
@@ -38,7 +46,7 @@ static void
 circbufPutGetTest(void **state)
 {
     uint64_t data;
-    cbuf_handle_t ch = cbufInit(5);
+    cbuf_handle_t ch = cbufInit(4);
     assert_non_null(ch);
     assert_non_null(ch->buffer);
 
@@ -50,12 +58,10 @@ circbufPutGetTest(void **state)
     assert_int_equal(cbufPut(ch, data), 0);
     data = 4;
     assert_int_equal(cbufPut(ch, data), 0);
-    data = 5;
-    assert_int_equal(cbufPut(ch, data), 0);
 
     // should not accept a new entry
     assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 0);
-    data = 6;
+    data = 5;
     assert_int_equal(cbufPut(ch, data), -1);
     // Note we removed the DBG statement as it caused a crash with 100k Go routines
     assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 1);
@@ -70,14 +76,331 @@ circbufPutGetTest(void **state)
     assert_int_equal(data, 3);
     assert_int_equal(cbufGet(ch, &data), 0);
     assert_int_equal(data, 4);
-    assert_int_equal(cbufGet(ch, &data), 0);
-    assert_int_equal(data, 5);
     // should not find a new entry
     assert_int_equal(cbufGet(ch, &data), -1);
 
     cbufFree(ch);
 }
 
+static void
+circbufZeroIsAValue(void **state)
+{
+    uint64_t data = 99;
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+
+    assert_int_equal(cbufPut(ch, 0ULL), 0);
+    assert_false(cbufEmpty(ch));
+    assert_int_equal(cbufGet(ch, &data), 0);
+    assert_int_equal(data, 0);
+    assert_true(cbufEmpty(ch));
+
+    cbufFree(ch);
+}
+
+static void
+circbufGetBatchTest(void **state)
+{
+    uint64_t data[8];
+    uint64_t i;
+    cbuf_handle_t ch = cbufInit(8);
+    assert_non_null(ch);
+
+    assert_int_equal(cbufGetBatch(ch, data, 8), 0);
+    assert_int_equal(cbufGetBatch(NULL, data, 8), 0);
+    assert_int_equal(cbufGetBatch(ch, NULL, 8), 0);
+    assert_int_equal(cbufGetBatch(ch, data, 0), 0);
+
+    // Go around the ring a few times so positions wrap
+    uint64_t next = 1, expect = 1;
+    int lap;
+    for (lap = 0; lap < 5; lap++) {
+        for (i = 0; i < 6; i++) {
+            assert_int_equal(cbufPut(ch, next++), 0);
+        }
+
+        // Less than is there, then the rest
+        assert_int_equal(cbufGetBatch(ch, data, 4), 4);
+        for (i = 0; i < 4; i++) assert_int_equal(data[i], expect++);
+        assert_int_equal(cbufGetBatch(ch, data, 8), 2);
+        for (i = 0; i < 2; i++) assert_int_equal(data[i], expect++);
+        assert_int_equal(cbufGetBatch(ch, data, 8), 0);
+    }
+
+    cbufFree(ch);
+}
+
+static uint64_t g_evicted[16];
+static int g_num_evicted = 0;
+
+static void
+evictFn(uint64_t data)
+{
+    if (g_num_evicted < 16) g_evicted[g_num_evicted] = data;
+    g_num_evicted++;
+}
+
+static void
+circbufPutBatchTest(void **state)
+{
+    uint64_t in[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint64_t out[8];
+    cbuf_stats_t stats;
+    int i;
+    cbuf_handle_t ch = cbufInit(8);
+    assert_non_null(ch);
+
+    assert_int_equal(cbufPutBatch(NULL, in, 4), 0);
+    assert_int_equal(cbufPutBatch(ch, NULL, 4), 0);
+    assert_int_equal(cbufPutBatch(ch, in, 0), 0);
+
+    // Across the wrap, in order
+    assert_int_equal(cbufPutBatch(ch, in, 6), 6);
+    assert_int_equal(cbufGetBatch(ch, out, 6), 6);
+    assert_int_equal(cbufPutBatch(ch, in, 5), 5);
+    assert_int_equal(cbufGetBatch(ch, out, 8), 5);
+    for (i = 0; i < 5; i++) assert_int_equal(out[i], in[i]);
+
+    // Only what fits goes in; the rest is the caller's
+    assert_int_equal(cbufPutBatch(ch, in, 5), 5);
+    assert_int_equal(cbufPutBatch(ch, in, 8), 3);
+    assert_int_equal(cbufPutBatch(ch, in, 8), 0);
+    assert_int_equal(cbufGetBatch(ch, out, 8), 8);
+    for (i = 0; i < 5; i++) assert_int_equal(out[i], in[i]);
+    for (i = 5; i < 8; i++) assert_int_equal(out[i], in[i - 5]);
+
+    cbufStats(ch, &stats, FALSE);
+    assert_int_equal(stats.enqueued, 19);
+    assert_int_equal(stats.dropped, 13);
+    assert_int_equal(stats.highwater, 8);
+
+    assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+    cbufFree(ch);
+}
+
+static void
+circbufPolicySetTest(void **state)
+{
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+
+    assert_int_equal(cbufPolicySet(NULL, CBUF_DROP_NEWEST, 0, NULL), -1);
+    // Drop-oldest has to have somewhere to put what it evicts
+    assert_int_equal(cbufPolicySet(ch, CBUF_DROP_OLDEST, 0, NULL), -1);
+    assert_int_equal(cbufPolicySet(ch, 99, 0, NULL), -1);
+    assert_int_equal(ch->policy, CBUF_DROP_NEWEST);
+
+    assert_int_equal(cbufPolicySet(ch, CBUF_DROP_OLDEST, 0, evictFn), 0);
+    assert_int_equal(ch->policy, CBUF_DROP_OLDEST);
+    // The evict function sticks around
+    assert_int_equal(cbufPolicySet(ch, CBUF_SAMPLE, 5, NULL), 0);
+    assert_int_equal(cbufPolicySet(ch, CBUF_DROP_OLDEST, 0, NULL), 0);
+    assert_int_equal(ch->rate, 5);
+
+    cbufFree(ch);
+}
+
+static void
+circbufDropOldestTest(void **state)
+{
+    uint64_t data;
+    cbuf_stats_t stats;
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+    assert_int_equal(cbufPolicySet(ch, CBUF_DROP_OLDEST, 0, evictFn), 0);
+    g_num_evicted = 0;
+
+    for (data = 1; data <= 6; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+
+    // The first two made room for the last two
+    assert_int_equal(g_num_evicted, 2);
+    assert_int_equal(g_evicted[0], 1);
+    assert_int_equal(g_evicted[1], 2);
+    uint64_t expect;
+    for (expect = 3; expect <= 6; expect++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+        assert_int_equal(data, expect);
+    }
+    assert_int_equal(cbufGet(ch, &data), -1);
+
+    cbufStats(ch, &stats, FALSE);
+    assert_int_equal(stats.enqueued, 6);
+    assert_int_equal(stats.dropped, 2);
+    assert_int_equal(stats.highwater, 4);
+
+    // Evicting isn't a failure
+    assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 0);
+    cbufFree(ch);
+}
+
+static void
+circbufPutBatchDropOldestTest(void **state)
+{
+    uint64_t in[6] = {11, 12, 13, 14, 15, 16};
+    uint64_t data;
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+    assert_int_equal(cbufPolicySet(ch, CBUF_DROP_OLDEST, 0, evictFn), 0);
+    g_num_evicted = 0;
+
+    assert_int_equal(cbufPut(ch, 1), 0);
+    assert_int_equal(cbufPut(ch, 2), 0);
+
+    // Room for two, so the two oldest go to make room for the rest
+    assert_int_equal(cbufPutBatch(ch, in, 4), 4);
+    assert_int_equal(g_num_evicted, 2);
+    assert_int_equal(g_evicted[0], 1);
+    assert_int_equal(g_evicted[1], 2);
+
+    // More than the whole queue holds; only the newest are left
+    assert_int_equal(cbufPutBatch(ch, in, 6), 6);
+    uint64_t expect;
+    for (expect = 13; expect <= 16; expect++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+        assert_int_equal(data, expect);
+    }
+    assert_int_equal(cbufGet(ch, &data), -1);
+
+    assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 0);
+    cbufFree(ch);
+}
+
+static void
+circbufSampleTest(void **state)
+{
+    uint64_t data;
+    cbuf_stats_t stats;
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+    assert_int_equal(cbufPolicySet(ch, CBUF_SAMPLE, 3, NULL), 0);
+
+    for (data = 1; data <= 4; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+    // Full; this starts sampling
+    assert_int_equal(cbufPut(ch, 5), -1);
+    assert_int_equal(cbufGet(ch, &data), 0);
+
+    // Still over half full, so only 1 in 3 gets a try
+    assert_int_equal(cbufPut(ch, 6), 0);
+    assert_int_equal(cbufPut(ch, 7), -1);
+    assert_int_equal(cbufPut(ch, 8), -1);
+    assert_int_equal(cbufPut(ch, 9), -1);     // tried, but full again
+
+    // Drained to half; everything gets in again
+    assert_int_equal(cbufGet(ch, &data), 0);
+    assert_int_equal(cbufGet(ch, &data), 0);
+    assert_int_equal(cbufPut(ch, 10), 0);
+    assert_int_equal(cbufPut(ch, 11), 0);
+
+    cbufStats(ch, &stats, FALSE);
+    assert_int_equal(stats.enqueued, 7);
+    assert_int_equal(stats.dropped, 4);
+    assert_int_equal(stats.highwater, 4);
+
+    // The puts that found it full leave a DBG; the sampled out ones don't
+    assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+    cbufFree(ch);
+}
+
+static void
+circbufStatsResetTest(void **state)
+{
+    uint64_t data;
+    cbuf_stats_t stats;
+    cbuf_handle_t ch = cbufInit(4);
+    assert_non_null(ch);
+
+    cbufStats(NULL, &stats, TRUE);
+    assert_int_equal(stats.enqueued, 0);
+    cbufStats(ch, NULL, TRUE);
+
+    for (data = 1; data <= 4; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+    assert_int_equal(cbufPut(ch, 5), -1);
+    dbgInit();
+    assert_int_equal(cbufGet(ch, &data), 0);
+
+    cbufStats(ch, &stats, TRUE);
+    assert_int_equal(stats.enqueued, 4);
+    assert_int_equal(stats.dropped, 1);
+    assert_int_equal(stats.highwater, 4);
+
+    // A new period starts from what's still queued
+    cbufStats(ch, &stats, TRUE);
+    assert_int_equal(stats.enqueued, 0);
+    assert_int_equal(stats.dropped, 0);
+    assert_int_equal(stats.highwater, 3);
+
+    cbufFree(ch);
+}
+
+#define NUM_PRODUCERS 4
+#define NUM_PUTS 50000
+
+static cbuf_handle_t g_shared = NULL;
+
+static void *
+putThread(void *arg)
+{
+    uint64_t id = (uint64_t)arg;
+    uint64_t i;
+    for (i = 1; i <= NUM_PUTS; i++) {
+        // Producer id in the top bits, sequence in the bottom
+        while (cbufPut(g_shared, (id << 32) | i) == -1) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void
+circbufManyProducersOneConsumer(void **state)
+{
+    g_shared = cbufInit(1024);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_PRODUCERS];
+    uint64_t last[NUM_PRODUCERS] = {0};
+    uint64_t data[64];
+    uint64_t i;
+    int total = 0;
+
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, putThread, (void *)i), 0);
+    }
+
+    // Each producer's entries have to come out in the order it put them
+    while (total < NUM_PRODUCERS * NUM_PUTS) {
+        int num = cbufGetBatch(g_shared, data, 64);
+        int j;
+        for (j = 0; j < num; j++) {
+            uint64_t id = data[j] >> 32;
+            uint64_t seq = data[j] & 0xffffffff;
+            assert_true(id < NUM_PRODUCERS);
+            assert_int_equal(seq, last[id] + 1);
+            last[id] = seq;
+        }
+        total += num;
+        if (!num) sched_yield();
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+        assert_int_equal(last[i], NUM_PUTS);
+    }
+    assert_true(cbufEmpty(g_shared));
+
+    // The full DBG may have been hit; that's expected here
+    dbgInit();
+    cbufFree(g_shared);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -88,6 +411,15 @@ main(int argc, char* argv[])
         cmocka_unit_test(circbufResetTest),
         cmocka_unit_test(circbufCapacityTest),
         cmocka_unit_test(circbufPutGetTest),
+        cmocka_unit_test(circbufZeroIsAValue),
+        cmocka_unit_test(circbufGetBatchTest),
+        cmocka_unit_test(circbufPutBatchTest),
+        cmocka_unit_test(circbufPolicySetTest),
+        cmocka_unit_test(circbufDropOldestTest),
+        cmocka_unit_test(circbufPutBatchDropOldestTest),
+        cmocka_unit_test(circbufSampleTest),
+        cmocka_unit_test(circbufStatsResetTest),
+        cmocka_unit_test(circbufManyProducersOneConsumer),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -668,6 +668,47 @@ ctlAddProtocol(void** state)
     destroyReq(&req);
 }
 
+static void
+ctlAddProtocolSignature(void** state)
+{
+    char pg[] = "{\"type\": \"req\",\"req\": \"AddProto\",\"reqId\":6395,\"body\":{\"binary\":\"true\",\"pname\":\"Postgres\","
+        "\"signature\":[{\"offset\":4,\"value\":\"00 03 00 00\"},{\"value\":\"00\",\"mask\":\"f0\"}],"
+        "\"length\":{\"offset\":0,\"size\":4,\"order\":\"big\",\"exact\":true}}}";
+
+    request_t *req = ctlParseRxMsg(pg);
+    assert_non_null(req);
+    assert_int_equal(req->cmd, REQ_ADD_PROTOCOL);
+    protocol_def_t *prot = req->protocol;
+    assert_string_equal(prot->protname, "Postgres");
+    assert_null(prot->regex);
+    assert_int_equal(prot->npatterns, 2);
+    assert_int_equal(prot->pattern[0].offset, 4);
+    assert_memory_equal(prot->pattern[0].value, "\x00\x03\x00\x00", 4);
+    assert_int_equal(prot->pattern[1].offset, 0);
+    assert_int_equal(prot->pattern[1].mask[0], 0xf0);
+    assert_int_equal(prot->length.size, 4);
+    assert_true(prot->length.bigendian);
+    assert_true(prot->length.exact);
+    destroyProtEntry(req->protocol);
+    destroyReq(&req);
+
+    // Neither a regex nor a signature, or a signature that isn't hex
+    char *bad[] = {
+        "{\"type\": \"req\",\"req\": \"AddProto\",\"reqId\":6396,\"body\":{\"binary\":\"true\",\"pname\":\"X\"}}",
+        "{\"type\": \"req\",\"req\": \"AddProto\",\"reqId\":6397,\"body\":{\"binary\":\"true\",\"pname\":\"X\","
+            "\"signature\":[{\"value\":\"0g\"}]}}",
+        "{\"type\": \"req\",\"req\": \"AddProto\",\"reqId\":6398,\"body\":{\"binary\":\"true\",\"pname\":\"X\","
+            "\"length\":{\"size\":8}}}",
+    };
+    int i;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        req = ctlParseRxMsg(bad[i]);
+        assert_non_null(req);
+        assert_int_equal(req->cmd, REQ_PARAM_ERR);
+        destroyReq(&req);
+    }
+}
+
 static void
 ctlDelProtocol(void** state)
 {
@@ -681,6 +722,104 @@ ctlDelProtocol(void** state)
     destroyReq(&req);
 }
 
+static int g_evicted = 0;
+
+static void
+countEvicted(uint64_t data)
+{
+    g_evicted++;
+}
+
+static void
+ctlQueuePolicyAndStats(void** state)
+{
+    ctl_t* ctl = ctlCreate();
+    assert_non_null(ctl);
+
+    // Payloads are the caller's; without a way to free them,
+    // drop-oldest has to act like drop-newest.
+    ctlQueuePolicySet(ctl, CFG_QUEUE_PAYLOADS, CFG_DROP_OLDEST, 0);
+
+    uint64_t i;
+    for (i = 1; ctlPostPayload(ctl, (char *)i) == 0; i++);
+    uint64_t capacity = i - 1;
+    assert_true(capacity >= DEFAULT_PAYLOAD_RING_SIZE);
+    dbgInit(); // reset dbg for the rest of the tests
+
+    // Now it can make room
+    ctlQueueEvictSet(ctl, CFG_QUEUE_PAYLOADS, countEvicted);
+    assert_int_equal(ctlPostPayload(ctl, (char *)i), 0);
+    assert_int_equal(g_evicted, 1);
+    assert_int_equal(ctlGetPayload(ctl), 2);
+
+    cbuf_stats_t stats;
+    ctlQueueStats(ctl, CFG_QUEUE_PAYLOADS, &stats);
+    assert_int_equal(stats.enqueued, capacity + 1);
+    assert_int_equal(stats.dropped, 2);
+    assert_int_equal(stats.highwater, capacity);
+
+    // Each call starts over; the other queues saw nothing
+    ctlQueueStats(ctl, CFG_QUEUE_PAYLOADS, &stats);
+    assert_int_equal(stats.enqueued, 0);
+    assert_int_equal(stats.dropped, 0);
+    ctlQueueStats(ctl, CFG_QUEUE_EVENTS, &stats);
+    assert_int_equal(stats.enqueued, 0);
+    assert_int_equal(stats.highwater, 0);
+
+    // Bad args don't crash
+    ctlQueueStats(NULL, CFG_QUEUE_EVENTS, &stats);
+    assert_int_equal(stats.enqueued, 0);
+    ctlQueueStats(ctl, CFG_QUEUE_MAX, &stats);
+    ctlQueuePolicySet(ctl, CFG_QUEUE_MAX, CFG_SAMPLE, 2);
+    ctlQueueEvictSet(NULL, CFG_QUEUE_EVENTS, countEvicted);
+
+    ctlDestroy(&ctl);
+}
+
+static void
+ctlPostEventStagesUntilFlush(void** state)
+{
+    ctl_t* ctl = ctlCreate();
+    assert_non_null(ctl);
+    uint64_t data[8];
+
+    // With nothing to free them, events go straight to the queue
+    assert_int_equal(ctlPostEvent(ctl, (char *)1), 0);
+    assert_int_equal(ctlGetEvents(ctl, data, 8), 1);
+    assert_int_equal(data[0], 1);
+
+    // With it, they wait with this thread until a flush
+    ctlQueueEvictSet(ctl, CFG_QUEUE_EVENTS, countEvicted);
+    uint64_t i;
+    for (i = 1; i <= 3; i++) {
+        assert_int_equal(ctlPostEvent(ctl, (char *)i), 0);
+    }
+    assert_int_equal(ctlGetEvents(ctl, data, 8), 0);
+    ctlFlushEvents(ctl);
+    assert_int_equal(ctlGetEvents(ctl, data, 8), 3);
+    for (i = 0; i < 3; i++) {
+        assert_int_equal(data[i], i + 1);
+    }
+
+    // A batch that can't all be queued is freed, not lost
+    cbuf_stats_t stats;
+    ctlQueueStats(ctl, CFG_QUEUE_EVENTS, &stats);
+    g_evicted = 0;
+    uint64_t posted = DEFAULT_CBUF_SIZE * 2;
+    for (i = 1; i <= posted; i++) {
+        assert_int_equal(ctlPostEvent(ctl, (char *)i), 0);
+    }
+    ctlFlushEvents(ctl);
+    ctlQueueStats(ctl, CFG_QUEUE_EVENTS, &stats);
+    assert_true(g_evicted > 0);
+    assert_int_equal(stats.dropped, g_evicted);
+    assert_int_equal(stats.enqueued + g_evicted, posted);
+    dbgInit(); // reset dbg for the rest of the tests
+
+    ctlFlushEvents(NULL);
+    ctlDestroy(&ctl);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -705,7 +844,10 @@ main(int argc, char* argv[])
         cmocka_unit_test(ctlSendMsgForNullMessageDoesntCrash),
         cmocka_unit_test(ctlTransportSetAndMtcSend),
         cmocka_unit_test(ctlAddProtocol),
+        cmocka_unit_test(ctlAddProtocolSignature),
         cmocka_unit_test(ctlDelProtocol),
+        cmocka_unit_test(ctlQueuePolicyAndStats),
+        cmocka_unit_test(ctlPostEventStagesUntilFlush),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
 
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include "ctrshard.h"
+#include "dbg.h"
+#include "test.h"
+
+#define NUM_THREADS 16
+#define NUM_ADDS 100000
+
+static void
+ctrShardCreateReturnsValidPtr(void **state)
+{
+    ctr_shard_t *cs = ctrShardCreate(10, 8);
+    assert_non_null(cs);
+    assert_int_equal(ctrShardCount(cs), 8);
+    ctrShardDestroy(&cs);
+    assert_null(cs);
+}
+
+static void
+ctrShardCreateWithZeroFails(void **state)
+{
+    assert_null(ctrShardCreate(0, 8));
+    assert_null(ctrShardCreate(10, 0));
+}
+
+static void
+ctrShardNullArgsDoNotCrash(void **state)
+{
+    ctr_shard_t *cs = NULL;
+    ctrShardDestroy(NULL);
+    ctrShardDestroy(&cs);
+
+    ctrShardAdd(NULL, 0, 1);
+    assert_int_equal(ctrShardFold(NULL, 0), 0);
+    assert_int_equal(ctrShardCount(NULL), 0);
+
+    // Out of range counters are ignored
+    cs = ctrShardCreate(2, 4);
+    ctrShardAdd(cs, 2, 5);
+    assert_int_equal(ctrShardFold(cs, 2), 0);
+    ctrShardDestroy(&cs);
+}
+
+static void
+ctrShardFoldReturnsSumAndZeroes(void **state)
+{
+    ctr_shard_t *cs = ctrShardCreate(3, 4);
+    assert_non_null(cs);
+
+    ctrShardAdd(cs, 0, 5);
+    ctrShardAdd(cs, 0, 7);
+    ctrShardAdd(cs, 2, 100);
+    assert_int_equal(ctrShardFold(cs, 0), 12);
+    assert_int_equal(ctrShardFold(cs, 1), 0);
+    assert_int_equal(ctrShardFold(cs, 2), 100);
+
+    // Folding took it all
+    assert_int_equal(ctrShardFold(cs, 0), 0);
+    assert_int_equal(ctrShardFold(cs, 2), 0);
+
+    // Subtracts net out, and can leave a negative change
+    ctrShardAdd(cs, 1, 10);
+    ctrShardAdd(cs, 1, -4);
+    assert_int_equal(ctrShardFold(cs, 1), 6);
+    ctrShardAdd(cs, 1, -3);
+    assert_int_equal(ctrShardFold(cs, 1), -3);
+
+    ctrShardDestroy(&cs);
+}
+
+static ctr_shard_t *g_shared = NULL;
+
+static void *
+addThread(void *arg)
+{
+    int i;
+    for (i = 0; i < NUM_ADDS; i++) {
+        ctrShardAdd(g_shared, 0, 1);
+        ctrShardAdd(g_shared, 1, 3);
+        // Give back a third of what went on counter 1
+        ctrShardAdd(g_shared, 1, -1);
+    }
+    return NULL;
+}
+
+static void
+ctrShardAddFromManyThreadsLosesNothing(void **state)
+{
+    // Fewer shards than threads, so some threads share
+    g_shared = ctrShardCreate(2, NUM_THREADS / 2);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_THREADS];
+    int64_t sum0 = 0, sum1 = 0;
+    int i;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, addThread, NULL), 0);
+    }
+    // Folding while adds are happening must not lose any
+    for (i = 0; i < 100; i++) {
+        sum0 += ctrShardFold(g_shared, 0);
+        sum1 += ctrShardFold(g_shared, 1);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+    }
+    sum0 += ctrShardFold(g_shared, 0);
+    sum1 += ctrShardFold(g_shared, 1);
+
+    assert_int_equal(sum0, (int64_t)NUM_THREADS * NUM_ADDS);
+    assert_int_equal(sum1, (int64_t)NUM_THREADS * NUM_ADDS * 2);
+
+    ctrShardDestroy(&g_shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(ctrShardCreateReturnsValidPtr),
+        cmocka_unit_test(ctrShardCreateWithZeroFails),
+        cmocka_unit_test(ctrShardNullArgsDoNotCrash),
+        cmocka_unit_test(ctrShardFoldReturnsSumAndZeroes),
+        cmocka_unit_test(ctrShardAddFromManyThreadsLosesNothing),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "dbg.h"
+#include "dnsresp.h"
+#include "test.h"
+
+// A query for example.com, type A
+static const unsigned char query[] = {
+    0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+};
+
+// Its response: example.com is a CNAME for www.example.com (ttl 300),
+// which is 93.184.216.34 (ttl 60).  Names after the question are
+// compressed; the second answer's points into the first's rdata.
+static const unsigned char response[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x06,
+    0x03, 'w', 'w', 'w', 0xc0, 0x0c,
+    0xc0, 0x29, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04,
+    0x5d, 0xb8, 0xd8, 0x22,
+};
+
+// No such name
+static const unsigned char nxdomain[] = {
+    0xbe, 0xef, 0x81, 0x83, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x04, 'n', 'o', 'n', 'e', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+};
+
+static void
+dnsPendingCreateAndDestroy(void **state)
+{
+    dns_pending_t *dp = dnsPendingCreate(100);
+    assert_non_null(dp);
+    dnsPendingDestroy(&dp);
+    assert_null(dp);
+}
+
+static void
+dnsNullArgsDoNotCrash(void **state)
+{
+    dns_pending_t *dp = NULL;
+    dns_resp_t resp;
+    uint64_t start;
+
+    dnsPendingDestroy(NULL);
+    dnsPendingDestroy(&dp);
+    dnsPendingAdd(NULL, 3, 1, 1);
+    assert_false(dnsPendingTake(NULL, 3, 1, &start));
+
+    dp = dnsPendingCreate(8);
+    dnsPendingAdd(dp, 3, 1, 1);
+    assert_false(dnsPendingTake(dp, 3, 1, NULL));
+    dnsPendingDestroy(&dp);
+
+    assert_int_equal(dnsQueryId(NULL, 12), -1);
+    assert_false(dnsParseResponse(NULL, sizeof(response), &resp));
+    assert_false(dnsParseResponse(response, sizeof(response), NULL));
+}
+
+static void
+dnsPendingMatchesSocketAndId(void **state)
+{
+    dns_pending_t *dp = dnsPendingCreate(64);
+    uint64_t start = 0;
+
+    dnsPendingAdd(dp, 3, 0x1234, 1000);
+    assert_false(dnsPendingTake(dp, 4, 0x1234, &start));
+    assert_false(dnsPendingTake(dp, 3, 0x1235, &start));
+    assert_int_equal(start, 0);
+
+    assert_true(dnsPendingTake(dp, 3, 0x1234, &start));
+    assert_int_equal(start, 1000);
+    // It's gone once taken; a duplicate response isn't matched again
+    assert_false(dnsPendingTake(dp, 3, 0x1234, &start));
+
+    dnsPendingDestroy(&dp);
+}
+
+static void
+dnsPendingNewQueryReplacesOld(void **state)
+{
+    // One slot, so every query lands on the same one
+    dns_pending_t *dp = dnsPendingCreate(1);
+    uint64_t start = 0;
+
+    dnsPendingAdd(dp, 3, 1, 10);
+    dnsPendingAdd(dp, 4, 2, 20);
+    assert_false(dnsPendingTake(dp, 3, 1, &start));
+    assert_true(dnsPendingTake(dp, 4, 2, &start));
+    assert_int_equal(start, 20);
+
+    // The same query again is timed from when it was last sent
+    dnsPendingAdd(dp, 3, 1, 30);
+    dnsPendingAdd(dp, 3, 1, 40);
+    assert_true(dnsPendingTake(dp, 3, 1, &start));
+    assert_int_equal(start, 40);
+
+    dnsPendingDestroy(&dp);
+}
+
+#define THREADS 4
+#define QUERIES 10000
+
+static dns_pending_t *g_dp;
+
+static void *
+addAndTake(void *arg)
+{
+    int fd = (int)(long)arg;
+    uint64_t start;
+    int i;
+    long found = 0;
+
+    for (i = 0; i < QUERIES; i++) {
+        dnsPendingAdd(g_dp, fd, (uint16_t)i, i);
+        if (dnsPendingTake(g_dp, fd, (uint16_t)i, &start) && (start == i)) found++;
+    }
+    return (void *)found;
+}
+
+static void
+dnsPendingFromManyThreads(void **state)
+{
+    // Plenty of room; nobody's query should be lost
+    g_dp = dnsPendingCreate(1024);
+    pthread_t thread[THREADS];
+    int i;
+
+    for (i = 0; i < THREADS; i++) {
+        assert_int_equal(pthread_create(&thread[i], NULL, addAndTake, (void *)(long)(i + 3)), 0);
+    }
+    long total = 0;
+    for (i = 0; i < THREADS; i++) {
+        void *found;
+        pthread_join(thread[i], &found);
+        total += (long)found;
+    }
+    // Queries from different threads can land on the same slot, but
+    // each thread takes its own right after adding it; most are found
+    assert_true(total > (THREADS * QUERIES) / 2);
+    assert_true(total <= THREADS * QUERIES);
+
+    dnsPendingDestroy(&g_dp);
+}
+
+static void
+dnsQueryIdOnlyForQueries(void **state)
+{
+    assert_int_equal(dnsQueryId(query, sizeof(query)), 0x1234);
+    assert_int_equal(dnsQueryId(response, sizeof(response)), -1);
+    // Too short to have a header
+    assert_int_equal(dnsQueryId(query, 11), -1);
+}
+
+static void
+dnsParseResponseWithAnswers(void **state)
+{
+    dns_resp_t resp;
+    assert_true(dnsParseResponse(response, sizeof(response), &resp));
+    assert_int_equal(resp.id, 0x1234);
+    assert_int_equal(resp.rcode, DNS_RCODE_NOERROR);
+    assert_int_equal(resp.answers, 2);
+    // The smaller of the two
+    assert_int_equal(resp.ttl, 60);
+    assert_string_equal(resp.name, "example.com");
+    // The CNAME isn't an address
+    assert_int_equal(resp.naddrs, 1);
+    assert_int_equal(resp.addr[0].family, AF_INET);
+    assert_memory_equal(resp.addr[0].addr, "\x5d\xb8\xd8\x22", 4);
+
+    // A query isn't a response
+    assert_false(dnsParseResponse(query, sizeof(query), &resp));
+}
+
+static void
+dnsParseResponseNxdomain(void **state)
+{
+    dns_resp_t resp;
+    assert_true(dnsParseResponse(nxdomain, sizeof(nxdomain), &resp));
+    assert_int_equal(resp.id, 0xbeef);
+    assert_int_equal(resp.rcode, DNS_RCODE_NXDOMAIN);
+    assert_int_equal(resp.answers, 0);
+    assert_int_equal(resp.ttl, 0);
+    assert_string_equal(resp.name, "none.example");
+    assert_int_equal(resp.naddrs, 0);
+}
+
+static void
+dnsParseResponseAddresses(void **state)
+{
+    // www.example.com: one AAAA, then more A records than are kept
+    unsigned char pkt[512] = {
+        0x00, 0x07, 0x81, 0x80, 0x00, 0x01, 0x00, 0x0b, 0x00, 0x00, 0x00, 0x00,
+        0x03, 'w', 'w', 'w', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+        0x03, 'c', 'o', 'm', 0x00, 0x00, 0x1c, 0x00, 0x01,
+    };
+    size_t len = 33;
+    unsigned char aaaa[] = {
+        0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x00, 0x10, 0x00, 0x10,
+        0x26, 0x06, 0x28, 0x00, 0x02, 0x20, 0x00, 0x01,
+        0x02, 0x48, 0x18, 0x93, 0x25, 0xc8, 0x19, 0x46,
+    };
+    memcpy(&pkt[len], aaaa, sizeof(aaaa));
+    len += sizeof(aaaa);
+
+    int i;
+    for (i = 0; i < 10; i++) {
+        unsigned char a[] = {
+            0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x10, 0x00, 0x04,
+            0x0a, 0x00, 0x00, (unsigned char)i,
+        };
+        memcpy(&pkt[len], a, sizeof(a));
+        len += sizeof(a);
+    }
+
+    dns_resp_t resp;
+    assert_true(dnsParseResponse(pkt, len, &resp));
+    assert_int_equal(resp.answers, 11);
+    assert_int_equal(resp.naddrs, DNS_MAX_ADDRS);
+    assert_int_equal(resp.addr[0].family, AF_INET6);
+    assert_memory_equal(resp.addr[0].addr, &aaaa[12], 16);
+    for (i = 1; i < DNS_MAX_ADDRS; i++) {
+        assert_int_equal(resp.addr[i].family, AF_INET);
+        assert_int_equal(resp.addr[i].addr[3], i - 1);
+    }
+
+    // An A record that isn't 4 bytes long isn't an address
+    unsigned char bad[] = {
+        0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x10, 0x00, 0x03,
+        0x0a, 0x00, 0x00,
+    };
+    memcpy(&pkt[33], bad, sizeof(bad));
+    pkt[7] = 0x01;
+    assert_true(dnsParseResponse(pkt, 33 + sizeof(bad), &resp));
+    assert_int_equal(resp.answers, 1);
+    assert_int_equal(resp.ttl, 16);
+    assert_int_equal(resp.naddrs, 0);
+}
+
+static void
+dnsParseResponseCutShort(void **state)
+{
+    dns_resp_t resp;
+    size_t len;
+
+    // Never read past the end, at any length
+    for (len = 0; len < sizeof(response); len++) {
+        unsigned char *pkt = malloc(len ? len : 1);
+        memcpy(pkt, response, len);
+        int rv = dnsParseResponse(pkt, len, &resp);
+        free(pkt);
+
+        if (len < 29) {
+            // Not even the question
+            assert_false(rv);
+        } else {
+            // The rest of the header is still good
+            assert_true(rv);
+            assert_int_equal(resp.rcode, DNS_RCODE_NOERROR);
+            assert_int_equal(resp.answers, 2);
+            assert_string_equal(resp.name, "example.com");
+            // Only the first answer is complete
+            if (len >= 47) assert_int_equal(resp.ttl, 300);
+        }
+    }
+}
+
+static void
+dnsParseResponseBadNames(void **state)
+{
+    dns_resp_t resp;
+    unsigned char pkt[sizeof(response)];
+
+    // A question name that points at itself
+    memcpy(pkt, response, sizeof(pkt));
+    pkt[12] = 0xc0;
+    pkt[13] = 0x0c;
+    assert_false(dnsParseResponse(pkt, sizeof(pkt), &resp));
+
+    // A pointer past the end
+    pkt[13] = 0xff;
+    assert_false(dnsParseResponse(pkt, sizeof(pkt), &resp));
+
+    // Label types 0x40 and 0x80 aren't used
+    memcpy(pkt, response, sizeof(pkt));
+    pkt[12] = 0x47;
+    assert_false(dnsParseResponse(pkt, sizeof(pkt), &resp));
+
+    // A label running past the end
+    memcpy(pkt, response, sizeof(pkt));
+    pkt[12] = 0x3f;
+    assert_false(dnsParseResponse(pkt, 40, &resp));
+
+    // A loop of pointers among the answers ends the answers there
+    memcpy(pkt, response, sizeof(pkt));
+    pkt[29] = 0xc0;
+    pkt[30] = 0x1d;
+    assert_true(dnsParseResponse(pkt, sizeof(pkt), &resp));
+    assert_int_equal(resp.answers, 2);
+    assert_int_equal(resp.ttl, 0);
+}
+
+static void
+dnsRcodeNames(void **state)
+{
+    assert_string_equal(dnsRcodeName(DNS_RCODE_NOERROR), "NOERROR");
+    assert_string_equal(dnsRcodeName(DNS_RCODE_SERVFAIL), "SERVFAIL");
+    assert_string_equal(dnsRcodeName(DNS_RCODE_NXDOMAIN), "NXDOMAIN");
+    assert_string_equal(dnsRcodeName(5), "REFUSED");
+    assert_string_equal(dnsRcodeName(11), "OTHER");
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(dnsPendingCreateAndDestroy),
+        cmocka_unit_test(dnsNullArgsDoNotCrash),
+        cmocka_unit_test(dnsPendingMatchesSocketAndId),
+        cmocka_unit_test(dnsPendingNewQueryReplacesOld),
+        cmocka_unit_test(dnsPendingFromManyThreads),
+        cmocka_unit_test(dnsQueryIdOnlyForQueries),
+        cmocka_unit_test(dnsParseResponseWithAnswers),
+        cmocka_unit_test(dnsParseResponseNxdomain),
+        cmocka_unit_test(dnsParseResponseAddresses),
+        cmocka_unit_test(dnsParseResponseCutShort),
+        cmocka_unit_test(dnsParseResponseBadNames),
+        cmocka_unit_test(dnsRcodeNames),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
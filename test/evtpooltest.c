@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "dbg.h"
+#include "evtpool.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define ALLOCS_PER_THREAD 10000
+
+static void
+evtPoolCreateReturnsValidPtr(void **state)
+{
+    evt_pool_t *pool = evtPoolCreate(100, 128);
+    assert_non_null(pool);
+    assert_int_equal(evtPoolBlockSize(pool), 100);
+    evtPoolDestroy(&pool);
+    assert_null(pool);
+}
+
+static void
+evtPoolCreateWithZeroSizeFails(void **state)
+{
+    assert_null(evtPoolCreate(0, 128));
+}
+
+static void
+evtPoolDestroyNullDoesNotCrash(void **state)
+{
+    evtPoolDestroy(NULL);
+    evt_pool_t *pool = NULL;
+    evtPoolDestroy(&pool);
+}
+
+static void
+evtPoolAllocNullPoolReturnsNull(void **state)
+{
+    assert_null(evtPoolAlloc(NULL));
+    assert_null(evtPoolTryAlloc(NULL));
+    evtPoolFree(NULL);
+
+    evt_pool_stats_t stats;
+    memset(&stats, 0xff, sizeof(stats));
+    evtPoolStats(NULL, &stats);
+    assert_int_equal(stats.allocs, 0);
+    assert_int_equal(stats.slabbytes, 0);
+}
+
+static void
+evtPoolAllocReusesFreedBlocks(void **state)
+{
+    evt_pool_t *pool = evtPoolCreate(64, 64);
+    assert_non_null(pool);
+
+    char *blk1 = evtPoolAlloc(pool);
+    assert_non_null(blk1);
+    memset(blk1, 'a', 64);
+    evtPoolFree(blk1);
+
+    char *blk2 = evtPoolAlloc(pool);
+    assert_ptr_equal(blk1, blk2);
+    evtPoolFree(blk2);
+
+    evt_pool_stats_t stats;
+    evtPoolStats(pool, &stats);
+    assert_int_equal(stats.allocs, 2);
+    assert_int_equal(stats.exhausted, 0);
+    assert_int_equal(stats.failed, 0);
+    assert_true(stats.slabbytes >= 64 * 64);
+
+    evtPoolDestroy(&pool);
+}
+
+static void
+evtPoolBlocksAreAlignedAndDistinct(void **state)
+{
+    evt_pool_t *pool = evtPoolCreate(13, 64);
+    assert_non_null(pool);
+
+    char *blk[64];
+    int i, j;
+    for (i = 0; i < 64; i++) {
+        blk[i] = evtPoolAlloc(pool);
+        assert_non_null(blk[i]);
+        assert_int_equal((uintptr_t)blk[i] % 16, 0);
+        memset(blk[i], i, 13);
+    }
+
+    for (i = 0; i < 64; i++) {
+        for (j = 0; j < 13; j++) {
+            assert_int_equal(blk[i][j], i);
+        }
+        evtPoolFree(blk[i]);
+    }
+
+    evtPoolDestroy(&pool);
+}
+
+static void
+evtPoolExhaustionFallsBackToMalloc(void **state)
+{
+    // maxblocks is rounded up to one slab of 64 blocks
+    evt_pool_t *pool = evtPoolCreate(32, 1);
+    assert_non_null(pool);
+
+    void *blk[70];
+    int i;
+    for (i = 0; i < 70; i++) {
+        blk[i] = evtPoolAlloc(pool);
+        assert_non_null(blk[i]);
+    }
+
+    evt_pool_stats_t stats;
+    evtPoolStats(pool, &stats);
+    assert_int_equal(stats.allocs, 64);
+    assert_int_equal(stats.exhausted, 6);
+    assert_int_equal(stats.failed, 0);
+
+    // Returning a malloc'd block does not put it on the free list
+    for (i = 0; i < 70; i++) {
+        evtPoolFree(blk[i]);
+    }
+
+    for (i = 0; i < 64; i++) {
+        blk[i] = evtPoolAlloc(pool);
+        assert_non_null(blk[i]);
+    }
+    evtPoolStats(pool, &stats);
+    assert_int_equal(stats.allocs, 128);
+    assert_int_equal(stats.exhausted, 6);
+
+    for (i = 0; i < 64; i++) {
+        evtPoolFree(blk[i]);
+    }
+
+    evtPoolDestroy(&pool);
+}
+
+static void
+evtPoolTryAllocStopsAtMaxBlocks(void **state)
+{
+    evt_pool_t *pool = evtPoolCreate(32, 1);
+    assert_non_null(pool);
+
+    void *blk[64];
+    int i;
+    for (i = 0; i < 64; i++) {
+        blk[i] = evtPoolTryAlloc(pool);
+        assert_non_null(blk[i]);
+    }
+    assert_null(evtPoolTryAlloc(pool));
+
+    evt_pool_stats_t stats;
+    evtPoolStats(pool, &stats);
+    assert_int_equal(stats.allocs, 64);
+    assert_int_equal(stats.exhausted, 0);
+    assert_int_equal(stats.failed, 1);
+
+    // Once one comes back, there's room again
+    evtPoolFree(blk[10]);
+    assert_ptr_equal(evtPoolTryAlloc(pool), blk[10]);
+
+    for (i = 0; i < 64; i++) {
+        evtPoolFree(blk[i]);
+    }
+    evtPoolDestroy(&pool);
+}
+
+static void *
+allocFreeThread(void *arg)
+{
+    evt_pool_t *pool = arg;
+    void *held[16];
+    int i, j;
+
+    for (i = 0; i < ALLOCS_PER_THREAD; i += 16) {
+        for (j = 0; j < 16; j++) {
+            held[j] = evtPoolAlloc(pool);
+            if (!held[j]) return (void *)-1;
+            memset(held[j], j, 48);
+        }
+        for (j = 0; j < 16; j++) {
+            if (((char *)held[j])[47] != j) return (void *)-1;
+            evtPoolFree(held[j]);
+        }
+    }
+    return NULL;
+}
+
+static void
+evtPoolAllocFreeFromManyThreads(void **state)
+{
+    evt_pool_t *pool = evtPoolCreate(48, 256);
+    assert_non_null(pool);
+
+    pthread_t tid[NUM_THREADS];
+    int i;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, allocFreeThread, pool), 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        void *rv;
+        assert_int_equal(pthread_join(tid[i], &rv), 0);
+        assert_null(rv);
+    }
+
+    evt_pool_stats_t stats;
+    evtPoolStats(pool, &stats);
+    assert_int_equal(stats.allocs + stats.exhausted,
+                     NUM_THREADS * ((ALLOCS_PER_THREAD + 15) / 16) * 16);
+    assert_int_equal(stats.failed, 0);
+
+    evtPoolDestroy(&pool);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(evtPoolCreateReturnsValidPtr),
+        cmocka_unit_test(evtPoolCreateWithZeroSizeFails),
+        cmocka_unit_test(evtPoolDestroyNullDoesNotCrash),
+        cmocka_unit_test(evtPoolAllocNullPoolReturnsNull),
+        cmocka_unit_test(evtPoolAllocReusesFreedBlocks),
+        cmocka_unit_test(evtPoolBlocksAreAlignedAndDistinct),
+        cmocka_unit_test(evtPoolExhaustionFallsBackToMalloc),
+        cmocka_unit_test(evtPoolTryAllocStopsAtMaxBlocks),
+        cmocka_unit_test(evtPoolAllocFreeFromManyThreads),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include "dbg.h"
+#include "evtstage.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define NUM_PUTS 10000
+
+static uint64_t g_published[64];
+static int g_num_published = 0;
+static int g_num_calls = 0;
+
+static void
+publishFn(void *arg, uint64_t *data, int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        if (g_num_published < 64) g_published[g_num_published] = data[i];
+        g_num_published++;
+    }
+    g_num_calls++;
+}
+
+static void
+evtStageCreateReturnsValidPtr(void **state)
+{
+    evt_stage_t *stage = evtStageCreate(16, publishFn, NULL);
+    assert_non_null(stage);
+    assert_int_equal(evtStageBatch(stage), 16);
+    evtStageDestroy(&stage);
+    assert_null(stage);
+}
+
+static void
+evtStageCreateWithBadArgsFails(void **state)
+{
+    assert_null(evtStageCreate(0, publishFn, NULL));
+    assert_null(evtStageCreate(-1, publishFn, NULL));
+    assert_null(evtStageCreate(16, NULL, NULL));
+}
+
+static void
+evtStageNullArgsDoNotCrash(void **state)
+{
+    evt_stage_t *stage = NULL;
+    evtStageDestroy(NULL);
+    evtStageDestroy(&stage);
+
+    assert_int_equal(evtStagePut(NULL, 1), -1);
+    evtStageFlush(NULL);
+    assert_int_equal(evtStageBatch(NULL), 0);
+}
+
+static void
+evtStagePublishesFullBatches(void **state)
+{
+    g_num_published = g_num_calls = 0;
+    evt_stage_t *stage = evtStageCreate(4, publishFn, NULL);
+    assert_non_null(stage);
+
+    uint64_t i;
+    for (i = 1; i <= 3; i++) {
+        assert_int_equal(evtStagePut(stage, i), 0);
+    }
+    // Not a full batch yet
+    assert_int_equal(g_num_calls, 0);
+
+    assert_int_equal(evtStagePut(stage, 4), 0);
+    assert_int_equal(g_num_calls, 1);
+    assert_int_equal(g_num_published, 4);
+
+    for (i = 5; i <= 10; i++) {
+        assert_int_equal(evtStagePut(stage, i), 0);
+    }
+    assert_int_equal(g_num_calls, 2);
+    assert_int_equal(g_num_published, 8);
+
+    // Flush takes the partial batch
+    evtStageFlush(stage);
+    assert_int_equal(g_num_calls, 3);
+    assert_int_equal(g_num_published, 10);
+    for (i = 0; i < 10; i++) {
+        assert_int_equal(g_published[i], i + 1);
+    }
+
+    // Nothing staged, nothing published
+    evtStageFlush(stage);
+    assert_int_equal(g_num_calls, 3);
+
+    evtStageDestroy(&stage);
+}
+
+static void
+evtStageDestroyPublishesWhatsLeft(void **state)
+{
+    g_num_published = g_num_calls = 0;
+    evt_stage_t *stage = evtStageCreate(8, publishFn, NULL);
+    assert_non_null(stage);
+
+    assert_int_equal(evtStagePut(stage, 7), 0);
+    assert_int_equal(evtStagePut(stage, 8), 0);
+    assert_int_equal(g_num_published, 0);
+
+    evtStageDestroy(&stage);
+    assert_int_equal(g_num_published, 2);
+    assert_int_equal(g_published[0], 7);
+    assert_int_equal(g_published[1], 8);
+}
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+} totals_t;
+
+static void
+countFn(void *arg, uint64_t *data, int num)
+{
+    totals_t *totals = arg;
+    uint64_t sum = 0;
+    int i;
+    for (i = 0; i < num; i++) {
+        sum += data[i];
+    }
+    __sync_fetch_and_add(&totals->count, num);
+    __sync_fetch_and_add(&totals->sum, sum);
+}
+
+static evt_stage_t *g_shared = NULL;
+
+static void *
+putThread(void *arg)
+{
+    uint64_t i;
+    for (i = 1; i <= NUM_PUTS; i++) {
+        if (evtStagePut(g_shared, i)) return (void *)1;
+    }
+    // Leave a partial batch behind for thread exit to publish
+    return NULL;
+}
+
+static void
+evtStageManyThreadsLoseNothing(void **state)
+{
+    totals_t totals = {0};
+    // An odd size, so every thread ends with something staged
+    g_shared = evtStageCreate(7, countFn, &totals);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_THREADS];
+    int i;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, putThread, NULL), 0);
+    }
+    // Flushing while threads put must not lose or repeat any
+    for (i = 0; i < 100; i++) {
+        evtStageFlush(g_shared);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        void *rv;
+        assert_int_equal(pthread_join(tid[i], &rv), 0);
+        assert_null(rv);
+    }
+
+    // Exiting threads published their leftovers; nothing is staged
+    assert_int_equal(totals.count, (uint64_t)NUM_THREADS * NUM_PUTS);
+    assert_int_equal(totals.sum, (uint64_t)NUM_THREADS * NUM_PUTS * (NUM_PUTS + 1) / 2);
+
+    // Slots from exited threads are reused, and still work
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, putThread, NULL), 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+    }
+    assert_int_equal(totals.count, (uint64_t)2 * NUM_THREADS * NUM_PUTS);
+
+    evtStageDestroy(&g_shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(evtStageCreateReturnsValidPtr),
+        cmocka_unit_test(evtStageCreateWithBadArgsFails),
+        cmocka_unit_test(evtStageNullArgsDoNotCrash),
+        cmocka_unit_test(evtStagePublishesFullBatches),
+        cmocka_unit_test(evtStageDestroyPublishesWhatsLeft),
+        cmocka_unit_test(evtStageManyThreadsLoseNothing),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
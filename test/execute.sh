@@ -71,10 +71,22 @@ run_test test/${OS}/evtformattest
 run_test test/${OS}/ctltest
 run_test test/${OS}/mtcformattest
 run_test test/${OS}/circbuftest
+run_test test/${OS}/evtpooltest
 run_test test/${OS}/linklisttest
 run_test test/${OS}/comtest
 run_test test/${OS}/dbgtest
 run_test test/${OS}/searchtest
+run_test test/${OS}/mpsearchtest
+run_test test/${OS}/dnsresptest
+run_test test/${OS}/hostcachetest
+run_test test/${OS}/strtabtest
+run_test test/${OS}/fdtabletest
+run_test test/${OS}/ctrshardtest
+run_test test/${OS}/evtstagetest
+run_test test/${OS}/hpacktest
+run_test test/${OS}/httphdrtest
+run_test test/${OS}/sketchtest
+run_test test/${OS}/hashmaptest
 run_test test/${OS}/httpstatetest
 if [ "${OS}" = "linux" ]; then
     run_test test/${OS}/glibcvertest
@@ -83,6 +95,7 @@ if [ "${OS}" = "linux" ]; then
     run_test test/${OS}/httpheadertest
 fi
 run_test test/${OS}/httpaggtest
+run_test test/${OS}/grpcaggtest
 run_test test/${OS}/selfinterposetest
 
 if [ "${OS}" = "linux" ]; then
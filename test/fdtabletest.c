@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dbg.h"
+#include "fdtable.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define MAX_FDS (1024 * 1024)
+
+typedef struct {
+    int fd;
+    uint64_t count;
+    char name[20];
+} entry_t;
+
+static void
+fdTableCreateReturnsValidPtr(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(tab);
+    assert_int_equal(fdTableMaxFds(tab), MAX_FDS);
+    assert_int_equal(fdTableLimit(tab), 0);
+    fdTableDestroy(&tab);
+    assert_null(tab);
+}
+
+static void
+fdTableCreateWithBadArgsFails(void **state)
+{
+    assert_null(fdTableCreate(0, MAX_FDS));
+    assert_null(fdTableCreate(sizeof(entry_t), 0));
+    assert_null(fdTableCreate(sizeof(entry_t), -1));
+}
+
+static void
+fdTableNullArgsDoNotCrash(void **state)
+{
+    fd_table_t *tab = NULL;
+    fdTableDestroy(NULL);
+    fdTableDestroy(&tab);
+
+    assert_null(fdTableGet(NULL, 1));
+    assert_null(fdTableSlot(NULL, 1));
+    assert_int_equal(fdTableMaxFds(NULL), 0);
+    assert_int_equal(fdTableLimit(NULL), 0);
+}
+
+static void
+fdTableOutOfRangeFdsReturnNull(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), 1000);
+    assert_non_null(tab);
+
+    assert_null(fdTableSlot(tab, -1));
+    assert_null(fdTableSlot(tab, 1000));
+    assert_null(fdTableGet(tab, -1));
+    assert_null(fdTableGet(tab, 1000));
+    assert_non_null(fdTableSlot(tab, 999));
+    assert_int_equal(fdTableLimit(tab), 1000);
+
+    fdTableDestroy(&tab);
+}
+
+static void
+fdTableGetDoesNotAllocate(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(tab);
+
+    assert_null(fdTableGet(tab, 5));
+    assert_int_equal(fdTableLimit(tab), 0);
+
+    entry_t *ent = fdTableSlot(tab, 5);
+    assert_non_null(ent);
+    assert_ptr_equal(fdTableGet(tab, 5), ent);
+
+    // The rest of the page is there, and zeroed
+    entry_t *next = fdTableGet(tab, 6);
+    assert_ptr_equal(next, ent + 1);
+    assert_int_equal(next->fd, 0);
+    assert_int_equal(next->count, 0);
+
+    // But fds far away are not
+    assert_null(fdTableGet(tab, 50000));
+    assert_true(fdTableLimit(tab) > 6);
+    assert_true(fdTableLimit(tab) < 50000);
+
+    fdTableDestroy(&tab);
+}
+
+static void
+fdTableEntriesStayPutAsTableGrows(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(tab);
+
+    entry_t *low = fdTableSlot(tab, 3);
+    assert_non_null(low);
+    low->fd = 3;
+    strcpy(low->name, "three");
+
+    // Way out past the 1024 entries we used to be limited to
+    entry_t *high = fdTableSlot(tab, MAX_FDS - 1);
+    assert_non_null(high);
+    high->fd = MAX_FDS - 1;
+    assert_int_equal(fdTableLimit(tab), MAX_FDS);
+
+    assert_ptr_equal(fdTableGet(tab, 3), low);
+    assert_int_equal(low->fd, 3);
+    assert_string_equal(low->name, "three");
+    assert_ptr_equal(fdTableSlot(tab, MAX_FDS - 1), high);
+    assert_int_equal(high->fd, MAX_FDS - 1);
+
+    fdTableDestroy(&tab);
+}
+
+static void
+fdTableNextActiveVisitsOnlyActiveFds(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(tab);
+
+    assert_int_equal(fdTableNextActive(tab, 0), -1);
+
+    // Spread over words within a page, across pages and across words of pages
+    int fds[] = {0, 5, 63, 64, 127, 128, 1000, 9000, 70000, MAX_FDS - 1};
+    int nfds = sizeof(fds) / sizeof(fds[0]);
+    int i;
+    for (i = 0; i < nfds; i++) {
+        assert_non_null(fdTableSlot(tab, fds[i]));
+        fdTableSetActive(tab, fds[i]);
+    }
+    // An allocated but inactive neighbor isn't visited
+    assert_non_null(fdTableSlot(tab, 6));
+
+    int fd = fdTableNextActive(tab, 0);
+    for (i = 0; i < nfds; i++) {
+        assert_int_equal(fd, fds[i]);
+        fd = fdTableNextActive(tab, fd + 1);
+    }
+    assert_int_equal(fd, -1);
+
+    // Starting in the middle
+    assert_int_equal(fdTableNextActive(tab, 6), 63);
+    assert_int_equal(fdTableNextActive(tab, 1001), 9000);
+    assert_int_equal(fdTableNextActive(tab, -5), 0);
+    assert_int_equal(fdTableNextActive(tab, MAX_FDS), -1);
+
+    // Clearing takes them out, including the only fd on a page
+    fdTableClearActive(tab, 5);
+    fdTableClearActive(tab, 9000);
+    assert_int_equal(fdTableNextActive(tab, 1), 63);
+    assert_int_equal(fdTableNextActive(tab, 1001), 70000);
+
+    for (i = 0; i < nfds; i++) {
+        fdTableClearActive(tab, fds[i]);
+    }
+    assert_int_equal(fdTableNextActive(tab, 0), -1);
+
+    fdTableDestroy(&tab);
+}
+
+static void
+fdTableSetActiveWithoutPageIsIgnored(void **state)
+{
+    fd_table_t *tab = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(tab);
+
+    fdTableSetActive(tab, 500);
+    fdTableClearActive(tab, 500);
+    fdTableSetActive(tab, -1);
+    fdTableSetActive(tab, MAX_FDS);
+    fdTableSetActive(NULL, 1);
+    fdTableClearActive(NULL, 1);
+    assert_int_equal(fdTableNextActive(tab, 0), -1);
+    assert_int_equal(fdTableNextActive(NULL, 0), -1);
+
+    fdTableDestroy(&tab);
+}
+
+static fd_table_t *g_shared = NULL;
+static entry_t *g_seen[NUM_THREADS][4096];
+
+static void *
+slotThread(void *arg)
+{
+    entry_t **seen = arg;
+    int i;
+
+    // Every thread touches the same fds, so they race to add pages
+    for (i = 0; i < 4096; i++) {
+        seen[i] = fdTableSlot(g_shared, i * 37);
+        if (seen[i]) __sync_fetch_and_add(&seen[i]->count, 1);
+    }
+    return NULL;
+}
+
+static void
+fdTableSlotFromManyThreadsGivesOneEntry(void **state)
+{
+    g_shared = fdTableCreate(sizeof(entry_t), MAX_FDS);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_THREADS];
+    int i, j;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, slotThread, g_seen[i]), 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+    }
+
+    for (j = 0; j < 4096; j++) {
+        assert_non_null(g_seen[0][j]);
+        assert_ptr_equal(fdTableGet(g_shared, j * 37), g_seen[0][j]);
+        assert_int_equal(g_seen[0][j]->count, NUM_THREADS);
+        for (i = 1; i < NUM_THREADS; i++) {
+            assert_ptr_equal(g_seen[i][j], g_seen[0][j]);
+        }
+    }
+
+    fdTableDestroy(&g_shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(fdTableCreateReturnsValidPtr),
+        cmocka_unit_test(fdTableCreateWithBadArgsFails),
+        cmocka_unit_test(fdTableNullArgsDoNotCrash),
+        cmocka_unit_test(fdTableOutOfRangeFdsReturnNull),
+        cmocka_unit_test(fdTableGetDoesNotAllocate),
+        cmocka_unit_test(fdTableEntriesStayPutAsTableGrows),
+        cmocka_unit_test(fdTableNextActiveVisitsOnlyActiveFds),
+        cmocka_unit_test(fdTableSetActiveWithoutPageIsIgnored),
+        cmocka_unit_test(fdTableSlotFromManyThreadsGivesOneEntry),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "grpcagg.h"
+#include "test.h"
+
+// We have our own implementation of cmdSendMetric, so the actual
+// value of this isn't really used, but it needs to be non-null.
+mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
+strtab_t *g_names = NULL;
+
+// Every metric reported, with the fields we look at
+#define MAX_METRICS 2048
+int g_metric_count = 0;
+struct {
+    char name[64];
+    char method[128];
+    char class[8];
+    long long status;
+    long long numops;
+    long long value;
+} g_metric[MAX_METRICS];
+
+// Needed for grpcAggSendReport
+int
+cmdSendMetric(mtc_t *mtc, event_t *evt)
+{
+    if (g_metric_count >= MAX_METRICS) return 0;
+
+    int i = g_metric_count++;
+    memset(&g_metric[i], 0, sizeof(g_metric[0]));
+    g_metric[i].status = -1;
+    g_metric[i].numops = -1;
+    snprintf(g_metric[i].name, sizeof(g_metric[0].name), "%s", evt->name);
+    g_metric[i].value = evt->value.integer;
+
+    event_field_t *field;
+    for (field = evt->fields; field->value_type != FMT_END; field++) {
+        if (!strcmp(field->name, "grpc.method")) {
+            snprintf(g_metric[i].method, sizeof(g_metric[0].method), "%s", field->value.str);
+        } else if (!strcmp(field->name, "grpc.status_class")) {
+            snprintf(g_metric[i].class, sizeof(g_metric[0].class), "%s", field->value.str);
+        } else if (!strcmp(field->name, "grpc.status_code")) {
+            g_metric[i].status = field->value.num;
+        } else if (!strcmp(field->name, "numops")) {
+            g_metric[i].numops = field->value.num;
+        }
+    }
+    return 0;
+}
+
+// The value of the metric that matches; -1 if there isn't one.  class
+// and status of NULL and -1 match anything.
+static long long
+metric(const char *name, const char *method, const char *class, long long status)
+{
+    int i;
+    for (i = 0; i < g_metric_count; i++) {
+        if (strcmp(g_metric[i].name, name)) continue;
+        if (strcmp(g_metric[i].method, method)) continue;
+        if (class && strcmp(g_metric[i].class, class)) continue;
+        if ((status != -1) && (g_metric[i].status != status)) continue;
+        return g_metric[i].value;
+    }
+    return -1;
+}
+
+static long long
+numops(const char *name, const char *method)
+{
+    int i;
+    for (i = 0; i < g_metric_count; i++) {
+        if (!strcmp(g_metric[i].name, name) && !strcmp(g_metric[i].method, method)) {
+            return g_metric[i].numops;
+        }
+    }
+    return -1;
+}
+
+static void
+sendReport(grpc_agg_t *agg)
+{
+    g_metric_count = 0;
+    grpcAggSendReport(agg, bogus_mtc_addr);
+}
+
+static void
+addCall(grpc_agg_t *agg, const char *method, int status, uint64_t duration)
+{
+    grpc_call_t call = {
+        .method = method,
+        .status = status,
+        .isServer = TRUE,
+        .duration = duration,
+    };
+    grpcAggAddCall(agg, &call);
+}
+
+static int
+namesSetup(void **state)
+{
+    g_names = strtabCreate(1024, 0);
+    return (g_names) ? groupSetup(state) : -1;
+}
+
+static int
+namesTeardown(void **state)
+{
+    strtabDestroy(&g_names);
+    return groupTeardown(state);
+}
+
+static void
+grpcAggCreateAndDestroy(void **state)
+{
+    grpc_agg_t *agg = grpcAggCreate(g_names);
+    assert_non_null(agg);
+    grpcAggDestroy(&agg);
+    assert_null(agg);
+}
+
+static void
+grpcAggNullArgsDoNotCrash(void **state)
+{
+    grpc_agg_t *agg = NULL;
+    grpcAggDestroy(NULL);
+    grpcAggDestroy(&agg);
+    grpcAggAddCall(NULL, NULL);
+    grpcAggSendReport(NULL, bogus_mtc_addr);
+    grpcAggReset(NULL);
+
+    agg = grpcAggCreate(g_names);
+    grpcAggAddCall(agg, NULL);
+    grpc_call_t call = {0};
+    grpcAggAddCall(agg, &call);
+    grpcAggSendReport(agg, NULL);
+    sendReport(agg);
+    assert_int_equal(g_metric_count, 0);
+    grpcAggDestroy(&agg);
+}
+
+static void
+grpcAggCountsCallsByMethodAndStatus(void **state)
+{
+    grpc_agg_t *agg = grpcAggCreate(g_names);
+    const char *get = "/shop.Catalog/GetItem";
+    const char *put = "/shop.Catalog/PutItem";
+
+    int i;
+    for (i = 0; i < 10; i++) {
+        addCall(agg, get, (i < 7) ? GRPC_STATUS_OK : 5, 2);
+    }
+    addCall(agg, put, GRPC_STATUS_OK, 2);
+    // Not a status; counted as UNKNOWN
+    addCall(agg, put, -1, 2);
+    addCall(agg, put, 99, 2);
+
+    // A client call of the same method is counted apart
+    grpc_call_t call = {.method = get, .status = 14, .duration = 9};
+    grpcAggAddCall(agg, &call);
+
+    sendReport(agg);
+    assert_int_equal(metric("grpc.server.calls", get, NULL, 0), 7);
+    assert_int_equal(metric("grpc.server.calls", get, NULL, 5), 3);
+    assert_int_equal(metric("grpc.server.calls", put, NULL, 0), 1);
+    assert_int_equal(metric("grpc.server.calls", put, NULL, GRPC_STATUS_UNKNOWN), 2);
+    assert_int_equal(metric("grpc.client.calls", get, NULL, 14), 1);
+    assert_int_equal(metric("grpc.client.calls", get, NULL, 0), -1);
+    assert_int_equal(metric("grpc.server.duration", get, NULL, -1), 20);
+    assert_int_equal(numops("grpc.server.duration", get), 10);
+    assert_int_equal(metric("grpc.client.duration", get, NULL, -1), 9);
+
+    // Reset starts the next period from nothing
+    grpcAggReset(agg);
+    sendReport(agg);
+    assert_int_equal(g_metric_count, 0);
+
+    grpcAggDestroy(&agg);
+}
+
+static void
+grpcAggSendReportHasDurationPercentiles(void **state)
+{
+    grpc_agg_t *agg = grpcAggCreate(g_names);
+    const char *method = "/helloworld.Greeter/SayHello";
+
+    // 90 fast calls and 10 slow ones that fail
+    int i;
+    for (i = 0; i < 90; i++) addCall(agg, method, GRPC_STATUS_OK, 3);
+    for (i = 0; i < 10; i++) addCall(agg, method, 4, 1000);
+
+    sendReport(agg);
+    assert_int_equal(metric("grpc.server.duration.p50", method, "ok", -1), 3);
+    assert_int_equal(metric("grpc.server.duration.max", method, "ok", -1), 3);
+    assert_int_equal(metric("grpc.server.duration.max", method, "error", -1), 1000);
+    assert_int_equal(metric("grpc.client.duration.max", method, "ok", -1), -1);
+
+    grpcAggDestroy(&agg);
+}
+
+static void
+grpcAggSendReportHasMessageSizes(void **state)
+{
+    grpc_agg_t *agg = grpcAggCreate(g_names);
+    const char *method = "/chat.Room/Stream";
+
+    // A stream of messages each way, and a call with none coming back
+    grpc_call_t call = {
+        .method = method,
+        .status = GRPC_STATUS_OK,
+        .msgs = {3, 5},
+        .bytes = {300, 50},
+    };
+    grpcAggAddCall(agg, &call);
+    call.msgs[1] = call.bytes[1] = 0;
+    grpcAggAddCall(agg, &call);
+
+    sendReport(agg);
+    assert_int_equal(metric("grpc.client.request.message_size", method, NULL, -1), 600);
+    assert_int_equal(numops("grpc.client.request.message_size", method), 6);
+    assert_int_equal(metric("grpc.client.response.message_size", method, NULL, -1), 50);
+    assert_int_equal(numops("grpc.client.response.message_size", method), 5);
+    assert_int_equal(metric("grpc.server.request.message_size", method, NULL, -1), -1);
+
+    grpcAggDestroy(&agg);
+}
+
+static void
+grpcAggPastMaxMethodsGoesToOther(void **state)
+{
+    grpc_agg_t *agg = grpcAggCreate(g_names);
+    char method[64];
+
+    int i;
+    for (i = 0; i < GRPC_MAX_METHODS + 10; i++) {
+        snprintf(method, sizeof(method), "/svc.Service/Method%d", i);
+        addCall(agg, method, GRPC_STATUS_OK, 1);
+    }
+    // Ones already seen still count as themselves
+    addCall(agg, "/svc.Service/Method0", GRPC_STATUS_OK, 1);
+
+    sendReport(agg);
+    assert_int_equal(metric("grpc.server.calls", "/svc.Service/Method0", NULL, 0), 2);
+    snprintf(method, sizeof(method), "/svc.Service/Method%d", GRPC_MAX_METHODS - 1);
+    assert_int_equal(metric("grpc.server.calls", method, NULL, 0), 1);
+    snprintf(method, sizeof(method), "/svc.Service/Method%d", GRPC_MAX_METHODS);
+    assert_int_equal(metric("grpc.server.calls", method, NULL, 0), -1);
+    assert_int_equal(metric("grpc.server.calls", "other", NULL, 0), 10);
+
+    grpcAggDestroy(&agg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(grpcAggCreateAndDestroy),
+        cmocka_unit_test(grpcAggNullArgsDoNotCrash),
+        cmocka_unit_test(grpcAggCountsCallsByMethodAndStatus),
+        cmocka_unit_test(grpcAggSendReportHasDurationPercentiles),
+        cmocka_unit_test(grpcAggSendReportHasMessageSizes),
+        cmocka_unit_test(grpcAggPastMaxMethodsGoesToOther),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, namesSetup, namesTeardown);
+}
@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "hashmap.h"
+#include "test.h"
+
+#define NUM_READERS 4
+#define NUM_KEYS 1000
+
+static uint64_t g_deleted = 0;
+
+static void
+countDelete(void *data)
+{
+    __sync_add_and_fetch(&g_deleted, 1);
+}
+
+// The data of an element is a malloc'd copy of its key
+static void
+poisonAndFree(void *data)
+{
+    *(list_key_t *)data = ~0ULL;
+    free(data);
+}
+
+static void *
+keyData(list_key_t key)
+{
+    list_key_t *data = malloc(sizeof(*data));
+    if (data) *data = key;
+    return data;
+}
+
+static void
+hmapCreateAndDestroy(void **state)
+{
+    hashmap_t *map = hmapCreate(NULL);
+    assert_non_null(map);
+    assert_int_equal(hmapCount(map), 0);
+    hmapDestroy(&map);
+    assert_null(map);
+}
+
+static void
+hmapNullArgsDoNotCrash(void **state)
+{
+    hashmap_t *map = NULL;
+    hmapDestroy(NULL);
+    hmapDestroy(&map);
+    assert_false(hmapInsert(NULL, 1, (void *)1));
+    assert_false(hmapDelete(NULL, 1));
+    assert_int_equal(hmapDeleteIf(NULL, NULL, NULL), 0);
+    assert_null(hmapFind(NULL, 1));
+    assert_int_equal(hmapCount(NULL), 0);
+    hmapExit(NULL, hmapEnter(NULL));
+}
+
+static void
+hmapInsertFindAndDelete(void **state)
+{
+    hashmap_t *map = hmapCreate(NULL);
+
+    assert_true(hmapInsert(map, 0, (void *)10));
+    assert_true(hmapInsert(map, 23, (void *)23));
+    assert_false(hmapInsert(map, 23, (void *)24));
+    assert_int_equal(hmapCount(map), 2);
+
+    assert_ptr_equal(hmapFind(map, 0), (void *)10);
+    assert_ptr_equal(hmapFind(map, 23), (void *)23);
+    assert_null(hmapFind(map, 24));
+
+    assert_true(hmapDelete(map, 23));
+    assert_false(hmapDelete(map, 23));
+    assert_null(hmapFind(map, 23));
+    assert_int_equal(hmapCount(map), 1);
+
+    // A deleted key can come back
+    assert_true(hmapInsert(map, 23, (void *)25));
+    assert_ptr_equal(hmapFind(map, 23), (void *)25);
+
+    hmapDestroy(&map);
+}
+
+static void
+hmapGrowsAndShrinks(void **state)
+{
+    hashmap_t *map = hmapCreate(NULL);
+
+    // Keys like the addresses and sequence numbers we use
+    list_key_t i;
+    for (i = 1; i <= 100000; i++) {
+        assert_true(hmapInsert(map, i * 64, (void *)i));
+    }
+    assert_int_equal(hmapCount(map), 100000);
+    for (i = 1; i <= 100000; i++) {
+        assert_ptr_equal(hmapFind(map, i * 64), (void *)i);
+    }
+
+    // Churn leaves deleted slots behind; they mustn't fill the table
+    for (i = 1; i <= 100000; i++) {
+        assert_true(hmapDelete(map, i * 64));
+        assert_true(hmapInsert(map, i * 64 + 1, (void *)i));
+    }
+    assert_int_equal(hmapCount(map), 100000);
+    for (i = 1; i <= 100000; i++) {
+        assert_null(hmapFind(map, i * 64));
+        assert_ptr_equal(hmapFind(map, i * 64 + 1), (void *)i);
+    }
+
+    hmapDestroy(&map);
+}
+
+static void
+hmapDeleteFnIsCalledOncePerElement(void **state)
+{
+    g_deleted = 0;
+    hashmap_t *map = hmapCreate(countDelete);
+
+    list_key_t i;
+    for (i = 0; i < NUM_KEYS; i++) {
+        assert_true(hmapInsert(map, i, (void *)i));
+    }
+
+    // With no readers, deletes are freed on the spot
+    for (i = 0; i < NUM_KEYS / 2; i++) {
+        assert_true(hmapDelete(map, i));
+    }
+    assert_int_equal(g_deleted, NUM_KEYS / 2);
+
+    hmapDestroy(&map);
+    assert_int_equal(g_deleted, NUM_KEYS);
+}
+
+static void
+hmapDeleteWaitsForReaders(void **state)
+{
+    g_deleted = 0;
+    hashmap_t *map = hmapCreate(countDelete);
+    assert_true(hmapInsert(map, 1, (void *)1));
+    assert_true(hmapInsert(map, 2, (void *)2));
+
+    int token = hmapEnter(map);
+    assert_ptr_equal(hmapFind(map, 1), (void *)1);
+    assert_true(hmapDelete(map, 1));
+
+    // Still in use; nested readers don't change that
+    assert_int_equal(g_deleted, 0);
+    hmapExit(map, hmapEnter(map));
+    assert_true(hmapDelete(map, 2));
+    assert_int_equal(g_deleted, 0);
+
+    // Freed with the next change once the reader leaves
+    hmapExit(map, token);
+    assert_true(hmapInsert(map, 3, (void *)3));
+    assert_int_equal(g_deleted, 2);
+
+    hmapDestroy(&map);
+    assert_int_equal(g_deleted, 3);
+}
+
+static int
+isEven(list_key_t key, void *data, void *arg)
+{
+    (*(int *)arg)++;
+    return !(key & 1);
+}
+
+static void
+hmapDeleteIfRemovesMatches(void **state)
+{
+    g_deleted = 0;
+    hashmap_t *map = hmapCreate(countDelete);
+
+    list_key_t i;
+    for (i = 0; i < NUM_KEYS; i++) {
+        assert_true(hmapInsert(map, i, (void *)i));
+    }
+
+    int calls = 0;
+    assert_int_equal(hmapDeleteIf(map, isEven, &calls), NUM_KEYS / 2);
+    assert_int_equal(calls, NUM_KEYS);
+    assert_int_equal(hmapCount(map), NUM_KEYS / 2);
+    assert_int_equal(g_deleted, NUM_KEYS / 2);
+    for (i = 0; i < NUM_KEYS; i++) {
+        assert_true((hmapFind(map, i) != NULL) == (i & 1));
+    }
+
+    hmapDestroy(&map);
+}
+
+typedef struct {
+    hashmap_t *map;
+    int stop;
+    uint64_t bad;
+} race_t;
+
+static void *
+readerThread(void *arg)
+{
+    race_t *race = arg;
+    list_key_t key = 0;
+
+    while (!__atomic_load_n(&race->stop, __ATOMIC_ACQUIRE)) {
+        key = (key + 7) % NUM_KEYS;
+
+        int token = hmapEnter(race->map);
+        list_key_t *data = hmapFind(race->map, key);
+        if (data) {
+            if (*data != key) __sync_add_and_fetch(&race->bad, 1);
+        }
+        hmapExit(race->map, token);
+    }
+    return NULL;
+}
+
+static void
+hmapReadersRaceWriters(void **state)
+{
+    race_t race = {.map = hmapCreate(poisonAndFree)};
+    assert_non_null(race.map);
+
+    pthread_t tid[NUM_READERS];
+    int i;
+    for (i = 0; i < NUM_READERS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, readerThread, &race), 0);
+    }
+
+    // Keep replacing elements and rebuilding the table under the readers
+    list_key_t key;
+    int round;
+    for (round = 0; round < 200; round++) {
+        for (key = 0; key < NUM_KEYS; key++) {
+            if (!hmapInsert(race.map, key, keyData(key))) {
+                fail_msg("insert of %lu failed", (unsigned long)key);
+            }
+        }
+        for (key = 0; key < NUM_KEYS; key++) {
+            assert_true(hmapDelete(race.map, key));
+        }
+    }
+
+    __atomic_store_n(&race.stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < NUM_READERS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+    }
+
+    assert_int_equal(race.bad, 0);
+    assert_int_equal(hmapCount(race.map), 0);
+    hmapDestroy(&race.map);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(hmapCreateAndDestroy),
+        cmocka_unit_test(hmapNullArgsDoNotCrash),
+        cmocka_unit_test(hmapInsertFindAndDelete),
+        cmocka_unit_test(hmapGrowsAndShrinks),
+        cmocka_unit_test(hmapDeleteFnIsCalledOncePerElement),
+        cmocka_unit_test(hmapDeleteWaitsForReaders),
+        cmocka_unit_test(hmapDeleteIfRemovesMatches),
+        cmocka_unit_test(hmapReadersRaceWriters),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
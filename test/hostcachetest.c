@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "dbg.h"
+#include "hostcache.h"
+#include "test.h"
+
+static char name[HOSTCACHE_MAX_NAME];
+
+static void
+add4(hostcache_t *hc, const char *ip, const char *host)
+{
+    struct in_addr addr;
+    assert_int_equal(inet_pton(AF_INET, ip, &addr), 1);
+    hostCacheAdd(hc, AF_INET, &addr, host);
+}
+
+static int
+find4(hostcache_t *hc, const char *ip)
+{
+    struct in_addr addr;
+    assert_int_equal(inet_pton(AF_INET, ip, &addr), 1);
+    return hostCacheFind(hc, AF_INET, &addr, name, sizeof(name));
+}
+
+static void
+hostCacheCreateAndDestroy(void **state)
+{
+    hostcache_t *hc = hostCacheCreate(10);
+    assert_non_null(hc);
+    assert_int_equal(hostCacheCount(hc), 0);
+    hostCacheDestroy(&hc);
+    assert_null(hc);
+
+    assert_null(hostCacheCreate(0));
+}
+
+static void
+hostCacheNullArgsDoNotCrash(void **state)
+{
+    hostcache_t *hc = NULL;
+    struct in_addr addr = {0};
+
+    hostCacheDestroy(NULL);
+    hostCacheDestroy(&hc);
+    hostCacheAdd(NULL, AF_INET, &addr, "a.example");
+    assert_false(hostCacheFind(NULL, AF_INET, &addr, name, sizeof(name)));
+    assert_int_equal(hostCacheCount(NULL), 0);
+
+    hc = hostCacheCreate(4);
+    hostCacheAdd(hc, AF_INET, NULL, "a.example");
+    hostCacheAdd(hc, AF_INET, &addr, NULL);
+    // Nothing is learned from an empty name
+    hostCacheAdd(hc, AF_INET, &addr, "");
+    // Or an address that isn't IP
+    hostCacheAdd(hc, AF_UNIX, &addr, "a.example");
+    assert_int_equal(hostCacheCount(hc), 0);
+
+    hostCacheAdd(hc, AF_INET, &addr, "a.example");
+    assert_false(hostCacheFind(hc, AF_INET, NULL, name, sizeof(name)));
+    assert_false(hostCacheFind(hc, AF_INET, &addr, NULL, sizeof(name)));
+    assert_false(hostCacheFind(hc, AF_INET, &addr, name, 0));
+    assert_false(hostCacheFind(hc, AF_UNIX, &addr, name, sizeof(name)));
+    hostCacheDestroy(&hc);
+}
+
+static void
+hostCacheFindsWhatWasAdded(void **state)
+{
+    hostcache_t *hc = hostCacheCreate(8);
+
+    add4(hc, "93.184.216.34", "example.com");
+    add4(hc, "10.0.0.1", "db.internal");
+    assert_int_equal(hostCacheCount(hc), 2);
+
+    assert_true(find4(hc, "93.184.216.34"));
+    assert_string_equal(name, "example.com");
+    assert_true(find4(hc, "10.0.0.1"));
+    assert_string_equal(name, "db.internal");
+    assert_false(find4(hc, "10.0.0.2"));
+
+    // The newer name wins
+    add4(hc, "10.0.0.1", "replica.internal");
+    assert_int_equal(hostCacheCount(hc), 2);
+    assert_true(find4(hc, "10.0.0.1"));
+    assert_string_equal(name, "replica.internal");
+
+    // A small buffer gets as much of the name as fits
+    struct in_addr addr;
+    char small[8];
+    inet_pton(AF_INET, "10.0.0.1", &addr);
+    assert_true(hostCacheFind(hc, AF_INET, &addr, small, sizeof(small)));
+    assert_string_equal(small, "replica");
+
+    hostCacheDestroy(&hc);
+}
+
+static void
+hostCacheIpv6AndMapped(void **state)
+{
+    hostcache_t *hc = hostCacheCreate(8);
+    struct in6_addr addr6;
+
+    assert_int_equal(inet_pton(AF_INET6, "2606:2800:220:1::1", &addr6), 1);
+    hostCacheAdd(hc, AF_INET6, &addr6, "example.com");
+    assert_true(hostCacheFind(hc, AF_INET6, &addr6, name, sizeof(name)));
+    assert_string_equal(name, "example.com");
+
+    // Connecting to an IPv4 address from an IPv6 socket is the same host
+    add4(hc, "192.0.2.7", "v4.example");
+    assert_int_equal(inet_pton(AF_INET6, "::ffff:192.0.2.7", &addr6), 1);
+    assert_true(hostCacheFind(hc, AF_INET6, &addr6, name, sizeof(name)));
+    assert_string_equal(name, "v4.example");
+
+    // And the other way around
+    assert_int_equal(inet_pton(AF_INET6, "::ffff:192.0.2.8", &addr6), 1);
+    hostCacheAdd(hc, AF_INET6, &addr6, "mapped.example");
+    assert_true(find4(hc, "192.0.2.8"));
+    assert_string_equal(name, "mapped.example");
+    assert_int_equal(hostCacheCount(hc), 3);
+
+    hostCacheDestroy(&hc);
+}
+
+static void
+hostCacheEvictsLeastRecentlyUsed(void **state)
+{
+    hostcache_t *hc = hostCacheCreate(3);
+
+    add4(hc, "10.0.0.1", "one");
+    add4(hc, "10.0.0.2", "two");
+    add4(hc, "10.0.0.3", "three");
+
+    // Using one makes two the oldest
+    assert_true(find4(hc, "10.0.0.1"));
+    add4(hc, "10.0.0.4", "four");
+    assert_int_equal(hostCacheCount(hc), 3);
+    assert_false(find4(hc, "10.0.0.2"));
+    assert_true(find4(hc, "10.0.0.1"));
+    assert_true(find4(hc, "10.0.0.3"));
+    assert_true(find4(hc, "10.0.0.4"));
+
+    // Adding again counts as a use, too; now 1 is the oldest
+    add4(hc, "10.0.0.3", "three");
+    add4(hc, "10.0.0.5", "five");
+    assert_false(find4(hc, "10.0.0.1"));
+    assert_true(find4(hc, "10.0.0.5"));
+    assert_string_equal(name, "five");
+
+    hostCacheDestroy(&hc);
+}
+
+static void
+hostCacheManyAddresses(void **state)
+{
+    hostcache_t *hc = hostCacheCreate(100);
+    char ip[32];
+    char host[32];
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 256, i % 256);
+        snprintf(host, sizeof(host), "host%d", i);
+        add4(hc, ip, host);
+    }
+    assert_int_equal(hostCacheCount(hc), 100);
+
+    // Only the last 100 are still there
+    for (i = 0; i < 1000; i++) {
+        snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 256, i % 256);
+        snprintf(host, sizeof(host), "host%d", i);
+        if (i < 900) {
+            assert_false(find4(hc, ip));
+        } else {
+            assert_true(find4(hc, ip));
+            assert_string_equal(name, host);
+        }
+    }
+
+    hostCacheDestroy(&hc);
+}
+
+#define THREADS 4
+
+static hostcache_t *g_hc;
+
+static void *
+addAndFind(void *arg)
+{
+    long t = (long)arg;
+    char found[HOSTCACHE_MAX_NAME];
+    long errors = 0;
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        unsigned char addr[4] = {10, (unsigned char)t, (unsigned char)(i >> 8), (unsigned char)i};
+        hostCacheAdd(g_hc, AF_INET, addr, (t & 1) ? "odd" : "even");
+        // Anything found has to be what some thread added for it
+        if (hostCacheFind(g_hc, AF_INET, addr, found, sizeof(found)) &&
+            strcmp(found, (t & 1) ? "odd" : "even")) errors++;
+    }
+    return (void *)errors;
+}
+
+static void
+hostCacheFromManyThreads(void **state)
+{
+    g_hc = hostCacheCreate(64);
+    pthread_t thread[THREADS];
+    long i;
+
+    for (i = 0; i < THREADS; i++) {
+        assert_int_equal(pthread_create(&thread[i], NULL, addAndFind, (void *)i), 0);
+    }
+    for (i = 0; i < THREADS; i++) {
+        void *errors;
+        pthread_join(thread[i], &errors);
+        assert_int_equal((long)errors, 0);
+    }
+    assert_int_equal(hostCacheCount(g_hc), 64);
+
+    hostCacheDestroy(&g_hc);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(hostCacheCreateAndDestroy),
+        cmocka_unit_test(hostCacheNullArgsDoNotCrash),
+        cmocka_unit_test(hostCacheFindsWhatWasAdded),
+        cmocka_unit_test(hostCacheIpv6AndMapped),
+        cmocka_unit_test(hostCacheEvictsLeastRecentlyUsed),
+        cmocka_unit_test(hostCacheManyAddresses),
+        cmocka_unit_test(hostCacheFromManyThreads),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
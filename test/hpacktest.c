@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include "dbg.h"
+#include "hpack.h"
+#include "test.h"
+
+#define MAX_FIELDS 16
+
+typedef struct {
+    int num;
+    char name[MAX_FIELDS][64];
+    char value[MAX_FIELDS][128];
+} fields_t;
+
+static void
+collect(void *arg, const hpack_field_t *field)
+{
+    fields_t *f = arg;
+    if (f->num >= MAX_FIELDS) return;
+    snprintf(f->name[f->num], sizeof(f->name[0]), "%.*s", (int)field->namelen, field->name);
+    snprintf(f->value[f->num], sizeof(f->value[0]), "%.*s", (int)field->valuelen, field->value);
+    f->num++;
+}
+
+static int
+decode(hpack_t *hp, const uint8_t *block, size_t len, fields_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    return hpackDecode(hp, block, len, collect, f);
+}
+
+static void
+assertField(fields_t *f, int i, const char *name, const char *value)
+{
+    assert_true(i < f->num);
+    assert_string_equal(f->name[i], name);
+    assert_string_equal(f->value[i], value);
+}
+
+static void
+hpackCreateReturnsValidPtr(void **state)
+{
+    hpack_t *hp = hpackCreate(4096);
+    assert_non_null(hp);
+    assert_int_equal(hpackTableSize(hp), 0);
+    assert_int_equal(hpackTableCount(hp), 0);
+    hpackDestroy(&hp);
+    assert_null(hp);
+}
+
+static void
+hpackNullArgsDoNotCrash(void **state)
+{
+    hpack_t *hp = NULL;
+    hpackDestroy(NULL);
+    hpackDestroy(&hp);
+
+    uint8_t block[] = {0x82};
+    assert_int_equal(hpackDecode(NULL, block, sizeof(block), collect, NULL), -1);
+    assert_int_equal(hpackTableSize(NULL), 0);
+    assert_int_equal(hpackTableCount(NULL), 0);
+
+    // No callback is fine; the table is still kept
+    hp = hpackCreate(4096);
+    assert_int_equal(hpackDecode(hp, block, sizeof(block), NULL, NULL), 0);
+    assert_int_equal(hpackDecode(hp, NULL, 0, NULL, NULL), 0);
+    hpackDestroy(&hp);
+}
+
+// RFC 7541 C.3, requests without huffman coding
+static void
+hpackDecodesRequestsWithoutHuffman(void **state)
+{
+    uint8_t req1[] = {
+        0x82, 0x86, 0x84, 0x41, 0x0f, 0x77, 0x77, 0x77, 0x2e, 0x65,
+        0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d,
+    };
+    uint8_t req2[] = {
+        0x82, 0x86, 0x84, 0xbe, 0x58, 0x08, 0x6e, 0x6f, 0x2d, 0x63,
+        0x61, 0x63, 0x68, 0x65,
+    };
+    uint8_t req3[] = {
+        0x82, 0x87, 0x85, 0xbf, 0x40, 0x0a, 0x63, 0x75, 0x73, 0x74,
+        0x6f, 0x6d, 0x2d, 0x6b, 0x65, 0x79, 0x0c, 0x63, 0x75, 0x73,
+        0x74, 0x6f, 0x6d, 0x2d, 0x76, 0x61, 0x6c, 0x75, 0x65,
+    };
+    fields_t f;
+    hpack_t *hp = hpackCreate(4096);
+    assert_non_null(hp);
+
+    assert_int_equal(decode(hp, req1, sizeof(req1), &f), 0);
+    assert_int_equal(f.num, 4);
+    assertField(&f, 0, ":method", "GET");
+    assertField(&f, 1, ":scheme", "http");
+    assertField(&f, 2, ":path", "/");
+    assertField(&f, 3, ":authority", "www.example.com");
+    assert_int_equal(hpackTableSize(hp), 57);
+    assert_int_equal(hpackTableCount(hp), 1);
+
+    assert_int_equal(decode(hp, req2, sizeof(req2), &f), 0);
+    assert_int_equal(f.num, 5);
+    assertField(&f, 3, ":authority", "www.example.com");
+    assertField(&f, 4, "cache-control", "no-cache");
+    assert_int_equal(hpackTableSize(hp), 110);
+    assert_int_equal(hpackTableCount(hp), 2);
+
+    assert_int_equal(decode(hp, req3, sizeof(req3), &f), 0);
+    assert_int_equal(f.num, 5);
+    assertField(&f, 1, ":scheme", "https");
+    assertField(&f, 2, ":path", "/index.html");
+    assertField(&f, 3, ":authority", "www.example.com");
+    assertField(&f, 4, "custom-key", "custom-value");
+    assert_int_equal(hpackTableSize(hp), 164);
+    assert_int_equal(hpackTableCount(hp), 3);
+
+    hpackDestroy(&hp);
+}
+
+// RFC 7541 C.4, the same requests with huffman coding
+static void
+hpackDecodesRequestsWithHuffman(void **state)
+{
+    uint8_t req1[] = {
+        0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2,
+        0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff,
+    };
+    uint8_t req2[] = {
+        0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64,
+        0x9c, 0xbf,
+    };
+    uint8_t req3[] = {
+        0x82, 0x87, 0x85, 0xbf, 0x40, 0x88, 0x25, 0xa8, 0x49, 0xe9,
+        0x5b, 0xa9, 0x7d, 0x7f, 0x89, 0x25, 0xa8, 0x49, 0xe9, 0x5b,
+        0xb8, 0xe8, 0xb4, 0xbf,
+    };
+    fields_t f;
+    hpack_t *hp = hpackCreate(4096);
+    assert_non_null(hp);
+
+    assert_int_equal(decode(hp, req1, sizeof(req1), &f), 0);
+    assertField(&f, 3, ":authority", "www.example.com");
+    assert_int_equal(hpackTableSize(hp), 57);
+
+    assert_int_equal(decode(hp, req2, sizeof(req2), &f), 0);
+    assertField(&f, 4, "cache-control", "no-cache");
+    assert_int_equal(hpackTableSize(hp), 110);
+
+    assert_int_equal(decode(hp, req3, sizeof(req3), &f), 0);
+    assertField(&f, 2, ":path", "/index.html");
+    assertField(&f, 4, "custom-key", "custom-value");
+    assert_int_equal(hpackTableSize(hp), 164);
+
+    hpackDestroy(&hp);
+}
+
+// RFC 7541 C.5, responses that overflow a 256 byte table
+static void
+hpackEvictsOldestEntries(void **state)
+{
+    uint8_t resp1[] =
+        "\x48\x03\x33\x30\x32\x58\x07\x70\x72\x69\x76\x61\x74\x65\x61\x1d"
+        "\x4d\x6f\x6e\x2c\x20\x32\x31\x20\x4f\x63\x74\x20\x32\x30\x31\x33"
+        "\x20\x32\x30\x3a\x31\x33\x3a\x32\x31\x20\x47\x4d\x54\x6e\x17\x68"
+        "\x74\x74\x70\x73\x3a\x2f\x2f\x77\x77\x77\x2e\x65\x78\x61\x6d\x70"
+        "\x6c\x65\x2e\x63\x6f\x6d";
+    uint8_t resp2[] = "\x48\x03\x33\x30\x37\xc1\xc0\xbf";
+    uint8_t resp3[] =
+        "\x88\xc1\x61\x1d\x4d\x6f\x6e\x2c\x20\x32\x31\x20\x4f\x63\x74\x20"
+        "\x32\x30\x31\x33\x20\x32\x30\x3a\x31\x33\x3a\x32\x32\x20\x47\x4d"
+        "\x54\xc0\x5a\x04\x67\x7a\x69\x70\x77\x38\x66\x6f\x6f\x3d\x41\x53"
+        "\x44\x4a\x4b\x48\x51\x4b\x42\x5a\x58\x4f\x51\x57\x45\x4f\x50\x49"
+        "\x55\x41\x58\x51\x57\x45\x4f\x49\x55\x3b\x20\x6d\x61\x78\x2d\x61"
+        "\x67\x65\x3d\x33\x36\x30\x30\x3b\x20\x76\x65\x72\x73\x69\x6f\x6e"
+        "\x3d\x31";
+    fields_t f;
+    hpack_t *hp = hpackCreate(256);
+    assert_non_null(hp);
+
+    assert_int_equal(decode(hp, resp1, sizeof(resp1) - 1, &f), 0);
+    assert_int_equal(f.num, 4);
+    assertField(&f, 0, ":status", "302");
+    assertField(&f, 1, "cache-control", "private");
+    assertField(&f, 2, "date", "Mon, 21 Oct 2013 20:13:21 GMT");
+    assertField(&f, 3, "location", "https://www.example.com");
+    assert_int_equal(hpackTableSize(hp), 222);
+    assert_int_equal(hpackTableCount(hp), 4);
+
+    // ":status: 302" falls out to make room
+    assert_int_equal(decode(hp, resp2, sizeof(resp2) - 1, &f), 0);
+    assert_int_equal(f.num, 4);
+    assertField(&f, 0, ":status", "307");
+    assertField(&f, 1, "cache-control", "private");
+    assertField(&f, 2, "date", "Mon, 21 Oct 2013 20:13:21 GMT");
+    assertField(&f, 3, "location", "https://www.example.com");
+    assert_int_equal(hpackTableSize(hp), 222);
+    assert_int_equal(hpackTableCount(hp), 4);
+
+    assert_int_equal(decode(hp, resp3, sizeof(resp3) - 1, &f), 0);
+    assert_int_equal(f.num, 6);
+    assertField(&f, 0, ":status", "200");
+    assertField(&f, 2, "date", "Mon, 21 Oct 2013 20:13:22 GMT");
+    assertField(&f, 4, "content-encoding", "gzip");
+    assertField(&f, 5, "set-cookie",
+                "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1");
+    assert_int_equal(hpackTableSize(hp), 215);
+    assert_int_equal(hpackTableCount(hp), 3);
+
+    hpackDestroy(&hp);
+}
+
+static void
+hpackSizeUpdateEmptiesTable(void **state)
+{
+    // custom-key: custom-value, indexed
+    uint8_t add[] = {
+        0x40, 0x0a, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x2d, 0x6b,
+        0x65, 0x79, 0x0c, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x2d,
+        0x76, 0x61, 0x6c, 0x75, 0x65,
+    };
+    uint8_t zero[] = {0x20};                // size update to 0
+    uint8_t back[] = {0x3f, 0xe1, 0x1f};    // size update to 4096
+    uint8_t big[] = {0x3f, 0xe1, 0x3f};     // size update to 8192
+    uint8_t ref[] = {0xbe};                 // the newest dynamic entry
+    fields_t f;
+    hpack_t *hp = hpackCreate(4096);
+    assert_non_null(hp);
+
+    assert_int_equal(decode(hp, add, sizeof(add), &f), 0);
+    assert_int_equal(hpackTableCount(hp), 1);
+    assert_int_equal(decode(hp, ref, sizeof(ref), &f), 0);
+    assertField(&f, 0, "custom-key", "custom-value");
+
+    assert_int_equal(decode(hp, zero, sizeof(zero), &f), 0);
+    assert_int_equal(hpackTableCount(hp), 0);
+    assert_int_equal(hpackTableSize(hp), 0);
+    assert_int_equal(decode(hp, ref, sizeof(ref), &f), -1);
+
+    // With no room, adding is allowed but keeps nothing
+    assert_int_equal(decode(hp, add, sizeof(add), &f), 0);
+    assert_int_equal(hpackTableCount(hp), 0);
+
+    assert_int_equal(decode(hp, back, sizeof(back), &f), 0);
+    assert_int_equal(decode(hp, add, sizeof(add), &f), 0);
+    assert_int_equal(hpackTableCount(hp), 1);
+
+    // More than we said the encoder could have
+    assert_int_equal(decode(hp, big, sizeof(big), &f), -1);
+
+    hpackDestroy(&hp);
+}
+
+static void
+hpackRejectsBadBlocks(void **state)
+{
+    hpack_t *hp = hpackCreate(4096);
+    assert_non_null(hp);
+    fields_t f;
+
+    // Index 0, and an index past the end of both tables
+    uint8_t zero[] = {0x80};
+    uint8_t past[] = {0xbe};
+    assert_int_equal(decode(hp, zero, sizeof(zero), &f), -1);
+    assert_int_equal(decode(hp, past, sizeof(past), &f), -1);
+
+    // A string longer than the block, and an integer that never ends
+    uint8_t shortstr[] = {0x40, 0x0a, 0x63, 0x75};
+    uint8_t longint[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0xff, 0xff, 0xff, 0xff};
+    assert_int_equal(decode(hp, shortstr, sizeof(shortstr), &f), -1);
+    assert_int_equal(decode(hp, longint, sizeof(longint), &f), -1);
+
+    // Huffman padding that isn't all ones, and padding longer than 7 bits
+    uint8_t badpad[] = {0x00, 0x81, 0x00, 0x00};
+    uint8_t longpad[] = {0x00, 0x81, 0xff, 0x81, 0xff, 0xff};
+    assert_int_equal(decode(hp, badpad, sizeof(badpad), &f), -1);
+    assert_int_equal(decode(hp, longpad, sizeof(longpad), &f), -1);
+
+    assert_int_equal(hpackTableCount(hp), 0);
+    hpackDestroy(&hp);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(hpackCreateReturnsValidPtr),
+        cmocka_unit_test(hpackNullArgsDoNotCrash),
+        cmocka_unit_test(hpackDecodesRequestsWithoutHuffman),
+        cmocka_unit_test(hpackDecodesRequestsWithHuffman),
+        cmocka_unit_test(hpackEvictsOldestEntries),
+        cmocka_unit_test(hpackSizeUpdateEmptiesTable),
+        cmocka_unit_test(hpackRejectsBadBlocks),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -11,18 +11,125 @@
 // value of this isn't really used, but it needs to be non-null.
 mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
 int g_send_metric_count = 0;
+strtab_t *g_names = NULL;
+
+// The http.target of each http.requests metric reported
+#define MAX_TARGETS 16
+int g_target_count = 0;
+char g_target[MAX_TARGETS][128];
+long long g_target_requests[MAX_TARGETS];
+
+// The http.requests.reused total reported; -1 if there wasn't one
+long long g_reused = -1;
+
+// How many duration max metrics were reported, one for each sketch
+int g_max_count = 0;
+
+// The duration metrics reported by status class
+#define MAX_LATENCIES 64
+int g_latency_count = 0;
+struct {
+    char name[64];
+    char class[8];
+    long long le;
+    long long value;
+    data_type_t type;
+} g_latency[MAX_LATENCIES];
+
+static void
+saveLatency(event_t *evt)
+{
+    if (g_latency_count >= MAX_LATENCIES) return;
+
+    event_field_t *field;
+    for (field = evt->fields; field->value_type != FMT_END; field++) {
+        if (!strcmp(field->name, "http.status_class")) {
+            snprintf(g_latency[g_latency_count].class, sizeof(g_latency[0].class), "%s", field->value.str);
+        }
+        if (!strcmp(field->name, "le")) {
+            g_latency[g_latency_count].le = field->value.num;
+        }
+    }
+    if (!g_latency[g_latency_count].class[0]) return;
+
+    snprintf(g_latency[g_latency_count].name, sizeof(g_latency[0].name), "%s", evt->name);
+    g_latency[g_latency_count].value = evt->value.integer;
+    g_latency[g_latency_count].type = evt->type;
+    g_latency_count++;
+}
+
+static long long
+latency(const char *name, const char *class)
+{
+    int i;
+    for (i = 0; i < g_latency_count; i++) {
+        if (!strcmp(g_latency[i].name, name) && !strcmp(g_latency[i].class, class)) {
+            return g_latency[i].value;
+        }
+    }
+    return -1;
+}
 
 // Needed for httpAggSendReport
 int cmdSendMetric(mtc_t *mtc, event_t *evt)
 {
     g_send_metric_count++;
+    saveLatency(evt);
+    if (!strcmp(evt->name, "http.client.duration.max")) g_max_count++;
+    if (!strcmp(evt->name, "http.requests.reused")) g_reused = evt->value.integer;
+
+    if (strcmp(evt->name, "http.requests") || (g_target_count >= MAX_TARGETS)) return 0;
+    event_field_t *field;
+    for (field = evt->fields; field->value_type != FMT_END; field++) {
+        if (!strcmp(field->name, "http.target")) {
+            snprintf(g_target[g_target_count], sizeof(g_target[0]), "%s", field->value.str);
+            g_target_requests[g_target_count++] = evt->value.integer;
+        }
+    }
+    return 0;
+}
+
+static void
+addTarget(http_agg_t *http_agg, const char *target)
+{
+    event_field_t fields[] = {
+        STRFIELD("http.target", target, 4, FALSE),
+        NUMFIELD("http.status_code", 200, 1, FALSE),
+        FIELDEND
+    };
+    event_t event = INT_EVENT("http.client.duration", 2, DELTA, fields);
+    httpAggAddMetric(http_agg, &event, -1, -1);
+}
+
+static void
+sendReport(http_agg_t *http_agg)
+{
+    g_target_count = 0;
+    g_reused = -1;
+    g_max_count = 0;
+    g_latency_count = 0;
+    memset(g_latency, 0, sizeof(g_latency));
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+}
+
+static int
+namesSetup(void **state)
+{
+    g_names = strtabCreate(1024, 0);
+    return (g_names) ? 0 : -1;
+}
+
+static int
+namesTeardown(void **state)
+{
+    strtabDestroy(&g_names);
     return 0;
 }
 
 static void
 httpAggCreateReturnsNonNull(void **state)
 {
-    http_agg_t *http_agg = httpAggCreate();
+    http_agg_t *http_agg = httpAggCreate(g_names);
     assert_non_null(http_agg);
     httpAggDestroy(&http_agg);
     assert_null(http_agg);
@@ -45,7 +152,7 @@ httpAggAddMetricForNullDoesNotCrash(void **state)
 static void
 httpAggAddMetricHappyPath(void **state)
 {
-    http_agg_t *http_agg = httpAggCreate();
+    http_agg_t *http_agg = httpAggCreate(g_names);
 
     event_field_t fields[] = {
         STRFIELD("http.target", "/", 4, FALSE),
@@ -91,9 +198,10 @@ httpAggAddMetricHappyPath(void **state)
 static void
 httpAggAddMetricWithQueryStringsAreAggregatedTogether(void **state)
 {
-    http_agg_t *http_agg = httpAggCreate();
+    http_agg_t *http_agg = httpAggCreate(g_names);
 
     int previous_metric_count = 0;
+    unsigned int names_before = strtabCount(g_names);
 
     char *target[] = {"/hey/dude",
                       "/hey/dude?like=what",
@@ -120,13 +228,23 @@ httpAggAddMetricWithQueryStringsAreAggregatedTogether(void **state)
         previous_metric_count = g_send_metric_count;
     }
 
+    // Only the part before the query string is kept
+    assert_int_equal(strtabCount(g_names), names_before + 1);
+
+    // Targets are given back at reset, for the table's owner to reclaim;
+    // no other agg is holding any
+    httpAggReset(http_agg);
+    strtabReclaim(g_names);
+    strtabReclaim(g_names);
+    assert_int_equal(strtabCount(g_names), 0);
+
     httpAggDestroy(&http_agg);
 }
 
 static void
 httpAggAddMetricWithManyStatusCodesDoesNotCrash(void **state)
 {
-    http_agg_t *http_agg = httpAggCreate();
+    http_agg_t *http_agg = httpAggCreate(g_names);
 
     // When this was written, MAX_CODE_ENTRIES was set to 64 in src/httpreport.c
     // 100 here is chosen to make sure we tolerate more than this.
@@ -148,14 +266,15 @@ httpAggAddMetricWithManyStatusCodesDoesNotCrash(void **state)
 static void
 httpAggAddMetricWithManyHttpTargetsDoesNotCrash(void **state)
 {
-    http_agg_t *http_agg = httpAggCreate();
+    http_agg_t *http_agg = httpAggCreate(g_names);
 
     // When this was written, DEFAULT_TARGET_LEN was set to 128 in 
     // src/httpreport.c.  250 is used here to exercise a realloc case.
+    // (These aren't numbers, which would all be /{id}.)
     int i;
     for (i=0; i<250; i++) {
         char http_target[128];
-        snprintf(http_target, sizeof(http_target), "/%d", i);
+        snprintf(http_target, sizeof(http_target), "/t%d", i);
         event_field_t fields[] = {
             STRFIELD("http.target", http_target, 4, FALSE),
             NUMFIELD("http.status_code", 200, 1, FALSE),
@@ -169,6 +288,199 @@ httpAggAddMetricWithManyHttpTargetsDoesNotCrash(void **state)
     httpAggDestroy(&http_agg);
 }
 
+static void
+httpAggAddMetricNormalizesIdsInTargets(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+
+    addTarget(http_agg, "/users/8812/orders");
+    addTarget(http_agg, "/users/17/orders?page=2");
+    addTarget(http_agg, "/users/123e4567-e89b-12d3-a456-426614174000/orders");
+    addTarget(http_agg, "/commits/5f518a6c/");
+    addTarget(http_agg, "/blob/deadbeef");
+    addTarget(http_agg, "/v2/users");
+    sendReport(http_agg);
+
+    assert_int_equal(g_target_count, 4);
+    assert_string_equal(g_target[0], "/users/{id}/orders");
+    assert_int_equal(g_target_requests[0], 3);
+    assert_string_equal(g_target[1], "/commits/{id}/");
+    // Words that happen to be hex are left alone, as are mixed segments
+    assert_string_equal(g_target[2], "/blob/deadbeef");
+    assert_string_equal(g_target[3], "/v2/users");
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggAddMetricWithoutNormalizeKeepsIds(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+    httpAggNormalizeSet(http_agg, FALSE);
+
+    addTarget(http_agg, "/users/8812");
+    addTarget(http_agg, "/users/17");
+    sendReport(http_agg);
+
+    assert_int_equal(g_target_count, 2);
+    assert_string_equal(g_target[0], "/users/8812");
+    assert_string_equal(g_target[1], "/users/17");
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggAddMetricPastMaxTargetsGoesToOther(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+    httpAggMaxTargetsSet(http_agg, 2);
+
+    addTarget(http_agg, "/a");
+    addTarget(http_agg, "/b");
+    addTarget(http_agg, "/c");
+    addTarget(http_agg, "/d");
+    // Targets already seen still count as themselves
+    addTarget(http_agg, "/a");
+    sendReport(http_agg);
+
+    assert_int_equal(g_target_count, 3);
+    assert_string_equal(g_target[0], "/a");
+    assert_int_equal(g_target_requests[0], 2);
+    assert_string_equal(g_target[1], "/b");
+    assert_int_equal(g_target_requests[1], 1);
+    assert_string_equal(g_target[2], "other");
+    assert_int_equal(g_target_requests[2], 2);
+
+    // A new period starts with room again
+    httpAggReset(http_agg);
+    addTarget(http_agg, "/c");
+    sendReport(http_agg);
+    assert_int_equal(g_target_count, 1);
+    assert_string_equal(g_target[0], "/c");
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggSendReportHasDurationPercentiles(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+
+    // 1 to 100 ms for 200s, and a 500 that took 900 ms
+    int i;
+    for (i = 1; i <= 101; i++) {
+        event_field_t fields[] = {
+            STRFIELD("http.target", "/api", 4, FALSE),
+            NUMFIELD("http.status_code", (i <= 100) ? 200 : 500, 1, FALSE),
+            FIELDEND
+        };
+        event_t event = INT_EVENT("http.server.duration", (i <= 100) ? i : 900, DELTA, fields);
+        httpAggAddMetric(http_agg, &event, -1, -1);
+    }
+    sendReport(http_agg);
+
+    // The sketch is within 1/32 of the true value
+    long long p50 = latency("http.server.duration.p50", "2xx");
+    long long p99 = latency("http.server.duration.p99", "2xx");
+    assert_true((p50 >= 49) && (p50 <= 53));
+    assert_true((p99 >= 96) && (p99 <= 100));
+    assert_int_equal(latency("http.server.duration.max", "2xx"), 100);
+    assert_int_equal(latency("http.server.duration.max", "5xx"), 900);
+    assert_int_equal(latency("http.client.duration.p50", "2xx"), -1);
+    assert_int_equal(latency("http.server.duration.p50", "4xx"), -1);
+
+    // The bucket counts are cumulative, and go up by powers of two
+    long long total = 0, le = -1;
+    for (i = 0; i < g_latency_count; i++) {
+        if (strcmp(g_latency[i].name, "http.server.duration.bucket") ||
+            strcmp(g_latency[i].class, "2xx")) continue;
+        assert_int_equal(g_latency[i].type, DELTA);
+        assert_true(g_latency[i].le > le);
+        assert_int_equal((g_latency[i].le + 1) & g_latency[i].le, 0);
+        assert_true(g_latency[i].value > total);
+        // 1 to 100, so everything up to le
+        if (g_latency[i].le < 100) {
+            assert_int_equal(g_latency[i].value, g_latency[i].le);
+        }
+        le = g_latency[i].le;
+        total = g_latency[i].value;
+    }
+    assert_int_equal(total, 100);
+    assert_int_equal(le, 127);
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggSendReportHasTimingBreakdown(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+
+    // Four requests on one connection; the first has no body to time
+    int i;
+    for (i = 1; i <= 4; i++) {
+        event_field_t fields[] = {
+            STRFIELD("http.target", "/api", 4, FALSE),
+            NUMFIELD("http.status_code", 200, 1, FALSE),
+            NUMFIELD("http.ttfb", i * 10, 1, FALSE),
+            NUMFIELD("http.connection.requests", i, 1, FALSE),
+            FIELDEND
+        };
+        event_t event = INT_EVENT("http.server.duration", i * 10, DELTA, fields);
+        httpAggAddMetric(http_agg, &event, -1, -1);
+
+        if (i == 1) continue;
+        event_field_t xfields[] = {
+            STRFIELD("http.target", "/api", 4, FALSE),
+            NUMFIELD("http.status_code", 200, 1, FALSE),
+            FIELDEND
+        };
+        event_t transfer = INT_EVENT("http.server.transfer", i, DELTA, xfields);
+        httpAggAddMetric(http_agg, &transfer, -1, -1);
+    }
+
+    // And one without any of it
+    addTarget(http_agg, "/api");
+    sendReport(http_agg);
+
+    // Transfers aren't more requests
+    assert_int_equal(g_target_count, 1);
+    assert_int_equal(g_target_requests[0], 5);
+
+    assert_int_equal(latency("http.server.ttfb.max", "2xx"), 40);
+    assert_int_equal(latency("http.server.ttfb.p50", "2xx"), 30);
+    assert_int_equal(latency("http.server.transfer.max", "2xx"), 4);
+    assert_int_equal(latency("http.server.transfer.p50", "2xx"), 3);
+    assert_int_equal(latency("http.client.ttfb.max", "2xx"), -1);
+    assert_int_equal(g_reused, 3);
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggSketchesAreLimited(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate(g_names);
+
+    // A sketch each, to start with
+    char target[32];
+    int i;
+    for (i = 0; i < 300; i++) {
+        snprintf(target, sizeof(target), "/t%d", i);
+        addTarget(http_agg, target);
+    }
+    sendReport(http_agg);
+    assert_int_equal(g_max_count, 256);
+
+    // The next period has room again
+    httpAggReset(http_agg);
+    addTarget(http_agg, "/t299");
+    sendReport(http_agg);
+    assert_int_equal(g_max_count, 1);
+
+    httpAggDestroy(&http_agg);
+}
+
 static void
 httpAggSendReportForNullDoesNotCrash(void **state)
 {
@@ -194,9 +506,15 @@ main(int argc, char *argv[])
         cmocka_unit_test(httpAggAddMetricWithQueryStringsAreAggregatedTogether),
         cmocka_unit_test(httpAggAddMetricWithManyStatusCodesDoesNotCrash),
         cmocka_unit_test(httpAggAddMetricWithManyHttpTargetsDoesNotCrash),
+        cmocka_unit_test(httpAggAddMetricNormalizesIdsInTargets),
+        cmocka_unit_test(httpAggAddMetricWithoutNormalizeKeepsIds),
+        cmocka_unit_test(httpAggAddMetricPastMaxTargetsGoesToOther),
+        cmocka_unit_test(httpAggSendReportHasDurationPercentiles),
+        cmocka_unit_test(httpAggSendReportHasTimingBreakdown),
+        cmocka_unit_test(httpAggSketchesAreLimited),
         cmocka_unit_test(httpAggSendReportForNullDoesNotCrash),
         cmocka_unit_test(httpAggResetForNullDoesNotCrash)
     };
-    return cmocka_run_group_tests(tests, NULL, NULL);
+    return cmocka_run_group_tests(tests, namesSetup, namesTeardown);
 }
 
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include "dbg.h"
+#include "httphdr.h"
+#include "test.h"
+
+static void
+httpHdrParseNullArgs(void **state)
+{
+    http_hdr_t hdr = {0};
+    char buf[] = "GET / HTTP/1.1\r\n";
+    assert_int_equal(httpHdrParse(NULL, sizeof(buf), &hdr), -1);
+    assert_int_equal(httpHdrParse(buf, sizeof(buf), NULL), -1);
+    assert_string_equal(httpHdrStr(NULL, hdr.method), "");
+}
+
+static void
+httpHdrParseRequest(void **state)
+{
+    char buf[] = "GET /index.html?x=1 HTTP/1.1\r\n"
+                 "host: www.example.com\r\n"
+                 "USER-AGENT:curl/7.68.0  \r\n"
+                 "X-Forwarded-For: \t10.1.2.3\r\n"
+                 "X-Forwarded-Host: not.the.host\r\n"
+                 "Content-Length: 42\r\n";
+    http_hdr_t hdr;
+
+    assert_int_equal(httpHdrParse(buf, sizeof(buf), &hdr), 0);
+    assert_false(hdr.isResponse);
+    assert_int_equal(hdr.clen, 42);
+    assert_true(httpHdrHas(&hdr, HTTP_FLD_HOST));
+    assert_true(httpHdrHas(&hdr, HTTP_FLD_USER_AGENT));
+    assert_true(httpHdrHas(&hdr, HTTP_FLD_X_FORWARDED_FOR));
+    assert_true(httpHdrHas(&hdr, HTTP_FLD_CONTENT_LENGTH));
+
+    // The spans are over buf; nothing's been copied
+    assert_int_equal(hdr.method.off, 0);
+    assert_int_equal(hdr.method.len, 3);
+
+    // Every string can be taken, in any order
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_X_FORWARDED_FOR]), "10.1.2.3");
+    assert_string_equal(httpHdrStr(buf, hdr.flavor), "1.1");
+    assert_string_equal(httpHdrStr(buf, hdr.method), "GET");
+    assert_string_equal(httpHdrStr(buf, hdr.target), "/index.html?x=1");
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_HOST]), "www.example.com");
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_USER_AGENT]), "curl/7.68.0");
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_CONTENT_LENGTH]), "42");
+
+    // And taken again
+    assert_string_equal(httpHdrStr(buf, hdr.method), "GET");
+    assert_ptr_equal(httpHdrStr(buf, hdr.target), &buf[4]);
+}
+
+static void
+httpHdrParseResponse(void **state)
+{
+    char buf[] = "HTTP/1.0 404 Not Found\r\n"
+                 "Content-Length: 0\r\n"
+                 "Server: test\r\n";
+    http_hdr_t hdr;
+
+    assert_int_equal(httpHdrParse(buf, sizeof(buf), &hdr), 0);
+    assert_true(hdr.isResponse);
+    assert_int_equal(hdr.status, 404);
+    // A zero length is the same as none
+    assert_int_equal(hdr.clen, -1);
+    assert_false(httpHdrHas(&hdr, HTTP_FLD_HOST));
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_HOST]), "");
+    assert_string_equal(httpHdrStr(buf, hdr.method), "");
+    assert_string_equal(httpHdrStr(buf, hdr.flavor), "1.0");
+    assert_string_equal(httpHdrStr(buf, hdr.reason), "Not Found");
+}
+
+static void
+httpHdrParseHttp2Response(void **state)
+{
+    // What httpstate.c makes of an HTTP/2 response; there's no reason
+    char buf[] = "HTTP/2.0 200 \r\ncontent-length: 1234\r\n";
+    http_hdr_t hdr;
+
+    assert_int_equal(httpHdrParse(buf, sizeof(buf), &hdr), 0);
+    assert_true(hdr.isResponse);
+    assert_int_equal(hdr.status, 200);
+    assert_int_equal(hdr.clen, 1234);
+    assert_string_equal(httpHdrStr(buf, hdr.flavor), "2.0");
+    assert_string_equal(httpHdrStr(buf, hdr.reason), "");
+}
+
+static void
+httpHdrParseStopsAtNul(void **state)
+{
+    // Only the first of duplicate fields counts, and nothing after the NUL
+    char buf[] = "POST /a HTTP/1.1\nHost: one\nHost: two\n\0User-Agent: x\r\n";
+    http_hdr_t hdr;
+
+    assert_int_equal(httpHdrParse(buf, sizeof(buf), &hdr), 0);
+    assert_string_equal(httpHdrStr(buf, hdr.fld[HTTP_FLD_HOST]), "one");
+    assert_false(httpHdrHas(&hdr, HTTP_FLD_USER_AGENT));
+
+    // A last line without its line end is ignored
+    char partial[] = {'G', 'E', 'T', ' ', '/', '\r', '\n', 'H', 'o', 's', 't', ':', 'x'};
+    assert_int_equal(httpHdrParse(partial, sizeof(partial), &hdr), 0);
+    assert_false(httpHdrHas(&hdr, HTTP_FLD_HOST));
+    assert_string_equal(httpHdrStr(partial, hdr.target), "/");
+    assert_int_equal(hdr.flavor.len, 0);
+}
+
+static void
+httpHdrParseRejectsBadHeaders(void **state)
+{
+    http_hdr_t hdr;
+    char *bad[] = {
+        "",
+        "\r\nHost: x\r\n",
+        "GET\r\n",
+        " / HTTP/1.1\r\n",
+        "HTTP/1.1\r\n",
+        "HTTP/1.1 12345 Too Long\r\n",
+        "GET / HTTP/1.1",
+    };
+
+    int i;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert_int_equal(httpHdrParse(bad[i], strlen(bad[i]) + 1, &hdr), -1);
+    }
+
+    char badlen[] = "PUT / HTTP/1.1\r\nContent-Length: 12ab\r\n";
+    assert_int_equal(httpHdrParse(badlen, sizeof(badlen), &hdr), 0);
+    assert_true(httpHdrHas(&hdr, HTTP_FLD_CONTENT_LENGTH));
+    assert_int_equal(hdr.clen, -1);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(httpHdrParseNullArgs),
+        cmocka_unit_test(httpHdrParseRequest),
+        cmocka_unit_test(httpHdrParseResponse),
+        cmocka_unit_test(httpHdrParseHttp2Response),
+        cmocka_unit_test(httpHdrParseStopsAtNul),
+        cmocka_unit_test(httpHdrParseRejectsBadHeaders),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -8,8 +8,10 @@
 #include <arpa/inet.h>
 
 #include "dbg.h"
+#include "evtpool.h"
 #include "plattime.h"
 #include "fn.h"
+#include "cfgutils.h"
 #include "ctl.h"
 #include "evtformat.h"
 #include "httpstate.h"
@@ -20,6 +22,7 @@
 extern void doProtocolMetric(protocol_info *);
 rtconfig g_cfg = {0};
 char *header_event = NULL;
+char detected[64] = {0};
  
 static int
 needleTestSetup(void** state)
@@ -67,8 +70,16 @@ int cmdPostEvent(ctl_t *ctl, char *event)
 #endif // __MACOS__
 {
     //printf("%s: data at: %p\n", __FUNCTION__, event);
-    doProtocolMetric((protocol_info *)event);
-    free(event);
+    protocol_info *proto = (protocol_info *)event;
+    if (proto->ptype == EVT_DETECT) {
+        // Keep the name of what was detected instead of sending it
+        snprintf(detected, sizeof(detected), "%s", proto->data);
+        free(proto->data);
+        evtPoolFree(event);
+        return 0;
+    }
+    doProtocolMetric(proto);
+    evtPoolFree(event);
     return 0;
 }
 
@@ -247,6 +258,237 @@ headerRequestUnix(void **state)
     free(header_event);
 }
 
+static size_t
+h2Headers(uint8_t *buf, uint32_t stream, const uint8_t *block, size_t len)
+{
+    // A HEADERS frame with END_HEADERS set
+    buf[0] = 0;
+    buf[1] = 0;
+    buf[2] = len;
+    buf[3] = 0x1;
+    buf[4] = 0x4;
+    buf[5] = 0;
+    buf[6] = 0;
+    buf[7] = 0;
+    buf[8] = stream;
+    memcpy(&buf[9], block, len);
+    return 9 + len;
+}
+
+static void
+headerHttp2Streams(void **state)
+{
+    // :method GET, :scheme http, :path /one, :authority localhost:8080
+    uint8_t req1[] = {0x82, 0x86, 0x04, 0x04, '/', 'o', 'n', 'e', 0x01, 0x0e,
+                      'l', 'o', 'c', 'a', 'l', 'h', 'o', 's', 't', ':', '8',
+                      '0', '8', '0'};
+    // The same, with :path /three
+    uint8_t req3[] = {0x82, 0x86, 0x04, 0x06, '/', 't', 'h', 'r', 'e', 'e',
+                      0x01, 0x0e, 'l', 'o', 'c', 'a', 'l', 'h', 'o', 's', 't',
+                      ':', '8', '0', '8', '0'};
+    uint8_t resp200[] = {0x88};     // :status 200
+    uint8_t resp404[] = {0x8d};     // :status 404
+    uint8_t buf[128];
+    size_t len;
+
+    net_info *net = getNet(4);
+    assert_non_null(net);
+
+    memcpy(buf, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+    len = 24 + h2Headers(&buf[24], 1, req1, sizeof(req1));
+    assert_true(doHttp(0x12345, 4, net, (char *)buf, len, NETRX, BUF));
+    assert_non_null(strstr(header_event, "\"http.target\":\"/one\""));
+    assert_non_null(strstr(header_event, "\"http.flavor\":\"2.0\""));
+    assert_non_null(strstr(header_event, "\"http.host\":\"localhost:8080\""));
+    free(header_event);
+    header_event = NULL;
+
+    len = h2Headers(buf, 3, req3, sizeof(req3));
+    assert_true(doHttp(0x12345, 4, net, (char *)buf, len, NETRX, BUF));
+    assert_non_null(strstr(header_event, "\"http.target\":\"/three\""));
+    free(header_event);
+    header_event = NULL;
+
+    // Responses come back in the other order, and still find their requests
+    len = h2Headers(buf, 3, resp404, sizeof(resp404));
+    assert_true(doHttp(0x12345, 4, net, (char *)buf, len, NETTX, BUF));
+    assert_non_null(strstr(header_event, "\"http.status_code\":404"));
+    assert_non_null(strstr(header_event, "\"http.status_text\":\"\""));
+    assert_non_null(strstr(header_event, "\"http.target\":\"/three\""));
+    free(header_event);
+    header_event = NULL;
+
+    len = h2Headers(buf, 1, resp200, sizeof(resp200));
+    assert_true(doHttp(0x12345, 4, net, (char *)buf, len, NETTX, BUF));
+    assert_non_null(strstr(header_event, "\"http.status_code\":200"));
+    assert_non_null(strstr(header_event, "\"http.target\":\"/one\""));
+    free(header_event);
+    header_event = NULL;
+
+    resetHttp(&net->http);
+}
+
+static protocol_def_t *
+newProtocol(const char *name, const char *regex, bool binary)
+{
+    protocol_def_t *prot = calloc(1, sizeof(protocol_def_t));
+    assert_non_null(prot);
+    prot->protname = strdup(name);
+    prot->regex = (regex) ? strdup(regex) : NULL;
+    prot->binary = binary;
+    return prot;
+}
+
+static void
+detectProtocolsInBinaryAndText(void **state)
+{
+    request_t req = {0};
+
+    // Detection is done when metric events are on
+    evt_fmt_t *evt = evtFormatCreate();
+    assert_non_null(evt);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+    g_ctl = ctlCreate();
+    assert_non_null(g_ctl);
+    ctlEvtSet(g_ctl, evt);
+
+    // A TLS record, matched as hex
+    req.protocol = newProtocol("TLS", "^16030[0-3]", TRUE);
+    assert_true(addProtocol(&req));
+    char tls[] = "\x16\x03\x01\x02\x00\x01";
+    assert_non_null(getNet(5));
+    detected[0] = '\0';
+    doProtocol(0x12345, 5, tls, sizeof(tls) - 1, NETRX, BUF);
+    assert_string_equal(detected, "TLS");
+
+    // It's tried once per connection
+    detected[0] = '\0';
+    doProtocol(0x12345, 5, tls, sizeof(tls) - 1, NETRX, BUF);
+    assert_string_equal(detected, "");
+    assert_non_null(getNet(6));
+    doProtocol(0x12345, 6, "\x17\x03", 2, NETRX, BUF);
+    doProtocol(0x12345, 6, tls, sizeof(tls) - 1, NETRX, BUF);
+    assert_string_equal(detected, "");
+
+    req.protocol = newProtocol("TLS", NULL, FALSE);
+    assert_true(delProtocol(&req));
+
+    // A pattern with more captures than the match data has room for
+    req.protocol = newProtocol("Redis", "^\\*(\\d+)\\r\\n\\$(\\d+)", FALSE);
+    assert_true(addProtocol(&req));
+    char redis[] = "*1\r\n$4\r\nPING\r\n";
+    assert_non_null(getNet(7));
+    doProtocol(0x12345, 7, redis, sizeof(redis) - 1, NETRX, BUF);
+    assert_string_equal(detected, "Redis");
+
+    req.protocol = newProtocol("Redis", NULL, FALSE);
+    assert_true(delProtocol(&req));
+
+    // Ones with a literal anywhere, with alternatives, and with none
+    req.protocol = newProtocol("AMQP", "AMQP\\x00\\x00\\x09\\x01", FALSE);
+    assert_true(addProtocol(&req));
+    req.protocol = newProtocol("STOMP", "^(CONNECT|STOMP)\\r?\\n", FALSE);
+    assert_true(addProtocol(&req));
+    req.protocol = newProtocol("MEMCACHE", "^get .*\\r\\n|^stats\\r\\n", FALSE);
+    assert_true(addProtocol(&req));
+    req.protocol = newProtocol("PING", "(?i)^ping", FALSE);
+    assert_true(addProtocol(&req));
+
+    struct {
+        int fd;
+        char *buf;
+        size_t len;
+        char *name;
+    } tests[] = {
+        {8,  "  AMQP\x00\x00\x09\x01", 10, "AMQP"},
+        {9,  "STOMP\naccept-version:1.2\n", 26, "STOMP"},
+        {10, "stats\r\n", 7, "MEMCACHE"},
+        {11, "PiNg", 4, "PING"},
+        {12, "AMQP\x00\x00\x09\x02", 8, ""},
+    };
+    int i;
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        assert_non_null(getNet(tests[i].fd));
+        detected[0] = '\0';
+        doProtocol(0x12345, tests[i].fd, tests[i].buf, tests[i].len, NETRX, BUF);
+        assert_string_equal(detected, tests[i].name);
+    }
+
+    char *names[] = {"AMQP", "STOMP", "MEMCACHE", "PING"};
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        req.protocol = newProtocol(names[i], NULL, FALSE);
+        assert_true(delProtocol(&req));
+    }
+
+    ctlDestroy(&g_ctl);
+}
+
+static void
+detectProtocolsBySignature(void **state)
+{
+    request_t req = {0};
+
+    evt_fmt_t *evt = evtFormatCreate();
+    assert_non_null(evt);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+    g_ctl = ctlCreate();
+    assert_non_null(g_ctl);
+    ctlEvtSet(g_ctl, evt);
+
+    // A Postgres startup message: its length, then protocol 3.0
+    req.protocol = newProtocol("Postgres", NULL, TRUE);
+    assert_true(protocolPatternAdd(req.protocol, 4, "00 03 00 00", NULL));
+    assert_true(protocolLengthSet(req.protocol, 0, 4, "big", 0, 0, TRUE));
+    assert_true(addProtocol(&req));
+
+    // A TLS handshake of any version, no bigger than a record can be
+    req.protocol = newProtocol("TLS", NULL, TRUE);
+    assert_true(protocolPatternAdd(req.protocol, 0, "16 03 00", "ff ff fc"));
+    assert_true(protocolLengthSet(req.protocol, 3, 2, NULL, 0, 16384, FALSE));
+    assert_true(addProtocol(&req));
+
+    // And a signature that narrows down a regex
+    req.protocol = newProtocol("Kafka", "^.{8}\\x00\\x07client", FALSE);
+    assert_true(protocolLengthSet(req.protocol, 0, 4, "big", 4, 0, TRUE));
+    assert_true(addProtocol(&req));
+
+    struct {
+        int fd;
+        char *buf;
+        size_t len;
+        char *name;
+    } tests[] = {
+        {13, "\x00\x00\x00\x0c\x00\x03\x00\x00user", 12, "Postgres"},
+        // One byte short of what the length says
+        {14, "\x00\x00\x00\x0d\x00\x03\x00\x00user", 12, ""},
+        {15, "\x16\x03\x03\x00\x31\x01", 6, "TLS"},
+        {16, "\x16\x03\x03\x40\x01\x01", 6, ""},
+        {17, "\x16\x03\x05\x00\x31\x01", 6, ""},
+        {18, "\x00\x00\x00\x0c\x00\x12\x00\x00\x00\x07" "client", 16, "Kafka"},
+        {19, "\x00\x00\x00\x0d\x00\x12\x00\x00\x00\x07" "client", 16, ""},
+        {20, "\x00\x00", 2, ""},
+    };
+    int i;
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        assert_non_null(getNet(tests[i].fd));
+        detected[0] = '\0';
+        doProtocol(0x12345, tests[i].fd, tests[i].buf, tests[i].len, NETRX, BUF);
+        assert_string_equal(detected, tests[i].name);
+    }
+
+    char *names[] = {"Postgres", "TLS", "Kafka"};
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        req.protocol = newProtocol(names[i], NULL, FALSE);
+        assert_true(delProtocol(&req));
+    }
+
+    // Neither a regex nor a signature
+    req.protocol = newProtocol("Nothing", NULL, TRUE);
+    assert_false(addProtocol(&req));
+
+    ctlDestroy(&g_ctl);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -258,6 +500,9 @@ main(int argc, char *argv[])
         cmocka_unit_test(headerRequestIP),
         cmocka_unit_test(headerResponseIP),
         cmocka_unit_test(headerRequestUnix),
+        cmocka_unit_test(headerHttp2Streams),
+        cmocka_unit_test(detectProtocolsInBinaryAndText),
+        cmocka_unit_test(detectProtocolsBySignature),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, groupTeardown);
 }
@@ -6,16 +6,33 @@
 
 #include "ctl.h"
 #include "dbg.h"
+#include "evtpool.h"
 #include "fn.h"
+#include "grpcagg.h"
 #include "httpstate.h"
 #include "plattime.h"
 #include "test.h"
 
 
 int g_http_guard_enabled = TRUE;
-uint64_t g_http_guard[1024];
+uint64_t g_http_guard[HTTP_GUARD_ENTRIES];
 ctl_t *g_ctl = NULL;
 struct protocol_info_t* g_msg = NULL;
+evt_pool_t *g_proto_pool = NULL;
+
+// The first line of every header posted, for tests that post several
+#define MAX_POSTS 8
+int g_posts = 0;
+char g_post_line[MAX_POSTS][64];
+
+// The ends of response bodies posted, and when the last one was
+int g_body_ends = 0;
+uint64_t g_last_byte = 0;
+
+// The last gRPC call posted
+int g_grpc_calls = 0;
+grpc_call_t g_grpc;
+char g_grpc_method[64];
 
 
 void
@@ -27,9 +44,9 @@ freeMsg(struct protocol_info_t** msg_ptr)
     struct http_post_t *post = msg ? (struct http_post_t*) msg->data : NULL;
     char *header = post ? post->hdr : NULL;
 
-    if (header) free(header);
+    if (header) evtPoolFree(header);
     if (post) free(post);
-    if (msg) free(msg);
+    evtPoolFree(msg);
     *msg_ptr = NULL;
 }
 
@@ -46,12 +63,49 @@ getNetEntry(int fd)
     return NULL;
 }
 
+void *
+evtAlloc(evt_pool_class_t class)
+{
+    if (!g_proto_pool) {
+        g_proto_pool = evtPoolCreate(sizeof(struct protocol_info_t), 64);
+    }
+    return evtPoolAlloc(g_proto_pool);
+}
+
 // This on the other hand is an important part of this test.
 int
 cmdPostEvent(ctl_t *ctl, char *event)
 {
+    struct protocol_info_t *proto = (struct protocol_info_t *)event;
+    if (proto->ptype == EVT_GRPC) {
+        grpc_call_t *call = (grpc_call_t *)proto->data;
+        g_grpc = *call;
+        snprintf(g_grpc_method, sizeof(g_grpc_method), "%s", call->method);
+        g_grpc.method = g_grpc_method;
+        g_grpc_calls++;
+        free(call);
+        evtPoolFree(proto);
+        return 0;
+    }
+
+    if (proto->ptype == EVT_HBODY) {
+        struct http_post_t *post = (struct http_post_t *)proto->data;
+        g_last_byte = post->last_byte;
+        g_body_ends++;
+        free(post);
+        evtPoolFree(proto);
+        return 0;
+    }
+
     if (g_msg) freeMsg(&g_msg); // Don't leak
-    g_msg = (struct protocol_info_t*)event;
+    g_msg = proto;
+
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    if (post && post->hdr && (g_posts < MAX_POSTS)) {
+        int linelen = strcspn(post->hdr, "\r");
+        snprintf(g_post_line[g_posts], sizeof(g_post_line[0]), "%.*s", linelen, post->hdr);
+    }
+    g_posts++;
     return 0;
 }
 
@@ -294,6 +348,561 @@ doHttpWhichExceedsReallocSize(void** state)
 }
 
 
+static void
+doHttpWithHeaderEndSplitAnywhere(void** state)
+{
+    char *buffer =
+        "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: \"abc\"\r\n"
+        "\r\n"
+        "HTTP/1.1 304 Not Modified\r\n"
+        "\r\n";
+    size_t buflen = strlen(buffer);
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    // Every split that leaves "HTTP/" whole
+    size_t split;
+    for (split = strlen("HTTP/"); split < buflen; split++) {
+        if ((split > 42) && (split < 42 + strlen("HTTP/"))) continue;
+        g_posts = 0;
+        doHttp(13, 3, &net, buffer, split, NETRX, BUF);
+        doHttp(13, 3, &net, &buffer[split], buflen - split, NETRX, BUF);
+        assert_int_equal(g_posts, 2);
+        assert_non_null(g_msg);
+        struct http_post_t *post = (struct http_post_t*) g_msg->data;
+        assert_string_equal(post->hdr, "HTTP/1.1 304 Not Modified\r\n");
+        freeMsg(&g_msg);
+    }
+
+    resetHttp(&net.http);
+}
+
+static void
+doHttpWithPipelinedRequests(void** state)
+{
+    // A request body with "HTTP/" in it isn't mistaken for a header, and
+    // every request in the buffer is found
+    char *buffer =
+        "GET /one HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "\r\n"
+        "POST /two HTTP/1.1\r\n"
+        "content-length: 28\r\n"
+        "\r\n"
+        "GET /not HTTP/1.1\r\n\r\nabcdefg"
+        "HEAD /three HTTP/1.1\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    g_posts = 0;
+    assert_true(doHttp(13, 3, &net, buffer, strlen(buffer), NETRX, BUF));
+    assert_int_equal(g_posts, 3);
+    assert_string_equal(g_post_line[0], "GET /one HTTP/1.1");
+    assert_string_equal(g_post_line[1], "POST /two HTTP/1.1");
+    assert_string_equal(g_post_line[2], "HEAD /three HTTP/1.1");
+    freeMsg(&g_msg);
+
+    // The responses in order.  The HEAD response has a Content-Length but
+    // no body, so the header after it is found.
+    buffer =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "HTTP/1.1 5"
+        "HTTP/1.1 201 Created\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 1000\r\n"
+        "\r\n"
+        "HTTP/1.1 404 Not Found\r\n"
+        "\r\n";
+    g_posts = 0;
+    assert_true(doHttp(13, 3, &net, buffer, strlen(buffer), NETTX, BUF));
+    assert_int_equal(g_posts, 4);
+    assert_string_equal(g_post_line[0], "HTTP/1.1 200 OK");
+    assert_string_equal(g_post_line[1], "HTTP/1.1 201 Created");
+    assert_string_equal(g_post_line[2], "HTTP/1.1 200 OK");
+    assert_string_equal(g_post_line[3], "HTTP/1.1 404 Not Found");
+    freeMsg(&g_msg);
+
+    resetHttp(&net.http);
+}
+
+static void
+doHttpTimesResponsesAndCountsRequests(void** state)
+{
+    char *request = "GET / HTTP/1.1\r\n\r\n";
+    char *response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    int i;
+    for (i = 1; i <= 2; i++) {
+        g_posts = 0;
+        assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+        assert_int_equal(g_posts, 1);
+        http_post *post = (http_post *)g_msg->data;
+        assert_int_equal(post->conn_req, i);
+        assert_true(post->first_byte);
+        freeMsg(&g_msg);
+
+        // The response goes right away; the end of its body follows
+        g_body_ends = 0;
+        assert_true(doHttp(13, 3, &net, response, strlen(response), NETRX, BUF));
+        assert_int_equal(g_posts, 2);
+        post = (http_post *)g_msg->data;
+        assert_int_equal(post->conn_req, i);
+        assert_true(post->first_byte);
+        assert_true(post->timed);
+        assert_false(doHttp(13, 3, &net, "he", 2, NETRX, BUF));
+        assert_int_equal(g_body_ends, 0);
+        assert_false(doHttp(13, 3, &net, "llo", 3, NETRX, BUF));
+        assert_int_equal(g_body_ends, 1);
+        assert_true(g_last_byte >= post->first_byte);
+        assert_int_equal(g_posts, 2);
+        freeMsg(&g_msg);
+    }
+
+    // A body that lasts until the connection closes ends then
+    g_body_ends = 0;
+    assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+    response = "HTTP/1.0 200 OK\r\n\r\nsome of the body";
+    assert_true(doHttp(13, 3, &net, response, strlen(response), NETRX, BUF));
+    assert_int_equal(g_body_ends, 0);
+    resetHttp(&net.http);
+    assert_int_equal(g_body_ends, 1);
+    freeMsg(&g_msg);
+
+    // Without one to time, there's nothing to post
+    resetHttp(&net.http);
+    assert_int_equal(g_body_ends, 1);
+}
+
+static void
+doHttpWithChunkedResponse(void** state)
+{
+    char *request = "GET / HTTP/1.1\r\n\r\n";
+    // In one buffer, then split up everywhere but in "HTTP/"
+    char *response[] = {
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: gzip, Chunked\r\n"
+        "\r\n"
+        "1",
+        "1;name=val",
+        "ue\r",
+        "\nHTTP/1.1 200",
+        " OK\r\n\r",
+        "\n",
+        "0\r\nX-Trailer: HTTP/1.1\r",
+        "\n\r",
+        "\nHTTP/1.1 204 No Content\r\n",
+        "\r\n",
+        NULL };
+    char whole[256] = {0};
+    int i;
+    for (i = 0; response[i]; i++) {
+        strcat(whole, response[i]);
+    }
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    int pass;
+    for (pass = 0; pass < 2; pass++) {
+        assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+        assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+        freeMsg(&g_msg);
+
+        g_posts = 0;
+        if (!pass) {
+            assert_true(doHttp(13, 3, &net, whole, strlen(whole), NETRX, BUF));
+        } else {
+            for (i = 0; response[i]; i++) {
+                doHttp(13, 3, &net, response[i], strlen(response[i]), NETRX, BUF);
+            }
+        }
+        assert_int_equal(g_posts, 2);
+        assert_string_equal(g_post_line[0], "HTTP/1.1 200 OK");
+        assert_string_equal(g_post_line[1], "HTTP/1.1 204 No Content");
+        freeMsg(&g_msg);
+    }
+
+    resetHttp(&net.http);
+}
+
+static void
+doHttpWithInterimResponse(void** state)
+{
+    char *request =
+        "PUT /file HTTP/1.1\r\n"
+        "Expect: 100-continue\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    g_posts = 0;
+    assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+    assert_int_equal(g_posts, 1);
+    freeMsg(&g_msg);
+
+    // 100 Continue is HTTP, but isn't the response to report
+    char *interim = "HTTP/1.1 100 Continue\r\n\r\n";
+    g_posts = 0;
+    assert_true(doHttp(13, 3, &net, interim, strlen(interim), NETRX, BUF));
+    assert_int_equal(g_posts, 0);
+    assert_null(g_msg);
+
+    // The body goes after all
+    assert_false(doHttp(13, 3, &net, "HTTP/", 5, NETTX, BUF));
+    assert_null(g_msg);
+
+    char *response = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+    assert_true(doHttp(13, 3, &net, response, strlen(response), NETRX, BUF));
+    assert_int_equal(g_posts, 1);
+    assert_string_equal(g_post_line[0], "HTTP/1.1 201 Created");
+    freeMsg(&g_msg);
+
+    // Without a length, a response body lasts until the connection closes
+    assert_true(doHttp(13, 3, &net, request, strlen(request), NETTX, BUF));
+    assert_false(doHttp(13, 3, &net, "hello", 5, NETTX, BUF));
+    freeMsg(&g_msg);
+    response = "HTTP/1.0 200 OK\r\n\r\nHTTP/1.0 200 OK\r\n\r\n";
+    g_posts = 0;
+    assert_true(doHttp(13, 3, &net, response, strlen(response), NETRX, BUF));
+    assert_false(doHttp(13, 3, &net, response, strlen(response), NETRX, BUF));
+    assert_int_equal(g_posts, 1);
+    freeMsg(&g_msg);
+
+    resetHttp(&net.http);
+}
+
+// HTTP/2
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+static size_t
+h2Frame(uint8_t *buf, uint8_t type, uint8_t flags, uint32_t stream,
+        const uint8_t *payload, size_t len)
+{
+    buf[0] = (len >> 16) & 0xff;
+    buf[1] = (len >> 8) & 0xff;
+    buf[2] = len & 0xff;
+    buf[3] = type;
+    buf[4] = flags;
+    buf[5] = (stream >> 24) & 0x7f;
+    buf[6] = (stream >> 16) & 0xff;
+    buf[7] = (stream >> 8) & 0xff;
+    buf[8] = stream & 0xff;
+    if (len) memcpy(&buf[9], payload, len);
+    return 9 + len;
+}
+
+// :method GET, :path /, :scheme http, :authority www.example.com (indexed)
+static const uint8_t h2Req1[] = {
+    0x82, 0x84, 0x86, 0x41, 0x0f, 'w', 'w', 'w', '.', 'e', 'x', 'a', 'm',
+    'p', 'l', 'e', '.', 'c', 'o', 'm',
+};
+// :method GET, :path /index.html, :scheme http, and :authority from the
+// dynamic table, so this only decodes after h2Req1
+static const uint8_t h2Req2[] = {0x82, 0x85, 0x86, 0xbe};
+// :status 200, content-type: text/plain
+static const uint8_t h2Resp[] = {
+    0x88, 0x0f, 0x10, 0x0a, 't', 'e', 'x', 't', '/', 'p', 'l', 'a', 'i', 'n',
+};
+
+static void
+assertHttp2Post(const char *hdr, uint32_t stream)
+{
+    assert_non_null(g_msg);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_non_null(post);
+    assert_non_null(post->hdr);
+    assert_string_equal(post->hdr, hdr);
+    assert_int_equal(post->stream, stream);
+    assert_int_equal(g_msg->len, strlen(hdr) + 1);
+    freeMsg(&g_msg);
+}
+
+static void
+doHttpWithHttp2RequestAndResponse(void** state)
+{
+    uint8_t buf[256];
+    size_t len = 0;
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    // The client's preface, SETTINGS, and a request
+    memcpy(buf, H2_PREFACE, strlen(H2_PREFACE));
+    len += strlen(H2_PREFACE);
+    len += h2Frame(&buf[len], 0x4, 0, 0, NULL, 0);
+    len += h2Frame(&buf[len], 0x1, 0x5, 1, h2Req1, sizeof(h2Req1));
+
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    assertHttp2Post("GET / HTTP/2.0\r\nhost: www.example.com\r\n", 1);
+
+    // The server's SETTINGS and response go the other way
+    len = h2Frame(buf, 0x4, 0, 0, NULL, 0);
+    len += h2Frame(&buf[len], 0x1, 0x4, 1, h2Resp, sizeof(h2Resp));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETTX, BUF));
+    assertHttp2Post("HTTP/2.0 200 \r\ncontent-type: text/plain\r\n", 1);
+
+    // Data frames don't post anything
+    len = h2Frame(buf, 0x0, 0x1, 1, (uint8_t *)"hello", 5);
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETTX, BUF));
+    assert_null(g_msg);
+
+    resetHttp(&net.http);
+    assert_null(net.http.h2);
+}
+
+static void
+doHttpWithHttp2SplitFrames(void** state)
+{
+    uint8_t buf[256];
+    uint8_t payload[64];
+    size_t len = 0;
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    memcpy(buf, H2_PREFACE, strlen(H2_PREFACE));
+    len += strlen(H2_PREFACE);
+    len += h2Frame(&buf[len], 0x1, 0x5, 1, h2Req1, sizeof(h2Req1));
+
+    // A padded HEADERS with priority, then the rest in a CONTINUATION
+    payload[0] = 3;                                 // pad length
+    memset(&payload[1], 0, 5);                      // priority
+    memcpy(&payload[6], h2Req2, 2);
+    memset(&payload[8], 0, 3);                      // padding
+    len += h2Frame(&buf[len], 0x1, 0x29, 3, payload, 11);
+    len += h2Frame(&buf[len], 0x9, 0x4, 3, &h2Req2[2], 2);
+
+    // The preface in one piece, then a byte at a time
+    size_t plen = strlen(H2_PREFACE);
+    assert_true(doHttp(13, 3, &net, (char *)buf, plen, NETRX, BUF));
+    assert_null(g_msg);
+
+    size_t i;
+    for (i = plen; i < len; i++) {
+        assert_true(doHttp(13, 3, &net, (char *)&buf[i], 1, NETRX, BUF));
+        if (i == plen + 9 + sizeof(h2Req1) - 1) {
+            assertHttp2Post("GET / HTTP/2.0\r\nhost: www.example.com\r\n", 1);
+        } else if (i == len - 1) {
+            assertHttp2Post("GET /index.html HTTP/2.0\r\nhost: www.example.com\r\n", 3);
+        } else {
+            assert_null(g_msg);
+        }
+    }
+
+    resetHttp(&net.http);
+}
+
+static void
+doHttpWithHttp2SkipsInterimAndTrailers(void** state)
+{
+    uint8_t buf[256];
+    size_t len = 0;
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    memcpy(buf, H2_PREFACE, strlen(H2_PREFACE));
+    len += strlen(H2_PREFACE);
+    len += h2Frame(&buf[len], 0x1, 0x4, 1, h2Req1, sizeof(h2Req1));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, TLSRX, BUF));
+    assertHttp2Post("GET / HTTP/2.0\r\nhost: www.example.com\r\n", 1);
+
+    // The plain side of a TLS connection is ignored
+    assert_false(doHttp(13, 3, &net, "\x17\x03\x03", 3, NETRX, BUF));
+
+    // :status 100 (literal), then trailers (grpc-status: 0)
+    uint8_t interim[] = {0x08, 0x03, '1', '0', '0'};
+    uint8_t trailer[] = {0x00, 0x0b, 'g', 'r', 'p', 'c', '-', 's', 't', 'a',
+                         't', 'u', 's', 0x01, '0'};
+    len = h2Frame(buf, 0x1, 0x4, 1, interim, sizeof(interim));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, TLSTX, BUF));
+    assert_null(g_msg);
+    len = h2Frame(buf, 0x1, 0x4, 1, h2Resp, sizeof(h2Resp));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, TLSTX, BUF));
+    assertHttp2Post("HTTP/2.0 200 \r\ncontent-type: text/plain\r\n", 1);
+    len = h2Frame(buf, 0x1, 0x5, 1, trailer, sizeof(trailer));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, TLSTX, BUF));
+    assert_null(g_msg);
+
+    resetHttp(&net.http);
+}
+
+// :method POST, :scheme http, :path /shop.Catalog/GetItem,
+// content-type: application/grpc (literals not indexed)
+static const uint8_t grpcReq[] = {
+    0x83, 0x86, 0x04, 0x15, '/', 's', 'h', 'o', 'p', '.', 'C', 'a', 't', 'a',
+    'l', 'o', 'g', '/', 'G', 'e', 't', 'I', 't', 'e', 'm', 0x0f, 0x10, 0x10,
+    'a', 'p', 'p', 'l', 'i', 'c', 'a', 't', 'i', 'o', 'n', '/', 'g', 'r', 'p',
+    'c',
+};
+// :status 200, content-type: application/grpc
+static const uint8_t grpcResp[] = {
+    0x88, 0x0f, 0x10, 0x10, 'a', 'p', 'p', 'l', 'i', 'c', 'a', 't', 'i', 'o',
+    'n', '/', 'g', 'r', 'p', 'c',
+};
+// grpc-status: 5
+static const uint8_t grpcTrailer[] = {
+    0x00, 0x0b, 'g', 'r', 'p', 'c', '-', 's', 't', 'a', 't', 'u', 's', 0x01,
+    '5',
+};
+
+static void
+doHttpWithHttp2GrpcCalls(void** state)
+{
+    uint8_t buf[256];
+    uint8_t payload[64];
+    size_t len = 0;
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    g_grpc_calls = 0;
+
+    memcpy(buf, H2_PREFACE, strlen(H2_PREFACE));
+    len += strlen(H2_PREFACE);
+    len += h2Frame(&buf[len], 0x1, 0x4, 1, grpcReq, sizeof(grpcReq));
+
+    // Two messages: "abc", then 6 bytes over a padded frame and another
+    memcpy(payload, "\0\0\0\0\3abc\0\0\0\0\6xy", 15);
+    len += h2Frame(&buf[len], 0x0, 0, 1, payload, 15);
+    payload[0] = 2;
+    memcpy(&payload[1], "zzzz\0\0", 6);
+    len += h2Frame(&buf[len], 0x0, 0x9, 1, payload, 7);
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    assertHttp2Post("POST /shop.Catalog/GetItem HTTP/2.0\r\ncontent-type: application/grpc\r\n", 1);
+
+    // The response's messages a byte at a time; the call isn't over
+    // until the trailers
+    len = h2Frame(buf, 0x1, 0x4, 1, grpcResp, sizeof(grpcResp));
+    memcpy(payload, "\1\0\0\0\13hello worl", 15);
+    len += h2Frame(&buf[len], 0x0, 0, 1, payload, 15);
+    size_t i;
+    for (i = 0; i < len; i++) {
+        assert_true(doHttp(13, 3, &net, (char *)&buf[i], 1, NETTX, BUF));
+    }
+    freeMsg(&g_msg);
+    len = h2Frame(buf, 0x0, 0, 1, (uint8_t *)"d", 1);
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETTX, BUF));
+    assert_int_equal(g_grpc_calls, 0);
+
+    len = h2Frame(buf, 0x1, 0x5, 1, grpcTrailer, sizeof(grpcTrailer));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETTX, BUF));
+    assert_null(g_msg);
+    assert_int_equal(g_grpc_calls, 1);
+    assert_string_equal(g_grpc.method, "/shop.Catalog/GetItem");
+    assert_int_equal(g_grpc.status, 5);
+    assert_true(g_grpc.isServer);
+    assert_int_equal(g_grpc.msgs[0], 2);
+    assert_int_equal(g_grpc.bytes[0], 9);
+    assert_int_equal(g_grpc.msgs[1], 1);
+    assert_int_equal(g_grpc.bytes[1], 11);
+
+    // A call that's reset is cancelled
+    len = h2Frame(buf, 0x1, 0x4, 3, grpcReq, sizeof(grpcReq));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    freeMsg(&g_msg);
+    len = h2Frame(buf, 0x3, 0, 3, (uint8_t *)"\0\0\0\10", 4);
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    assert_int_equal(g_grpc_calls, 2);
+    assert_int_equal(g_grpc.status, 1);
+    assert_int_equal(g_grpc.msgs[0], 0);
+
+    // Plain HTTP/2 requests aren't gRPC calls
+    len = h2Frame(buf, 0x1, 0x5, 5, h2Req1, sizeof(h2Req1));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    freeMsg(&g_msg);
+    len = h2Frame(buf, 0x1, 0x5, 5, grpcTrailer, sizeof(grpcTrailer));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETTX, BUF));
+    assert_int_equal(g_grpc_calls, 2);
+
+    // Calls open when the connection closes aren't reported
+    len = h2Frame(buf, 0x1, 0x4, 7, grpcReq, sizeof(grpcReq));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    freeMsg(&g_msg);
+    resetHttp(&net.http);
+    assert_int_equal(g_grpc_calls, 2);
+}
+
+static void
+doHttpWithHttp2BadFrameStopsDecoding(void** state)
+{
+    uint8_t buf[256];
+    size_t len = 0;
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    // A CONTINUATION with no HEADERS before it
+    memcpy(buf, H2_PREFACE, strlen(H2_PREFACE));
+    len += strlen(H2_PREFACE);
+    len += h2Frame(&buf[len], 0x9, 0x4, 1, h2Req1, sizeof(h2Req1));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    assert_null(g_msg);
+
+    // Everything after is still HTTP/2, just not reported
+    len = h2Frame(buf, 0x1, 0x4, 3, h2Req1, sizeof(h2Req1));
+    assert_true(doHttp(13, 3, &net, (char *)buf, len, NETRX, BUF));
+    assert_null(g_msg);
+
+    resetHttp(&net.http);
+}
+
+static void
+doHttpHeaderBuffersComeFromCappedPools(void** state)
+{
+    char *buffer =
+        "GET / HTTP/1.0\r\n"
+        "Host: www.google.com\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    evt_pool_stats_t before, after;
+
+    // A header in one buffer is one block, and it's reused once returned
+    httpHdrPoolStats(&before);
+    assert_true(doHttp(13, 3, &net, buffer, strlen(buffer), NETRX, BUF));
+    freeMsg(&g_msg);
+    assert_true(doHttp(13, 3, &net, buffer, strlen(buffer), NETRX, BUF));
+    freeMsg(&g_msg);
+    httpHdrPoolStats(&after);
+    assert_int_equal(after.allocs - before.allocs, 2);
+    assert_true(after.slabbytes > 0);
+
+    // One that outgrows the small block moves to a big one
+    char big[6000];
+    memset(big, 'x', sizeof(big));
+    memcpy(big, "x: ", 3);
+    memcpy(&big[sizeof(big) - 4], "\r\n\r\n", 4);
+    before = after;
+    assert_false(doHttp(13, 3, &net, "GET / HTTP/1.0\r\n", 16, NETRX, BUF));
+    assert_true(doHttp(13, 3, &net, big, sizeof(big), NETRX, BUF));
+    assert_non_null(g_msg);
+    freeMsg(&g_msg);
+    httpHdrPoolStats(&after);
+    assert_int_equal(after.allocs - before.allocs, 2);
+
+    // Connections holding partial headers can't take more than the cap;
+    // the rest are dropped and counted
+    int nconn = 16 * 1024 * 1024 / 2 / 4096;
+    net_info *conn = calloc(nconn + 1, sizeof(net_info));
+    assert_non_null(conn);
+    int i;
+    for (i = 0; i <= nconn; i++) {
+        conn[i].type = SOCK_STREAM;
+        assert_false(doHttp(13, 3, &conn[i], "GET / HTTP/1.0\r\n", 16, NETRX, BUF));
+    }
+    httpHdrPoolStats(&before);
+    assert_int_equal(before.failed - after.failed, 1);
+    assert_null(conn[nconn].http.hdr);
+
+    for (i = 0; i <= nconn; i++) {
+        resetHttp(&conn[i].http);
+    }
+    free(conn);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -308,6 +917,17 @@ main(int argc, char* argv[])
         cmocka_unit_test(doHttpWithInterleavedEncryption),
         cmocka_unit_test(doHttpWhichRequiresRealloc),
         cmocka_unit_test(doHttpWhichExceedsReallocSize),
+        cmocka_unit_test(doHttpWithHeaderEndSplitAnywhere),
+        cmocka_unit_test(doHttpWithPipelinedRequests),
+        cmocka_unit_test(doHttpTimesResponsesAndCountsRequests),
+        cmocka_unit_test(doHttpWithChunkedResponse),
+        cmocka_unit_test(doHttpWithInterimResponse),
+        cmocka_unit_test(doHttpWithHttp2RequestAndResponse),
+        cmocka_unit_test(doHttpWithHttp2SplitFrames),
+        cmocka_unit_test(doHttpWithHttp2SkipsInterimAndTrailers),
+        cmocka_unit_test(doHttpWithHttp2GrpcCalls),
+        cmocka_unit_test(doHttpWithHttp2BadFrameStopsDecoding),
+        cmocka_unit_test(doHttpHeaderBuffersComeFromCappedPools),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, groupTeardown);
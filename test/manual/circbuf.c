@@ -0,0 +1,179 @@
+/*
+ * Compare queue throughput: the original CAS-on-index circbuf against
+ * the slot-sequence circbuf in src/circbuf.c.  N producer threads put
+ * while one consumer drains, either one entry at a time or in batches,
+ * the way the periodic thread does.
+ *
+ * gcc test/manual/circbuf.c src/circbuf.c src/dbg.c -Isrc -Wall -O2 -DSCOPE_VER=\"bench\" -lpthread -o circbuf
+ * ./circbuf [puts per producer]
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "atomic.h"
+#include "circbuf.h"
+
+#define MAX_PRODUCERS 16
+#define QUEUE_SIZE 10000
+#define BATCH 256
+
+// The original implementation, less its DBG calls
+typedef struct {
+    uint64_t *buffer;
+    int head;
+    int tail;
+    int maxlen;
+} old_cbuf_t;
+
+static old_cbuf_t *
+oldInit(size_t size)
+{
+    old_cbuf_t *cbuf = calloc(1, sizeof(old_cbuf_t));
+    cbuf->buffer = calloc(size + 1, sizeof(uint64_t));
+    cbuf->maxlen = size + 1;
+    return cbuf;
+}
+
+static int
+oldPut(old_cbuf_t *cbuf, uint64_t data)
+{
+    int head, head_next, attempts, success;
+    attempts = success = 0;
+    do {
+        head = cbuf->head;
+        head_next = (head + 1) % cbuf->maxlen;
+        if (head_next == cbuf->tail) break;
+        success = atomicCas32(&cbuf->head, head, head_next);
+    } while (!success && (attempts++ < cbuf->maxlen));
+
+    if (success) {
+        if (cbuf->buffer[head_next] != 0) return -1;
+        cbuf->buffer[head_next] = data;
+        return 0;
+    }
+    return -1;
+}
+
+static int
+oldGet(old_cbuf_t *cbuf, uint64_t *data)
+{
+    int tail, tail_next, attempts, success;
+    attempts = success = 0;
+    do {
+        tail = cbuf->tail;
+        tail_next = (tail + 1) % cbuf->maxlen;
+        if (tail == cbuf->head) break;
+        success = atomicCas32(&cbuf->tail, tail, tail_next);
+    } while (!success && (attempts++ < cbuf->maxlen));
+
+    if (success) {
+        *data = cbuf->buffer[tail_next];
+        cbuf->buffer[tail_next] = 0ULL;
+        return 0;
+    }
+    return -1;
+}
+
+typedef enum {OLD, NEW, NEW_BATCH} which_t;
+
+static which_t g_which;
+static old_cbuf_t *g_old;
+static cbuf_handle_t g_new;
+static long g_puts = 1000000;
+static uint64_t g_lost;     // entries the old queue took but never gave back
+
+static void *
+producer(void *arg)
+{
+    long i;
+    for (i = 1; i <= g_puts; i++) {
+        if (g_which == OLD) {
+            while (oldPut(g_old, i) == -1) sched_yield();
+        } else {
+            while (cbufPut(g_new, i) == -1) sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double
+run(which_t which, int nprod)
+{
+    pthread_t tid[MAX_PRODUCERS];
+    struct timespec start, end;
+    uint64_t data[BATCH];
+    long total = nprod * g_puts, got = 0;
+    int i;
+
+    g_which = which;
+    g_old = oldInit(QUEUE_SIZE);
+    g_new = cbufInit(QUEUE_SIZE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nprod; i++) {
+        pthread_create(&tid[i], NULL, producer, NULL);
+    }
+
+    int idle = 0;
+    while (got < total) {
+        int num = 0;
+        switch (which) {
+            case OLD:
+                num = (oldGet(g_old, data) == 0);
+                break;
+            case NEW:
+                num = (cbufGet(g_new, data) == 0);
+                break;
+            case NEW_BATCH:
+                num = cbufGetBatch(g_new, data, BATCH);
+                break;
+        }
+        got += num;
+        if (num) {
+            idle = 0;
+        } else if (++idle > 1000000) {
+            // The old queue can strand an entry when a put is preempted
+            // between claiming head and storing its data
+            g_lost += total - got;
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+
+    for (i = 0; i < nprod; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(g_old->buffer);
+    free(g_old);
+    cbufFree(g_new);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return got / secs / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) g_puts = atol(argv[1]);
+
+    printf("%10s %12s %12s %12s   (million entries/s)\n",
+           "producers", "old", "new", "new batch");
+
+    int nprod;
+    for (nprod = 1; nprod <= MAX_PRODUCERS; nprod *= 2) {
+        double old = run(OLD, nprod);
+        double new = run(NEW, nprod);
+        double batch = run(NEW_BATCH, nprod);
+        printf("%10d %12.1f %12.1f %12.1f\n", nprod, old, new, batch);
+    }
+    if (g_lost) printf("old queue lost %lu entries\n", (unsigned long)g_lost);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Compare counter update throughput: one shared counter updated with
+ * the CAS loop in atomicAddU64() against ctrShardAdd() with 64 shards.
+ * Runs 1 to 64 threads; each thread does a fixed number of adds.
+ *
+ * gcc test/manual/ctrshard.c src/ctrshard.c src/dbg.c -Isrc -Wall -O2 -lpthread -o ctrshard
+ * ./ctrshard [adds per thread]
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "atomic.h"
+#include "ctrshard.h"
+
+#define MAX_THREADS 64
+#define NUM_CTRS 15
+#define NUM_SHARDS 64
+
+static uint64_t g_shared[NUM_CTRS];
+static ctr_shard_t *g_shards;
+static long g_adds = 1000000;
+
+static void *
+sharedThread(void *arg)
+{
+    long i;
+    for (i = 0; i < g_adds; i++) {
+        atomicAddU64(&g_shared[i % NUM_CTRS], 1);
+    }
+    return NULL;
+}
+
+static void *
+shardThread(void *arg)
+{
+    long i;
+    for (i = 0; i < g_adds; i++) {
+        ctrShardAdd(g_shards, i % NUM_CTRS, 1);
+    }
+    return NULL;
+}
+
+static double
+run(void *(*fn)(void *), int nthreads)
+{
+    pthread_t tid[MAX_THREADS];
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, fn, NULL)) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    // millions of adds per second, over all threads
+    return (nthreads * (double)g_adds) / secs / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) g_adds = atol(argv[1]);
+
+    if ((g_shards = ctrShardCreate(NUM_CTRS, NUM_SHARDS)) == NULL) {
+        fprintf(stderr, "ctrShardCreate failed\n");
+        return 1;
+    }
+
+    printf("%8s %16s %16s %8s\n", "threads", "shared Madd/s", "sharded Madd/s", "ratio");
+
+    int nthreads;
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        double shared = run(sharedThread, nthreads);
+        double sharded = run(shardThread, nthreads);
+        printf("%8d %16.1f %16.1f %8.2f\n", nthreads, shared, sharded, sharded / shared);
+    }
+
+    // Make sure nothing went missing
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < NUM_CTRS; i++) {
+        total += ctrShardFold(g_shards, i);
+    }
+    printf("sharded total %lu, expected %lu\n", total,
+           (unsigned long)g_adds * (2 * MAX_THREADS - 1));
+
+    ctrShardDestroy(&g_shards);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Compare event posting throughput: every thread putting straight onto
+ * one shared cbuf against staging through evtStagePut() and publishing
+ * batches with cbufPutBatch().  A consumer thread drains the cbuf the
+ * whole time, as the periodic thread does.  Runs 1 to 64 threads; each
+ * thread posts a fixed number of events.
+ *
+ * gcc test/manual/evtstage.c src/evtstage.c src/circbuf.c src/dbg.c -Isrc -Wall -O2 -DSCOPE_VER=\"bench\" -lpthread -o evtstage
+ * ./evtstage [posts per thread]
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "circbuf.h"
+#include "evtstage.h"
+
+#define MAX_THREADS 64
+#define BATCH 32
+
+static cbuf_handle_t g_cbuf;
+static evt_stage_t *g_stage;
+static long g_posts = 1000000;
+static volatile int g_done;
+static uint64_t g_drained;
+
+static __thread int t_drainer;
+
+static void
+publish(void *arg, uint64_t *data, int num)
+{
+    // Wait rather than drop, so both sides do the same work.  The drain
+    // thread flushing can't wait on itself; it makes room as it goes.
+    uint64_t tmp[64];
+    int put = 0;
+    while ((put += cbufPutBatch(g_cbuf, &data[put], num - put)) < num) {
+        if (t_drainer) {
+            g_drained += cbufGetBatch(g_cbuf, tmp, 64);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void *
+directThread(void *arg)
+{
+    long i;
+    for (i = 1; i <= g_posts; i++) {
+        while (cbufPut(g_cbuf, i) == -1) sched_yield();
+    }
+    return NULL;
+}
+
+static void *
+stageThread(void *arg)
+{
+    long i;
+    for (i = 1; i <= g_posts; i++) {
+        if (evtStagePut(g_stage, i)) {
+            while (cbufPut(g_cbuf, i) == -1) sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+drainThread(void *arg)
+{
+    uint64_t data[64];
+    t_drainer = 1;
+    while (!g_done) {
+        int num = cbufGetBatch(g_cbuf, data, 64);
+        if (num) {
+            g_drained += num;
+        } else {
+            // Idle, like the periodic thread between reports
+            struct timespec ts = {0, 100000};
+            evtStageFlush(g_stage);
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+static double
+run(void *(*fn)(void *), int nthreads)
+{
+    pthread_t tid[MAX_THREADS], drain;
+    struct timespec start, end;
+    int i;
+
+    g_done = 0;
+    if (pthread_create(&drain, NULL, drainThread, NULL)) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, fn, NULL)) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    g_done = 1;
+    pthread_join(drain, NULL);
+    t_drainer = 1;
+    evtStageFlush(g_stage);
+    uint64_t data[64];
+    int num;
+    while ((num = cbufGetBatch(g_cbuf, data, 64))) g_drained += num;
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    // millions of posts per second, over all threads
+    return (nthreads * (double)g_posts) / secs / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) g_posts = atol(argv[1]);
+
+    g_cbuf = cbufInit(100000);
+    g_stage = evtStageCreate(BATCH, publish, NULL);
+    if (!g_cbuf || !g_stage) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+
+    printf("%8s %16s %16s %8s\n", "threads", "direct Mpost/s", "staged Mpost/s", "ratio");
+
+    int nthreads;
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        double direct = run(directThread, nthreads);
+        double staged = run(stageThread, nthreads);
+        printf("%8d %16.1f %16.1f %8.2f\n", nthreads, direct, staged, staged / direct);
+    }
+
+    // Make sure nothing went missing
+    printf("drained %lu, expected %lu\n", (unsigned long)g_drained,
+           (unsigned long)g_posts * 2 * (2 * MAX_THREADS - 1));
+
+    evtStageDestroy(&g_stage);
+    cbufFree(g_cbuf);
+    return 0;
+}
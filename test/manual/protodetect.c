@@ -0,0 +1,192 @@
+/*
+ * Compare the cost of protocol detection on a new connection: the way
+ * detectProtocol() used to match (match data created from the pattern and
+ * the buffer hex encoded with snprintf for each protocol, interpreted
+ * regexes) against the way it does now (JIT compiled regexes, one match
+ * data reused, the buffer hex encoded once from a table).  Runs with 1,
+ * 10 and 50 protocol definitions, half of them binary, none of which
+ * match; a connection that is nothing we know is tried against them all.
+ *
+ * gcc test/manual/protodetect.c -I./contrib/pcre2/src -I./contrib/pcre2/build -Wall -O2 contrib/pcre2/build/libpcre2-8.a -o protodetect
+ * ./protodetect [connections]
+ */
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pcre2.h"
+
+#define MAX_CONVERT 256
+#define MAX_PROTOCOLS 50
+
+typedef struct {
+    pcre2_code *re;
+    int binary;
+} proto_t;
+
+static proto_t g_proto[MAX_PROTOCOLS];
+static long g_conns = 100000;
+
+// The first read of a connection; it's a lot like http, but it isn't
+static const char g_buf[] =
+    "PUT /v1/objects/8812 HTTP/1.1\r\nHost: store.example.com\r\n"
+    "Content-Type: application/octet-stream\r\nContent-Length: 4096\r\n\r\n";
+
+static const char hexDigit[] = "0123456789abcdef";
+
+static void
+compile(int num, int jit)
+{
+    char regex[64];
+    int errnum;
+    PCRE2_SIZE erroff;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        g_proto[i].binary = i & 1;
+        if (g_proto[i].binary) {
+            snprintf(regex, sizeof(regex), "^%02x0[0-3]%02x", 0x80 + i, i);
+        } else {
+            snprintf(regex, sizeof(regex), "^PROTO%d (\\d+) [A-Z]+\\r\\n", i);
+        }
+        g_proto[i].re = pcre2_compile((PCRE2_SPTR)regex, PCRE2_ZERO_TERMINATED,
+                                      0, &errnum, &erroff, NULL);
+        if (!g_proto[i].re) {
+            fprintf(stderr, "pcre2_compile failed for %s\n", regex);
+            exit(1);
+        }
+        if (jit && pcre2_jit_compile(g_proto[i].re, PCRE2_JIT_COMPLETE)) {
+            fprintf(stderr, "pcre2_jit_compile failed; is pcre2 built with JIT?\n");
+        }
+    }
+}
+
+static void
+freeAll(int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        pcre2_code_free(g_proto[i].re);
+    }
+}
+
+static int
+detectOld(int num, const char *buf, size_t len)
+{
+    size_t cvlen = (len < MAX_CONVERT) ? len : MAX_CONVERT;
+    int matched = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        pcre2_match_data *match_data =
+            pcre2_match_data_create_from_pattern(g_proto[i].re, NULL);
+        if (!match_data) exit(1);
+
+        const char *data = buf;
+        char *cpdata = NULL;
+        size_t mlen = cvlen;
+        if (g_proto[i].binary) {
+            size_t alloclen = (cvlen * 2) + 1;
+            if ((cpdata = calloc(1, alloclen)) == NULL) exit(1);
+            size_t j;
+            for (j = 0; j < cvlen; j++) {
+                snprintf(&cpdata[j * 2], alloclen - (j * 2), "%02x", (unsigned char)buf[j]);
+            }
+            data = cpdata;
+            mlen = cvlen * 2;
+        }
+
+        if (pcre2_match(g_proto[i].re, (PCRE2_SPTR)data, mlen, 0, 0, match_data, NULL) > 0) {
+            matched++;
+        }
+        if (cpdata) free(cpdata);
+        pcre2_match_data_free(match_data);
+    }
+    return matched;
+}
+
+static int
+detectNew(int num, const char *buf, size_t len, pcre2_match_data *match_data)
+{
+    size_t cvlen = (len < MAX_CONVERT) ? len : MAX_CONVERT;
+    char hex[MAX_CONVERT * 2];
+    int encoded = 0;
+    int matched = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        const char *data = buf;
+        size_t mlen = cvlen;
+        if (g_proto[i].binary) {
+            if (!encoded) {
+                size_t j;
+                for (j = 0; j < cvlen; j++) {
+                    hex[j * 2] = hexDigit[(unsigned char)buf[j] >> 4];
+                    hex[j * 2 + 1] = hexDigit[(unsigned char)buf[j] & 0xf];
+                }
+                encoded = 1;
+            }
+            data = hex;
+            mlen = cvlen * 2;
+        }
+
+        if (pcre2_match(g_proto[i].re, (PCRE2_SPTR)data, mlen, 0, 0, match_data, NULL) >= 0) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+static double
+elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) g_conns = atol(argv[1]);
+
+    static const int nums[] = {1, 10, 50};
+    size_t len = sizeof(g_buf) - 1;
+    struct timespec start, end;
+    int matched = 0;
+    long c;
+    int n;
+
+    printf("%10s %14s %14s %8s\n", "protocols", "old ns/conn", "new ns/conn", "ratio");
+
+    for (n = 0; n < sizeof(nums) / sizeof(nums[0]); n++) {
+        int num = nums[n];
+
+        compile(num, 0);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (c = 0; c < g_conns; c++) {
+            matched += detectOld(num, g_buf, len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double old = elapsed(&start, &end) / g_conns;
+        freeAll(num);
+
+        compile(num, 1);
+        pcre2_match_data *match_data = pcre2_match_data_create(1, NULL);
+        if (!match_data) return 1;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (c = 0; c < g_conns; c++) {
+            matched += detectNew(num, g_buf, len, match_data);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double new = elapsed(&start, &end) / g_conns;
+        pcre2_match_data_free(match_data);
+        freeAll(num);
+
+        printf("%10d %14.0f %14.0f %8.2f\n", num, old, new, old / new);
+    }
+
+    // Nothing should have matched
+    if (matched) printf("unexpected matches: %d\n", matched);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Measure what an interposed read() and write() cost over the libc call.
+ * Reads and writes one byte at a time on /dev/zero and /dev/null, and
+ * prints nanoseconds per call.  Run it bare, then under libscope with
+ * metrics and events on and with them off; with them off the wrappers
+ * should add one branch and come out within noise of the bare run.
+ *
+ * gcc test/manual/rwcost.c -Wall -O2 -o rwcost
+ * ./rwcost [calls]
+ * LD_PRELOAD=./lib/linux/libscope.so ./rwcost [calls]
+ * SCOPE_METRIC_ENABLE=false SCOPE_EVENT_ENABLE=false \
+ *     LD_PRELOAD=./lib/linux/libscope.so ./rwcost [calls]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+nsPerCall(struct timespec *start, struct timespec *end, long calls)
+{
+    double ns = (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+    return ns / calls;
+}
+
+int
+main(int argc, char **argv)
+{
+    long calls = 10000000;
+    if (argc > 1) calls = atol(argv[1]);
+
+    int rfd = open("/dev/zero", O_RDONLY);
+    int wfd = open("/dev/null", O_WRONLY);
+    if ((rfd == -1) || (wfd == -1)) {
+        perror("open");
+        return 1;
+    }
+
+    struct timespec start, end;
+    char c = 0;
+    long i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < calls; i++) {
+        if (read(rfd, &c, 1) != 1) {
+            perror("read");
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("read  %8.1f ns/call\n", nsPerCall(&start, &end, calls));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < calls; i++) {
+        if (write(wfd, &c, 1) != 1) {
+            perror("write");
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("write %8.1f ns/call\n", nsPerCall(&start, &end, calls));
+
+    close(rfd);
+    close(wfd);
+    return 0;
+}
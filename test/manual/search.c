@@ -0,0 +1,112 @@
+/*
+ * Compare searchExec() throughput for each implementation in search.c:
+ * Horspool (scalar), SSE2 and AVX2.  Each needle is run over a buffer
+ * it isn't in, so the whole buffer is searched every time.
+ *
+ *   "HTTP/"       over binary data, as on a socket that isn't HTTP
+ *   "\r\n\r\n"    over header lines, as when looking for the end of one
+ *   "Content-Length:" over header lines
+ *
+ * gcc test/manual/search.c src/search.c -Isrc -Wall -O2 -o search
+ * ./search [buffer size] [passes]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "search.h"
+
+static const char *g_lines =
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:72.0) Gecko/20100101 Firefox/72.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: visitor_id763193=27707599; lpv763193=aHR0cHM6Ly93dzIua2xvdmUuY29tL25ld3Mv\r\n";
+
+static double
+run(search_t *handle, char *buf, int len, int passes)
+{
+    struct timespec start, end;
+    volatile int found = 0;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < passes; i++) {
+        found += searchExec(handle, buf, len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (found != -passes) {
+        fprintf(stderr, "unexpected match\n");
+        exit(1);
+    }
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return ((double)len * passes) / secs / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    int len = (argc > 1) ? atoi(argv[1]) : 16 * 1024;
+    int passes = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    char *binary = malloc(len);
+    char *header = malloc(len);
+    if (!binary || !header) return 1;
+
+    int i;
+    srand(1);
+    for (i = 0; i < len; i++) {
+        binary[i] = rand();
+    }
+    // No "HTTP/" by chance
+    for (i = 0; i < len; i++) {
+        if (binary[i] == 'H') binary[i] = 'h';
+    }
+    size_t llen = strlen(g_lines);
+    for (i = 0; i < len; i++) {
+        header[i] = g_lines[i % llen];
+    }
+
+    struct {
+        const char *name;
+        const char *needle;
+        char *buf;
+    } cases[] = {
+        {"HTTP/ in binary", "HTTP/", binary},
+        {"CRLFCRLF in header", "\r\n\r\n", header},
+        {"Content-Length: in header", "Content-Length:", header},
+    };
+    const char *implName[] = {"scalar", "sse2", "avx2"};
+
+    printf("%d byte buffer, %d passes; GB/s\n", len, passes);
+    printf("%-28s %10s %10s %10s\n", "", implName[0], implName[1], implName[2]);
+
+    search_impl_t orig = searchImpl();
+    int c;
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        search_t *handle = searchComp(cases[c].needle);
+        printf("%-28s", cases[c].name);
+
+        search_impl_t impl;
+        for (impl = SEARCH_SCALAR; impl <= SEARCH_AVX2; impl++) {
+            if (searchSetImpl(impl)) {
+                printf(" %10s", "n/a");
+                continue;
+            }
+            printf(" %10.2f", run(handle, cases[c].buf, len, passes));
+        }
+        printf("\n");
+        searchFree(&handle);
+    }
+    printf("searchExec() uses %s on this cpu\n", implName[orig]);
+
+    free(binary);
+    free(header);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "mpsearch.h"
+#include "test.h"
+
+static uint64_t hits[MPSEARCH_WORDS(MPSEARCH_MAX_STRINGS)];
+
+static int
+add(mpsearch_t *mps, const char *str, int anchored)
+{
+    return mpsearchAdd(mps, (const unsigned char *)str, strlen(str), anchored);
+}
+
+static int
+exec(mpsearch_t *mps, const char *buf)
+{
+    return mpsearchExec(mps, (const unsigned char *)buf, strlen(buf), hits);
+}
+
+static int
+hit(int id)
+{
+    return (hits[id / 64] & (1ULL << (id % 64))) != 0;
+}
+
+static void
+mpsearchCreateAndDestroy(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+    assert_non_null(mps);
+    assert_int_equal(mpsearchCount(mps), 0);
+    mpsearchDestroy(&mps);
+    assert_null(mps);
+}
+
+static void
+mpsearchNullArgsDoNotCrash(void **state)
+{
+    mpsearch_t *mps = NULL;
+    mpsearchDestroy(NULL);
+    mpsearchDestroy(&mps);
+    assert_int_equal(add(NULL, "hey", 0), -1);
+    assert_false(mpsearchBuild(NULL));
+    assert_int_equal(mpsearchCount(NULL), 0);
+    assert_int_equal(exec(NULL, "hey"), -1);
+
+    mps = mpsearchCreate();
+    assert_int_equal(mpsearchAdd(mps, NULL, 3, 0), -1);
+    assert_int_equal(add(mps, "", 0), -1);
+    // Not built yet
+    assert_int_equal(exec(mps, "hey"), -1);
+    assert_true(mpsearchBuild(mps));
+    assert_int_equal(mpsearchExec(mps, NULL, 3, hits), 0);
+    assert_int_equal(mpsearchExec(mps, (const unsigned char *)"hey", 3, NULL), -1);
+    // Built; nothing more can be added
+    assert_int_equal(add(mps, "hey", 0), -1);
+    mpsearchDestroy(&mps);
+}
+
+static void
+mpsearchFindsStringsAnywhere(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+
+    // The classic example, where matches overlap and end inside others
+    assert_int_equal(add(mps, "he", 0), 0);
+    assert_int_equal(add(mps, "she", 0), 1);
+    assert_int_equal(add(mps, "his", 0), 2);
+    assert_int_equal(add(mps, "hers", 0), 3);
+    assert_int_equal(mpsearchCount(mps), 4);
+    assert_true(mpsearchBuild(mps));
+
+    assert_int_equal(exec(mps, "ushers"), 3);
+    assert_true(hit(0));
+    assert_true(hit(1));
+    assert_false(hit(2));
+    assert_true(hit(3));
+
+    assert_int_equal(exec(mps, "this"), 1);
+    assert_true(hit(2));
+    assert_false(hit(0));
+
+    assert_int_equal(exec(mps, "nothing here"), 1);
+    assert_true(hit(0));
+    assert_int_equal(exec(mps, "xyz"), 0);
+    assert_int_equal(exec(mps, ""), 0);
+
+    mpsearchDestroy(&mps);
+}
+
+static void
+mpsearchAnchoredOnlyAtTheStart(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+    assert_int_equal(add(mps, "GET ", 1), 0);
+    assert_int_equal(add(mps, "GE", 1), 1);
+    assert_int_equal(add(mps, "PRI * HTTP/2.0", 1), 2);
+    assert_int_equal(add(mps, "HTTP/", 0), 3);
+    assert_true(mpsearchBuild(mps));
+
+    assert_int_equal(exec(mps, "GET / HTTP/1.1\r\n"), 3);
+    assert_true(hit(0));
+    assert_true(hit(1));
+    assert_true(hit(3));
+
+    // Where it's found matters
+    assert_int_equal(exec(mps, "x GET / HTTP/1.1\r\n"), 1);
+    assert_true(hit(3));
+    assert_int_equal(exec(mps, "GE"), 1);
+    assert_true(hit(1));
+    assert_int_equal(exec(mps, "PRI * HTTP/2.0\r\n"), 2);
+    assert_true(hit(2));
+
+    mpsearchDestroy(&mps);
+}
+
+static void
+mpsearchSameStringTwice(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+    assert_int_equal(add(mps, "AMQP", 0), 0);
+    assert_int_equal(add(mps, "AMQP", 0), 1);
+    assert_int_equal(add(mps, "AMQP", 1), 2);
+    assert_true(mpsearchBuild(mps));
+
+    // Each is reported once, however often it's there
+    assert_int_equal(exec(mps, "AMQP AMQP"), 3);
+    assert_true(hit(0) && hit(1) && hit(2));
+
+    mpsearchDestroy(&mps);
+}
+
+static void
+mpsearchBinaryData(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+    const unsigned char tls[] = {0x16, 0x03};
+    const unsigned char nul[] = {0x00, 0x00, 0x00, 0x08};
+    assert_int_equal(mpsearchAdd(mps, tls, sizeof(tls), 1), 0);
+    assert_int_equal(mpsearchAdd(mps, nul, sizeof(nul), 0), 1);
+    assert_true(mpsearchBuild(mps));
+
+    const unsigned char buf[] = {0x16, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x08, 0xff};
+    assert_int_equal(mpsearchExec(mps, buf, sizeof(buf), hits), 2);
+    // The length limits what's looked at
+    assert_int_equal(mpsearchExec(mps, buf, 7, hits), 1);
+    assert_true(hit(0));
+    assert_int_equal(mpsearchExec(mps, buf, 1, hits), 0);
+
+    mpsearchDestroy(&mps);
+}
+
+static void
+mpsearchManyStrings(void **state)
+{
+    mpsearch_t *mps = mpsearchCreate();
+    char str[32];
+    int i;
+
+    for (i = 0; i < MPSEARCH_MAX_STRINGS; i++) {
+        snprintf(str, sizeof(str), "<%d>", i);
+        assert_int_equal(add(mps, str, i & 1), i);
+    }
+    assert_int_equal(add(mps, "one too many", 0), -1);
+    assert_int_equal(mpsearchCount(mps), MPSEARCH_MAX_STRINGS);
+    assert_true(mpsearchBuild(mps));
+
+    // Only even ones can be anywhere
+    assert_int_equal(exec(mps, "<1023> <1000> <1001> <7> <8>"), 3);
+    assert_true(hit(1023));
+    assert_true(hit(1000));
+    assert_false(hit(1001));
+    assert_false(hit(7));
+    assert_true(hit(8));
+
+    mpsearchDestroy(&mps);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(mpsearchCreateAndDestroy),
+        cmocka_unit_test(mpsearchNullArgsDoNotCrash),
+        cmocka_unit_test(mpsearchFindsStringsAnywhere),
+        cmocka_unit_test(mpsearchAnchoredOnlyAtTheStart),
+        cmocka_unit_test(mpsearchSameStringTwice),
+        cmocka_unit_test(mpsearchBinaryData),
+        cmocka_unit_test(mpsearchManyStrings),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
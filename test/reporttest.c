@@ -1,4 +1,5 @@
 #define _GNU_SOURCE
+#include <arpa/inet.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -6,10 +7,12 @@
 #include "cfg.h"
 #include "dbg.h"
 #include "fn.h"
+#include "httpstate.h"
 #include "plattime.h"
 #include "report.h"
 #include "runtimecfg.h"
 #include "state.h"
+#include "state_private.h"
 #include "test.h"
 
 
@@ -19,8 +22,11 @@ rtconfig g_cfg = {0};
 #define BUFSIZE 500
 
 event_t evtBuf[BUFSIZE] = {{0}};
+char evtFileBuf[BUFSIZE][64] = {{0}};
+char evtPeerBuf[BUFSIZE][64] = {{0}};
 int evtBufNext = 0;
 event_t mtcBuf[BUFSIZE] = {{0}};
+char mtcHostBuf[BUFSIZE][64] = {{0}};
 int mtcBufNext = 0;
 
 // These signatures satisfy --wrap=cmdSendEvent in the Makefile
@@ -32,7 +38,17 @@ int __wrap_cmdSendEvent(ctl_t* ctl, event_t* event, uint64_t uid, proc_id_t* pro
 int cmdSendEvent(ctl_t* ctl, event_t* event, uint64_t uit, proc_id_t* proc)
 #endif // __MACOS__
 {
-    // Store event for later inspection
+    // Store event for later inspection.  The fields are gone once we
+    // return, so keep a copy of the one we care about.
+    event_field_t *fld;
+    for (fld = event->fields; fld && fld->value_type != FMT_END; fld++) {
+        if ((fld->value_type == FMT_STR) && !strcmp(fld->name, "file")) {
+            strncpy(evtFileBuf[evtBufNext], fld->value.str, sizeof(evtFileBuf[0]) - 1);
+        }
+        if ((fld->value_type == FMT_STR) && !strcmp(fld->name, "net.peer.name")) {
+            strncpy(evtPeerBuf[evtBufNext], fld->value.str, sizeof(evtPeerBuf[0]) - 1);
+        }
+    }
     memcpy(&evtBuf[evtBufNext++], event, sizeof(*event));
     if (evtBufNext >= BUFSIZE) fail();
 
@@ -48,7 +64,14 @@ int __wrap_cmdSendMetric(mtc_t* mtc, event_t* metric)
 int cmdSendMetric(mtc_t* mtc, event_t* metric)
 #endif // __MACOS__
 {
-    // Store metric for later inspection
+    // Store metric for later inspection, and a copy of the field we
+    // care about
+    event_field_t *fld;
+    for (fld = metric->fields; fld && fld->value_type != FMT_END; fld++) {
+        if ((fld->value_type == FMT_STR) && !strcmp(fld->name, "remotehost")) {
+            strncpy(mtcHostBuf[mtcBufNext], fld->value.str, sizeof(mtcHostBuf[0]) - 1);
+        }
+    }
     memcpy(&mtcBuf[mtcBufNext++], metric, sizeof(*metric));
     if (mtcBufNext >= BUFSIZE) fail();
 
@@ -121,13 +144,42 @@ metricValues(const char* str)
     return returnVal;
 }
 
+// The net.peer.name of the last str event; "" if it had none
+const char *
+eventPeerName(const char *str)
+{
+    doEvent();
+    int i;
+    const char *name = NULL;
+    for (i=0; i < evtBufNext; i++) {
+        if (!strcmp(evtBuf[i].name, str)) name = evtPeerBuf[i];
+    }
+    return name;
+}
+
+// The remotehost of the last str metric; "" if it had none
+const char *
+metricRemoteHost(const char *str)
+{
+    doEvent();
+    int i;
+    const char *name = NULL;
+    for (i=0; i < mtcBufNext; i++) {
+        if (!strcmp(mtcBuf[i].name, str)) name = mtcHostBuf[i];
+    }
+    return name;
+}
+
 void
 clearTestData(void)
 {
     doEvent();
     memset(&evtBuf, 0, sizeof(evtBuf));
+    memset(&evtFileBuf, 0, sizeof(evtFileBuf));
+    memset(&evtPeerBuf, 0, sizeof(evtPeerBuf));
     evtBufNext = 0;
     memset(&mtcBuf, 0, sizeof(mtcBuf));
+    memset(&mtcHostBuf, 0, sizeof(mtcHostBuf));
     mtcBufNext = 0;
 }
 
@@ -189,6 +241,7 @@ nothingCrashesBeforeAnyInit(void** state)
     doProcMetric(PROC_CPU, 2345);
     doStatMetric("statFunc", "/the/path/to/something", NULL);
     doTotal(TOT_READ);
+    doHttpMetrics();
     doTotalDuration(TOT_DNS_DURATION);
     doEvent();
 
@@ -375,6 +428,38 @@ doReadFileFullSummarization(void** state)
     assert_int_equal(eventCalls("fs.op.close"), 0);
 }
 
+static void
+doReadFileReportsPathAfterClose(void** state)
+{
+    clearTestData();
+    setVerbosity(9);
+
+    // Reads are posted without the path.  Close and reuse the fd
+    // before the periodic thread gets to them.
+    doOpen(16, "/the/first/path", FD, "openFunc");
+    doRead(16, 987, 1, NULL, 13, "readFunc", BUF, 0);
+    doClose(16, "closeFunc");
+    doOpen(16, "/the/second/path", FD, "openFunc");
+    doRead(16, 987, 1, NULL, 17, "readFunc", BUF, 0);
+
+    assert_int_equal(eventCalls("fs.read"), 2);
+    int i, found = 0;
+    for (i = 0; i < evtBufNext; i++) {
+        if (strcmp(evtBuf[i].name, "fs.read")) continue;
+        if (evtBuf[i].value.integer == 13) {
+            assert_string_equal(evtFileBuf[i], "/the/first/path");
+            found++;
+        } else if (evtBuf[i].value.integer == 17) {
+            assert_string_equal(evtFileBuf[i], "/the/second/path");
+            found++;
+        }
+    }
+    assert_int_equal(found, 2);
+
+    doClose(16, "closeFunc");
+    clearTestData();
+}
+
 static void
 doWriteFileNoSummarization(void** state)
 {
@@ -1634,6 +1719,272 @@ doDNSErrSummarization(void** state)
     assert_int_equal(eventCalls(NULL), 0);
 }
 
+static void
+doDNSResponseNoDNSSummarization(void** state)
+{
+    struct sockaddr_in resolver = {0};
+    resolver.sin_family = AF_INET;
+    resolver.sin_port = htons(53);
+    resolver.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    clearTestData();
+    setVerbosity(6);
+    addSock(17, SOCK_DGRAM, 0);
+    doSetConnection(17, (struct sockaddr *)&resolver, sizeof(resolver), REMOTE);
+
+    // A query for nope.example, and the answer that there's no such name
+    uint8_t query[] = {
+        0x4e, 0x58, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x04, 'n',  'o',  'p',
+        'e',  0x07, 'e',  'x',  'a',  'm',  'p',  'l',
+        'e',  0x00, 0x00, 0x01, 0x00, 0x01
+    };
+    uint8_t resp[sizeof(query)];
+    memcpy(resp, query, sizeof(resp));
+    resp[2] = 0x81;
+    resp[3] = 0x83;
+    getDNSName(17, query, sizeof(query));
+    doSend(17, sizeof(query), query, sizeof(query), BUF);
+    clearTestData();
+
+    doRecv(17, sizeof(resp), resp, sizeof(resp), BUF);
+    assert_int_equal(eventCalls("net.dns.answer"), 1);
+    assert_int_equal(metricCalls("net.dns.answer"), 1);
+    assert_int_equal(metricValues("net.dns.answer"), 1);
+    // No answers, so nothing about how long they can be kept
+    assert_int_equal(metricCalls("net.dns.ttl"), 0);
+    assert_int_equal(eventCalls("net.dns.duration"), 1);
+    assert_int_equal(eventCalls("net.error"), 1);
+    assert_int_equal(metricCalls("net.error"), 1);
+
+    // The same response again isn't matched with anything
+    clearTestData();
+    doRecv(17, sizeof(resp), resp, sizeof(resp), BUF);
+    assert_int_equal(eventCalls("net.dns.answer"), 0);
+    assert_int_equal(eventCalls("net.dns.duration"), 0);
+    assert_int_equal(eventCalls("net.error"), 0);
+
+    // This time it's there, with one answer good for 5 minutes
+    uint8_t found[sizeof(query) + 16] = {0};
+    memcpy(found, query, sizeof(query));
+    found[2] = 0x81;
+    found[3] = 0x80;
+    found[7] = 0x01;
+    uint8_t answer[] = {
+        0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+        0x01, 0x2c, 0x00, 0x04, 0x0a, 0x00, 0x00, 0x01
+    };
+    memcpy(&found[sizeof(query)], answer, sizeof(answer));
+    getDNSName(17, query, sizeof(query));
+    doSend(17, sizeof(query), query, sizeof(query), BUF);
+    clearTestData();
+
+    doRecv(17, sizeof(found), found, sizeof(found), BUF);
+    assert_int_equal(eventCalls("net.dns.answer"), 1);
+    assert_int_equal(eventValues("net.dns.answer"), 1);
+    assert_int_equal(metricCalls("net.dns.ttl"), 1);
+    assert_int_equal(metricValues("net.dns.ttl"), 300);
+    assert_int_equal(eventCalls("net.error"), 0);
+
+    doClose(17, "closeFunc");
+}
+
+static void
+doNetReportsPeerName(void** state)
+{
+    struct sockaddr_in db = {0};
+    db.sin_family = AF_INET;
+    db.sin_port = htons(5432);
+    inet_pton(AF_INET, "10.1.2.3", &db.sin_addr);
+    struct sockaddr_in local = {0};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(40000);
+    inet_pton(AF_INET, "10.1.2.1", &local.sin_addr);
+    struct addrinfo res = {0};
+    res.ai_family = AF_INET;
+    res.ai_addr = (struct sockaddr *)&db;
+    res.ai_addrlen = sizeof(db);
+
+    // Connection events are net events
+    evt_fmt_t *net = evtFormatCreate();
+    watch_t src;
+    for (src = CFG_SRC_FILE; src < CFG_SRC_MAX; src++) {
+        evtFormatSourceEnabledSet(net, src, FALSE);
+    }
+    evtFormatSourceEnabledSet(net, CFG_SRC_METRIC, TRUE);
+    evtFormatSourceEnabledSet(net, CFG_SRC_NET, TRUE);
+    ctlEvtSet(g_ctl, net);
+
+    clearTestData();
+    setVerbosity(9);
+    doHostAddrInfo("db.example", &res);
+    // Numbers aren't names
+    struct sockaddr_in other = db;
+    inet_pton(AF_INET, "10.1.2.4", &other.sin_addr);
+    res.ai_addr = (struct sockaddr *)&other;
+    doHostAddrInfo("10.1.2.4", &res);
+
+    // A connection to an address that was looked up has its name
+    socklen_t len = sizeof(db);
+    doAccept(19, (struct sockaddr *)&db, &len, "acceptFunc");
+    doSetConnection(19, (struct sockaddr *)&local, sizeof(local), LOCAL);
+    assert_int_equal(eventCalls("net.conn.open"), 1);
+    assert_string_equal(eventPeerName("net.conn.open"), "db.example");
+    doRecv(19, 13, NULL, 13, BUF);
+    assert_int_equal(metricCalls("net.rx"), 1);
+    assert_string_equal(metricRemoteHost("net.rx"), "db.example");
+    doSend(19, 13, NULL, 13, BUF);
+    assert_string_equal(metricRemoteHost("net.tx"), "db.example");
+    doClose(19, "closeFunc");
+    assert_string_equal(eventPeerName("net.conn.close"), "db.example");
+
+    // And one to an address that wasn't doesn't
+    clearTestData();
+    len = sizeof(other);
+    doAccept(20, (struct sockaddr *)&other, &len, "acceptFunc");
+    doSetConnection(20, (struct sockaddr *)&local, sizeof(local), LOCAL);
+    assert_int_equal(eventCalls("net.conn.open"), 1);
+    assert_string_equal(eventPeerName("net.conn.open"), "");
+    doRecv(20, 13, NULL, 13, BUF);
+    assert_int_equal(metricCalls("net.rx"), 1);
+    assert_string_equal(metricRemoteHost("net.rx"), "");
+    doClose(20, "closeFunc");
+
+    evt_fmt_t *metric = evtFormatCreate();
+    evtFormatSourceEnabledSet(metric, CFG_SRC_METRIC, TRUE);
+    ctlEvtSet(g_ctl, metric);
+    evtFormatDestroy(&net);
+}
+
+static void
+doHttpMetricsReportsPendingRequests(void** state)
+{
+    clearTestData();
+    doHttpMetrics();
+    assert_int_equal(metricCalls("scope.http.evicted"), 1);
+    assert_int_equal(metricCalls("scope.http.pending"), 1);
+    assert_int_equal(metricValues("scope.http.evicted"), 0);
+    assert_int_equal(metricValues("scope.http.pending"), 0);
+    assert_int_equal(metricCalls("scope.http.header.memory"), 1);
+    assert_int_equal(metricCalls("scope.http.header.dropped"), 1);
+}
+
+static void
+closedFileNamesAreReclaimed(void** state)
+{
+    reclaimState();
+    reclaimState();
+    unsigned int names = strtabCount(g_strtab);
+
+    doOpen(28, "/a/file/only/open/here", FD, "openFunc");
+    assert_int_equal(strtabCount(g_strtab), names + 1);
+
+    // The records posted for it keep the name after the close, for as
+    // long as it takes the periodic thread to get to them
+    doClose(28, "closeFunc");
+    reclaimState();
+    reclaimState();
+    reclaimState();
+    assert_int_equal(strtabCount(g_strtab), names + 1);
+
+    // Then it outlives them by a period
+    doEvent();
+    reclaimState();
+    assert_int_equal(strtabCount(g_strtab), names + 1);
+    reclaimState();
+    assert_int_equal(strtabCount(g_strtab), names);
+}
+
+static void
+dupSockLeavesHttpStateWithOldSocket(void** state)
+{
+    char *partial = "GET / HTTP/1.1\r\nHost: ";
+    addSock(29, SOCK_STREAM, AF_INET);
+    net_info *old = getNetEntry(29);
+    assert_non_null(old);
+    assert_false(doHttp(1, 29, old, partial, strlen(partial), NETRX, BUF));
+    assert_non_null(old->http.hdr);
+
+    // Only one of them can give the header buffer back
+    doDupSock(29, 30);
+    net_info *new = getNetEntry(30);
+    assert_non_null(new);
+    assert_null(new->http.hdr);
+    assert_int_equal(new->http.state, HTTP_NONE);
+    assert_non_null(old->http.hdr);
+
+    doClose(30, "closeFunc");
+    doClose(29, "closeFunc");
+}
+
+static void
+doEvtPoolMetricsReportsEachPool(void** state)
+{
+    clearTestData();
+    doEvtPoolMetrics();
+    assert_int_equal(metricCalls("scope.pool.exhausted"), EVT_POOL_MAX);
+    assert_int_equal(metricCalls("scope.pool.failed"), EVT_POOL_MAX);
+    assert_int_equal(metricCalls("scope.pool.memory"), EVT_POOL_MAX);
+
+    // Exhaustion is counted since the last report
+    clearTestData();
+    doEvtPoolMetrics();
+    assert_int_equal(metricValues("scope.pool.exhausted"), 0);
+    assert_int_equal(metricValues("scope.pool.failed"), 0);
+}
+
+static void
+setOpEnableFollowsConfig(void** state)
+{
+    // Metrics are on by default, so everything has work to do
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_READ | OP_WRITE | OP_SEEK);
+
+    // Nothing on; every wrapper goes straight to libc
+    evt_fmt_t *evt = evtFormatCreate();
+    watch_t src;
+    for (src = CFG_SRC_FILE; src < CFG_SRC_MAX; src++) {
+        evtFormatSourceEnabledSet(evt, src, FALSE);
+    }
+    ctlEvtSet(g_ctl, evt);
+    mtcEnabledSet(g_mtc, FALSE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, 0);
+    assert_false(OP_ENABLED(OP_READ));
+
+    // Watching files only needs writes
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FILE, TRUE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_WRITE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FILE, FALSE);
+
+    // Net events need reads and writes, but not seeks
+    evtFormatSourceEnabledSet(evt, CFG_SRC_NET, TRUE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_READ | OP_WRITE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_NET, FALSE);
+
+    // So do payloads
+    ctlPayEnableSet(g_ctl, TRUE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_READ | OP_WRITE);
+    ctlPayEnableSet(g_ctl, FALSE);
+
+    // Fs events need all of them
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FS, TRUE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_READ | OP_WRITE | OP_SEEK);
+
+    // Put back what the other tests expect
+    evt_fmt_t *metric = evtFormatCreate();
+    evtFormatSourceEnabledSet(metric, CFG_SRC_METRIC, TRUE);
+    ctlEvtSet(g_ctl, metric);
+    evtFormatDestroy(&evt);
+    mtcEnabledSet(g_mtc, TRUE);
+    setOpEnable();
+    assert_int_equal(g_op_enable, OP_READ | OP_WRITE | OP_SEEK);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -1652,6 +2003,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(doReadFileNoSummarization),
         cmocka_unit_test(doReadFileSummarizedOpenCloseNotSummarized),
         cmocka_unit_test(doReadFileFullSummarization),
+        cmocka_unit_test(doReadFileReportsPathAfterClose),
         cmocka_unit_test(doWriteFileNoSummarization),
         cmocka_unit_test(doWriteFileSummarizedOpenCloseNotSummarized),
         cmocka_unit_test(doWriteFileFullSummarization),
@@ -1685,6 +2037,13 @@ main(int argc, char* argv[])
 #endif // __LINUX__
         cmocka_unit_test(doDNSErrNoSummarization),
         cmocka_unit_test(doDNSErrSummarization),
+        cmocka_unit_test(doDNSResponseNoDNSSummarization),
+        cmocka_unit_test(doNetReportsPeerName),
+        cmocka_unit_test(doHttpMetricsReportsPendingRequests),
+        cmocka_unit_test(doEvtPoolMetricsReportsEachPool),
+        cmocka_unit_test(closedFileNamesAreReclaimed),
+        cmocka_unit_test(dupSockLeavesHttpStateWithOldSocket),
+        cmocka_unit_test(setOpEnableFollowsConfig),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     int test_errors = cmocka_run_group_tests(tests, countTestSetup, countTestTeardown);
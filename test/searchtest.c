@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "search.h"
 #include "test.h"
@@ -102,6 +104,63 @@ searchExecReturnsExpectedResultsInHappyPath(void** state)
     searchFree(&handle);
 }
 
+static int
+naiveSearch(const char *needle, char *haystack, int hlen)
+{
+    char *found = memmem(haystack, hlen, needle, strlen(needle));
+    return (found) ? found - haystack : -1;
+}
+
+static void
+searchImplsAllAgree(void** state)
+{
+    const char *needles[] = {"\r\n", "\r\n\r\n", "HTTP/", "a", "ab", "\r\na",
+                             "HTTP/1.1 ", "Content-Length:", NULL};
+    // Few letters, so there are lots of near misses
+    const char letters[] = "aHTP/\r\n1. b";
+    char haystack[300];
+    search_impl_t impls[] = {SEARCH_SCALAR, SEARCH_SSE2, SEARCH_AVX2};
+    search_impl_t orig = searchImpl();
+    int i, j, n, len;
+
+    srand(1);
+    for (n = 0; needles[n]; n++) {
+        search_t *handle = searchComp(needles[n]);
+        assert_non_null(handle);
+
+        for (j = 0; j < 2000; j++) {
+            len = rand() % sizeof(haystack);
+            for (i = 0; i < len; i++) {
+                haystack[i] = letters[rand() % (sizeof(letters) - 1)];
+            }
+            // Often put the needle somewhere, including at the very end
+            if ((j & 1) && (len >= strlen(needles[n]))) {
+                int at = (j & 2) ? len - strlen(needles[n]) :
+                                   rand() % (len - strlen(needles[n]) + 1);
+                memcpy(&haystack[at], needles[n], strlen(needles[n]));
+            }
+
+            int expected = naiveSearch(needles[n], haystack, len);
+            for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+                if (searchSetImpl(impls[i])) continue;
+                assert_int_equal(searchExec(handle, haystack, len), expected);
+            }
+        }
+        searchFree(&handle);
+    }
+
+    assert_int_equal(searchSetImpl(orig), 0);
+    assert_int_equal(searchImpl(), orig);
+}
+
+static void
+searchSetImplRejectsUnknownImpl(void** state)
+{
+    search_impl_t orig = searchImpl();
+    assert_int_equal(searchSetImpl(SEARCH_AVX2 + 1), -1);
+    assert_int_equal(searchImpl(), orig);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -116,6 +175,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(searchLenReturnsLengthOfOriginalStr),
         cmocka_unit_test(searchExecReturnsMinusOneForBadArgs),
         cmocka_unit_test(searchExecReturnsExpectedResultsInHappyPath),
+        cmocka_unit_test(searchImplsAllAgree),
+        cmocka_unit_test(searchSetImplRejectsUnknownImpl),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include "dbg.h"
+#include "sketch.h"
+#include "test.h"
+
+// Within the error sketch.h promises
+static void
+assertNear(uint64_t value, uint64_t expected)
+{
+    uint64_t err = expected >> (SKETCH_SUB_BITS + 1);
+    assert_true(value + err >= expected);
+    assert_true(value <= expected + err);
+}
+
+static void
+sketchCreateAndDestroy(void **state)
+{
+    sketch_t *sketch = sketchCreate();
+    assert_non_null(sketch);
+    assert_int_equal(sketchCount(sketch), 0);
+    assert_int_equal(sketchMax(sketch), 0);
+    assert_int_equal(sketchQuantile(sketch, 0.5), 0);
+    sketchDestroy(&sketch);
+    assert_null(sketch);
+}
+
+static void
+sketchNullArgsDoNotCrash(void **state)
+{
+    sketch_t *sketch = NULL;
+    sketchDestroy(NULL);
+    sketchDestroy(&sketch);
+    sketchAdd(NULL, 1);
+    sketchMerge(NULL, NULL);
+    sketchReset(NULL);
+    assert_int_equal(sketchCount(NULL), 0);
+    assert_int_equal(sketchMax(NULL), 0);
+    assert_int_equal(sketchQuantile(NULL, 0.5), 0);
+    assert_int_equal(sketchBucket(NULL, 0, NULL, NULL), 0);
+
+    sketch = sketchCreate();
+    assert_int_equal(sketchBucket(sketch, -1, NULL, NULL), 0);
+    assert_int_equal(sketchBucket(sketch, SKETCH_BUCKETS, NULL, NULL), 0);
+    sketchDestroy(&sketch);
+}
+
+static void
+sketchSmallValuesAreExact(void **state)
+{
+    sketch_t *sketch = sketchCreate();
+
+    // 0 to 9, ten times each
+    int i;
+    for (i = 0; i < 100; i++) {
+        sketchAdd(sketch, i % 10);
+    }
+    assert_int_equal(sketchCount(sketch), 100);
+    assert_int_equal(sketchMax(sketch), 9);
+    assert_int_equal(sketchQuantile(sketch, 0.0), 0);
+    assert_int_equal(sketchQuantile(sketch, 0.5), 5);
+    assert_int_equal(sketchQuantile(sketch, 0.9), 9);
+    assert_int_equal(sketchQuantile(sketch, 1.0), 9);
+
+    sketchDestroy(&sketch);
+}
+
+static void
+sketchQuantilesAreClose(void **state)
+{
+    sketch_t *sketch = sketchCreate();
+
+    // In an order that isn't sorted
+    uint64_t i;
+    for (i = 0; i < 100000; i++) {
+        sketchAdd(sketch, (i * 7919) % 100000 + 1);
+    }
+    assertNear(sketchQuantile(sketch, 0.5), 50000);
+    assertNear(sketchQuantile(sketch, 0.9), 90000);
+    assertNear(sketchQuantile(sketch, 0.99), 99000);
+    assert_int_equal(sketchQuantile(sketch, 1.0), 100000);
+    assert_int_equal(sketchMax(sketch), 100000);
+
+    // A long tail shows in p99 but not p50
+    sketchReset(sketch);
+    assert_int_equal(sketchCount(sketch), 0);
+    for (i = 0; i < 1000; i++) {
+        sketchAdd(sketch, (i < 985) ? 20 : 3000);
+    }
+    assertNear(sketchQuantile(sketch, 0.5), 20);
+    assertNear(sketchQuantile(sketch, 0.99), 3000);
+
+    sketchDestroy(&sketch);
+}
+
+static void
+sketchMergeIsTheSameAsAddingBoth(void **state)
+{
+    sketch_t *a = sketchCreate();
+    sketch_t *b = sketchCreate();
+    sketch_t *both = sketchCreate();
+
+    uint64_t i;
+    for (i = 0; i < 5000; i++) {
+        sketchAdd(a, i);
+        sketchAdd(both, i);
+        sketchAdd(b, i * 3);
+        sketchAdd(both, i * 3);
+    }
+    sketchMerge(a, b);
+
+    assert_int_equal(sketchCount(a), sketchCount(both));
+    assert_int_equal(sketchMax(a), sketchMax(both));
+    int j;
+    for (j = 0; j < SKETCH_BUCKETS; j++) {
+        assert_int_equal(sketchBucket(a, j, NULL, NULL), sketchBucket(both, j, NULL, NULL));
+    }
+    assert_int_equal(sketchQuantile(a, 0.99), sketchQuantile(both, 0.99));
+
+    sketchDestroy(&a);
+    sketchDestroy(&b);
+    sketchDestroy(&both);
+}
+
+static void
+sketchBucketsCoverEveryValue(void **state)
+{
+    sketch_t *sketch = sketchCreate();
+
+    // Each bucket starts right after the one before it
+    uint64_t low, high, next = 0;
+    int i;
+    for (i = 0; i < SKETCH_BUCKETS; i++) {
+        sketchBucket(sketch, i, &low, &high);
+        assert_int_equal(low, next);
+        assert_true(high >= low);
+        next = high + 1;
+    }
+    assert_int_equal(next - 1, UINT32_MAX);
+
+    // and holds the values in its range
+    uint64_t value[] = {0, 15, 16, 17, 31, 32, 1000, 65535, 65536, UINT32_MAX};
+    for (i = 0; i < sizeof(value) / sizeof(value[0]); i++) {
+        sketchReset(sketch);
+        sketchAdd(sketch, value[i]);
+        int j, found = 0;
+        for (j = 0; j < SKETCH_BUCKETS; j++) {
+            if (!sketchBucket(sketch, j, &low, &high)) continue;
+            assert_true((value[i] >= low) && (value[i] <= high));
+            found++;
+        }
+        assert_int_equal(found, 1);
+    }
+
+    // Values too big for the buckets are counted in the last one
+    sketchReset(sketch);
+    sketchAdd(sketch, UINT64_MAX);
+    assert_int_equal(sketchBucket(sketch, SKETCH_BUCKETS - 1, NULL, NULL), 1);
+    assert_int_equal(sketchMax(sketch), UINT64_MAX);
+    assert_int_equal(sketchQuantile(sketch, 0.5), UINT32_MAX - (1U << 26));
+
+    sketchDestroy(&sketch);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(sketchCreateAndDestroy),
+        cmocka_unit_test(sketchNullArgsDoNotCrash),
+        cmocka_unit_test(sketchSmallValuesAreExact),
+        cmocka_unit_test(sketchQuantilesAreClose),
+        cmocka_unit_test(sketchMergeIsTheSameAsAddingBoth),
+        cmocka_unit_test(sketchBucketsCoverEveryValue),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
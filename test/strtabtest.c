@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "dbg.h"
+#include "strtab.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define NUM_STRINGS 2000
+
+static void
+strtabCreateReturnsValidPtr(void **state)
+{
+    strtab_t *tab = strtabCreate(100, 0);
+    assert_non_null(tab);
+    assert_int_equal(strtabCount(tab), 0);
+    strtabDestroy(&tab);
+    assert_null(tab);
+}
+
+static void
+strtabCreateWithZeroStringsFails(void **state)
+{
+    assert_null(strtabCreate(0, 0));
+}
+
+static void
+strtabNullArgsDoNotCrash(void **state)
+{
+    strtab_t *tab = NULL;
+    strtabDestroy(NULL);
+    strtabDestroy(&tab);
+
+    assert_int_equal(strtabIntern(NULL, "hey"), STRTAB_NONE);
+    assert_int_equal(strtabCount(NULL), 0);
+    assert_string_equal(strtabStr(NULL, 1), "");
+
+    tab = strtabCreate(100, 0);
+    assert_int_equal(strtabIntern(tab, NULL), STRTAB_NONE);
+    assert_string_equal(strtabStr(tab, STRTAB_NONE), "");
+    assert_string_equal(strtabStr(tab, 50), "");
+    assert_string_equal(strtabStr(tab, 5000), "");
+    strtabDestroy(&tab);
+}
+
+static void
+strtabInternReturnsSameIdForEqualStrings(void **state)
+{
+    strtab_t *tab = strtabCreate(100, 0);
+    assert_non_null(tab);
+
+    char path[] = "/the/file/path";
+    strtab_id_t id1 = strtabIntern(tab, "/the/file/path");
+    strtab_id_t id2 = strtabIntern(tab, path);
+    strtab_id_t id3 = strtabIntern(tab, "/another/path");
+    assert_int_not_equal(id1, STRTAB_NONE);
+    assert_int_equal(id1, id2);
+    assert_int_not_equal(id1, id3);
+    assert_int_equal(strtabCount(tab), 2);
+
+    // The table keeps its own copy
+    path[1] = 'X';
+    assert_string_equal(strtabStr(tab, id1), "/the/file/path");
+    assert_string_equal(strtabStr(tab, id3), "/another/path");
+
+    // The empty string is a string like any other
+    strtab_id_t empty = strtabIntern(tab, "");
+    assert_int_not_equal(empty, STRTAB_NONE);
+    assert_string_equal(strtabStr(tab, empty), "");
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabInternLenUsesOnlyLenBytes(void **state)
+{
+    strtab_t *tab = strtabCreate(100, 0);
+    assert_non_null(tab);
+
+    strtab_id_t id1 = strtabInternLen(tab, "/hey/dude?like=what", 9);
+    strtab_id_t id2 = strtabIntern(tab, "/hey/dude");
+    assert_int_equal(id1, id2);
+    assert_string_equal(strtabStr(tab, id1), "/hey/dude");
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabFullTableStillFindsExistingStrings(void **state)
+{
+    strtab_t *tab = strtabCreate(2, 0);
+    assert_non_null(tab);
+
+    strtab_id_t id1 = strtabIntern(tab, "one");
+    strtab_id_t id2 = strtabIntern(tab, "two");
+    assert_int_not_equal(id1, STRTAB_NONE);
+    assert_int_not_equal(id2, STRTAB_NONE);
+    assert_int_equal(strtabIntern(tab, "three"), STRTAB_NONE);
+    assert_int_equal(strtabIntern(tab, "one"), id1);
+    assert_int_equal(strtabIntern(tab, "two"), id2);
+    strtabDestroy(&tab);
+
+    // Same idea, but limited by bytes this time
+    tab = strtabCreate(100, 64);
+    assert_non_null(tab);
+    id1 = strtabIntern(tab, "short");
+    assert_int_not_equal(id1, STRTAB_NONE);
+    assert_int_equal(strtabIntern(tab, "a string that is much too long to fit in the table"), STRTAB_NONE);
+    assert_int_equal(strtabIntern(tab, "short"), id1);
+    strtabDestroy(&tab);
+}
+
+static void
+strtabManyStringsCrossPages(void **state)
+{
+    strtab_t *tab = strtabCreate(NUM_STRINGS, 0);
+    assert_non_null(tab);
+
+    strtab_id_t id[NUM_STRINGS];
+    char str[64];
+    int i;
+    for (i = 0; i < NUM_STRINGS; i++) {
+        snprintf(str, sizeof(str), "/path/number/%d", i);
+        id[i] = strtabIntern(tab, str);
+        assert_int_not_equal(id[i], STRTAB_NONE);
+    }
+    assert_int_equal(strtabCount(tab), NUM_STRINGS);
+
+    for (i = 0; i < NUM_STRINGS; i++) {
+        snprintf(str, sizeof(str), "/path/number/%d", i);
+        assert_int_equal(strtabIntern(tab, str), id[i]);
+        assert_string_equal(strtabStr(tab, id[i]), str);
+    }
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabReleasedStringsAreReclaimedLater(void **state)
+{
+    strtab_t *tab = strtabCreate(100, 0);
+    assert_non_null(tab);
+
+    strtab_id_t kept = strtabIntern(tab, "/kept");
+    strtab_id_t gone = strtabIntern(tab, "/gone");
+    assert_int_equal(strtabCount(tab), 2);
+    strtabRelease(tab, gone);
+
+    // Copies of the id can still be read until the second reclaim
+    assert_int_equal(strtabReclaim(tab), 0);
+    assert_string_equal(strtabStr(tab, gone), "/gone");
+    assert_int_equal(strtabReclaim(tab), 1);
+    assert_string_equal(strtabStr(tab, gone), "");
+    assert_int_equal(strtabCount(tab), 1);
+
+    // What's still referenced stays
+    assert_int_equal(strtabReclaim(tab), 0);
+    assert_string_equal(strtabStr(tab, kept), "/kept");
+
+    // Every reference has to be given back
+    strtabRef(tab, kept);
+    assert_int_equal(strtabIntern(tab, "/kept"), kept);
+    strtabRelease(tab, kept);
+    strtabRelease(tab, kept);
+    strtabReclaim(tab);
+    strtabReclaim(tab);
+    assert_string_equal(strtabStr(tab, kept), "/kept");
+    strtabRelease(tab, kept);
+    strtabReclaim(tab);
+    assert_int_equal(strtabReclaim(tab), 1);
+    assert_int_equal(strtabCount(tab), 0);
+
+    // Nothing to do for these
+    strtabRef(tab, STRTAB_NONE);
+    strtabRelease(tab, STRTAB_NONE);
+    strtabRelease(NULL, kept);
+    assert_int_equal(strtabReclaim(NULL), 0);
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabInternBeforeReclaimKeepsString(void **state)
+{
+    strtab_t *tab = strtabCreate(100, 0);
+    assert_non_null(tab);
+
+    strtab_id_t id = strtabIntern(tab, "/again");
+    strtabRelease(tab, id);
+    strtabReclaim(tab);
+
+    // Interned again before it was freed; it's the same string
+    assert_int_equal(strtabIntern(tab, "/again"), id);
+    strtabReclaim(tab);
+    strtabReclaim(tab);
+    assert_string_equal(strtabStr(tab, id), "/again");
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabFullTableHasRoomAfterReclaim(void **state)
+{
+    strtab_t *tab = strtabCreate(2, 80);
+    assert_non_null(tab);
+
+    strtab_id_t id1 = strtabIntern(tab, "one");
+    strtab_id_t id2 = strtabIntern(tab, "two");
+    assert_int_equal(strtabIntern(tab, "three"), STRTAB_NONE);
+
+    strtabRelease(tab, id1);
+    strtabRelease(tab, id2);
+    strtabReclaim(tab);
+    strtabReclaim(tab);
+
+    // Both the ids and the bytes are there to be used again
+    strtab_id_t id3 = strtabIntern(tab, "three");
+    assert_int_not_equal(id3, STRTAB_NONE);
+    assert_int_not_equal(strtabIntern(tab, "a longer string than one"), STRTAB_NONE);
+    assert_string_equal(strtabStr(tab, id3), "three");
+    assert_int_equal(strtabCount(tab), 2);
+
+    strtabDestroy(&tab);
+}
+
+static void
+strtabUsableAfterLockAll(void **state)
+{
+    strtab_t *tab = strtabCreate(10, 0);
+    assert_non_null(tab);
+    strtab_id_t id = strtabIntern(tab, "forked");
+
+    strtabLockAll(tab);
+    // Lookups by id don't need any of the locks
+    assert_string_equal(strtabStr(tab, id), "forked");
+    strtabUnlockAll(tab);
+
+    assert_int_equal(strtabIntern(tab, "forked"), id);
+    assert_int_not_equal(strtabIntern(tab, "after"), STRTAB_NONE);
+    strtabRelease(tab, id);
+    strtabReclaim(tab);
+
+    // Null is harmless
+    strtabLockAll(NULL);
+    strtabUnlockAll(NULL);
+
+    strtabDestroy(&tab);
+}
+
+static strtab_t *g_shared = NULL;
+static strtab_id_t g_ids[NUM_THREADS][NUM_STRINGS];
+
+static void *
+internThread(void *arg)
+{
+    strtab_id_t *ids = arg;
+    char str[64];
+    int i;
+
+    // Every thread interns the same strings, so they all race
+    for (i = 0; i < NUM_STRINGS; i++) {
+        snprintf(str, sizeof(str), "/shared/%d", i);
+        ids[i] = strtabIntern(g_shared, str);
+    }
+    return NULL;
+}
+
+static void *
+internReleaseThread(void *arg)
+{
+    long t = (long)arg;
+    char str[64];
+    int i;
+
+    // Each string is only ever referenced by the thread using it
+    for (i = 0; i < NUM_STRINGS * 10; i++) {
+        snprintf(str, sizeof(str), "/churn/%ld/%d", t, i % 50);
+        strtab_id_t id = strtabIntern(g_shared, str);
+        if (strcmp(strtabStr(g_shared, id), str)) return (void *)1;
+        strtabRelease(g_shared, id);
+    }
+    return NULL;
+}
+
+static void
+strtabReclaimWhileOthersIntern(void **state)
+{
+    g_shared = strtabCreate(NUM_STRINGS, 0);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_THREADS];
+    long i;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, internReleaseThread, (void *)i), 0);
+    }
+    for (i = 0; i < 1000; i++) {
+        strtabReclaim(g_shared);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        void *rv;
+        assert_int_equal(pthread_join(tid[i], &rv), 0);
+        assert_null(rv);
+    }
+
+    strtabReclaim(g_shared);
+    strtabReclaim(g_shared);
+    assert_int_equal(strtabCount(g_shared), 0);
+    strtabDestroy(&g_shared);
+}
+
+static void
+strtabInternFromManyThreadsGivesOneId(void **state)
+{
+    g_shared = strtabCreate(NUM_STRINGS * 2, 0);
+    assert_non_null(g_shared);
+
+    pthread_t tid[NUM_THREADS];
+    int i, j;
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, internThread, g_ids[i]), 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_join(tid[i], NULL), 0);
+    }
+
+    char str[64];
+    for (j = 0; j < NUM_STRINGS; j++) {
+        snprintf(str, sizeof(str), "/shared/%d", j);
+        assert_int_not_equal(g_ids[0][j], STRTAB_NONE);
+        assert_string_equal(strtabStr(g_shared, g_ids[0][j]), str);
+        for (i = 1; i < NUM_THREADS; i++) {
+            assert_int_equal(g_ids[i][j], g_ids[0][j]);
+        }
+    }
+
+    strtabDestroy(&g_shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(strtabCreateReturnsValidPtr),
+        cmocka_unit_test(strtabCreateWithZeroStringsFails),
+        cmocka_unit_test(strtabNullArgsDoNotCrash),
+        cmocka_unit_test(strtabInternReturnsSameIdForEqualStrings),
+        cmocka_unit_test(strtabInternLenUsesOnlyLenBytes),
+        cmocka_unit_test(strtabFullTableStillFindsExistingStrings),
+        cmocka_unit_test(strtabManyStringsCrossPages),
+        cmocka_unit_test(strtabReleasedStringsAreReclaimedLater),
+        cmocka_unit_test(strtabInternBeforeReclaimKeepsString),
+        cmocka_unit_test(strtabFullTableHasRoomAfterReclaim),
+        cmocka_unit_test(strtabUsableAfterLockAll),
+        cmocka_unit_test(strtabReclaimWhileOthersIntern),
+        cmocka_unit_test(strtabInternFromManyThreadsGivesOneId),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}